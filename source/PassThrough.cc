@@ -0,0 +1,140 @@
+//	PassThrough.cc
+//
+//	implements copy_bitmap(), which hands a B_TRANSLATOR_BITMAP through
+//	without decoding its pixels.  Only the header is looked at, to learn
+//	how many bytes make up the bitmap; those are then copied in the
+//	cheapest way the two streams allow: out of the input's own buffer if it
+//	lives in memory, inside the kernel if both are files and the system
+//	can, and otherwise in large blocks.
+
+#include <File.h>
+#include <errno.h>
+#include <unistd.h>
+#include "XPM.h"
+#include "PassThrough.h"
+
+#define		COPY_BLOCK_SIZE		(1 << 20)
+
+status_t copy_memory(BPositionIO *, BPositionIO *, off_t);
+status_t copy_file(BPositionIO *, BPositionIO *, off_t);
+status_t copy_blocks(BPositionIO *, BPositionIO *, off_t);
+
+//	copy_bitmap()
+//	copy the B_TRANSLATOR_BITMAP at the position of "input", header and
+//	pixel data, onto "output".
+status_t copy_bitmap(BPositionIO *input, BPositionIO *output)
+{
+	status_t err;
+	TranslatorBitmap bmap;
+	off_t length;
+
+	err = input->ReadAt(input->Position(),&bmap,sizeof(bmap));
+	if (err != sizeof(bmap) || B_BENDIAN_TO_HOST_INT32(bmap.magic) != B_TRANSLATOR_BITMAP)
+		return B_ERROR;
+	length = sizeof(bmap) + (off_t)(uint32)B_BENDIAN_TO_HOST_INT32(bmap.dataSize);
+
+	err = copy_memory(input,output,length);
+	if (err == B_BAD_TYPE)
+		err = copy_file(input,output,length);
+	if (err == B_BAD_TYPE)
+		err = copy_blocks(input,output,length);
+	return err;
+}
+
+//	copy_memory()
+//	an input held in memory is written out straight from its buffer.
+//	B_BAD_TYPE if the input isn't a BMallocIO.
+status_t copy_memory(BPositionIO *input, BPositionIO *output, off_t length)
+{
+	BMallocIO *memory = dynamic_cast<BMallocIO *>(input);
+	off_t position;
+
+	if (!memory)
+		return B_BAD_TYPE;
+	position = memory->Position();
+	if (position < 0 || position + length > (off_t)memory->BufferLength())
+		return B_ERROR;
+	if (output->Write((const char *)memory->Buffer() + position,length) != length)
+		return B_IO_ERROR;
+	memory->Seek(length,SEEK_CUR);
+	return B_OK;
+}
+
+//	copy_file()
+//	file to file, the kernel does the copying where it knows how to
+//	(copy_file_range() on Linux).  B_BAD_TYPE if it can't, before anything
+//	has been copied.
+status_t copy_file(BPositionIO *input, BPositionIO *output, off_t length)
+{
+#if defined(__linux__)
+	BFile *from = dynamic_cast<BFile *>(input);
+	BFile *to = dynamic_cast<BFile *>(output);
+	off_t inPosition, outPosition, done = 0;
+	ssize_t n;
+	int in, out;
+
+	if (!from || !to)
+		return B_BAD_TYPE;
+	inPosition = from->Position();
+	outPosition = to->Position();
+	in = from->Dup();
+	out = to->Dup();
+	n = 0;
+	while (in >= 0 && out >= 0 && done < length)
+	{
+		n = copy_file_range(in,&inPosition,out,&outPosition,length - done,0);
+		if (n <= 0)
+			break;
+		done += n;
+	}
+	if (in >= 0)
+		close(in);
+	if (out >= 0)
+		close(out);
+
+//	the descriptors are duplicates, so the positions of the files
+//	themselves have to be moved past what was copied
+	from->Seek(done,SEEK_CUR);
+	to->Seek(done,SEEK_CUR);
+	if (done == length)
+		return B_OK;
+	if (done == 0
+		&& (n == 0 || errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EBADF))
+		return B_BAD_TYPE;
+	return n == 0 ? B_ERROR : B_IO_ERROR;
+#else
+	return B_BAD_TYPE;
+#endif
+}
+
+//	copy_blocks()
+//	copy "length" bytes through a large buffer.
+status_t copy_blocks(BPositionIO *input, BPositionIO *output, off_t length)
+{
+	status_t err = B_OK;
+	ssize_t n;
+	size_t size;
+	char *block;
+
+	size = length < COPY_BLOCK_SIZE ? length : COPY_BLOCK_SIZE;
+	block = (char *)malloc(size ? size : 1);
+	if (!block)
+		return B_NO_MEMORY;
+	while (length > 0)
+	{
+		n = input->Read(block,length < (off_t)size ? length : size);
+		if (n <= 0)
+		{
+			err = B_ERROR;
+			break;
+		}
+		if (output->Write(block,n) != n)
+		{
+			err = B_IO_ERROR;
+			break;
+		}
+		length -= n;
+	}
+	free(block);
+	return err;
+}
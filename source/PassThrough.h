@@ -0,0 +1,10 @@
+//	PassThrough.h
+//	copies a B_TRANSLATOR_BITMAP from one stream to another unchanged, for
+//	bits-to-bits translation.
+
+#ifndef PASS_THROUGH_H
+#define PASS_THROUGH_H
+
+status_t copy_bitmap(BPositionIO *, BPositionIO *);
+
+#endif
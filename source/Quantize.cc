@@ -0,0 +1,757 @@
+//	Quantize.cc
+//
+//	implements quantize_bitmap(), which reduces the colors of a scanned
+//	bitmap to a palette of a given size before it is written out.  Colors
+//	are first gathered into a histogram of 5 bits per channel; the palette
+//	is chosen from the histogram, either by median cut or with an octree,
+//	and every pixel is then replaced by the nearest palette color, with or
+//	without Floyd-Steinberg dithering.  Transparent pixels are left alone.
+//
+//	A bitmap encoded in strips is never in memory whole, so a quant_stream
+//	does the same a row at a time: the histogram is gathered as the rows
+//	first go by, and the rows mapped as they go by again, in order, so that
+//	error diffusion carries from row to row as it does over a whole bitmap.
+
+#include <limits.h>
+#include "XPM.h"
+#include "Quantize.h"
+#include "RowBands.h"
+
+#define		QUANT_BITS			5
+#define		QUANT_LEVELS		(1 << QUANT_BITS)
+#define		QUANT_BINS			(1 << 3*QUANT_BITS)
+#define		QUANT_BIN(r,g,b)	((((r) >> 3) << 10) | (((g) >> 3) << 5) | ((b) >> 3))
+#define		QUANT_MAX_COLORS	QUANT_BINS
+
+//	a histogram cell: the number of pixels that fell in it, and the sums of
+//	their channels, so that palette colors are true averages rather than
+//	the centers of the cells.  Counted a strip at a time, one cell may hold
+//	more pixels than 32 bits can count.
+typedef struct
+{
+	uint64 count;
+	uint64 red;
+	uint64 green;
+	uint64 blue;
+}
+quant_cell;
+
+//	a box of histogram cells for median cut; bounds are inclusive
+typedef struct
+{
+	int lo[3];
+	int hi[3];
+	uint64 count;
+}
+quant_box;
+
+//	an octree node.  The tree is five levels deep, one per bit of the
+//	histogram cells; interior nodes on each level are chained through "next"
+//	so that they can be found again when the tree is reduced.
+typedef struct
+{
+	int child[8];
+	int next;
+	bool leaf;
+	uint64 count;
+	uint64 red;
+	uint64 green;
+	uint64 blue;
+}
+octree_node;
+
+typedef struct
+{
+	bitmap_record *br;
+	quant_cell *hist;
+	rgb_color *palette;
+	int ncolors;
+	int32 *map;					// palette index for each cell; -1 until known
+}
+quant_data;
+
+//	the state of a quantizer fed a row at a time; see Quantize.h
+struct quant_stream
+{
+	quant_data qd;
+	const xpm_encode_settings *settings;
+	bool transparent;				// a transparent pixel was counted
+	bool *used;						// palette colors mapped to
+	int *current;					// errors carried to this row and the next,
+	int *next;						// when dithering
+};
+
+void count_cells(quant_data *, rgb_color *, size_t, bool *);
+status_t choose_palette(quant_data *, const xpm_encode_settings *, bool, bool **);
+void mark_used_cells(quant_data *, bool *);
+status_t rebuild_color_table(quant_data *, bool *, bool);
+status_t median_cut_palette(quant_data *, int);
+void shrink_box(quant_box *, quant_cell *);
+status_t octree_palette(quant_data *, int);
+int nearest_color(quant_data *, int, int, int);
+status_t map_cells_band(int, int, int, void *);
+status_t map_pixels_band(int, int, int, void *);
+status_t dither_bitmap(quant_data *, bool *);
+void dither_row(quant_data *, rgb_color *, int **, int **, bool *);
+bool is_transparent(rgb_color *);
+
+//	quantize_bitmap()
+//	reduce the colors of "br" to at most settings->maxColors, rewriting its
+//	pixels and rebuilding its color table.  Nothing is done if no limit is
+//	set, or if the bitmap already fits within it.  Transparency counts as
+//	one of the colors; a limit of 1 on a bitmap with both transparent and
+//	opaque pixels can't be met, and is B_BAD_VALUE.
+status_t quantize_bitmap(bitmap_record *br, const xpm_encode_settings *settings)
+{
+	status_t err;
+	quant_data qd;
+	bool *used = NULL;
+	bool transparent = false;
+
+	if (!settings || settings->maxColors <= 0 || br->ncolors <= settings->maxColors)
+		return B_OK;
+
+	qd.br = br;
+	qd.palette = NULL;
+	qd.map = NULL;
+	qd.hist = (quant_cell *)xpm_calloc(br->heap,QUANT_BINS,sizeof(quant_cell));
+	if (!qd.hist)
+		return B_NO_MEMORY;
+	count_cells(&qd,br->pix,(size_t)br->width*br->height,&transparent);
+	err = choose_palette(&qd,settings,transparent,&used);
+	if (err != B_OK)
+		goto bail;
+
+//	map the pixels.  Error diffusion carries state from pixel to pixel, so
+//	dithering is done serially; otherwise the nearest palette color was
+//	found once per occupied cell, and the pixels are mapped in parallel.
+	if (settings->dither)
+		err = dither_bitmap(&qd,used);
+	else
+	{
+		err = run_row_bands(count_row_bands(br->width,br->height),br->height,map_pixels_band,NULL,
+			&qd);
+		mark_used_cells(&qd,used);
+	}
+	if (err == B_OK)
+		err = rebuild_color_table(&qd,used,transparent);
+
+bail:
+	xpm_free(br->heap,used);
+	xpm_free(br->heap,qd.map);
+	xpm_free(br->heap,qd.palette);
+	xpm_free(br->heap,qd.hist);
+	return err;
+}
+
+//	new_quant_stream()
+//	a quantizer for the rows of "br", which need never be in memory at
+//	once; NULL if there is no memory for it.
+quant_stream *new_quant_stream(bitmap_record *br, const xpm_encode_settings *settings)
+{
+	quant_stream *qs;
+
+	qs = (quant_stream *)xpm_calloc(br->heap,1,sizeof(quant_stream));
+	if (!qs)
+		return NULL;
+	qs->qd.br = br;
+	qs->settings = settings;
+	qs->qd.hist = (quant_cell *)xpm_calloc(br->heap,QUANT_BINS,sizeof(quant_cell));
+	if (!qs->qd.hist)
+	{
+		xpm_free(br->heap,qs);
+		return NULL;
+	}
+	return qs;
+}
+
+//	quant_stream_count()
+//	add a row of "br->width" pixels to the histogram.
+void quant_stream_count(quant_stream *qs, rgb_color *row)
+{
+	count_cells(&qs->qd,row,qs->qd.br->width,&qs->transparent);
+}
+
+//	quant_stream_palette()
+//	choose the palette, once every row has been counted, and replace the
+//	color table of the bitmap with it.  If dithering, which colors are
+//	used isn't known until every row has been mapped; the caller must then
+//	map them all once with quant_stream_map(), start again with
+//	quant_stream_rewind(), and only then call quant_stream_table().
+status_t quant_stream_palette(quant_stream *qs)
+{
+	xpm_heap *heap = qs->qd.br->heap;
+	size_t size = 3*(qs->qd.br->width+2)*sizeof(int);
+	status_t err;
+
+	err = choose_palette(&qs->qd,qs->settings,qs->transparent,&qs->used);
+	if (err != B_OK)
+		return err;
+	if (!qs->settings->dither)
+	{
+		mark_used_cells(&qs->qd,qs->used);
+		return B_OK;
+	}
+	qs->current = (int *)xpm_calloc(heap,size,1);
+	qs->next = (int *)xpm_calloc(heap,size,1);
+	return qs->current && qs->next ? B_OK : B_NO_MEMORY;
+}
+
+//	quant_stream_map()
+//	replace the pixels of the next row with their palette colors.
+void quant_stream_map(quant_stream *qs, rgb_color *row)
+{
+	quant_data *qd = &qs->qd;
+	rgb_color *end = row + qd->br->width;
+
+	if (qs->settings->dither)
+		dither_row(qd,row,&qs->current,&qs->next,qs->used);
+	else
+		for (; row < end; row++)
+			if (!is_transparent(row))
+				*row = qd->palette[qd->map[QUANT_BIN(row->red,row->green,row->blue)]];
+}
+
+//	quant_stream_rewind()
+//	start mapping from the first row again.
+void quant_stream_rewind(quant_stream *qs)
+{
+	size_t size = 3*(qs->qd.br->width+2)*sizeof(int);
+
+	if (qs->current)
+	{
+		memset(qs->current,0,size);
+		memset(qs->next,0,size);
+	}
+}
+
+//	quant_stream_table()
+//	replace the color table of the bitmap with the palette colors used.
+status_t quant_stream_table(quant_stream *qs)
+{
+	return rebuild_color_table(&qs->qd,qs->used,qs->transparent);
+}
+
+void delete_quant_stream(quant_stream *qs)
+{
+	xpm_heap *heap;
+
+	if (!qs)
+		return;
+	heap = qs->qd.br->heap;
+	xpm_free(heap,qs->current);
+	xpm_free(heap,qs->next);
+	xpm_free(heap,qs->used);
+	xpm_free(heap,qs->qd.map);
+	xpm_free(heap,qs->qd.palette);
+	xpm_free(heap,qs->qd.hist);
+	xpm_free(heap,qs);
+}
+
+//	count_cells()
+//	add "count" pixels to the histogram, noting whether any is transparent.
+void count_cells(quant_data *qd, rgb_color *pixel, size_t count, bool *transparent)
+{
+	quant_cell *cell;
+
+	for (; count; count--, pixel++)
+	{
+		if (is_transparent(pixel))
+		{
+			*transparent = true;
+			continue;
+		}
+		cell = &qd->hist[QUANT_BIN(pixel->red,pixel->green,pixel->blue)];
+		cell->count++;
+		cell->red += pixel->red;
+		cell->green += pixel->green;
+		cell->blue += pixel->blue;
+	}
+}
+
+//	choose_palette()
+//	choose the palette from the histogram, by the settings' quantizer, and
+//	get "*used" to mark the colors mapped to.  Without dithering, the
+//	nearest palette color of each occupied cell is found here, once.
+status_t choose_palette(quant_data *qd, const xpm_encode_settings *settings, bool transparent,
+	bool **used)
+{
+	xpm_heap *heap = qd->br->heap;
+	status_t err;
+	int budget, i;
+
+//	transparency keeps a palette slot of its own, so a single color can't
+//	hold both it and the opaque pixels
+	budget = settings->maxColors;
+	if (transparent)
+		budget--;
+	if (budget < 1)
+		return B_BAD_VALUE;
+	if (budget > QUANT_MAX_COLORS)
+		budget = QUANT_MAX_COLORS;
+
+	qd->palette = (rgb_color *)xpm_malloc(heap,budget*sizeof(rgb_color));
+	qd->map = (int32 *)xpm_malloc(heap,QUANT_BINS*sizeof(int32));
+	*used = (bool *)xpm_calloc(heap,budget,sizeof(bool));
+	if (!qd->palette || !qd->map || !*used)
+		return B_NO_MEMORY;
+	qd->ncolors = 0;
+	if (settings->quantizer == XPM_QUANTIZE_OCTREE)
+		err = octree_palette(qd,budget);
+	else
+		err = median_cut_palette(qd,budget);
+	if (err != B_OK)
+		return err;
+	for (i = 0; i < QUANT_BINS; i++)
+		qd->map[i] = -1;
+	if (!settings->dither)
+		err = run_row_bands(count_row_bands(qd->ncolors,QUANT_BINS),QUANT_BINS,map_cells_band,NULL,
+			qd);
+	return err;
+}
+
+//	mark_used_cells()
+//	mark the palette colors that occupied cells map to.
+void mark_used_cells(quant_data *qd, bool *used)
+{
+	int i;
+
+	for (i = 0; i < QUANT_BINS; i++)
+		if (qd->hist[i].count)
+			used[qd->map[i]] = true;
+}
+
+//	rebuild_color_table()
+//	make the color table of the bitmap the palette colors used, and the
+//	transparent color if there was any.
+status_t rebuild_color_table(quant_data *qd, bool *used, bool transparent)
+{
+	bitmap_record *br = qd->br;
+	int32 *pixint;
+	int i;
+
+	delete_dictionary(br->ctable);
+	br->ctable = new_dictionary(sizeof(rgb_color),br->heap);
+	if (!br->ctable)
+		return B_NO_MEMORY;
+	br->ncolors = 0;
+	for (i = 0; i < qd->ncolors; i++)
+		if (used[i])
+		{
+			pixint = (int32 *)&qd->palette[i];
+			if (!br->ctable->Find(NULL,*pixint))
+			{
+				br->ncolors++;
+				br->ctable->Insert(&qd->palette[i],*pixint);
+			}
+		}
+	if (transparent)
+	{
+		rgb_color transp = B_TRANSPARENT_32_BIT;
+
+		pixint = (int32 *)&transp;
+		br->ncolors++;
+		br->ctable->Insert(&transp,*pixint);
+	}
+	return B_OK;
+}
+
+//	median_cut_palette()
+//	start with one box around all occupied cells, and keep splitting the
+//	box with the most pixels times its longest side, at the median of that
+//	side, until there are "budget" boxes or none can be split.  Each box
+//	becomes the average of its pixels.
+status_t median_cut_palette(quant_data *qd, int budget)
+{
+	quant_box *box;
+	quant_box *b, *c;
+	uint64 slice[QUANT_LEVELS];
+	uint64 best, score, half, sum;
+	int nboxes, i, axis, side, cut, r, g, bl, ix;
+	int coord[3];
+
+	box = (quant_box *)xpm_malloc(qd->br->heap,budget*sizeof(quant_box));
+	if (!box)
+		return B_NO_MEMORY;
+	for (i = 0; i < 3; i++)
+	{
+		box[0].lo[i] = 0;
+		box[0].hi[i] = QUANT_LEVELS-1;
+	}
+	shrink_box(&box[0],qd->hist);
+	nboxes = box[0].count ? 1 : 0;
+
+	while (nboxes < budget)
+	{
+//	pick the box to split
+		b = NULL;
+		best = 0;
+		for (i = 0; i < nboxes; i++)
+		{
+			side = 0;
+			for (axis = 0; axis < 3; axis++)
+				if (box[i].hi[axis] - box[i].lo[axis] > side)
+					side = box[i].hi[axis] - box[i].lo[axis];
+			score = box[i].count*side;
+			if (score > best)
+			{
+				best = score;
+				b = &box[i];
+			}
+		}
+		if (!b)
+			break;
+
+//	split it along its longest side, at the median pixel
+		axis = 0;
+		for (i = 1; i < 3; i++)
+			if (b->hi[i] - b->lo[i] > b->hi[axis] - b->lo[axis])
+				axis = i;
+		memset(slice,0,sizeof(slice));
+		for (r = b->lo[0]; r <= b->hi[0]; r++)
+			for (g = b->lo[1]; g <= b->hi[1]; g++)
+				for (bl = b->lo[2]; bl <= b->hi[2]; bl++)
+				{
+					coord[0] = r;
+					coord[1] = g;
+					coord[2] = bl;
+					ix = (r << 2*QUANT_BITS) | (g << QUANT_BITS) | bl;
+					slice[coord[axis]] += qd->hist[ix].count;
+				}
+		half = b->count/2;
+		sum = 0;
+		for (cut = b->lo[axis]; cut < b->hi[axis]; cut++)
+		{
+			sum += slice[cut];
+			if (sum >= half)
+				break;
+		}
+		if (cut >= b->hi[axis])
+			cut = b->hi[axis]-1;
+
+		c = &box[nboxes++];
+		*c = *b;
+		b->hi[axis] = cut;
+		c->lo[axis] = cut+1;
+		shrink_box(b,qd->hist);
+		shrink_box(c,qd->hist);
+	}
+
+//	average each box into a palette color
+	for (i = 0; i < nboxes; i++)
+	{
+		uint64 red = 0, green = 0, blue = 0;
+
+		b = &box[i];
+		for (r = b->lo[0]; r <= b->hi[0]; r++)
+			for (g = b->lo[1]; g <= b->hi[1]; g++)
+				for (bl = b->lo[2]; bl <= b->hi[2]; bl++)
+				{
+					ix = (r << 2*QUANT_BITS) | (g << QUANT_BITS) | bl;
+					red += qd->hist[ix].red;
+					green += qd->hist[ix].green;
+					blue += qd->hist[ix].blue;
+				}
+		qd->palette[i].red = (red + b->count/2)/b->count;
+		qd->palette[i].green = (green + b->count/2)/b->count;
+		qd->palette[i].blue = (blue + b->count/2)/b->count;
+		qd->palette[i].alpha = 0xff;
+	}
+	qd->ncolors = nboxes;
+
+	xpm_free(qd->br->heap,box);
+	return B_OK;
+}
+
+//	shrink_box()
+//	fit the bounds of a box tightly around its occupied cells, and count
+//	its pixels.
+void shrink_box(quant_box *b, quant_cell *hist)
+{
+	int lo[3], hi[3];
+	int r, g, bl, ix;
+
+	lo[0] = lo[1] = lo[2] = QUANT_LEVELS;
+	hi[0] = hi[1] = hi[2] = -1;
+	b->count = 0;
+	for (r = b->lo[0]; r <= b->hi[0]; r++)
+		for (g = b->lo[1]; g <= b->hi[1]; g++)
+			for (bl = b->lo[2]; bl <= b->hi[2]; bl++)
+			{
+				ix = (r << 2*QUANT_BITS) | (g << QUANT_BITS) | bl;
+				if (!hist[ix].count)
+					continue;
+				b->count += hist[ix].count;
+				if (r < lo[0]) lo[0] = r;
+				if (r > hi[0]) hi[0] = r;
+				if (g < lo[1]) lo[1] = g;
+				if (g > hi[1]) hi[1] = g;
+				if (bl < lo[2]) lo[2] = bl;
+				if (bl > hi[2]) hi[2] = bl;
+			}
+	if (b->count)
+		for (r = 0; r < 3; r++)
+		{
+			b->lo[r] = lo[r];
+			b->hi[r] = hi[r];
+		}
+}
+
+//	octree_palette()
+//	insert every occupied cell into an octree, then fold the least
+//	populated nodes of the deepest level into their parents until no more
+//	than "budget" leaves remain.  Each leaf becomes the average of its pixels.
+status_t octree_palette(quant_data *qd, int budget)
+{
+	octree_node *node;
+	int reducible[QUANT_BITS];
+	int maxNodes, nnodes, leaves, level, ix, n, k, child, shift;
+	int *prev, *bestPrev;
+	uint64 least;
+
+//	1 + 8 + 64 + ... nodes at most
+	maxNodes = 0;
+	for (level = 0, n = 1; level <= QUANT_BITS; level++, n *= 8)
+		maxNodes += n;
+	node = (octree_node *)xpm_calloc(qd->br->heap,maxNodes,sizeof(octree_node));
+	if (!node)
+		return B_NO_MEMORY;
+	for (level = 0; level < QUANT_BITS; level++)
+		reducible[level] = -1;
+	nnodes = 1;
+	node[0].next = reducible[0];
+	reducible[0] = 0;
+	leaves = 0;
+
+	for (ix = 0; ix < QUANT_BINS; ix++)
+	{
+		quant_cell *cell = &qd->hist[ix];
+
+		if (!cell->count)
+			continue;
+		n = 0;
+		for (level = 0; level < QUANT_BITS; level++)
+		{
+			shift = QUANT_BITS-1-level;
+			child = (((ix >> (2*QUANT_BITS+shift)) & 1) << 2)
+				| (((ix >> (QUANT_BITS+shift)) & 1) << 1)
+				| ((ix >> shift) & 1);
+			if (!node[n].child[child])
+			{
+				k = nnodes++;
+				node[n].child[child] = k;
+				if (level+1 < QUANT_BITS)
+				{
+					node[k].next = reducible[level+1];
+					reducible[level+1] = k;
+				}
+				else
+				{
+					node[k].leaf = true;
+					leaves++;
+				}
+			}
+			n = node[n].child[child];
+		}
+		node[n].count += cell->count;
+		node[n].red += cell->red;
+		node[n].green += cell->green;
+		node[n].blue += cell->blue;
+	}
+
+//	reduce, deepest level first
+	for (level = QUANT_BITS-1; level >= 0 && leaves > budget; level--)
+		while (leaves > budget && reducible[level] != -1)
+		{
+			octree_node *t;
+
+			bestPrev = &reducible[level];
+			least = 0;
+			for (prev = &reducible[level]; *prev != -1; prev = &node[*prev].next)
+			{
+				t = &node[*prev];
+				uint64 count = 0;
+
+				for (k = 0; k < 8; k++)
+					if (t->child[k])
+						count += node[t->child[k]].count;
+				if (prev == &reducible[level] || count < least)
+				{
+					least = count;
+					bestPrev = prev;
+				}
+			}
+			t = &node[*bestPrev];
+			*bestPrev = t->next;
+			n = 0;
+			for (k = 0; k < 8; k++)
+				if (t->child[k])
+				{
+					octree_node *c = &node[t->child[k]];
+
+					t->count += c->count;
+					t->red += c->red;
+					t->green += c->green;
+					t->blue += c->blue;
+					c->leaf = false;
+					c->count = 0;
+					t->child[k] = 0;
+					n++;
+				}
+			t->leaf = true;
+			leaves -= n-1;
+		}
+
+	qd->ncolors = 0;
+	for (n = 0; n < nnodes && qd->ncolors < budget; n++)
+		if (node[n].leaf && node[n].count)
+		{
+			rgb_color *color = &qd->palette[qd->ncolors++];
+
+			color->red = (node[n].red + node[n].count/2)/node[n].count;
+			color->green = (node[n].green + node[n].count/2)/node[n].count;
+			color->blue = (node[n].blue + node[n].count/2)/node[n].count;
+			color->alpha = 0xff;
+		}
+
+	xpm_free(qd->br->heap,node);
+	return B_OK;
+}
+
+//	nearest_color()
+//	find the palette color closest to (r, g, b), by squared distance.
+int nearest_color(quant_data *qd, int r, int g, int b)
+{
+	int i, best = 0, dr, dg, db, d, bestDistance = INT_MAX;
+
+	for (i = 0; i < qd->ncolors; i++)
+	{
+		dr = r - qd->palette[i].red;
+		dg = g - qd->palette[i].green;
+		db = b - qd->palette[i].blue;
+		d = dr*dr + dg*dg + db*db;
+		if (d < bestDistance)
+		{
+			bestDistance = d;
+			best = i;
+		}
+	}
+	return best;
+}
+
+//	map_cells_band()
+//	find the nearest palette color of every occupied histogram cell in
+//	[first, last); the cells' average colors stand for their pixels.
+status_t map_cells_band(int, int first, int last, void *arg)
+{
+	quant_data *qd = (quant_data *)arg;
+	quant_cell *cell;
+	int ix;
+
+	for (ix = first; ix < last; ix++)
+	{
+		cell = &qd->hist[ix];
+		if (cell->count)
+			qd->map[ix] = nearest_color(qd,cell->red/cell->count,
+				cell->green/cell->count,cell->blue/cell->count);
+	}
+	return B_OK;
+}
+
+//	map_pixels_band()
+//	replace the pixels of rows [first, last) with their palette colors.
+status_t map_pixels_band(int, int first, int last, void *arg)
+{
+	quant_data *qd = (quant_data *)arg;
+	rgb_color *pixel, *end;
+
+	pixel = qd->br->pix + (size_t)first*qd->br->width;
+	end = qd->br->pix + (size_t)last*qd->br->width;
+	for (; pixel < end; pixel++)
+		if (!is_transparent(pixel))
+			*pixel = qd->palette[qd->map[QUANT_BIN(pixel->red,pixel->green,pixel->blue)]];
+	return B_OK;
+}
+
+//	dither_bitmap()
+//	map the pixels with Floyd-Steinberg error diffusion, marking the palette
+//	colors used.  Errors are kept in sixteenths, with a spare column on
+//	either side of the row so that the edges need no special cases.
+status_t dither_bitmap(quant_data *qd, bool *used)
+{
+	bitmap_record *br = qd->br;
+	int *current, *next;
+	int i;
+
+	current = (int *)xpm_calloc(br->heap,3*(br->width+2),sizeof(int));
+	next = (int *)xpm_calloc(br->heap,3*(br->width+2),sizeof(int));
+	if (!current || !next)
+	{
+		xpm_free(br->heap,current);
+		xpm_free(br->heap,next);
+		return B_NO_MEMORY;
+	}
+
+	for (i = 0; i < br->height; i++)
+		dither_row(qd,br->pix + (size_t)i*br->width,&current,&next,used);
+
+	xpm_free(br->heap,current);
+	xpm_free(br->heap,next);
+	return B_OK;
+}
+
+//	dither_row()
+//	map the next row of pixels, taking the errors carried to it from
+//	"*next" and leaving those it carries to the row after there.
+void dither_row(quant_data *qd, rgb_color *pixel, int **currentRow, int **nextRow, bool *used)
+{
+	int width = qd->br->width;
+	int *current, *next;
+	int value[3], error[3];
+	rgb_color *color;
+	int j, c, ix;
+
+	current = *nextRow;
+	next = *currentRow;
+	*currentRow = current;
+	*nextRow = next;
+	memset(next,0,3*(width+2)*sizeof(int));
+	for (j = 0; j < width; j++, pixel++)
+	{
+		if (is_transparent(pixel))
+			continue;
+		value[0] = pixel->red + current[3*(j+1)]/16;
+		value[1] = pixel->green + current[3*(j+1)+1]/16;
+		value[2] = pixel->blue + current[3*(j+1)+2]/16;
+		for (c = 0; c < 3; c++)
+		{
+			if (value[c] < 0)
+				value[c] = 0;
+			else if (value[c] > 255)
+				value[c] = 255;
+		}
+		ix = QUANT_BIN(value[0],value[1],value[2]);
+		if (qd->map[ix] < 0)
+			qd->map[ix] = nearest_color(qd,value[0],value[1],value[2]);
+		used[qd->map[ix]] = true;
+		color = &qd->palette[qd->map[ix]];
+		error[0] = value[0] - color->red;
+		error[1] = value[1] - color->green;
+		error[2] = value[2] - color->blue;
+		for (c = 0; c < 3; c++)
+		{
+			current[3*(j+2)+c] += 7*error[c];
+			next[3*j+c] += 3*error[c];
+			next[3*(j+1)+c] += 5*error[c];
+			next[3*(j+2)+c] += error[c];
+		}
+		*pixel = *color;
+	}
+}
+
+bool is_transparent(rgb_color *color)
+{
+	rgb_color transp = B_TRANSPARENT_32_BIT;
+
+	return !memcmp(color,&transp,sizeof(rgb_color));
+}
@@ -0,0 +1,23 @@
+//	Quantize.h
+//	color reduction for toXPM()
+#ifndef QUANTIZE_H
+#define QUANTIZE_H
+
+#include "ScanBitmap.h"
+#include "toXPM.h"
+
+status_t quantize_bitmap(bitmap_record *, const xpm_encode_settings *);
+
+//	the same for a bitmap that is never in memory whole: every row is
+//	counted, then the palette chosen, then every row mapped in order
+typedef struct quant_stream quant_stream;
+
+quant_stream *new_quant_stream(bitmap_record *, const xpm_encode_settings *);
+void quant_stream_count(quant_stream *, rgb_color *);
+status_t quant_stream_palette(quant_stream *);
+void quant_stream_map(quant_stream *, rgb_color *);
+void quant_stream_rewind(quant_stream *);
+status_t quant_stream_table(quant_stream *);
+void delete_quant_stream(quant_stream *);
+
+#endif
@@ -0,0 +1,102 @@
+//	RowBands.cc
+//
+//	implements run_row_bands(), which hands each of a number of row bands to
+//	a thread of its own, then waits for the bands in order so that the caller
+//	can consume band 0 while the later bands are still being worked on.
+
+#include "XPM.h"
+#include "RowBands.h"
+
+typedef struct
+{
+	rowBandHook hook;
+	void *arg;
+	int band;
+	int first;
+	int last;
+}
+band_record;
+
+status_t band_thread(void *);
+
+//	count_row_bands()
+//	choose the number of bands for an image of the given size: one per CPU,
+//	but never more bands than rows, and only one for small images, where
+//	spawning threads would cost more than it saves.
+int count_row_bands(int width, int height)
+{
+	system_info info;
+	int bands;
+
+	if (height <= 1 || (double)width*height < ROW_BANDS_MIN_PIXELS)
+		return 1;
+	if (get_system_info(&info) != B_OK)
+		return 1;
+	bands = info.cpu_count;
+	if (bands > ROW_BANDS_MAX)
+		bands = ROW_BANDS_MAX;
+	if (bands > height)
+		bands = height;
+	return bands < 1 ? 1 : bands;
+}
+
+//	run_row_bands()
+//	split "height" rows into "bands" nearly equal bands and run "hook" on
+//	each.  "doneHook", if not NULL, is called for each band in order once
+//	that band's hook has returned.  A single band, or a band whose thread
+//	can't be spawned, runs in the calling thread.
+status_t run_row_bands(int bands, int height, rowBandHook hook, rowBandDoneHook doneHook, void *arg)
+{
+	band_record record[ROW_BANDS_MAX];
+	thread_id thread[ROW_BANDS_MAX];
+	status_t result[ROW_BANDS_MAX];
+	status_t err = B_OK;
+	int i;
+
+	if (bands < 1)
+		bands = 1;
+	if (bands > ROW_BANDS_MAX)
+		bands = ROW_BANDS_MAX;
+
+	for (i = 0; i < bands; i++)
+	{
+		record[i].hook = hook;
+		record[i].arg = arg;
+		record[i].band = i;
+		record[i].first = (int)((double)height*i/bands);
+		record[i].last = (int)((double)height*(i+1)/bands);
+		thread[i] = -1;
+		if (bands > 1)
+		{
+			thread[i] = spawn_thread(band_thread,"xpm row band",B_NORMAL_PRIORITY,&record[i]);
+			if (thread[i] >= 0 && resume_thread(thread[i]) != B_OK)
+			{
+				kill_thread(thread[i]);
+				thread[i] = -1;
+			}
+		}
+		if (thread[i] < 0)
+			result[i] = band_thread(&record[i]);
+	}
+
+//	collect the bands in order; keep waiting after an error, since the
+//	threads still hold pointers into "record".
+	for (i = 0; i < bands; i++)
+	{
+		if (thread[i] >= 0)
+			wait_for_thread(thread[i],&result[i]);
+		if (err == B_OK)
+			err = result[i];
+		if (err == B_OK && doneHook)
+			err = doneHook(i,arg);
+	}
+
+	return err;
+}
+
+status_t band_thread(void *data)
+{
+	band_record *record = (band_record *)data;
+
+	return record->hook(record->band,record->first,record->last,record->arg);
+}
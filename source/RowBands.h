@@ -0,0 +1,19 @@
+//	RowBands.h
+//	splits the rows of an image into contiguous bands and works on the bands
+//	in threads of their own.
+
+#ifndef ROW_BANDS_H
+#define ROW_BANDS_H
+
+#define		ROW_BANDS_MAX			64
+#define		ROW_BANDS_MIN_PIXELS	65536		// smaller images stay on one thread
+
+//	called in a worker thread with the band number and its rows, [first, last)
+typedef status_t (*rowBandHook)(int, int, int, void *);
+//	called in the calling thread, in band order, as each band finishes
+typedef status_t (*rowBandDoneHook)(int, void *);
+
+int count_row_bands(int, int);
+status_t run_row_bands(int, int, rowBandHook, rowBandDoneHook, void *);
+
+#endif
@@ -1,150 +1,387 @@
 //	ScanBitmap.cc
 //
-//	implements scan_bitmap(), which reads an B_TRANSLATOR_BITMAP from a stream.
+//	implements read_bitmap(), which reads an B_TRANSLATOR_BITMAP from a stream,
+//	and scan_bitmap() and scan_indexed_bitmap(), which make sense of its pixels.
 //	some attempt is made at covering all the possible bitmap color spaces, but only
 //	B_RGBA32 has been tested at all, and that only on BeOS R3 Intel.  Endianness
 //	issues will doubtless trip me up down the line.
 
 #include "XPM.h"
 #include "ScanBitmap.h"
+#include "XPMCache.h"
 
-//	scan_bitmap()
-//	scans in a B_TRANSLATOR_BITMAP from "stream", and fills out a bitmap_record
-//	for use by other code.
-status_t scan_bitmap(BPositionIO *stream, bitmap_record *br)
+//	read_bitmap()
+//	reads a B_TRANSLATOR_BITMAP header from "stream", swapping it to host
+//	byte order, and then the pixel data it describes into "*data", which
+//	the caller must free().
+status_t read_bitmap(BPositionIO *stream, TranslatorBitmap *bmap, uint8 **data)
+{
+	status_t err;
+
+	err = read_bitmap_header(stream,bmap);
+	if (err != B_OK)
+		return err;
+	return read_bitmap_data(stream,bmap,data);
+}
+
+//	read_bitmap_data()
+//	reads the pixel data "bmap" describes from "stream", which is at the
+//	first row, into "*data", which the caller must xpm_free() from "heap".
+status_t read_bitmap_data(BPositionIO *stream, TranslatorBitmap *bmap, uint8 **data, xpm_heap *heap)
+{
+	status_t err;
+
+// allocate and initialize the pixel data
+	*data = (uint8 *)xpm_calloc(heap,bmap->dataSize,1);
+	if (!*data)
+		return B_NO_MEMORY;
+	err = stream->Read(*data,bmap->dataSize);
+	if (err <= 0)
+	{
+		xpm_free(heap,*data);
+		*data = NULL;
+		return B_ERROR;
+	}
+	return B_OK;
+}
+
+//	read_bitmap_header()
+//	reads just the B_TRANSLATOR_BITMAP header from "stream", swapping it to
+//	host byte order, and leaves the stream at the first row.
+status_t read_bitmap_header(BPositionIO *stream, TranslatorBitmap *bmap)
 {
 	status_t err;
-	rgb_color *pixel;
-	int i, j, k;
-	uint16 word;
-	int32 *pixint;
-	uint8 *data, *addr, *t;
-	const color_map *clut;
-	TranslatorBitmap bmap;
-	rgb_color white = { 0xff, 0xff, 0xff, 0xff };
-	rgb_color black = { 0x00, 0x00, 0x00, 0xff };
 
 //	get the header first
-	err = stream->Read(&bmap,sizeof(bmap));
+	err = stream->Read(bmap,sizeof(*bmap));
 	if (err <= 0)
 		return B_ERROR;
 	
 //	confirm the "magic number"
-    bmap.magic = B_BENDIAN_TO_HOST_INT32(bmap.magic);
+    bmap->magic = B_BENDIAN_TO_HOST_INT32(bmap->magic);
     
-	if (bmap.magic != B_TRANSLATOR_BITMAP)
+	if (bmap->magic != B_TRANSLATOR_BITMAP)
 		return B_ERROR;
 
-	bmap.bounds.left = B_BENDIAN_TO_HOST_FLOAT(bmap.bounds.left);
-	bmap.bounds.right = B_BENDIAN_TO_HOST_FLOAT(bmap.bounds.right);
-	bmap.bounds.top = B_BENDIAN_TO_HOST_FLOAT(bmap.bounds.top);
-	bmap.bounds.bottom = B_BENDIAN_TO_HOST_FLOAT(bmap.bounds.bottom);
-	bmap.rowBytes = B_BENDIAN_TO_HOST_INT32(bmap.rowBytes);
-	bmap.colors = (color_space)B_BENDIAN_TO_HOST_INT32(bmap.colors);
-	bmap.dataSize = B_BENDIAN_TO_HOST_INT32(bmap.dataSize);
+	bmap->bounds.left = B_BENDIAN_TO_HOST_FLOAT(bmap->bounds.left);
+	bmap->bounds.right = B_BENDIAN_TO_HOST_FLOAT(bmap->bounds.right);
+	bmap->bounds.top = B_BENDIAN_TO_HOST_FLOAT(bmap->bounds.top);
+	bmap->bounds.bottom = B_BENDIAN_TO_HOST_FLOAT(bmap->bounds.bottom);
+	bmap->rowBytes = B_BENDIAN_TO_HOST_INT32(bmap->rowBytes);
+	bmap->colors = (color_space)B_BENDIAN_TO_HOST_INT32(bmap->colors);
+	bmap->dataSize = B_BENDIAN_TO_HOST_INT32(bmap->dataSize);
 
-// allocate and initialize the pixel data
-	data = (uint8 *)calloc(bmap.dataSize,1);
-	err = stream->Read(data,bmap.dataSize);
-	if (err <= 0)
+//	the rows must fit in the data
+	if (bmap->bounds.IntegerWidth() < 0 || bmap->bounds.IntegerHeight() < 0
+		|| (uint64)bmap->rowBytes*(1+bmap->bounds.IntegerHeight()) > bmap->dataSize)
 		return B_ERROR;
-	br->width = 1+bmap.bounds.IntegerWidth();
-	br->height = 1+bmap.bounds.IntegerHeight();
-	br->pix = (rgb_color *)malloc(br->width*br->height*sizeof(rgb_color));
+	return B_OK;
+}
+
+//	row_bytes()
+//	the fewest bytes that can hold a row of "width" pixels in "space";
+//	spaces not understood are taken to have four bytes per pixel.
+size_t row_bytes(color_space space, int width)
+{
+	switch (space)
+	{
+		case B_RGB16_BIG:
+		case B_RGB16_LITTLE:
+		case B_RGB15_BIG:
+		case B_RGB15_LITTLE:
+			return 2*(size_t)width;
+		case B_CMAP8:
+		case B_GRAY8:
+			return width;
+		case B_GRAY1:
+			return ((size_t)width+7)/8;
+		default:
+			return 4*(size_t)width;
+	}
+}
+
+//	is_indexed_space()
+//	true for the color spaces whose pixels are indices into a palette of
+//	at most 256 colors.
+bool is_indexed_space(color_space space)
+{
+	return space == B_CMAP8 || space == B_GRAY8 || space == B_GRAY1;
+}
+
+//	scan_indexed_bitmap()
+//	fills out a bitmap_record for a B_CMAP8, B_GRAY8 or B_GRAY1 bitmap
+//	without expanding its pixels: the record keeps pointing into "data",
+//	and gets a histogram of the indices used and the color of each index.
+status_t scan_indexed_bitmap(TranslatorBitmap *bmap, const uint8 *data, bitmap_record *br)
+{
+	int i;
+
+	br->width = 1+bmap->bounds.IntegerWidth();
+	br->height = 1+bmap->bounds.IntegerHeight();
+	br->ctable = NULL;
+	br->pix = NULL;
+	br->index = data;
+	br->rowBytes = bmap->rowBytes;
+	br->space = bmap->colors;
+	memset(br->count,0,sizeof(br->count));
+	if (bmap->rowBytes < row_bytes(bmap->colors,br->width)
+		|| indexed_palette(bmap->colors,br->palette) != B_OK)
+		return B_ERROR;
+
+	count_indexed_rows(br,data,br->height);
+	br->ncolors = 0;
+	for (i = 0; i < 256; i++)
+		if (br->count[i])
+			br->ncolors++;
+	return B_OK;
+}
+
+//	indexed_palette()
+//	the color of each index of an indexed color space.
+status_t indexed_palette(color_space space, rgb_color *palette)
+{
+	const color_map *clut;
+	int i;
+
+	switch (space)
+	{
+		case B_CMAP8:
+			clut = system_colors();
+			memcpy(palette,clut->color_list,256*sizeof(rgb_color));
+			break;
+		case B_GRAY8:
+			for (i = 0; i < 256; i++)
+			{
+				palette[i].red = i;
+				palette[i].green = i;
+				palette[i].blue = i;
+				palette[i].alpha = 0xff;
+			}
+			break;
+		case B_GRAY1:
+			palette[0].red = palette[0].green = palette[0].blue = 0x00;
+			palette[1].red = palette[1].green = palette[1].blue = 0xff;
+			palette[0].alpha = palette[1].alpha = 0xff;
+			break;
+		default:
+			return B_ERROR;
+	}
+	return B_OK;
+}
+
+//	count_indexed_rows()
+//	add the indices of "rows" rows of "data", each br->rowBytes after the
+//	last, to the histogram br->count.
+void count_indexed_rows(bitmap_record *br, const uint8 *data, int rows)
+{
+	uint32 *count = br->count;
+	const uint8 *t;
+	int i, j;
+
+	for (i = 0; i < rows; i++)
+	{
+		t = data + (size_t)i*br->rowBytes;
+		if (br->space == B_GRAY1)
+			for (j = 0; j < br->width; j++)
+				count[(t[j >> 3] >> (7 - (j & 7))) & 1]++;
+		else
+			for (j = 0; j < br->width; j++)
+				count[t[j]]++;
+	}
+}
+
+//	scan_bitmap()
+//	converts the pixel data of a B_TRANSLATOR_BITMAP, as read by
+//	read_bitmap(), into a bitmap_record of rgb_colors for use by other code.
+//	If "colorLimit" is not zero, colors stop being collected once there are
+//	more than that many; the caller is going to reduce the colors anyway,
+//	and needs only to know that there are too many.
+status_t scan_bitmap(TranslatorBitmap *bmap, const uint8 *data, bitmap_record *br, int colorLimit)
+{
+	rgb_color *pixel;
+	int i;
+	const uint8 *addr;
+	size_t length;
+	row_seen *seen;
+	int k, mask;
+
+	br->width = 1+bmap->bounds.IntegerWidth();
+	br->height = 1+bmap->bounds.IntegerHeight();
+	br->index = NULL;
+	br->rowBytes = bmap->rowBytes;
+	br->space = bmap->colors;
+	if (bmap->rowBytes < row_bytes(bmap->colors,br->width))
+		return B_ERROR;
+	if ((uint64)br->width*br->height > (size_t)-1/sizeof(rgb_color))
+		return B_NO_MEMORY;
+	br->pix = (rgb_color *)xpm_malloc(br->heap,(size_t)br->width*br->height*sizeof(rgb_color));
+	if (!br->pix)
+		return B_NO_MEMORY;
 // allocate the ctable, for the purpose of keeping track of all colors used in a particular
 // bitmap.  This could get nasty for 32-bit color bitmaps with thousands of distinct colors...
-	br->ctable = new UTreeDictionary(sizeof(rgb_color));
+	br->ctable = new_dictionary(sizeof(rgb_color),br->heap);
+	if (!br->ctable)
+		return B_NO_MEMORY;
 	br->ncolors = 0;
 	
+	for (mask = 1; mask < 2*br->height; mask <<= 1)
+		;
+	seen = (row_seen *)xpm_malloc(br->heap,mask*sizeof(row_seen));
+	if (!seen)
+		return B_NO_MEMORY;
+	for (i = 0; i < mask; i++)
+		seen[i].row = -1;
+	mask--;
+
 	addr = data;
 	pixel = br->pix;
-	clut = system_colors();
+	length = row_bytes(bmap->colors,br->width);
 
 	for (i = 0; i < br->height; i++)
 	{
-		t = addr;
-		for (j = 0; j < br->width; j++)
+//	a row the same as an earlier one has no new colors to look for, nor
+//	has a pixel the same as the one to its left.
+		k = find_row(seen,mask,data,bmap->rowBytes,i,length);
+		if (k >= 0)
 		{
+			memcpy(pixel,br->pix + (size_t)k*br->width,(size_t)br->width*sizeof(rgb_color));
+			pixel += br->width;
+			addr += bmap->rowBytes;
+			continue;
+		}
+		convert_row(bmap->colors,addr,br->width,pixel);
+		collect_row_colors(br,pixel,colorLimit);
+		pixel += br->width;
+		addr += bmap->rowBytes;
+	}
+	
+	xpm_free(br->heap,seen);
+	return B_OK;
+}
+
+//	collect_row_colors()
+//	add the colors of a converted row to br->ctable, up to "colorLimit"
+//	as for scan_bitmap().
+void collect_row_colors(bitmap_record *br, rgb_color *pixel, int colorLimit)
+{
+	int32 *pixint;
+	int j;
+
+	for (j = 0; j < br->width; j++, pixel++)
+	{
+		pixint = (int32 *)pixel;
+		if (j > 0 && *pixint == *(pixint - 1))
+			continue;
+		if ((!colorLimit || br->ncolors <= colorLimit) && !br->ctable->Find(NULL,*pixint))
+		{
+			br->ncolors++;
+			br->ctable->Insert(pixel,*pixint);
+		}
+	}
+}
+
+//	find_row()
+//	look row "i" of "data" up in the table of rows seen so far, by a hash
+//	of its first "length" bytes, returning the number of the same row seen
+//	earlier, or -1 after adding the row to the table.  "mask" is one less
+//	than the size of the table, a power of two.
+int find_row(row_seen *seen, int mask, const uint8 *data, int32 rowBytes, int i, size_t length)
+{
+	const uint8 *row = data + (size_t)i*rowBytes;
+	uint64 h;
+	int ix;
+
+	h = hash_bytes(row,length,HASH_SEED);
+	for (ix = h & mask; seen[ix].row >= 0; ix = (ix + 1) & mask)
+		if (seen[ix].hash == h && !memcmp(row,data + (size_t)seen[ix].row*rowBytes,length))
+			return seen[ix].row;
+	seen[ix].hash = h;
+	seen[ix].row = i;
+	return -1;
+}
+
+//	convert_row()
+//	convert a row of "width" pixels in color space "space" into rgb_colors.
+void convert_row(color_space space, const uint8 *t, int width, rgb_color *pixel)
+{
+	int j, k;
+	uint16 word;
+	const color_map *clut;
+	rgb_color white = { 0xff, 0xff, 0xff, 0xff };
+	rgb_color black = { 0x00, 0x00, 0x00, 0xff };
+
+	clut = system_colors();
+	for (j = 0; j < width; j++)
+	{
 //	attempt to cover all possible formats.  
-			switch (bmap.colors)
-			{
-				case B_RGB32_LITTLE:
-				case B_RGBA32_LITTLE:
-					pixel->blue = *t++;
-					pixel->green = *t++;
-					pixel->red = *t++;
-					pixel->alpha = *t++;	
-					break;			
-				case B_RGB32_BIG:
-				case B_RGBA32_BIG:
-					pixel->alpha = *t++;	
-					pixel->red = *t++;
-					pixel->green = *t++;
-					pixel->blue = *t++;
-					break;
-				case B_RGB16_BIG:
-					word = B_BENDIAN_TO_HOST_INT16(*((uint16*)t));
-					goto rgb16biglittle;
-				case B_RGB16_LITTLE:
-				    word = B_LENDIAN_TO_HOST_INT16(*((uint16*)t));
+		switch (space)
+		{
+			case B_RGB32_LITTLE:
+			case B_RGBA32_LITTLE:
+				pixel->blue = *t++;
+				pixel->green = *t++;
+				pixel->red = *t++;
+				pixel->alpha = *t++;	
+				break;			
+			case B_RGB32_BIG:
+			case B_RGBA32_BIG:
+				pixel->alpha = *t++;	
+				pixel->red = *t++;
+				pixel->green = *t++;
+				pixel->blue = *t++;
+				break;
+			case B_RGB16_BIG:
+				word = B_BENDIAN_TO_HOST_INT16(*((const uint16*)t));
+				goto rgb16biglittle;
+			case B_RGB16_LITTLE:
+			    word = B_LENDIAN_TO_HOST_INT16(*((const uint16*)t));
                 rgb16biglittle:    
-					pixel->alpha = 0xff;
-					pixel->red = (word & 0xf800) >> 8;
-					pixel->red |= pixel->red >> 5;
-					pixel->green = (word & 0x07e0) >> 3;
-					pixel->green |= pixel->green >> 5;
-					pixel->blue = (word & 0x1f) << 3;
-					pixel->blue |= pixel->blue >> 5;
-					t += 2;
-					break;
+				pixel->alpha = 0xff;
+				pixel->red = (word & 0xf800) >> 8;
+				pixel->red |= pixel->red >> 5;
+				pixel->green = (word & 0x07e0) >> 3;
+				pixel->green |= pixel->green >> 5;
+				pixel->blue = (word & 0x1f) << 3;
+				pixel->blue |= pixel->blue >> 5;
+				t += 2;
+				break;
                 case B_RGB15_BIG:
-					word = B_BENDIAN_TO_HOST_INT16(*((uint16*)t));
-					goto rgb15biglittle;
-				case B_RGB15_LITTLE:
-				    word = B_LENDIAN_TO_HOST_INT16(*((uint16*)t));
+				word = B_BENDIAN_TO_HOST_INT16(*((const uint16*)t));
+				goto rgb15biglittle;
+			case B_RGB15_LITTLE:
+			    word = B_LENDIAN_TO_HOST_INT16(*((const uint16*)t));
                 rgb15biglittle:    
-					pixel->alpha = (word & 0x8000) ? 0xff : 0;
-					pixel->red = (word & 0x7c00) >> 7;
-					pixel->red |= pixel->red >> 5;
-					pixel->green = (word & 0x03e0) >> 2;
-					pixel->green |= pixel->green >> 5;
-					pixel->blue = (word & 0x1f) << 3;
-					pixel->blue |= pixel->blue >> 5;
-					t += 2;
-					break;
-				case B_CMAP8:
-					*pixel = clut->color_list[*t++];
-					break;
-				case B_GRAY8:
-					pixel->red = *t++;
-					pixel->green = pixel->red;
-					pixel->blue = pixel->red;
-					pixel->alpha = 0xff;
-					break;
-				case B_GRAY1:
-					k = i % 8;
-					if (*t & (1 << (7-k)))
-						*pixel = white;
-					else
-						*pixel = black;
-					if (k == 7)
-						t++;
-					break;
-				default:
+				pixel->alpha = (word & 0x8000) ? 0xff : 0;
+				pixel->red = (word & 0x7c00) >> 7;
+				pixel->red |= pixel->red >> 5;
+				pixel->green = (word & 0x03e0) >> 2;
+				pixel->green |= pixel->green >> 5;
+				pixel->blue = (word & 0x1f) << 3;
+				pixel->blue |= pixel->blue >> 5;
+				t += 2;
+				break;
+			case B_CMAP8:
+				*pixel = clut->color_list[*t++];
+				break;
+			case B_GRAY8:
+				pixel->red = *t++;
+				pixel->green = pixel->red;
+				pixel->blue = pixel->red;
+				pixel->alpha = 0xff;
+				break;
+			case B_GRAY1:
+				k = j % 8;
+				if (*t & (1 << (7-k)))
+					*pixel = white;
+				else
 					*pixel = black;
-					break;
-			}
-			pixint = (int32 *)pixel;
-			if (!br->ctable->Find(NULL,*pixint))
-			{
-				br->ncolors++;
-				br->ctable->Insert(pixel,*pixint);
-			}
-			pixel++;
-		}	
-		addr += bmap.rowBytes;
+				if (k == 7)
+					t++;
+				break;
+			default:
+				*pixel = black;
+				break;
+		}
+		pixel++;
 	}
-	
-	free(data);
-	return B_OK;
 }
@@ -8,6 +8,10 @@
 //	have used the "TranslatorBitmap" structure but this is a bit
 //	more complete, storing a color table as well in the hash table
 //	"ctable".
+//	Bitmaps in an indexed color space (see is_indexed_space()) are not
+//	expanded into "pix": "index" points at their rows as read, "count" is
+//	a histogram of the indices used, and "palette" gives each index a color.
+//	"pix" and "ctable" are allocated from "heap".
 typedef struct
 {
 	int width;
@@ -15,9 +19,34 @@ typedef struct
 	UTreeDictionary *ctable;
 	int ncolors;
 	rgb_color *pix;
+	const uint8 *index;
+	int rowBytes;
+	color_space space;
+	uint32 count[256];
+	rgb_color palette[256];
+	xpm_heap *heap;
 }
 bitmap_record;
 
-status_t scan_bitmap(BPositionIO *, bitmap_record *);
+//	a row met before, by the hash of its pixels; see find_row()
+typedef struct
+{
+	uint64 hash;
+	int row;
+}
+row_seen;
+
+status_t read_bitmap(BPositionIO *, TranslatorBitmap *, uint8 **);
+status_t read_bitmap_header(BPositionIO *, TranslatorBitmap *);
+status_t read_bitmap_data(BPositionIO *, TranslatorBitmap *, uint8 **, xpm_heap * = NULL);
+size_t row_bytes(color_space, int);
+bool is_indexed_space(color_space);
+status_t scan_indexed_bitmap(TranslatorBitmap *, const uint8 *, bitmap_record *);
+status_t indexed_palette(color_space, rgb_color *);
+void count_indexed_rows(bitmap_record *, const uint8 *, int);
+status_t scan_bitmap(TranslatorBitmap *, const uint8 *, bitmap_record *, int = 0);
+void collect_row_colors(bitmap_record *, rgb_color *, int);
+void convert_row(color_space, const uint8 *, int, rgb_color *);
+int find_row(row_seen *, int, const uint8 *, int32, int, size_t);
 
-#endif
\ No newline at end of file
+#endif
@@ -1,5 +1,6 @@
 //	UTreeDictionary.cc
 
+#include <new>
 #include "XPM.h"
 #include "UTreeDictionary.h"
 
@@ -14,7 +15,10 @@ typedef struct
 }
 tree_record;
 
-UTreeDictionary::UTreeDictionary(int datSize)
+//	UTreeDictionary::UTreeDictionary(int, xpm_heap *)
+//	a dictionary of "datSize" bytes of data per key, whose nodes come from
+//	"nodeHeap".
+UTreeDictionary::UTreeDictionary(int datSize, xpm_heap *nodeHeap)
 {
 	uint8 *addr;
 	tree_record *t;
@@ -23,7 +27,8 @@ UTreeDictionary::UTreeDictionary(int datSize)
 	dataSize = datSize;	
 	nodeSize = dataSize+sizeof(tree_record);
 	length = UTD_LENGTH_UNIT;
-	list = (uint8 *)malloc(length*nodeSize);
+	heap = nodeHeap;
+	list = (uint8 *)xpm_malloc(heap,length*nodeSize);
 	addr = list;
 	for (i = 0; i < length-1; i++)
 	{
@@ -38,7 +43,34 @@ UTreeDictionary::UTreeDictionary(int datSize)
 
 UTreeDictionary::~UTreeDictionary()
 {
-	free(list);
+	xpm_free(heap,list);
+}
+
+xpm_heap *UTreeDictionary::Heap(void) const
+{
+	return heap;
+}
+
+//	new_dictionary()
+//	a UTreeDictionary of "dataSize" bytes per key, itself and its nodes
+//	from "heap", so that a context can keep it for next time; free it with
+//	delete_dictionary().
+UTreeDictionary *new_dictionary(int dataSize, xpm_heap *heap)
+{
+	void *place = xpm_malloc(heap,sizeof(UTreeDictionary));
+
+	return place ? new (place) UTreeDictionary(dataSize,heap) : NULL;
+}
+
+void delete_dictionary(UTreeDictionary *dictionary)
+{
+	xpm_heap *heap;
+
+	if (!dictionary)
+		return;
+	heap = dictionary->Heap();
+	dictionary->~UTreeDictionary();
+	xpm_free(heap,dictionary);
 }
 
 bool UTreeDictionary::Find(void *data, int key)
@@ -89,7 +121,7 @@ status_t UTreeDictionary::Insert(void *data, int key)
 		oldLength = length;
 		head->next = oldLength;
 		length += UTD_LENGTH_UNIT;
-		list = (uint8 *)realloc(list,length*nodeSize);
+		list = (uint8 *)xpm_realloc(heap,list,length*nodeSize);
 		head = (tree_record *)list;
 		addr = list+oldLength*nodeSize;
 		for (i = oldLength; i < length-1; i++)
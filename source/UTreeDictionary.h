@@ -3,22 +3,26 @@
 #ifndef UTREEDICTIONARY_H
 #define UTREEDICTIONARY_H
 
+#include "XPMContext.h"
+
 typedef void (*utdTraverseHook)(int, void *, void *);
 
 class UTreeDictionary
 {
 	public:
 	
-		UTreeDictionary(int);
+		UTreeDictionary(int, xpm_heap * = NULL);
 		~UTreeDictionary();
 		
 		bool Find(void *, int);
 		status_t Insert(void *, int);
 		void TraverseInOrder(utdTraverseHook, void *);
+		xpm_heap *Heap(void) const;
 		
 	private:
 	
 		uint8 *list;
+		xpm_heap *heap;
 		int dataSize;
 		int nodeSize;
 		int length;
@@ -29,4 +33,8 @@ class UTreeDictionary
 		void traverseInOrder(int, utdTraverseHook, void *);
 };
 
+//	a dictionary allocated, as well as its nodes, from "heap"
+UTreeDictionary *new_dictionary(int, xpm_heap *);
+void delete_dictionary(UTreeDictionary *);
+
 #endif 
\ No newline at end of file
@@ -6,6 +6,56 @@
 #include <be/SupportKit.h>
 
 #define		XPM_HEADER		"/* XPM */"
+#define		XPM2_HEADER		"! XPM2"
 #define		phi					0.61803399
 
+//	XPM pixels are represented by strings of characters.  This is every
+//	printable ASCII character that may appear in a C string without an
+//	escape: '"' and '\\' are left out, and so is '?', which could form a
+//	trigraph with its neighbors.  '!' comes last: an XPM2 line that begins
+//	with it is a comment to some readers, so XPM2 pixel strings never begin
+//	with the last character.
+#define		XPM_CHAR_SET		" qwertyuiopasdfghjklzxcvbnmQWERTYUIOPASDFGHJKLZXCVBNM" \
+							"1234567890@#$%^&*()-=_+|[]{};':,.<>/`~!"
+#define		XPM_CHAR_COUNT		(sizeof(XPM_CHAR_SET) - 1)
+
+//	fields of the ioExtension message understood by Translate() when it
+//	writes XPM; a field that is missing keeps the default given here.
+//	int32, at most this many colors, transparency included; default 0, every color exactly
+#define		XPM_EXT_MAX_COLORS		"xpm/maxColors"
+//	int32, XPM_QUANTIZE_MEDIAN_CUT (0) or XPM_QUANTIZE_OCTREE (1); default median cut
+#define		XPM_EXT_QUANTIZER		"xpm/quantizer"
+//	bool, diffuse the quantization error; default false
+#define		XPM_EXT_DITHER			"xpm/dither"
+//	bool, name the array after the content, not the time; default false
+#define		XPM_EXT_DETERMINISTIC	"xpm/deterministic"
+//	string, reuse and keep earlier output here; default none
+#define		XPM_EXT_CACHE_DIRECTORY	"xpm/cacheDirectory"
+//	int32, XPM_FORMAT_XPM3 (0) or XPM_FORMAT_XPM2 (1); default XPM3
+#define		XPM_EXT_FORMAT			"xpm/format"
+//	bool, write a gzip stream; default false
+#define		XPM_EXT_GZIP			"xpm/gzip"
+//	int64 bytes, encode in strips to stay near this; default 0, no limit
+#define		XPM_EXT_MEMORY_LIMIT	"xpm/memoryLimit"
+//	bool, to be given the counters below; default false
+#define		XPM_EXT_STATS			"xpm/stats"
+
+//	fields Translate() adds to the ioExtension message when asked for
+//	XPM_EXT_STATS; see XPMStats.h.  Times are in microseconds.
+#define		XPM_STAT_BYTES_READ		"xpm/stats/bytesRead"		// int64
+#define		XPM_STAT_BYTES_WRITTEN	"xpm/stats/bytesWritten"	// int64
+#define		XPM_STAT_READS			"xpm/stats/reads"			// int32
+#define		XPM_STAT_WRITES			"xpm/stats/writes"			// int32
+#define		XPM_STAT_HEADER_TIME	"xpm/stats/headerTime"		// int64
+#define		XPM_STAT_PALETTE_TIME	"xpm/stats/paletteTime"		// int64
+#define		XPM_STAT_PIXELS_TIME	"xpm/stats/pixelsTime"		// int64
+#define		XPM_STAT_OUTPUT_TIME	"xpm/stats/outputTime"		// int64
+#define		XPM_STAT_PROBES			"xpm/stats/probes"			// int64
+#define		XPM_STAT_MAX_CHAIN		"xpm/stats/maxChain"		// int32
+#define		XPM_STAT_COLORS			"xpm/stats/colors"			// int32
+#define		XPM_STAT_CPP			"xpm/stats/cpp"				// int32
+#define		XPM_STAT_ALLOCS			"xpm/stats/allocs"			// int32
+#define		XPM_STAT_ALLOC_BYTES	"xpm/stats/allocBytes"		// int64
+#define		XPM_STAT_PEAK_BYTES		"xpm/stats/peakBytes"		// int64
+
 #endif
\ No newline at end of file
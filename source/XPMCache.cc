@@ -0,0 +1,219 @@
+//	XPMCache.cc
+//
+//	implements the encode cache used by toXPM().  Every entry is a file in
+//	the cache directory, named by its key in hexadecimal: a cache_header
+//	giving the geometry of the bitmap it was made from, then the XPM.  An
+//	entry whose header doesn't match the bitmap being encoded is a miss, so
+//	that two bitmaps whose keys collide can't be given each other's output
+//	unless they are also the same size and color space.  Entries are
+//	written to a temporary file of the writer's own, named by its process
+//	and thread, and renamed into place, so a reader never sees half an
+//	entry, and two writers of the same key, in one process or several
+//	sharing the directory, simply replace one another with identical
+//	bytes.
+
+#include <stdio.h>
+#include <unistd.h>
+#include <StorageDefs.h>
+#include "XPM.h"
+#include "XPMCache.h"
+#include "ScanBitmap.h"
+
+#define		CACHE_BUFFER_SIZE		65536
+#define		CACHE_MAGIC				'XPMc'
+#define		HASH_PRIME_1			0x9e3779b185ebca87ULL
+#define		HASH_PRIME_2			0xc2b2ae3d27d4eb4fULL
+
+//	what an entry starts with, each field big-endian
+typedef struct
+{
+	uint32 magic;
+	int32 width;
+	int32 height;
+	uint32 colors;
+	uint32 dataBytes;				// of the pixels that were hashed
+}
+cache_header;
+
+void cache_path(char *, const char *, uint64);
+void make_cache_header(TranslatorBitmap *, cache_header *);
+uint64 hash_round(uint64, uint64);
+
+//	hash_bitmap()
+//	a 64-bit hash of a bitmap's geometry, color space and rows, as
+//	read by read_bitmap().  Only the bytes of each row that hold pixels are
+//	hashed, so the padding at the ends of the rows doesn't matter.
+uint64 hash_bitmap(TranslatorBitmap *bmap, const uint8 *data)
+{
+	uint64 h;
+	int i, height;
+	size_t length;
+
+	h = hash_bitmap_header(bmap);
+	height = 1+bmap->bounds.IntegerHeight();
+	length = row_bytes(bmap->colors,1+bmap->bounds.IntegerWidth());
+	for (i = 0; i < height; i++)
+		h = hash_bytes(data + (size_t)i*bmap->rowBytes,length,h);
+	return h;
+}
+
+//	hash_bitmap_header()
+//	the start of hash_bitmap(), for a bitmap whose rows are hashed as they
+//	come: continue it with hash_bytes() over each row in turn.
+uint64 hash_bitmap_header(TranslatorBitmap *bmap)
+{
+	int32 header[3];
+
+	header[0] = bmap->bounds.IntegerWidth();
+	header[1] = bmap->bounds.IntegerHeight();
+	header[2] = bmap->colors;
+	return hash_bytes(header,sizeof(header),HASH_SEED);
+}
+
+//	cache_key()
+//	combine a bitmap hash with every setting that changes the output.
+uint64 cache_key(uint64 h, const xpm_encode_settings *settings)
+{
+	int32 options[5];
+
+	options[0] = settings->maxColors;
+	options[1] = settings->quantizer;
+	options[2] = settings->dither;
+	options[3] = settings->deterministic;
+	options[4] = settings->format;
+	return hash_bytes(options,sizeof(options),h);
+}
+
+//	read_cached_xpm()
+//	copy the entry for "key", made from a bitmap like "bmap", onto
+//	"output".  Returns B_ENTRY_NOT_FOUND if there is no such entry, or it
+//	was made from a bitmap of another size or color space, in which case
+//	nothing has been written.
+status_t read_cached_xpm(const char *directory, uint64 key, TranslatorBitmap *bmap,
+	BPositionIO *output)
+{
+	char path[B_PATH_NAME_LENGTH];
+	char *buffer;
+	size_t n;
+	status_t err = B_OK;
+	cache_header expected, header;
+	FILE *file;
+
+	cache_path(path,directory,key);
+	file = fopen(path,"rb");
+	if (!file)
+		return B_ENTRY_NOT_FOUND;
+	make_cache_header(bmap,&expected);
+	if (fread(&header,sizeof(header),1,file) != 1
+		|| memcmp(&header,&expected,sizeof(header)))
+	{
+		fclose(file);
+		return B_ENTRY_NOT_FOUND;
+	}
+	buffer = (char *)malloc(CACHE_BUFFER_SIZE);
+	if (!buffer)
+	{
+		fclose(file);
+		return B_NO_MEMORY;
+	}
+	while ((n = fread(buffer,1,CACHE_BUFFER_SIZE,file)) > 0)
+		if (output->Write(buffer,n) != (ssize_t)n)
+		{
+			err = B_IO_ERROR;
+			break;
+		}
+	if (err == B_OK && ferror(file))
+		err = B_IO_ERROR;
+	free(buffer);
+	fclose(file);
+	return err;
+}
+
+//	write_cached_xpm()
+//	store "length" bytes of XPM data, made from "bmap", as the entry for
+//	"key".
+status_t write_cached_xpm(const char *directory, uint64 key, TranslatorBitmap *bmap,
+	const void *data, size_t length)
+{
+	char path[B_PATH_NAME_LENGTH];
+	char temp[B_PATH_NAME_LENGTH + 48];
+	cache_header header;
+	FILE *file;
+	bool ok;
+
+	cache_path(path,directory,key);
+	sprintf(temp,"%s.%ld.%ld.tmp",path,(long)getpid(),(long)find_thread(NULL));
+	file = fopen(temp,"wb");
+	if (!file)
+		return B_ERROR;
+	make_cache_header(bmap,&header);
+	ok = fwrite(&header,sizeof(header),1,file) == 1
+		&& fwrite(data,1,length,file) == length;
+	if (fclose(file))
+		ok = false;
+	if (!ok || rename(temp,path))
+	{
+		remove(temp);
+		return B_IO_ERROR;
+	}
+	return B_OK;
+}
+
+//	hash_bytes()
+//	continue a 64-bit hash over "length" bytes, eight at a time.  Each word
+//	goes through the round of xxHash64, whose rotations carry every bit of
+//	it into the low bits of the hash as well as the high ones, and the
+//	result through MurmurHash3's finalizer, so that any bit of the input
+//	can change any bit of the hash; "h" may be HASH_SEED, or the hash of
+//	what came before.
+uint64 hash_bytes(const void *data, size_t length, uint64 h)
+{
+	const uint8 *t = (const uint8 *)data;
+	uint64 word;
+
+	h ^= length*HASH_PRIME_2;
+	for (; length >= sizeof(word); length -= sizeof(word), t += sizeof(word))
+	{
+		memcpy(&word,t,sizeof(word));
+		h = hash_round(h,word);
+	}
+	if (length)
+	{
+		word = 0;
+		memcpy(&word,t,length);
+		h = hash_round(h,word);
+	}
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+inline uint64 hash_round(uint64 h, uint64 word)
+{
+	word *= HASH_PRIME_2;
+	word = (word << 31) | (word >> 33);
+	h ^= word*HASH_PRIME_1;
+	h = (h << 27) | (h >> 37);
+	return h*HASH_PRIME_1 + 0x85ebca77c2b2ae63ULL;
+}
+
+void make_cache_header(TranslatorBitmap *bmap, cache_header *header)
+{
+	int width = 1+bmap->bounds.IntegerWidth();
+	int height = 1+bmap->bounds.IntegerHeight();
+
+	header->magic = B_HOST_TO_BENDIAN_INT32(CACHE_MAGIC);
+	header->width = B_HOST_TO_BENDIAN_INT32(width);
+	header->height = B_HOST_TO_BENDIAN_INT32(height);
+	header->colors = B_HOST_TO_BENDIAN_INT32(bmap->colors);
+	header->dataBytes =
+		B_HOST_TO_BENDIAN_INT32((uint32)(row_bytes(bmap->colors,width)*height));
+}
+
+void cache_path(char *path, const char *directory, uint64 key)
+{
+	snprintf(path,B_PATH_NAME_LENGTH,"%s/%016llx.xpm",directory,(unsigned long long)key);
+}
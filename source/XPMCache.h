@@ -0,0 +1,20 @@
+//	XPMCache.h
+//	a directory of previously written XPM files, named by a hash of the
+//	bitmap they were made from and the settings they were made with, and
+//	the 64-bit hash that names them.
+
+#ifndef XPM_CACHE_H
+#define XPM_CACHE_H
+
+#include "toXPM.h"
+
+#define		HASH_SEED				0xcbf29ce484222325ULL
+
+uint64 hash_bitmap(TranslatorBitmap *, const uint8 *);
+uint64 hash_bitmap_header(TranslatorBitmap *);
+uint64 cache_key(uint64, const xpm_encode_settings *);
+status_t read_cached_xpm(const char *, uint64, TranslatorBitmap *, BPositionIO *);
+status_t write_cached_xpm(const char *, uint64, TranslatorBitmap *, const void *, size_t);
+uint64 hash_bytes(const void *, size_t, uint64);
+
+#endif
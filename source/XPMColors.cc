@@ -762,3 +762,18 @@ const xpm_named_color named_color[] =
 	{ "LightGreen", { 144, 238, 144, 255 } },
 	NULL
 };
+
+//	find_named_color()
+//	look "name" up in the list of named colors.
+bool find_named_color(const char *name, rgb_color *color)
+{
+	int i;
+
+	for (i = 0; named_color[i].name; i++)
+		if (!strcmp(named_color[i].name,name))
+		{
+			*color = named_color[i].color;
+			return true;
+		}
+	return false;
+}
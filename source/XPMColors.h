@@ -12,4 +12,6 @@ xpm_named_color;
 
 extern const xpm_named_color named_color[];
 
+bool find_named_color(const char *, rgb_color *);
+
 #endif 
\ No newline at end of file
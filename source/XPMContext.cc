@@ -0,0 +1,301 @@
+//	XPMContext.cc
+//
+//	every block from a context, or counted into stats, is preceded by a
+//	header holding the size it was asked for, and the room it has; the
+//	header is as large as malloc()'s alignment, so that the block keeps it.
+//	A context rounds the room up, a little, so that a block can serve a
+//	later request of not quite the same size; the pool is searched for the
+//	closest fit, under a lock, since the row bands allocate too.
+
+#include <stdlib.h>
+#include <string.h>
+#include "XPM.h"
+#include "XPMContext.h"
+
+#define		XPM_HEAP_HEADER		16
+
+typedef struct
+{
+	size_t size;				// as asked for
+	size_t room;				// as allocated
+}
+heap_header;
+
+//	a pooled block is used for a request down to this fraction of its room
+#define		XPM_POOL_FIT		2
+
+inline heap_header *header_of(void *data)
+{
+	return (heap_header *)((uint8 *)data - XPM_HEAP_HEADER);
+}
+
+size_t round_room(size_t);
+void *new_block(xpm_heap *, size_t, bool);
+void count_heap(xpm_stats *, size_t, int64);
+
+//	XPMContext::XPMContext(size_t)
+//	an empty context, that will pool at most "limit" bytes of the blocks
+//	given back to it, or all of them if "limit" is 0.
+XPMContext::XPMContext(size_t limit)
+{
+	pool = NULL;
+	count = room = 0;
+	pooled = held = 0;
+	keep = limit;
+	allocations = 0;
+	lock = create_sem(1,"xpm context");
+}
+
+XPMContext::~XPMContext()
+{
+	Empty();
+	free(pool);
+	delete_sem(lock);
+}
+
+//	XPMContext::Size(void)
+//	the bytes of every block the context has taken from malloc() and not
+//	freed, whether in use or pooled.
+size_t XPMContext::Size(void) const
+{
+	return held;
+}
+
+//	XPMContext::Allocations(void)
+//	the blocks the context has taken from malloc(), all told; once it is
+//	warmed up, translating again adds none.
+int32 XPMContext::Allocations(void) const
+{
+	return allocations;
+}
+
+//	XPMContext::Empty(void)
+//	free the pooled blocks.
+void XPMContext::Empty(void)
+{
+	int i;
+
+	acquire_sem(lock);
+	for (i = 0; i < count; i++)
+		free(header_of(pool[i]));
+	held -= pooled;
+	pooled = 0;
+	count = 0;
+	release_sem(lock);
+}
+
+//	XPMContext::Take(size_t)
+//	the pooled block that fits "size" the closest, or a new one.
+void *XPMContext::Take(size_t size)
+{
+	heap_header *h;
+	size_t want = round_room(size), best = 0;
+	int i, found = -1;
+
+	acquire_sem(lock);
+	for (i = 0; i < count; i++)
+	{
+		h = header_of(pool[i]);
+		if (h->room >= size && h->room/XPM_POOL_FIT <= want && (found < 0 || h->room < best))
+		{
+			found = i;
+			best = h->room;
+		}
+	}
+	if (found >= 0)
+	{
+		h = header_of(pool[found]);
+		pool[found] = pool[--count];
+		pooled -= h->room;
+		release_sem(lock);
+		return (uint8 *)h + XPM_HEAP_HEADER;
+	}
+	release_sem(lock);
+
+	if (want > (size_t)-1 - XPM_HEAP_HEADER)
+		return NULL;
+	h = (heap_header *)malloc(XPM_HEAP_HEADER + want);
+	if (!h)
+		return NULL;
+	h->room = want;
+	acquire_sem(lock);
+	held += want;
+	allocations++;
+	release_sem(lock);
+	return (uint8 *)h + XPM_HEAP_HEADER;
+}
+
+//	XPMContext::Give(void *)
+//	pool a block from Take() once it is no longer in use, unless the pool
+//	would grow past its limit.
+void XPMContext::Give(void *data)
+{
+	heap_header *h = header_of(data);
+	void **larger;
+
+	acquire_sem(lock);
+	if (count == room && (!keep || pooled + h->room <= keep))
+	{
+		larger = (void **)realloc(pool,(room ? 2*room : 16)*sizeof(void *));
+		if (larger)
+		{
+			pool = larger;
+			room = room ? 2*room : 16;
+		}
+	}
+	if (count < room && (!keep || pooled + h->room <= keep))
+	{
+		pool[count++] = data;
+		pooled += h->room;
+	}
+	else
+	{
+		held -= h->room;
+		free(h);
+	}
+	release_sem(lock);
+}
+
+//	xpm_malloc()
+//	malloc(), from and into "heap".
+void *xpm_malloc(xpm_heap *heap, size_t size)
+{
+	if (!heap || (!heap->stats && !heap->context))
+		return malloc(size);
+	return new_block(heap,size,false);
+}
+
+//	xpm_calloc()
+//	calloc(), from and into "heap".
+void *xpm_calloc(xpm_heap *heap, size_t count, size_t size)
+{
+	if (!heap || (!heap->stats && !heap->context))
+		return calloc(count,size);
+	if (size && count > ((size_t)-1 - XPM_HEAP_HEADER)/size)
+		return NULL;
+	return new_block(heap,count*size,true);
+}
+
+//	xpm_realloc()
+//	realloc(), from and into "heap".  It is counted as an allocation of
+//	the new size; a block from a context that has the room is grown where
+//	it is.
+void *xpm_realloc(xpm_heap *heap, void *data, size_t size)
+{
+	heap_header *h;
+	size_t oldSize;
+	void *larger;
+
+	if (!heap || (!heap->stats && !heap->context))
+		return realloc(data,size);
+	if (!data)
+		return new_block(heap,size,false);
+	h = header_of(data);
+	oldSize = h->size;
+	if (heap->context && h->room < size)
+	{
+		larger = heap->context->Take(size);
+		if (!larger)
+			return NULL;
+		memcpy(larger,data,oldSize);
+		heap->context->Give(data);
+		data = larger;
+	}
+	else if (!heap->context)
+	{
+		if (size > (size_t)-1 - XPM_HEAP_HEADER)
+			return NULL;
+		h = (heap_header *)realloc(h,XPM_HEAP_HEADER + size);
+		if (!h)
+			return NULL;
+		h->room = size;
+		data = (uint8 *)h + XPM_HEAP_HEADER;
+	}
+	header_of(data)->size = size;
+	if (heap->stats)
+		count_heap(heap->stats,size,(int64)size - (int64)oldSize);
+	return data;
+}
+
+//	xpm_free()
+//	free(), of a block from "heap".
+void xpm_free(xpm_heap *heap, void *data)
+{
+	if (!heap || (!heap->stats && !heap->context) || !data)
+	{
+		free(data);
+		return;
+	}
+	if (heap->stats)
+		atomic_add64(&heap->stats->heapBytes,-(int64)header_of(data)->size);
+	if (heap->context)
+		heap->context->Give(data);
+	else
+		free(header_of(data));
+}
+
+//	round_room()
+//	the room to allocate for "size" bytes: to within an eighth, or so.
+size_t round_room(size_t size)
+{
+	size_t step;
+
+	if (size <= 64)
+		return 64;
+	for (step = 64; step*16 <= size; step <<= 1)
+		;
+	if (size > (size_t)-1 - step)
+		return size;
+	return (size + step - 1) & ~(step - 1);
+}
+
+//	new_block()
+//	a block of "size" bytes, cleared if asked, with its header, from the
+//	heap's context if it has one; counted into its stats if it has them.
+void *new_block(xpm_heap *heap, size_t size, bool clear)
+{
+	heap_header *h;
+	void *data;
+
+	if (heap->context)
+	{
+		data = heap->context->Take(size);
+		if (data && clear)
+			memset(data,0,size);
+	}
+	else
+	{
+		if (size > (size_t)-1 - XPM_HEAP_HEADER)
+			return NULL;
+		h = (heap_header *)(clear ? calloc(1,XPM_HEAP_HEADER + size)
+			: malloc(XPM_HEAP_HEADER + size));
+		data = h ? (uint8 *)h + XPM_HEAP_HEADER : NULL;
+		if (h)
+			h->room = size;
+	}
+	if (!data)
+		return NULL;
+	header_of(data)->size = size;
+	if (heap->stats)
+		count_heap(heap->stats,size,size);
+	return data;
+}
+
+//	count_heap()
+//	count an allocation of "size" bytes, by which the heap "grew", and
+//	raise the peak if it is higher.  Worker threads allocate too, so the
+//	counts are kept atomically.
+void count_heap(xpm_stats *stats, size_t size, int64 grew)
+{
+	int64 heap, peak, old;
+
+	atomic_add(&stats->allocs,1);
+	atomic_add64(&stats->allocBytes,size);
+	heap = atomic_add64(&stats->heapBytes,grew) + grew;
+	for (peak = stats->peakBytes; heap > peak; peak = old)
+	{
+		old = atomic_test_and_set64(&stats->peakBytes,heap,peak);
+		if (old == peak)
+			break;
+	}
+}
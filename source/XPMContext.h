@@ -0,0 +1,62 @@
+//	XPMContext.h
+//	the codec's heap.  Every block fromXPM() and toXPM() allocate comes
+//	from xpm_malloc() and its kin, through an xpm_heap that says where to
+//	count it, and where to take it from: an XPMContext, if the caller keeps
+//	one, or malloc().
+//
+//	An XPMContext holds on to the blocks given back to it and hands them
+//	out again, so that a program translating many images, one after
+//	another, stops allocating once it has translated the largest of them.
+//	One context may serve translations in several threads at once; each
+//	takes what it needs, and the context grows to what they need together.
+
+#ifndef XPM_CONTEXT_H
+#define XPM_CONTEXT_H
+
+#include "XPMStats.h"
+
+class XPMContext
+{
+	public:
+
+		XPMContext(size_t = 0);
+		~XPMContext();
+
+		size_t Size(void) const;
+		int32 Allocations(void) const;
+		void Empty(void);
+
+//	for xpm_malloc() and its kin: a block of at least "size" bytes, from
+//	the pool if there is one that fits, and its return to the pool
+		void *Take(size_t);
+		void Give(void *);
+
+	private:
+
+		void **pool;				// the blocks not in use
+		int count;
+		int room;
+		size_t pooled;				// bytes in them
+		size_t keep;				// the most to pool; 0 for no limit
+		size_t held;				// bytes in every block, in use or not
+		int32 allocations;
+		sem_id lock;
+};
+
+//	where a translation's blocks come from, and are counted
+typedef struct
+{
+	xpm_stats *stats;			// count into this; NULL for not
+	XPMContext *context;		// take blocks from this; NULL for malloc()
+}
+xpm_heap;
+
+//	malloc() and its kin, from and into "heap".  A NULL heap, or one with
+//	neither stats nor a context, is malloc() itself.  A block must be
+//	grown and freed through the same heap it was allocated from.
+void *xpm_malloc(xpm_heap *, size_t);
+void *xpm_calloc(xpm_heap *, size_t, size_t);
+void *xpm_realloc(xpm_heap *, void *, size_t);
+void xpm_free(xpm_heap *, void *);
+
+#endif
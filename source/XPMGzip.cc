@@ -0,0 +1,207 @@
+//	XPMGzip.cc
+//
+//	implements the gzip support shared by the scanner, get_stream_type()
+//	and toXPM().  Reading inflates inside XPMScanner itself; this file has
+//	what is needed around it.
+
+#include <zlib.h>
+#include "XPM.h"
+#include "XPMGzip.h"
+#include "XPMTrace.h"
+
+voidpf zstream_alloc(voidpf, uInt, uInt);
+void zstream_free(voidpf, voidpf);
+
+//	is_gzip()
+//	true if "data" begins with the gzip magic number.
+bool is_gzip(const void *data, size_t length)
+{
+	const uint8 *t = (const uint8 *)data;
+
+	return length >= 2 && t[0] == 0x1f && t[1] == 0x8b;
+}
+
+//	peek_gzip()
+//	inflate up to "size" bytes from the start of the gzip stream at the
+//	position of "stream", without moving it.  Returns the number of bytes
+//	inflated, or an error.  The stream may give each read only a few bytes.
+ssize_t peek_gzip(BPositionIO *stream, void *data, size_t size)
+{
+	unsigned char input[4096];
+	z_stream z;
+	ssize_t n, got;
+	int result;
+
+	for (n = 0; n < (ssize_t)sizeof(input); n += got)
+	{
+		got = stream->ReadAt(stream->Position() + n,input + n,sizeof(input) - n);
+		if (got <= 0)
+			break;
+	}
+	if (n <= 0)
+		return B_ERROR;
+	memset(&z,0,sizeof(z));
+	if (inflateInit2(&z,16 + MAX_WBITS) != Z_OK)
+		return B_NO_MEMORY;
+	z.next_in = input;
+	z.avail_in = n;
+	z.next_out = (unsigned char *)data;
+	z.avail_out = size;
+	result = inflate(&z,Z_SYNC_FLUSH);
+	n = size - z.avail_out;
+	inflateEnd(&z);
+	if (result != Z_OK && result != Z_STREAM_END && result != Z_BUF_ERROR)
+		return B_ERROR;
+	return n;
+}
+
+//	heap_zstream()
+//	have zlib allocate the state of "z", which is yet to be initialized,
+//	from "heap", if it isn't NULL.
+void heap_zstream(struct z_stream_s *z, xpm_heap *heap)
+{
+	if (!heap)
+		return;
+	z->zalloc = zstream_alloc;
+	z->zfree = zstream_free;
+	z->opaque = heap;
+}
+
+voidpf zstream_alloc(voidpf heap, uInt items, uInt size)
+{
+	return xpm_malloc((xpm_heap *)heap,(size_t)items*size);
+}
+
+void zstream_free(voidpf heap, voidpf address)
+{
+	xpm_free((xpm_heap *)heap,address);
+}
+
+//	XPMGzipIO::XPMGzipIO(BPositionIO *, xpm_heap *)
+//	start a gzip stream onto "stream", allocating from "gzipHeap"; check
+//	InitCheck() before use.
+XPMGzipIO::XPMGzipIO(BPositionIO *stream, xpm_heap *gzipHeap)
+{
+	output = stream;
+	heap = gzipHeap;
+	position = 0;
+	zstream = (z_stream *)xpm_calloc(heap,1,sizeof(z_stream));
+	zbuffer = (unsigned char *)xpm_malloc(heap,GZIP_BUFFER_SIZE);
+	status = B_NO_MEMORY;
+	if (zstream)
+		heap_zstream(zstream,heap);
+	if (zstream && zbuffer
+		&& deflateInit2(zstream,Z_DEFAULT_COMPRESSION,Z_DEFLATED,16 + MAX_WBITS,8,
+			Z_DEFAULT_STRATEGY) == Z_OK)
+		status = B_OK;
+	else
+	{
+		xpm_free(heap,zstream);
+		zstream = NULL;
+	}
+}
+
+XPMGzipIO::~XPMGzipIO()
+{
+	if (zstream)
+	{
+		deflateEnd(zstream);
+		xpm_free(heap,zstream);
+	}
+	xpm_free(heap,zbuffer);
+}
+
+status_t XPMGzipIO::InitCheck(void) const
+{
+	return zstream ? B_OK : B_NO_MEMORY;
+}
+
+//	XPMGzipIO::Finish(void)
+//	flush what is left and write the gzip trailer.
+status_t XPMGzipIO::Finish(void)
+{
+	if (status != B_OK)
+		return status;
+	status = deflate_buffer(Z_FINISH);
+	if (status != B_OK)
+		return status;
+	status = B_NOT_SUPPORTED;				// the stream is closed
+	return B_OK;
+}
+
+ssize_t XPMGzipIO::Read(void *, size_t)
+{
+	return B_NOT_SUPPORTED;
+}
+
+ssize_t XPMGzipIO::Write(const void *data, size_t size)
+{
+	if (status != B_OK)
+		return status;
+	zstream->next_in = (unsigned char *)data;
+	zstream->avail_in = size;
+	status = deflate_buffer(Z_NO_FLUSH);
+	if (status != B_OK)
+		return status;
+	position += size;
+	return size;
+}
+
+ssize_t XPMGzipIO::ReadAt(off_t, void *, size_t)
+{
+	return B_NOT_SUPPORTED;
+}
+
+//	XPMGzipIO::WriteAt(off_t, const void *, size_t)
+//	only writes at the current position, which is all a gzip stream allows.
+ssize_t XPMGzipIO::WriteAt(off_t at, const void *data, size_t size)
+{
+	if (at != position)
+		return B_NOT_SUPPORTED;
+	return Write(data,size);
+}
+
+//	XPMGzipIO::Seek(off_t, uint32)
+//	the position can be asked for, but not changed.
+off_t XPMGzipIO::Seek(off_t to, uint32 mode)
+{
+	if (mode == SEEK_CUR)
+		to += position;
+	if (mode == SEEK_END || to != position)
+		return B_NOT_SUPPORTED;
+	return position;
+}
+
+off_t XPMGzipIO::Position(void) const
+{
+	return position;
+}
+
+//	XPMGzipIO::deflate_buffer(int)
+//	deflate the pending input, writing out the compressed bytes whenever
+//	the buffer fills, and at the end.
+status_t XPMGzipIO::deflate_buffer(int flush)
+{
+	ssize_t n, written;
+	int result;
+
+	do
+	{
+		zstream->next_out = zbuffer;
+		zstream->avail_out = GZIP_BUFFER_SIZE;
+		result = deflate(zstream,flush);
+		if (result == Z_STREAM_ERROR)
+			return B_ERROR;
+		n = GZIP_BUFFER_SIZE - zstream->avail_out;
+		if (n > 0)
+		{
+			trace_begin("gzip flush","bytes",n);
+			written = output->Write(zbuffer,n);
+			trace_end("gzip flush");
+			if (written != n)
+				return B_IO_ERROR;
+		}
+	}
+	while (zstream->avail_out == 0 || (flush == Z_FINISH && result != Z_STREAM_END));
+	return B_OK;
+}
@@ -0,0 +1,49 @@
+//	XPMGzip.h
+//	gzip-compressed XPM: recognizing it, peeking into it, and a stream
+//	that deflates whatever is written to it onto another stream.
+
+#ifndef XPM_GZIP_H
+#define XPM_GZIP_H
+
+#include "XPMContext.h"
+
+struct z_stream_s;
+
+#define		GZIP_BUFFER_SIZE		65536
+
+bool is_gzip(const void *, size_t);
+ssize_t peek_gzip(BPositionIO *, void *, size_t);
+void heap_zstream(struct z_stream_s *, xpm_heap *);
+
+//	only ever written to, front to back; Finish() writes out the end of
+//	the gzip stream, and must be called once everything is written.
+class XPMGzipIO : public BPositionIO
+{
+	public:
+
+		XPMGzipIO(BPositionIO *, xpm_heap * = NULL);
+		virtual ~XPMGzipIO();
+
+		status_t InitCheck(void) const;
+		status_t Finish(void);
+
+		virtual ssize_t Read(void *, size_t);
+		virtual ssize_t Write(const void *, size_t);
+		virtual ssize_t ReadAt(off_t, void *, size_t);
+		virtual ssize_t WriteAt(off_t, const void *, size_t);
+		virtual off_t Seek(off_t, uint32);
+		virtual off_t Position(void) const;
+
+	private:
+
+		status_t deflate_buffer(int);
+
+		BPositionIO *output;
+		xpm_heap *heap;
+		struct z_stream_s *zstream;
+		unsigned char *zbuffer;
+		off_t position;
+		status_t status;
+};
+
+#endif
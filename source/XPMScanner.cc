@@ -1,82 +1,149 @@
 //	XPMScanner.cc
 
+#include <zlib.h>
 #include "XPM.h"
 #include "XPMScanner.h"
+#include "XPMGzip.h"
+#include "XPMTrace.h"
 
-//	XPMScanner::XPMScanner(BPositionIO *)
-//	accept pointer to a BPositionIO stream;
-//	initialize 'buffer' and set 'index' to 0
-XPMScanner::XPMScanner(BPositionIO *input)
+//	XPMScanner::XPMScanner(BPositionIO *, xpm_heap *)
+//	accept pointer to a BPositionIO stream, and the heap to allocate the
+//	inflater from; initialize 'buffer' and set 'index' to 0
+XPMScanner::XPMScanner(BPositionIO *input, xpm_heap *scannerHeap)
 {
 	stream = input;
+	heap = scannerHeap;
 	index = length = 0;
+	lines = false;
+	zstream = NULL;
+	zbuffer = NULL;
 	buffer[XPM_BUFFER_SIZE] = 0;				// ensure null-termination
 }
 
+XPMScanner::~XPMScanner()
+{
+	if (zstream)
+	{
+		inflateEnd(zstream);
+		xpm_free(heap,zstream);
+	}
+	xpm_free(heap,zbuffer);
+}
+
 //	XPMScanner::Setup(void)
-//	fill 'buffer' from the stream for the first time.
+//	fill 'buffer' from the stream for the first time.  A gzip stream is
+//	inflated from here on, starting with the bytes already read.  An XPM2
+//	header line switches the scanner to reading lines, and is skipped.
+//	A stream such as a pipe may give a read fewer bytes than it asks for,
+//	so it is read until the headers can be told apart.
 status_t XPMScanner::Setup(void)
 {
 	status_t err;
+	ssize_t n;
 	
-	err = stream->Read(buffer,XPM_BUFFER_SIZE);
+	err = 0;
+	do
+	{
+		n = stream->Read(buffer + err,XPM_BUFFER_SIZE - err);
+		if (n > 0)
+			err += n;
+	}
+	while (n > 0 && err < (ssize_t)sizeof(XPM_HEADER));
 	if (err <= 0)
 		return B_ERROR;
-	else
+	if (is_gzip(buffer,err))
 	{
-		index = 0;
-		length = err;
-		return B_OK;
+		zbuffer = (unsigned char *)xpm_malloc(heap,GZIP_BUFFER_SIZE);
+		zstream = (z_stream *)xpm_calloc(heap,1,sizeof(z_stream));
+		if (zstream)
+			heap_zstream(zstream,heap);
+		if (!zbuffer || !zstream || inflateInit2(zstream,16 + MAX_WBITS) != Z_OK)
+		{
+			xpm_free(heap,zstream);
+			zstream = NULL;
+			return B_NO_MEMORY;
+		}
+		memcpy(zbuffer,buffer,err);
+		zstream->next_in = zbuffer;
+		zstream->avail_in = err;
+		err = fill();
+		if (err <= 0)
+			return B_ERROR;
+	}
+	index = 0;
+	length = err;
+	buffer[length] = 0;
+	if (!strncmp(buffer,XPM2_HEADER,strlen(XPM2_HEADER)))
+	{
+		lines = true;
+		return GetLine(NULL,0);
 	}
+	return B_OK;
+}
+
+//	XPMScanner::IsXPM2(void)
+//	true if the stream is an XPM2 file, read a line at a time.
+bool XPMScanner::IsXPM2(void) const
+{
+	return lines;
 }
 
-//	XPMScanner::GetLine(char *)
+//	XPMScanner::GetLine(char *, size_t)
 //	read in a complete line, demarcated either by a newline or a carriage return,
-//	into 'string'.
-status_t XPMScanner::GetLine(char *string)
+//	into 'string', which has room for 'size' characters including the null;
+//	the rest of a longer line is skipped, as is the whole line if 'string' is
+//	NULL.  The last line of the stream needn't end in a newline.
+status_t XPMScanner::GetLine(char *string, size_t size)
 {
 	status_t err;
-	int n, i = 0;
+	int n;
+	size_t i = 0;
 	bool wrapAround;
 	bool done = false;
 	
 	while (!done)								// eat characters until the newline or
 	{											// carriage return is reached
 		n = strcspn(&buffer[index],"\r\n");
-		strncpy(&string[i],&buffer[index],n);
+		if (string)
+			copy_chars(string,size,i,n);
 		i += n;
 		err = advance_n_chars(n,&wrapAround);
-		if (err)
+		if (err && i == 0)
 			return B_ERROR;
-		if (!wrapAround)
+		if (err || !wrapAround)
 			done = true;
 	}
 	
 	done = false;
-	while (!done)								// read past the newline(s) or
+	while (!done && !err)						// read past the newline(s) or
 	{											// carriage return(s)
 		n = strspn(&buffer[index],"\r\n");
 		err = advance_n_chars(n,&wrapAround);
-		if (err != B_OK)
-			return B_ERROR;
-		if (!wrapAround)
+		if (err != B_OK || !wrapAround)			// the stream may end here
 			done = true;
 	}
 		
-	string[i] = 0;								// ensure null termination
+	if (string)
+		string[i < size ? i : size - 1] = 0;	// ensure null termination
 	return B_OK;
 }
 
-//	XPMScanner::GetString(char *)
-//	read complete strings, demarcated by double quotes, into 'string'.  'C' escaped
-//	characters are ignored, since a proper XPM file is not likely to contain them.
-status_t XPMScanner::GetString(char *string)
+//	XPMScanner::GetString(char *, size_t)
+//	read complete strings, demarcated by double quotes, into 'string', which has
+//	room for 'size' characters including the null; the rest of a longer string
+//	is skipped.  'C' escaped characters are ignored, since a proper XPM file is
+//	not likely to contain them.
+status_t XPMScanner::GetString(char *string, size_t size)
 {
 	status_t err;
-	int n, i = 0;
+	int n;
+	size_t i = 0;
 	bool wrapAround;
 	bool done = false;
 	
+	if (lines)
+		return GetLine(string,size);
+
 	while (!done)								// eat characters until a quote is reached
 	{
 		n = strcspn(&buffer[index],"\"");
@@ -95,7 +162,7 @@ status_t XPMScanner::GetString(char *string)
 	while (!done)								// read characters until the closing quote
 	{											// is found
 		n = strcspn(&buffer[index],"\"");
-		strncpy(&string[i],&buffer[index],n);
+		copy_chars(string,size,i,n);
 		i += n;
 		err = advance_n_chars(n,&wrapAround);
 		if (err)
@@ -108,13 +175,26 @@ status_t XPMScanner::GetString(char *string)
 	if (err)
 		return B_ERROR;
 
-	string[i] = 0;
+	string[i < size ? i : size - 1] = 0;
 	return B_OK;
 }
 
+//	XPMScanner::copy_chars(char *, size_t, size_t, int)
+//	copy 'n' characters from the buffer to 'string' at 'i', as far as the
+//	'size' of 'string' allows, leaving room for the null.
+void XPMScanner::copy_chars(char *string, size_t size, size_t i, int n)
+{
+	if (i + 1 >= size)
+		return;
+	if (i + n + 1 > size)
+		n = size - 1 - i;
+	memcpy(&string[i],&buffer[index],n);
+}
+
 //	XPMScanner::advance_n_chars(int, bool *)
 //	advance 'n' characters in the internal buffer.  If the end of the buffer be reached,
 //	refresh the buffer from the stream and signal 'wrapAround' to warn the caller.
+//	At the end of the stream the buffer is left empty.
 status_t XPMScanner::advance_n_chars(int n, bool *wrapAround)
 {
 	status_t err;
@@ -123,17 +203,63 @@ status_t XPMScanner::advance_n_chars(int n, bool *wrapAround)
 	if (index >= length)
 	{
 		*wrapAround = true;
-		err = stream->Read(buffer,XPM_BUFFER_SIZE);
+		err = fill();
+		index = 0;
+		length = err > 0 ? err : 0;
+		buffer[length] = 0;						// a short read leaves no stale text
 		if (err <= 0)
 			return B_ERROR;
-		else
-		{
-			index = 0;
-			length = err;
-		}	
 	}
 	else
 		*wrapAround = false;
 		
 	return B_OK;
 }
+
+//	XPMScanner::fill(void)
+//	read the next buffer's worth from the stream, inflating it if it is
+//	compressed.  Returns the number of bytes read, or 0 at the end.
+ssize_t XPMScanner::fill(void)
+{
+	ssize_t n;
+
+	trace_begin("scanner refill");
+	n = read_buffer();
+	trace_end("scanner refill","bytes",n);
+	return n;
+}
+
+//	XPMScanner::read_buffer(void)
+//	fill()'s work, untraced.
+ssize_t XPMScanner::read_buffer(void)
+{
+	ssize_t n;
+	int result;
+
+	if (!zstream)
+		return stream->Read(buffer,XPM_BUFFER_SIZE);
+
+	zstream->next_out = (unsigned char *)buffer;
+	zstream->avail_out = XPM_BUFFER_SIZE;
+	while (zstream->avail_out > 0)
+	{
+		if (zstream->avail_in == 0)
+		{
+			n = stream->Read(zbuffer,GZIP_BUFFER_SIZE);
+			if (n <= 0)
+				break;
+			zstream->next_in = zbuffer;
+			zstream->avail_in = n;
+		}
+		result = inflate(zstream,Z_NO_FLUSH);
+//	gzip files may be made of several members, one after the other
+		if (result == Z_STREAM_END)
+		{
+			if (zstream->avail_in == 0 || inflateReset(zstream) != Z_OK)
+				break;
+		}
+		else if (result != Z_OK)
+			break;
+	}
+	return XPM_BUFFER_SIZE - zstream->avail_out;
+}
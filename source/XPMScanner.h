@@ -1,30 +1,45 @@
 //	XPMScanner.h
 //	a class for buffered reading-in of entire lines and quoted strings
-//	from XPM files.
+//	from XPM files.  An XPM2 file, which has no quotes, is read a line at
+//	a time instead: GetString() returns the next line.  A gzip-compressed
+//	stream is inflated into the buffer as it is read.
 
 #ifndef XPM_SCANNER_H
 #define XPM_SCANNER_H
 
+#include "XPMContext.h"
+
 #define		XPM_BUFFER_SIZE		4096
 
+struct z_stream_s;
+
 class XPMScanner
 {
 	public:
 	
-		XPMScanner(BPositionIO *);
+		XPMScanner(BPositionIO *, xpm_heap * = NULL);
+		~XPMScanner();
 
 		status_t Setup(void);		
-		status_t GetLine(char *);
-		status_t GetString(char *);
+		status_t GetLine(char *, size_t);
+		status_t GetString(char *, size_t);
+		bool IsXPM2(void) const;
 		
 	private:
 	
 		status_t advance_n_chars(int, bool *);
+		ssize_t fill(void);
+		ssize_t read_buffer(void);
+		void copy_chars(char *, size_t, size_t, int);
 		
 		BPositionIO *stream;
+		xpm_heap *heap;
 		char buffer[XPM_BUFFER_SIZE+1];
 		int length;
 		int index;
+		bool lines;
+		struct z_stream_s *zstream;
+		unsigned char *zbuffer;
 };
 
 #endif 
\ No newline at end of file
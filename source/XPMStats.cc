@@ -0,0 +1,103 @@
+//	XPMStats.cc
+
+#include <string.h>
+#include "XPM.h"
+#include "XPMStats.h"
+
+//	init_xpm_stats()
+//	nothing counted yet.
+void init_xpm_stats(xpm_stats *stats)
+{
+	memset(stats,0,sizeof(*stats));
+}
+
+//	start_phase()
+//	note the time, and the output time so far; "stats" may be NULL, when
+//	nothing is being counted.
+void start_phase(xpm_stats *stats, xpm_phase *phase)
+{
+	if (!stats)
+		return;
+	phase->start = system_time();
+	phase->output = stats->time[XPM_PHASE_OUTPUT];
+}
+
+//	end_phase()
+//	charge the time since start_phase() to phase "which", less what went to
+//	writing the output meanwhile, which is already charged to output.
+void end_phase(xpm_stats *stats, xpm_phase *phase, int which)
+{
+	if (!stats)
+		return;
+	stats->time[which] += system_time() - phase->start
+		- (stats->time[XPM_PHASE_OUTPUT] - phase->output);
+}
+
+XPMStatsIO::XPMStatsIO(BPositionIO *io, xpm_stats *stats)
+	: io(io), stats(stats)
+{
+}
+
+ssize_t XPMStatsIO::Read(void *buffer, size_t size)
+{
+	ssize_t result = io->Read(buffer,size);
+
+	stats->reads++;
+	if (result > 0)
+		stats->bytesRead += result;
+	return result;
+}
+
+ssize_t XPMStatsIO::Write(const void *buffer, size_t size)
+{
+	bigtime_t start = system_time();
+	ssize_t result = io->Write(buffer,size);
+
+	stats->time[XPM_PHASE_OUTPUT] += system_time() - start;
+	stats->writes++;
+	if (result > 0)
+		stats->bytesWritten += result;
+	return result;
+}
+
+ssize_t XPMStatsIO::ReadAt(off_t position, void *buffer, size_t size)
+{
+	ssize_t result = io->ReadAt(position,buffer,size);
+
+	stats->reads++;
+	if (result > 0)
+		stats->bytesRead += result;
+	return result;
+}
+
+ssize_t XPMStatsIO::WriteAt(off_t position, const void *buffer, size_t size)
+{
+	bigtime_t start = system_time();
+	ssize_t result = io->WriteAt(position,buffer,size);
+
+	stats->time[XPM_PHASE_OUTPUT] += system_time() - start;
+	stats->writes++;
+	if (result > 0)
+		stats->bytesWritten += result;
+	return result;
+}
+
+off_t XPMStatsIO::Seek(off_t position, uint32 seekMode)
+{
+	return io->Seek(position,seekMode);
+}
+
+off_t XPMStatsIO::Position(void) const
+{
+	return io->Position();
+}
+
+status_t XPMStatsIO::SetSize(off_t size)
+{
+	return io->SetSize(size);
+}
+
+status_t XPMStatsIO::GetSize(off_t *size) const
+{
+	return io->GetSize(size);
+}
@@ -0,0 +1,79 @@
+//	XPMStats.h
+//	counters of a single translation--where its time went, how much it
+//	read and wrote, how well its color table hashed, and how much memory
+//	it took--kept by fromXPM() and toXPM() when given somewhere to keep
+//	them.  Keeping them costs a few clock readings per phase and chunk, an
+//	addition per I/O call and per color table probe, and a few atomic
+//	additions per heap block.
+
+#ifndef XPM_STATS_H
+#define XPM_STATS_H
+
+//	the phases of a translation.  Decoding: the value string; the color
+//	strings; the pixel strings.  Encoding: the bitmap header and rows as
+//	read; gathering the colors and writing the color strings; formatting
+//	the rows.  Time spent writing the output, in any phase, is the output
+//	phase's alone.
+enum
+{
+	XPM_PHASE_HEADER,
+	XPM_PHASE_PALETTE,
+	XPM_PHASE_PIXELS,
+	XPM_PHASE_OUTPUT,
+	XPM_PHASE_COUNT
+};
+
+typedef struct
+{
+	int64 bytesRead;
+	int64 bytesWritten;			// including those written into a mapped file
+	int32 reads;				// Read() and ReadAt() calls
+	int32 writes;				// Write() and WriteAt() calls
+	bigtime_t time[XPM_PHASE_COUNT];
+	int64 probes;				// color table entries looked at, for the pixels
+	int32 maxChain;				// entries in the longest color table chain
+	int32 ncolors;
+	int32 cpp;
+	int32 allocs;				// heap blocks allocated, or grown; see XPMContext.h
+	int64 allocBytes;			// their sizes, summed
+	int64 heapBytes;			// bytes allocated and not yet freed
+	int64 peakBytes;			// the most there were at once
+}
+xpm_stats;
+
+//	a phase under way; see start_phase()
+typedef struct
+{
+	bigtime_t start;
+	bigtime_t output;
+}
+xpm_phase;
+
+//	a stream that counts what passes through it onto another, and the
+//	time spent writing
+class XPMStatsIO : public BPositionIO
+{
+	public:
+
+		XPMStatsIO(BPositionIO *, xpm_stats *);
+
+		virtual ssize_t Read(void *, size_t);
+		virtual ssize_t Write(const void *, size_t);
+		virtual ssize_t ReadAt(off_t, void *, size_t);
+		virtual ssize_t WriteAt(off_t, const void *, size_t);
+		virtual off_t Seek(off_t, uint32);
+		virtual off_t Position(void) const;
+		virtual status_t SetSize(off_t);
+		virtual status_t GetSize(off_t *) const;
+
+	private:
+
+		BPositionIO *io;
+		xpm_stats *stats;
+};
+
+void init_xpm_stats(xpm_stats *);
+void start_phase(xpm_stats *, xpm_phase *);
+void end_phase(xpm_stats *, xpm_phase *, int);
+
+#endif
@@ -0,0 +1,143 @@
+//	XPMTrace.cc
+//
+//	events go straight into the trace file, under a lock, as they happen;
+//	each traced span is a chunk of rows or a buffer's worth of I/O, so
+//	there are few enough of them for that to cost little.  A trace started
+//	by XPM_TRACE is stopped at exit(); one cut short, by _exit() or a
+//	crash, lacks its closing bracket, which the trace viewers accept.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <StorageDefs.h>
+#include "XPM.h"
+#include "XPMTrace.h"
+
+static FILE * volatile sTraceFile = NULL;
+static sem_id sTraceLock = -1;
+static int32 sTraceChecked = 0;
+
+void check_trace_env(void);
+void trace_event(const char *, char, const char *, int64);
+
+//	start_xpm_trace()
+//	begin writing a trace to the file at "path", ending any trace under way.
+status_t start_xpm_trace(const char *path)
+{
+	FILE *file;
+
+	atomic_add(&sTraceChecked,1);
+	stop_xpm_trace();
+	sTraceLock = create_sem(1,"xpm trace");
+	if (sTraceLock < 0)
+		return sTraceLock;
+	file = fopen(path,"w");
+	if (!file)
+	{
+		delete_sem(sTraceLock);
+		sTraceLock = -1;
+		return B_ERROR;
+	}
+	fprintf(file,"[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%ld,"
+		"\"args\":{\"name\":\"XPMTranslator\"}}",(long)getpid());
+	sTraceFile = file;
+	return B_OK;
+}
+
+//	stop_xpm_trace()
+//	finish the trace and close its file.  No translation may be running.
+void stop_xpm_trace(void)
+{
+	FILE *file = sTraceFile;
+
+	if (!file)
+		return;
+	sTraceFile = NULL;
+	fprintf(file,"\n]\n");
+	fclose(file);
+	delete_sem(sTraceLock);
+	sTraceLock = -1;
+}
+
+//	trace_begin()
+//	the start of span "name" in this thread, with an argument if
+//	"argName" is given.
+void trace_begin(const char *name, const char *argName, int64 arg)
+{
+	check_trace_env();
+	if (sTraceFile)
+		trace_event(name,'B',argName,arg);
+}
+
+//	trace_end()
+//	the end of the latest span "name" begun in this thread.
+void trace_end(const char *name, const char *argName, int64 arg)
+{
+	if (sTraceFile)
+		trace_event(name,'E',argName,arg);
+}
+
+//	trace_flush()
+//	write out the events buffered so far.
+void trace_flush(void)
+{
+	if (!sTraceFile || acquire_sem(sTraceLock) != B_OK)
+		return;
+	if (sTraceFile)
+		fflush(sTraceFile);
+	release_sem(sTraceLock);
+}
+
+//	check_trace_env()
+//	start tracing, the first time through, if XPM_TRACE asks for it.
+void check_trace_env(void)
+{
+	const char *name, *pid;
+	char path[B_PATH_NAME_LENGTH];
+
+	if (sTraceChecked || atomic_add(&sTraceChecked,1) != 0)
+		return;
+	name = getenv(XPM_TRACE_ENV);
+	if (!name || !name[0])
+		return;
+	pid = strstr(name,"%d");
+	if (pid && (size_t)(pid - name) < sizeof(path))
+	{
+		snprintf(path,sizeof(path),"%.*s%ld%s",(int)(pid - name),name,(long)getpid(),pid + 2);
+		name = path;
+	}
+	if (start_xpm_trace(name) == B_OK)
+		atexit(stop_xpm_trace);
+}
+
+void trace_event(const char *name, char phase, const char *argName, int64 arg)
+{
+	bigtime_t now = system_time();
+	thread_id thread = find_thread(NULL);
+
+	if (acquire_sem(sTraceLock) != B_OK)
+		return;
+	if (sTraceFile)
+	{
+		fprintf(sTraceFile,",\n{\"name\":\"%s\",\"cat\":\"xpm\",\"ph\":\"%c\",\"ts\":%lld,"
+			"\"pid\":%ld,\"tid\":%ld",name,phase,(long long)now,(long)getpid(),(long)thread);
+		if (argName)
+			fprintf(sTraceFile,",\"args\":{\"%s\":%lld}",argName,(long long)arg);
+		fputc('}',sTraceFile);
+	}
+	release_sem(sTraceLock);
+}
+
+XPMTraceSpan::XPMTraceSpan(const char *name, bool flush)
+	: name(name), flush(flush)
+{
+	trace_begin(name);
+}
+
+XPMTraceSpan::~XPMTraceSpan()
+{
+	trace_end(name);
+	if (flush)
+		trace_flush();
+}
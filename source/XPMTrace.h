@@ -0,0 +1,39 @@
+//	XPMTrace.h
+//	an opt-in timeline of what the codec does, thread by thread, written as
+//	a Chrome/Perfetto trace (the JSON array format) to load into
+//	chrome://tracing or ui.perfetto.dev.  Tracing starts with
+//	start_xpm_trace(), or at the first traced event if the environment
+//	variable XPM_TRACE names a file, and lasts until stop_xpm_trace(), or
+//	the program exits.  A "%d" in the name of XPM_TRACE is replaced
+//	by the process id, so that processes forked to translate, as xpmbench
+//	does for each case, each write a trace of their own.  While tracing is
+//	off, an event costs a test of a pointer.
+
+#ifndef XPM_TRACE_H
+#define XPM_TRACE_H
+
+#define		XPM_TRACE_ENV		"XPM_TRACE"
+
+status_t start_xpm_trace(const char *);
+void stop_xpm_trace(void);
+void trace_begin(const char *, const char * = NULL, int64 = 0);
+void trace_end(const char *, const char * = NULL, int64 = 0);
+void trace_flush(void);
+
+//	a span from construction to destruction, for functions with many
+//	returns; the outermost spans flush the trace as they end, so that it
+//	is complete after each translation.
+class XPMTraceSpan
+{
+	public:
+
+		XPMTraceSpan(const char *, bool = false);
+		~XPMTraceSpan();
+
+	private:
+
+		const char *name;
+		bool flush;
+};
+
+#endif
@@ -7,6 +7,8 @@
 #include "XPM.h"
 #include "toXPM.h"
 #include "fromXPM.h"
+#include "PassThrough.h"
+#include "XPMGzip.h"
 #include <TranslatorAddOn.h>
 
 //	completely arbitrary of course
@@ -14,7 +16,22 @@
 
 //	necessary
 char translatorName[] = "XPMTranslator x86";
-char translatorInfo[] = "XPMTranslator x86 version 1.1.1, by C.B.Larsen, original by E. Tomlinson)";
+char translatorInfo[] =
+	"XPMTranslator x86 version 1.1.1, by C.B.Larsen, original by E. Tomlinson)\n"
+	"\n"
+	"Options for writing XPM, read from the ioExtension message:\n"
+	"xpm/maxColors (int32, default 0): at most this many colors, transparency included;"
+	" 0 for every color exactly\n"
+	"xpm/quantizer (int32, default 0): 0 for median cut, 1 for octree\n"
+	"xpm/dither (bool, default false): diffuse the quantization error\n"
+	"xpm/deterministic (bool, default false): name the array after the content, not the time\n"
+	"xpm/cacheDirectory (string, default none): reuse and keep earlier output here\n"
+	"xpm/format (int32, default 0): 0 for XPM3, 1 for XPM2\n"
+	"xpm/gzip (bool, default false): write a gzip stream\n"
+	"xpm/memoryLimit (int64, default 0): encode in strips of rows to stay near this many bytes;"
+	" 0 for no limit\n"
+	"xpm/stats (bool, default false): add the translation's counters, xpm/stats/...,"
+	" to the message";
 int32 translatorVersion = 111;
 
 //  optional.  Covers both read and write translation.
@@ -61,6 +78,9 @@ translation_format outputFormats[] =
 };
 
 uint32 get_stream_type(BPositionIO *);
+void get_encode_settings(BMessage *, xpm_encode_settings *);
+bool wants_stats(BMessage *);
+void put_stats(BMessage *, xpm_stats *);
 
 //	Identify()
 //	check the identity of the input stream, and see if a match with the
@@ -68,6 +88,7 @@ uint32 get_stream_type(BPositionIO *);
 //	are:
 //	input = B_TRANSLATOR_BITMAP, output = XPM_TYPE_CODE or nothing -> output XPM data
 //	input = XPM_TYPE_CODE, output = B_TRANSLATOR_BITMAP or nothing -> output B_TRANSLATOR_BITMAP
+//	input = B_TRANSLATOR_BITMAP, output = B_TRANSLATOR_BITMAP -> copy the bitmap through
 
 status_t Identify(BPositionIO *stream, \
 	const translation_format *format, \
@@ -88,7 +109,8 @@ status_t Identify(BPositionIO *stream, \
 		strcpy(info->MIME,inputFormats[0].MIME);
 		return B_OK;
 	}
-	else if (ourType == B_TRANSLATOR_BITMAP && (!type || type == XPM_TYPE_CODE))
+	else if (ourType == B_TRANSLATOR_BITMAP
+		&& (!type || type == XPM_TYPE_CODE || type == B_TRANSLATOR_BITMAP))
 	{
 		info->type = inputFormats[1].type;
 		info->group = inputFormats[1].group;
@@ -106,42 +128,152 @@ status_t Identify(BPositionIO *stream, \
 
 //	Translate()
 //	do the same identification job as above, and execute the translation
-//	with either toXPM() or fromXPM(), as necessary.
+//	with either toXPM() or fromXPM(), as necessary.  A bitmap asked for as a
+//	bitmap is copied through as it is, without an XPM round trip.  The
+//	counters of an XPM translation go back in the extension if it asks
+//	for XPM_EXT_STATS.
 status_t Translate(BPositionIO *input, \
 	const translator_info *info, \
 	BMessage *extension, \
 	uint32 type, \
 	BPositionIO *output)
 {
+	status_t err;
 	uint32 ourType;
+	xpm_stats stats;
+	xpm_stats *counted = wants_stats(extension) ? &stats : NULL;
 	
 	ourType = get_stream_type(input);
 	if (ourType == XPM_TYPE_CODE && (!type || type == B_TRANSLATOR_BITMAP))
-		return fromXPM(input,output);
+	{
+		err = fromXPM(input,output,counted);
+		if (counted)
+			put_stats(extension,counted);
+		return err;
+	}
 	else if (ourType == B_TRANSLATOR_BITMAP && (!type || type == XPM_TYPE_CODE))
-		return toXPM(input,output);
+	{
+		xpm_encode_settings settings;
+
+		get_encode_settings(extension,&settings);
+		settings.stats = counted;
+		err = toXPM(input,output,&settings);
+		if (counted)
+			put_stats(extension,counted);
+		return err;
+	}
+	else if (ourType == B_TRANSLATOR_BITMAP && type == B_TRANSLATOR_BITMAP)
+		return copy_bitmap(input,output);
 	else
 		return B_NO_TRANSLATOR;
 }
 
+//	get_encode_settings()
+//	read the options for toXPM() out of the ioExtension message; anything
+//	missing, or other than the values XPM.h gives for it, keeps its
+//	default.
+void get_encode_settings(BMessage *extension, xpm_encode_settings *settings)
+{
+	int32 value;
+	int64 limit;
+	bool flag;
+	const char *string;
+
+	init_encode_settings(settings);
+	if (!extension)
+		return;
+	if (extension->FindInt32(XPM_EXT_MAX_COLORS,&value) == B_OK && value > 0)
+		settings->maxColors = value;
+	if (extension->FindInt32(XPM_EXT_QUANTIZER,&value) == B_OK
+		&& (value == XPM_QUANTIZE_MEDIAN_CUT || value == XPM_QUANTIZE_OCTREE))
+		settings->quantizer = value;
+	if (extension->FindBool(XPM_EXT_DITHER,&flag) == B_OK)
+		settings->dither = flag;
+	if (extension->FindBool(XPM_EXT_DETERMINISTIC,&flag) == B_OK)
+		settings->deterministic = flag;
+	if (extension->FindString(XPM_EXT_CACHE_DIRECTORY,&string) == B_OK && string[0])
+		settings->cacheDirectory = string;
+	if (extension->FindInt32(XPM_EXT_FORMAT,&value) == B_OK
+		&& (value == XPM_FORMAT_XPM3 || value == XPM_FORMAT_XPM2))
+		settings->format = value;
+	if (extension->FindBool(XPM_EXT_GZIP,&flag) == B_OK)
+		settings->gzip = flag;
+	if (extension->FindInt64(XPM_EXT_MEMORY_LIMIT,&limit) == B_OK && limit > 0)
+		settings->memoryLimit = limit;
+}
+
+//	wants_stats()
+//	whether the ioExtension message asks for the translation's counters.
+bool wants_stats(BMessage *extension)
+{
+	bool flag;
+
+	return extension && extension->FindBool(XPM_EXT_STATS,&flag) == B_OK && flag;
+}
+
+//	put_stats()
+//	add the counters to the ioExtension message, replacing any left from
+//	an earlier translation.
+void put_stats(BMessage *extension, xpm_stats *stats)
+{
+	const char *int64Names[] = { XPM_STAT_BYTES_READ, XPM_STAT_BYTES_WRITTEN, XPM_STAT_HEADER_TIME,
+		XPM_STAT_PALETTE_TIME, XPM_STAT_PIXELS_TIME, XPM_STAT_OUTPUT_TIME, XPM_STAT_PROBES,
+		XPM_STAT_ALLOC_BYTES, XPM_STAT_PEAK_BYTES };
+	int64 int64Values[] = { stats->bytesRead, stats->bytesWritten, stats->time[XPM_PHASE_HEADER],
+		stats->time[XPM_PHASE_PALETTE], stats->time[XPM_PHASE_PIXELS],
+		stats->time[XPM_PHASE_OUTPUT], stats->probes, stats->allocBytes, stats->peakBytes };
+	const char *int32Names[] = { XPM_STAT_READS, XPM_STAT_WRITES, XPM_STAT_MAX_CHAIN,
+		XPM_STAT_COLORS, XPM_STAT_CPP, XPM_STAT_ALLOCS };
+	int32 int32Values[] = { stats->reads, stats->writes, stats->maxChain, stats->ncolors,
+		stats->cpp, stats->allocs };
+	int i;
+
+	for (i = 0; i < (int)(sizeof(int64Names)/sizeof(int64Names[0])); i++)
+	{
+		extension->RemoveName(int64Names[i]);
+		extension->AddInt64(int64Names[i],int64Values[i]);
+	}
+	for (i = 0; i < (int)(sizeof(int32Names)/sizeof(int32Names[0])); i++)
+	{
+		extension->RemoveName(int32Names[i]);
+		extension->AddInt32(int32Names[i],int32Values[i]);
+	}
+}
+
 //	get_stream_type()
 //	accomplish the job of stream identification.  A B_TRANSLATOR_BITMAP is
 //	indicated by the first byte, which must equal the "magic" value of
-//	'bits'.  An XPM file stream must begin with the XPM header, "/* XPM */".
-//	Otherwise return zero, to indicate unknown type.
+//	'bits'.  An XPM file stream must begin with the XPM header, "/* XPM */",
+//	or the XPM2 header, "! XPM2", after being inflated if it is gzipped.
+//	Otherwise return zero, to indicate unknown type.  A stream such as a
+//	pipe may give a read fewer bytes than it asks for.
 uint32 get_stream_type(BPositionIO *stream)
 {
 	status_t err;
+	ssize_t n;
 	char buffer[17];
 	uint32 bitsType = B_HOST_TO_BENDIAN_INT32(B_TRANSLATOR_BITMAP);
 	
-	err = stream->Read(buffer,sizeof(buffer) - 1);
+	memset(buffer,0,sizeof(buffer));
+	for (err = 0; err < (ssize_t)sizeof(buffer) - 1; err += n)
+	{
+		n = stream->Read(buffer + err,sizeof(buffer) - 1 - err);
+		if (n <= 0)
+			break;
+	}
 	if (err <= 0)
 	{
       return 0;
     }
 	stream->Seek(-err,SEEK_CUR);
-	if (!strncmp(buffer,XPM_HEADER,strlen(XPM_HEADER)))
+	if (is_gzip(buffer,err))
+	{
+		err = peek_gzip(stream,buffer,sizeof(buffer) - 1);
+		if (err <= 0)
+			return 0;
+	}
+	if (!strncmp(buffer,XPM_HEADER,strlen(XPM_HEADER))
+		|| !strncmp(buffer,XPM2_HEADER,strlen(XPM2_HEADER)))
 		return XPM_TYPE_CODE;
 	else if (!memcmp(buffer,&bitsType,sizeof(bitsType)))
 		return B_TRANSLATOR_BITMAP;
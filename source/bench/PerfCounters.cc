@@ -0,0 +1,161 @@
+//	PerfCounters.cc
+//
+//	each counter is opened on its own rather than as a group, so that one
+//	the processor lacks doesn't cost us the others; when there are more
+//	than it can count at once, the kernel takes turns and the counts are
+//	scaled up by the share of the time each was counting.
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "PerfCounters.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+//	what each counter is, to perf_event_open()
+typedef struct
+{
+	uint32 type;
+	uint64 config;
+}
+perf_event;
+
+const perf_event kEvents[PERF_COUNTER_COUNT] =
+{
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+	{ PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | PERF_COUNT_HW_CACHE_OP_READ << 8
+		| PERF_COUNT_HW_CACHE_RESULT_MISS << 16 },
+	{ PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | PERF_COUNT_HW_CACHE_OP_READ << 8
+		| PERF_COUNT_HW_CACHE_RESULT_MISS << 16 },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES }
+};
+#endif
+
+const char *kCounterNames[PERF_COUNTER_COUNT] =
+{
+	"cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses"
+};
+
+//	perf_open()
+//	open what counters there are for this thread and the threads it starts
+//	from now on, such as the row bands', user time only; whether there were
+//	any.  A started thread's counts join ours when it exits.
+bool perf_open(perf_counters *pc)
+{
+	bool any = false;
+	int i;
+
+	for (i = 0; i < PERF_COUNTER_COUNT; i++)
+	{
+		pc->fd[i] = -1;
+#ifdef __linux__
+		struct perf_event_attr attr;
+
+		memset(&attr,0,sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = kEvents[i].type;
+		attr.config = kEvents[i].config;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.inherit = 1;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		pc->fd[i] = syscall(SYS_perf_event_open,&attr,0,-1,-1,0);
+		if (pc->fd[i] >= 0)
+			any = true;
+#endif
+	}
+	return any;
+}
+
+void perf_close(perf_counters *pc)
+{
+	int i;
+
+	for (i = 0; i < PERF_COUNTER_COUNT; i++)
+		if (pc->fd[i] >= 0)
+		{
+			close(pc->fd[i]);
+			pc->fd[i] = -1;
+		}
+}
+
+//	perf_start()
+//	count from zero.
+void perf_start(perf_counters *pc)
+{
+#ifdef __linux__
+	int i;
+
+	for (i = 0; i < PERF_COUNTER_COUNT; i++)
+		if (pc->fd[i] >= 0)
+		{
+			ioctl(pc->fd[i],PERF_EVENT_IOC_RESET,0);
+			ioctl(pc->fd[i],PERF_EVENT_IOC_ENABLE,0);
+		}
+#endif
+}
+
+//	perf_stop()
+//	stop counting, and add what was counted since perf_start() to "counts".
+void perf_stop(perf_counters *pc, perf_counts *counts)
+{
+#ifdef __linux__
+	uint64 data[3];				// value, time enabled, time running
+	int i;
+
+	for (i = 0; i < PERF_COUNTER_COUNT; i++)
+		if (pc->fd[i] >= 0)
+			ioctl(pc->fd[i],PERF_EVENT_IOC_DISABLE,0);
+	for (i = 0; i < PERF_COUNTER_COUNT; i++)
+	{
+		if (pc->fd[i] < 0 || read(pc->fd[i],data,sizeof(data)) != sizeof(data) || !data[2])
+			continue;
+		counts->valid[i] = true;
+		counts->value[i] += (double)data[0]*data[1]/data[2];
+	}
+#endif
+}
+
+void perf_clear(perf_counts *counts)
+{
+	memset(counts,0,sizeof(*counts));
+}
+
+bool perf_any(const perf_counts *counts)
+{
+	int i;
+
+	for (i = 0; i < PERF_COUNTER_COUNT; i++)
+		if (counts->valid[i])
+			return true;
+	return false;
+}
+
+const char *perf_counter_name(int i)
+{
+	return kCounterNames[i];
+}
+
+//	perf_format()
+//	the counts, each divided by "per", as a JSON object--"null" if there
+//	are none--into "text"; its length, as snprintf() gives it.
+int perf_format(const perf_counts *counts, double per, char *text, size_t size)
+{
+	size_t length = 0;
+	int i;
+
+	if (!perf_any(counts) || per <= 0)
+		return snprintf(text,size,"null");
+	for (i = 0; i < PERF_COUNTER_COUNT; i++)
+		if (counts->valid[i] && length < size)
+			length += snprintf(text + length,size - length,"%s\"%s\":%.4g",length ? "," : "{",
+				kCounterNames[i],counts->value[i]/per);
+	if (length < size)
+		length += snprintf(text + length,size - length,"}");
+	return length;
+}
@@ -0,0 +1,43 @@
+//	PerfCounters.h
+//
+//	the processor's own counts of what a stretch of the benchmark cost:
+//	cycles, instructions, cache and branch misses, from Linux's
+//	perf_event_open().  Where there is no such call, or the kernel won't
+//	let us count, or the processor lacks a counter, that counter is
+//	simply missing from the results.
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <be/SupportKit.h>
+
+#define		PERF_CYCLES				0
+#define		PERF_INSTRUCTIONS		1
+#define		PERF_L1D_MISSES			2
+#define		PERF_LLC_MISSES			3
+#define		PERF_BRANCH_MISSES		4
+#define		PERF_COUNTER_COUNT		5
+
+typedef struct
+{
+	int fd[PERF_COUNTER_COUNT];				// -1 for a counter not to be had
+}
+perf_counters;
+
+//	the counts over one or more stretches
+typedef struct
+{
+	bool valid[PERF_COUNTER_COUNT];
+	double value[PERF_COUNTER_COUNT];
+}
+perf_counts;
+
+bool perf_open(perf_counters *);
+void perf_close(perf_counters *);
+void perf_start(perf_counters *);
+void perf_stop(perf_counters *, perf_counts *);
+void perf_clear(perf_counts *);
+bool perf_any(const perf_counts *);
+const char *perf_counter_name(int);
+int perf_format(const perf_counts *, double, char *, size_t);
+
+#endif
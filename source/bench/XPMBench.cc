@@ -0,0 +1,479 @@
+//	XPMBench.cc
+//
+//	end-to-end throughput of fromXPM() and toXPM() over a matrix of image
+//	sizes, characters-per-pixel, palette sizes and color spaces.  Each case
+//	runs in a process of its own, so that its peak resident set is its own
+//	and a case that takes too long can be given up on.  A line of JSON is
+//	written to the output for every case, and a table to stderr.  The
+//	inputs are made by XPMCorpus; --named, --transparent, --repeat and
+//	--keys shape them as they do for xpmgen.  Where Linux's performance
+//	counters can be read, each case also reports what the codec cost in
+//	cycles, instructions and misses, per pixel and per input byte.  The
+//	heap a translation takes, by the codec's own count, comes from one
+//	more run, with stats.  With --context, a case's runs share one
+//	XPMContext, as a caller translating many images would.
+//
+//	usage: xpmbench [--quick] [--sizes=16,64,...] [--cpp=1,2,...]
+//		[--palettes=2,16,...] [--spaces=rgba32,cmap8,...]
+//		[--direction=decode|encode|both] [--min-time=seconds]
+//		[--timeout=seconds] [--named] [--transparent=fraction]
+//		[--repeat=fraction] [--keys=spread|shuffled|prefix|ascending]
+//		[--seed=n] [--context] [--output=file]
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "XPM.h"
+#include "fromXPM.h"
+#include "toXPM.h"
+#include "ScanBitmap.h"
+#include "XPMCorpus.h"
+#include "PerfCounters.h"
+
+#define		BENCH_MAX_VALUES		32
+
+//	the values each dimension of the matrix takes
+typedef struct
+{
+	int count;
+	int value[BENCH_MAX_VALUES];
+}
+bench_list;
+
+typedef struct
+{
+	bench_list sizes;
+	bench_list cpp;
+	bench_list palettes;
+	bench_list spaces;
+	bool decode;
+	bool encode;
+	double minTime;
+	int timeout;
+	corpus_spec corpus;				// all but the case's own dimensions
+	bool context;					// keep one XPMContext across a case's iterations
+	FILE *output;
+}
+bench_options;
+
+//	what a case sends back to the parent
+typedef struct
+{
+	status_t err;
+	int iterations;
+	double seconds;					// the fastest iteration
+	double meanSeconds;
+	uint64 inputBytes;
+	uint64 outputBytes;
+	int cpp;						// as written, for the encoder
+	long inputRSS;					// KB, once the input was made
+	long peakRSS;					// KB
+	perf_counts counts;				// over every iteration, of the codec alone
+	int32 allocs;					// heap blocks of one translation, as the codec counts them
+	int64 allocBytes;
+	int64 heapPeak;					// bytes
+}
+bench_result;
+
+status_t parse_options(int, char **, bench_options *);
+bool parse_list(const char *, bench_list *);
+bool parse_spaces(const char *, bench_list *);
+void run_case(bench_options *, bool, int, int, int, int);
+void measure_case(bench_options *, bool, int, int, int, int, bench_result *);
+void case_spec(bench_options *, int, int, int, int, corpus_spec *);
+int written_cpp(BMallocIO *);
+long peak_rss(void);
+double now(void);
+
+int main(int argc, char **argv)
+{
+	bench_options options;
+	int i, j, k, s;
+	time_t start;
+
+	if (parse_options(argc,argv,&options) != B_OK)
+	{
+		fprintf(stderr,"usage: %s [--quick] [--sizes=16,64,...] [--cpp=1,2,...]"
+			" [--palettes=2,16,...]\n"
+			"\t[--spaces=rgba32,rgb32,rgb16,rgb15,cmap8,gray8,gray1]"
+			" [--direction=decode|encode|both]\n"
+			"\t[--min-time=seconds] [--timeout=seconds] [--named] [--transparent=fraction]\n"
+			"\t[--repeat=fraction] [--keys=spread|shuffled|prefix|ascending] [--seed=n]"
+			" [--context]\n"
+			"\t[--output=file]\n",
+			argv[0]);
+		return 1;
+	}
+
+	start = time(NULL);
+	fprintf(options.output,"{\"type\":\"run\",\"timestamp\":%ld,\"cpus\":%ld,\"seed\":%lu,"
+		"\"min_time\":%g,\"named\":%s,\"transparent\":%g,\"repeat\":%g,\"keys\":\"%s\"}\n",
+		(long)start,sysconf(_SC_NPROCESSORS_ONLN),(unsigned long)options.corpus.seed,
+		options.minTime,
+		options.corpus.named ? "true" : "false",options.corpus.transparent,options.corpus.repeat,
+		corpus_keys_name(options.corpus.keys));
+	fprintf(stderr,"%-6s %-6s %11s %3s %6s %10s %10s %12s %9s %8s\n","dir","space","size","cpp",
+		"colors","ms","MB/s","pixels/s","peak KB","cyc/px");
+
+//	decoding depends on the XPM only, so it is measured once per size,
+//	cpp and palette; encoding on the bitmap, whose cpp is the encoder's
+	for (i = 0; i < options.sizes.count; i++)
+		for (j = 0; j < options.palettes.count; j++)
+		{
+			if (options.decode)
+				for (k = 0; k < options.cpp.count; k++)
+					run_case(&options,true,options.sizes.value[i],options.cpp.value[k],
+						options.palettes.value[j],-1);
+			if (options.encode)
+				for (s = 0; s < options.spaces.count; s++)
+					run_case(&options,false,options.sizes.value[i],0,options.palettes.value[j],
+						options.spaces.value[s]);
+		}
+
+	if (options.output != stdout)
+		fclose(options.output);
+	return 0;
+}
+
+//	parse_options()
+//	the defaults are the whole matrix; --quick is a smaller one that runs
+//	in a minute or so.
+status_t parse_options(int argc, char **argv, bench_options *options)
+{
+	const char *arg;
+	int i;
+
+	parse_list("16,64,256,1024,4096,8192",&options->sizes);
+	parse_list("1,2,3,4",&options->cpp);
+	parse_list("2,16,256,4096,65536",&options->palettes);
+	parse_spaces("rgba32,rgb32,rgb16,rgb15,cmap8,gray8,gray1",&options->spaces);
+	options->decode = options->encode = true;
+	options->minTime = 0.5;
+	options->timeout = 120;
+	corpus_defaults(&options->corpus);
+	options->context = false;
+	options->output = stdout;
+
+	for (i = 1; i < argc; i++)
+	{
+		arg = argv[i];
+		if (!strcmp(arg,"--quick"))
+		{
+			parse_list("16,256,1024",&options->sizes);
+			parse_list("1,2,3",&options->cpp);
+			parse_list("2,256,4096",&options->palettes);
+			parse_spaces("rgba32,rgb16,cmap8,gray1",&options->spaces);
+			options->minTime = 0.2;
+			options->timeout = 30;
+		}
+		else if (!strncmp(arg,"--sizes=",8))
+		{
+			if (!parse_list(arg + 8,&options->sizes))
+				return B_BAD_VALUE;
+		}
+		else if (!strncmp(arg,"--cpp=",6))
+		{
+			if (!parse_list(arg + 6,&options->cpp))
+				return B_BAD_VALUE;
+		}
+		else if (!strncmp(arg,"--palettes=",11))
+		{
+			if (!parse_list(arg + 11,&options->palettes))
+				return B_BAD_VALUE;
+		}
+		else if (!strncmp(arg,"--spaces=",9))
+		{
+			if (!parse_spaces(arg + 9,&options->spaces))
+				return B_BAD_VALUE;
+		}
+		else if (!strncmp(arg,"--direction=",12))
+		{
+			options->decode = !strcmp(arg + 12,"decode") || !strcmp(arg + 12,"both");
+			options->encode = !strcmp(arg + 12,"encode") || !strcmp(arg + 12,"both");
+			if (!options->decode && !options->encode)
+				return B_BAD_VALUE;
+		}
+		else if (!strncmp(arg,"--min-time=",11))
+			options->minTime = atof(arg + 11);
+		else if (!strncmp(arg,"--timeout=",10))
+			options->timeout = atoi(arg + 10);
+		else if (!strcmp(arg,"--named"))
+			options->corpus.named = true;
+		else if (!strncmp(arg,"--transparent=",14))
+			options->corpus.transparent = atof(arg + 14);
+		else if (!strncmp(arg,"--repeat=",9))
+			options->corpus.repeat = atof(arg + 9);
+		else if (!strncmp(arg,"--keys=",7))
+		{
+			options->corpus.keys = corpus_keys_value(arg + 7);
+			if (options->corpus.keys < 0)
+				return B_BAD_VALUE;
+		}
+		else if (!strncmp(arg,"--seed=",7))
+			options->corpus.seed = strtoul(arg + 7,NULL,0);
+		else if (!strcmp(arg,"--context"))
+			options->context = true;
+		else if (!strncmp(arg,"--output=",9))
+		{
+			options->output = fopen(arg + 9,"w");
+			if (!options->output)
+				return B_ERROR;
+		}
+		else
+			return B_BAD_VALUE;
+	}
+	return B_OK;
+}
+
+//	parse_list()
+//	a comma-separated list of positive numbers.
+bool parse_list(const char *text, bench_list *list)
+{
+	char *end;
+	long n;
+
+	list->count = 0;
+	while (*text && list->count < BENCH_MAX_VALUES)
+	{
+		n = strtol(text,&end,10);
+		if (end == text || n <= 0)
+			return false;
+		list->value[list->count++] = n;
+		text = *end == ',' ? end + 1 : end;
+	}
+	return list->count > 0;
+}
+
+//	parse_spaces()
+//	a comma-separated list of color space names, kept as indices into
+//	corpus_spaces.
+bool parse_spaces(const char *text, bench_list *list)
+{
+	size_t length;
+	int i;
+
+	list->count = 0;
+	while (*text && list->count < BENCH_MAX_VALUES)
+	{
+		length = strcspn(text,",");
+		i = corpus_space_index(text,length);
+		if (i < 0)
+			return false;
+		list->value[list->count++] = i;
+		text += length;
+		if (*text == ',')
+			text++;
+	}
+	return list->count > 0;
+}
+
+//	run_case()
+//	measure one case in a child process and report it.  Cases that can't
+//	be made--more colors than pixels, or than the cpp or the color space
+//	allow--are skipped.
+void run_case(bench_options *options, bool decode, int size, int cpp, int colors, int space)
+{
+	bench_result result;
+	const char *spaceName = decode ? "xpm" : corpus_spaces[space].name;
+	const char *status = "ok";
+	char statusText[32];
+	int fds[2], waitStatus;
+	double mbps = 0, pps = 0;
+	corpus_spec spec;
+	char perPixel[256], perByte[256], cycles[32] = "-", ipc[32] = "null";
+	pid_t pid;
+
+	case_spec(options,size,cpp,colors,space,&spec);
+	if ((uint64)colors > (uint64)size*size || colors > corpus_max_colors(&spec,decode))
+		return;
+
+	memset(&result,0,sizeof(result));
+	fflush(options->output);
+	fflush(stderr);
+	if (pipe(fds))
+		return;
+	pid = fork();
+	if (pid == 0)
+	{
+		close(fds[0]);
+		alarm(options->timeout);
+		measure_case(options,decode,size,cpp,colors,space,&result);
+		if (write(fds[1],&result,sizeof(result)) != sizeof(result))
+			_exit(1);
+		_exit(0);
+	}
+	close(fds[1]);
+	if (pid < 0 || read(fds[0],&result,sizeof(result)) != sizeof(result))
+		result.err = B_ERROR;
+	close(fds[0]);
+	if (pid > 0)
+		waitpid(pid,&waitStatus,0);
+
+	if (pid > 0 && WIFSIGNALED(waitStatus))
+		status = WTERMSIG(waitStatus) == SIGALRM ? "timeout" : "crashed";
+	else if (result.err != B_OK)
+	{
+		sprintf(statusText,"error %ld",(long)result.err);
+		status = statusText;
+	}
+	else
+	{
+//	throughput is of the XPM text, read or written, and of the pixels
+		mbps = (decode ? result.inputBytes : result.outputBytes)/result.seconds/1e6;
+		pps = (double)size*size/result.seconds;
+	}
+	perf_format(&result.counts,(double)result.iterations*size*size,perPixel,sizeof(perPixel));
+	perf_format(&result.counts,(double)result.iterations*result.inputBytes,perByte,sizeof(perByte));
+	if (result.counts.valid[PERF_CYCLES] && result.iterations)
+		sprintf(cycles,"%.1f",
+			result.counts.value[PERF_CYCLES]/result.iterations/((double)size*size));
+	if (result.counts.valid[PERF_CYCLES] && result.counts.valid[PERF_INSTRUCTIONS])
+		sprintf(ipc,"%.3f",result.counts.value[PERF_INSTRUCTIONS]/result.counts.value[PERF_CYCLES]);
+
+	fprintf(options->output,"{\"type\":\"case\",\"direction\":\"%s\",\"space\":\"%s\","
+		"\"width\":%d,\"height\":%d,\"cpp\":%d,\"colors\":%d,\"status\":\"%s\",\"context\":%s,"
+		"\"iterations\":%d,\"seconds\":%.9f,\"mean_seconds\":%.9f,"
+		"\"input_bytes\":%llu,\"output_bytes\":%llu,\"xpm_mb_per_s\":%.3f,\"pixels_per_s\":%.0f,"
+		"\"input_rss_kb\":%ld,\"peak_rss_kb\":%ld,\"allocs\":%ld,\"alloc_bytes\":%lld,"
+		"\"heap_peak_bytes\":%lld,\"counters_per_pixel\":%s,\"counters_per_byte\":%s,\"ipc\":%s}\n",
+		decode ? "decode" : "encode",spaceName,size,size,decode ? cpp : result.cpp,colors,status,
+		options->context ? "true" : "false",result.iterations,result.seconds,result.meanSeconds,
+		(unsigned long long)result.inputBytes,(unsigned long long)result.outputBytes,mbps,pps,
+		result.inputRSS,result.peakRSS,(long)result.allocs,(long long)result.allocBytes,
+		(long long)result.heapPeak,perPixel,perByte,ipc);
+	fprintf(stderr,"%-6s %-6s %5dx%-5d %3d %6d %10.3f %10.2f %12.0f %9ld %8s %s\n",
+		decode ? "decode" : "encode",spaceName,size,size,decode ? cpp : result.cpp,colors,
+		result.seconds*1e3,mbps,pps,result.peakRSS,cycles,strcmp(status,"ok") ? status : "");
+}
+
+//	measure_case()
+//	make the input, then run the codec over it until "minTime" has passed,
+//	at least twice, counting what the codec costs where that can be done.
+//	Runs in the child.
+void measure_case(bench_options *options, bool decode, int size, int cpp, int colors, int space,
+	bench_result *result)
+{
+	perf_counters counters;
+	xpm_encode_settings settings;
+	XPMContext *context = NULL;
+	corpus_spec spec;
+	uint8 *input;
+	size_t length;
+	double start, elapsed, total = 0;
+	BMallocIO *output;
+
+	result->seconds = 1e30;
+	case_spec(options,size,cpp,colors,space,&spec);
+	input = make_corpus(&spec,decode,&length);
+	if (!input)
+	{
+		result->err = B_NO_MEMORY;
+		return;
+	}
+	result->inputBytes = length;
+	result->inputRSS = peak_rss();
+	init_encode_settings(&settings);
+	if (options->context)
+		context = settings.context = new XPMContext();
+	perf_open(&counters);
+
+	while (result->iterations < 2 || total < options->minTime)
+	{
+		BMemoryIO in(input,length);
+
+		output = new BMallocIO();
+		start = now();
+		perf_start(&counters);
+		if (decode)
+			result->err = fromXPM(&in,output,NULL,context);
+		else
+			result->err = toXPM(&in,output,&settings);
+		perf_stop(&counters,&result->counts);
+		elapsed = now() - start;
+		result->outputBytes = output->BufferLength();
+		if (!decode && result->iterations == 0)
+			result->cpp = written_cpp(output);
+		delete output;
+		if (result->err != B_OK)
+			break;
+		result->iterations++;
+		total += elapsed;
+		if (elapsed < result->seconds)
+			result->seconds = elapsed;
+	}
+	result->meanSeconds = result->iterations ? total/result->iterations : 0;
+	result->peakRSS = peak_rss();
+
+//	the codec's own count of its heap comes from one more, untimed, run
+	if (result->err == B_OK)
+	{
+		BMemoryIO in(input,length);
+		xpm_stats stats;
+
+		output = new BMallocIO();
+		settings.stats = &stats;
+		if ((decode ? fromXPM(&in,output,&stats,context) : toXPM(&in,output,&settings)) == B_OK)
+		{
+			result->allocs = stats.allocs;
+			result->allocBytes = stats.allocBytes;
+			result->heapPeak = stats.peakBytes;
+		}
+		delete output;
+	}
+	perf_close(&counters);
+	delete context;
+	free(input);
+}
+
+//	case_spec()
+//	the corpus spec of a case: the options' own, at its size and palette,
+//	with its cpp or color space.
+void case_spec(bench_options *options, int size, int cpp, int colors, int space, corpus_spec *spec)
+{
+	*spec = options->corpus;
+	spec->width = spec->height = size;
+	spec->colors = colors;
+	if (cpp > 0)
+		spec->cpp = cpp;
+	if (space >= 0)
+		spec->space = corpus_spaces[space].space;
+}
+
+//	written_cpp()
+//	the characters-per-pixel of an XPM the encoder wrote, from its value
+//	string.
+int written_cpp(BMallocIO *xpm)
+{
+	const char *text = (const char *)xpm->Buffer();
+	const char *end = text + xpm->BufferLength();
+	const char *quote;
+	int width, height, colors, cpp;
+
+	quote = (const char *)memchr(text,'"',end - text);
+	if (!quote || sscanf(quote + 1,"%d %d %d %d",&width,&height,&colors,&cpp) != 4)
+		return 0;
+	return cpp;
+}
+
+//	peak_rss()
+//	the most memory the process has had resident so far, in KB.
+long peak_rss(void)
+{
+	struct rusage usage;
+
+	getrusage(RUSAGE_SELF,&usage);
+	return usage.ru_maxrss;
+}
+
+double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec + ts.tv_nsec*1e-9;
+}
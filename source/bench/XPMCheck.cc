@@ -0,0 +1,2083 @@
+//	XPMCheck.cc
+//
+//	regression checks for the codec, run on the portable build with
+//	"make check".  Each check builds its own small inputs, runs them
+//	through the codec and compares what comes back; the name of each is
+//	printed with "ok" or with what went wrong, and the exit status is the
+//	number that failed.
+//
+//	The tools are checked against the codec too, when --tools names the
+//	directory they were built in; without it, their checks are skipped.
+//
+//	usage: xpmcheck [--filter=substring] [--tools=directory]
+
+#include <dirent.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <File.h>
+#include <StorageDefs.h>
+#include <TranslatorAddOn.h>
+#include "XPM.h"
+#include "fromXPM.h"
+#include "toXPM.h"
+#include "XPMCache.h"
+#include "XPMContext.h"
+#include "PassThrough.h"
+#include "ScanBitmap.h"
+#include "XPMTrace.h"
+#include "RowBands.h"
+#include "updateXPM.h"
+
+//	a check returns NULL if it passed, or else what failed
+typedef const char *(*check_func)(void);
+
+//	a quoted string of an XPM: the offset of its first character, and
+//	its length
+typedef struct
+{
+	size_t start;
+	size_t length;
+}
+quoted_string;
+
+//	a stream over memory that gives each read at most a few bytes, as a
+//	pipe may
+class TrickleIO : public BPositionIO
+{
+	public:
+
+		TrickleIO(BMallocIO *, size_t);
+
+		virtual ssize_t ReadAt(off_t, void *, size_t);
+		virtual ssize_t WriteAt(off_t, const void *, size_t);
+		virtual off_t Seek(off_t, uint32);
+		virtual off_t Position(void) const;
+
+	private:
+
+		BMallocIO *io;
+		size_t most;
+		off_t position;
+};
+
+//	one of several decodes run at once by check_parallel_decodes()
+typedef struct
+{
+	BMallocIO *xpm;
+	BMallocIO *expected;
+	int rounds;
+	const char *failure;
+}
+decode_job;
+
+typedef struct
+{
+	const char *name;
+	check_func func;
+}
+check_entry;
+
+//	returned by a check that can't be run here
+static const char kSkipped[] = "skipped";
+
+//	where the tools are, from --tools; NULL to skip their checks
+static const char *sToolDirectory = NULL;
+
+const char *check_quantize_transparent_limit(void);
+const char *check_cache_hash_collision(void);
+const char *check_cache_colliding_pair(void);
+const char *check_cache_header_mismatch(void);
+const char *check_update_heap(void);
+const char *check_decode_mapped_output(void);
+const char *check_strips_quantize(void);
+const char *check_round_trip(void);
+const char *check_strips_exact(void);
+const char *check_parallel_serial(void);
+const char *check_cache_hit(void);
+const char *check_stats(void);
+const char *check_trace(void);
+const char *check_filter_round_trip(void);
+const char *check_convert_matches_filter(void);
+const char *check_translator_identify(void);
+const char *check_cpp_boundary(void);
+const char *check_unknown_settings(void);
+const char *check_indexed(void);
+const char *check_cache_writers(void);
+const char *check_update_rows(void);
+const char *check_update_palette_overflow(void);
+const char *check_update_cpp_growth(void);
+const char *check_update_size_change(void);
+const char *check_encode_padded(void);
+const char *check_decode_padded(void);
+const char *check_pass_through(void);
+const char *check_translate_bits(void);
+const char *check_xpm2_first_char(void);
+const char *check_gzip_trickle(void);
+const char *check_find_row(void);
+const char *check_repeated_rows(void);
+const char *check_hash_spread(void);
+const char *check_parallel_decodes(void);
+status_t decode_thread(void *);
+void colliding_pair(uint8 *, uint8 *, TranslatorBitmap *);
+void make_pixels(uint8 *, int, int, int, uint32);
+void make_cycle_pixels(uint8 *, int, int, int);
+void put_color(uint8 *, int);
+status_t write_bits(const uint8 *, int, int, BMallocIO *);
+status_t encode_pixels(const uint8 *, int32, color_space, int, int, const xpm_encode_settings *,
+	BMallocIO *);
+status_t decode_pixels(BMallocIO *, uint8 **, int *, int *);
+void add_transparency(uint8 *, int, int);
+void clear_output(BMallocIO *);
+bool same_output(BMallocIO *, BMallocIO *);
+status_t read_file(const char *, BMallocIO *);
+int run_tool(const char *, ...);
+bool same_gray(const uint8 *, const uint8 *, int);
+bool same_colors(const rgb_color *, const uint8 *, int);
+int xpm_color_count(BMallocIO *);
+int quoted_strings(BMallocIO *, quoted_string *, int);
+bool same_string(BMallocIO *, quoted_string *, BMallocIO *, quoted_string *);
+bool same_text(BMallocIO *, size_t, BMallocIO *, size_t, size_t);
+bool same_body(BMallocIO *, BMallocIO *);
+status_t update_pixels(BMallocIO *, const uint8 *, int, int, int, int,
+	const xpm_encode_settings *, BMallocIO *);
+const char *check_update_fallback(const uint8 *, int, int, const uint8 *, int, int,
+	const xpm_encode_settings *);
+char *make_scratch_directory(void);
+void remove_scratch_directory(char *);
+void make_bitmap_stream(BMallocIO *, BMallocIO *);
+
+static const check_entry sChecks[] =
+{
+	{ "quantize/transparent-limit", check_quantize_transparent_limit },
+	{ "cache/hash-collision", check_cache_hash_collision },
+	{ "cache/colliding-pair", check_cache_colliding_pair },
+	{ "cache/header-mismatch", check_cache_header_mismatch },
+	{ "update/heap", check_update_heap },
+	{ "decode/mapped-output", check_decode_mapped_output },
+	{ "encode/strips-quantize", check_strips_quantize },
+	{ "codec/round-trip", check_round_trip },
+	{ "encode/strips-exact", check_strips_exact },
+	{ "codec/parallel-serial", check_parallel_serial },
+	{ "cache/hit", check_cache_hit },
+	{ "codec/stats", check_stats },
+	{ "codec/trace", check_trace },
+	{ "tools/filter-round-trip", check_filter_round_trip },
+	{ "tools/convert-matches-filter", check_convert_matches_filter },
+	{ "translator/identify", check_translator_identify },
+	{ "encode/cpp-boundary", check_cpp_boundary },
+	{ "settings/unknown-values", check_unknown_settings },
+	{ "encode/indexed", check_indexed },
+	{ "cache/concurrent-writers", check_cache_writers },
+	{ "update/unchanged-rows", check_update_rows },
+	{ "update/palette-overflow", check_update_palette_overflow },
+	{ "update/cpp-growth", check_update_cpp_growth },
+	{ "update/size-change", check_update_size_change },
+	{ "encode/padded-rows", check_encode_padded },
+	{ "decode/padded-rows", check_decode_padded },
+	{ "copy/pass-through", check_pass_through },
+	{ "translator/bits-to-bits", check_translate_bits },
+	{ "encode/xpm2-first-char", check_xpm2_first_char },
+	{ "decode/gzip-trickle", check_gzip_trickle },
+	{ "scan/find-row", check_find_row },
+	{ "codec/repeated-rows", check_repeated_rows },
+	{ "decode/hash-spread", check_hash_spread },
+	{ "decode/parallel-decodes", check_parallel_decodes }
+};
+
+int main(int argc, char **argv)
+{
+	const char *filter = NULL, *failure;
+	int i, failed = 0;
+
+	for (i = 1; i < argc; i++)
+		if (!strncmp(argv[i],"--filter=",9))
+			filter = argv[i] + 9;
+		else if (!strncmp(argv[i],"--tools=",8))
+			sToolDirectory = argv[i] + 8;
+		else
+		{
+			fprintf(stderr,"usage: %s [--filter=substring] [--tools=directory]\n",argv[0]);
+			return 1;
+		}
+
+	for (i = 0; i < (int)(sizeof(sChecks)/sizeof(sChecks[0])); i++)
+	{
+		if (filter && !strstr(sChecks[i].name,filter))
+			continue;
+		failure = sChecks[i].func();
+		if (failure == kSkipped)
+			printf("skip %s\n",sChecks[i].name);
+		else if (failure)
+		{
+			printf("FAIL %s: %s\n",sChecks[i].name,failure);
+			failed++;
+		}
+		else
+			printf("ok   %s\n",sChecks[i].name);
+	}
+	return failed;
+}
+
+//	check_quantize_transparent_limit()
+//	transparency takes one of the maxColors: a limit of 1 can't hold it
+//	and an opaque color both, and a limit of 2 gives exactly two.
+const char *check_quantize_transparent_limit(void)
+{
+	uint8 pixels[4*4] =
+	{
+		0x00, 0x00, 0xff, 0xff,		0x00, 0xff, 0x00, 0xff,
+		0xff, 0x00, 0x00, 0xff,		0x77, 0x74, 0x77, 0x00
+	};
+	xpm_encode_settings settings;
+	BMallocIO output;
+
+	init_encode_settings(&settings);
+	settings.maxColors = 1;
+	if (encode_pixels(pixels,16,B_RGBA32,4,1,&settings,&output) != B_BAD_VALUE)
+		return "a limit of 1 with transparency was not refused";
+	settings.maxColors = 2;
+	output.SetSize(0);
+	output.Seek(0,SEEK_SET);
+	if (encode_pixels(pixels,16,B_RGBA32,4,1,&settings,&output) != B_OK)
+		return "a limit of 2 with transparency failed";
+	if (xpm_color_count(&output) != 2)
+		return "a limit of 2 with transparency did not give two colors";
+	return NULL;
+}
+
+//	check_cache_hash_collision()
+//	two bitmaps that differ only in the top bits of two different words
+//	hashed alike when words were hashed by multiplying alone.
+const char *check_cache_hash_collision(void)
+{
+	uint8 first[16], second[16];
+	TranslatorBitmap bmap;
+
+	colliding_pair(first,second,&bmap);
+	if (hash_bitmap(&bmap,first) == hash_bitmap(&bmap,second))
+		return "the pair hashes alike";
+	return NULL;
+}
+
+//	check_cache_colliding_pair()
+//	each of the pair, encoded through the same cache, decodes to its own
+//	pixels.
+const char *check_cache_colliding_pair(void)
+{
+	uint8 first[16], second[16];
+	uint8 *bits = NULL;
+	TranslatorBitmap bmap;
+	xpm_encode_settings settings;
+	BMallocIO firstXPM, secondXPM;
+	const char *failure = NULL;
+	char *directory;
+	int width, height;
+
+	colliding_pair(first,second,&bmap);
+	directory = make_scratch_directory();
+	if (!directory)
+		return "can't make a cache directory";
+	init_encode_settings(&settings);
+	settings.cacheDirectory = directory;
+	if (encode_pixels(first,16,B_GRAY8,16,1,&settings,&firstXPM) != B_OK
+		|| encode_pixels(second,16,B_GRAY8,16,1,&settings,&secondXPM) != B_OK)
+		failure = "encoding failed";
+	else if (decode_pixels(&secondXPM,&bits,&width,&height) != B_OK || width != 16 || height != 1)
+		failure = "decoding failed";
+	else if (!same_gray(second,bits,16))
+		failure = "the second bitmap was given the first one's XPM";
+	free(bits);
+	remove_scratch_directory(directory);
+	return failure;
+}
+
+//	check_cache_header_mismatch()
+//	an entry made from a bitmap of another size is a miss, even under the
+//	same key.
+const char *check_cache_header_mismatch(void)
+{
+	uint8 first[16], second[16];
+	TranslatorBitmap bmap, other;
+	BMallocIO output;
+	const char *failure = NULL;
+	char *directory;
+
+	colliding_pair(first,second,&bmap);
+	other = bmap;
+	other.bounds.Set(0,0,3,3);
+	directory = make_scratch_directory();
+	if (!directory)
+		return "can't make a cache directory";
+	if (write_cached_xpm(directory,1,&bmap,"x",1) != B_OK)
+		failure = "can't write an entry";
+	else if (read_cached_xpm(directory,1,&other,&output) != B_ENTRY_NOT_FOUND)
+		failure = "an entry for a 16x1 bitmap was found for a 4x4 one";
+	else if (output.BufferLength())
+		failure = "a miss wrote output";
+	else if (read_cached_xpm(directory,1,&bmap,&output) != B_OK || output.BufferLength() != 1)
+		failure = "an entry was not found for its own bitmap";
+	remove_scratch_directory(directory);
+	return failure;
+}
+
+//	check_update_heap()
+//	updateXPM() takes its memory through the settings, as toXPM() does:
+//	it is counted in their stats, and a second update takes nothing new
+//	from their context.
+const char *check_update_heap(void)
+{
+	uint8 pixels[32*32*4];
+	uint8 *bits = NULL;
+	xpm_encode_settings settings;
+	xpm_stats stats;
+	XPMContext context;
+	BMallocIO oldXPM, input, output;
+	const char *failure = NULL;
+	int32 allocations;
+	int pass, width, height;
+
+	make_pixels(pixels,32,32,16,1);
+	if (encode_pixels(pixels,32*4,B_RGBA32,32,32,NULL,&oldXPM) != B_OK)
+		return "encoding failed";
+	make_pixels(pixels + 5*32*4,32,1,16,2);
+	init_encode_settings(&settings);
+	settings.context = &context;
+	allocations = 0;
+	for (pass = 0; pass < 2 && !failure; pass++)
+	{
+		init_xpm_stats(&stats);
+		settings.stats = &stats;
+		input.SetSize(0);
+		input.Seek(0,SEEK_SET);
+		output.SetSize(0);
+		output.Seek(0,SEEK_SET);
+		oldXPM.Seek(0,SEEK_SET);
+		write_bits(pixels,32,32,&input);
+		input.Seek(0,SEEK_SET);
+		if (updateXPM(&oldXPM,&input,5,5,&output,&settings) != B_OK)
+			failure = "updating failed";
+		else if (stats.allocs == 0 || stats.peakBytes == 0)
+			failure = "the update was not counted";
+		else if (stats.heapBytes != 0)
+			failure = "the update didn't free all it took";
+		else if (pass == 1 && context.Allocations() != allocations)
+			failure = "a second update took new memory from the context";
+		allocations = context.Allocations();
+	}
+	if (!failure && (decode_pixels(&output,&bits,&width,&height) != B_OK
+		|| width != 32 || height != 32 || memcmp(bits,pixels,sizeof(pixels))))
+		failure = "the update doesn't decode to the new pixels";
+	free(bits);
+	return failure;
+}
+
+//	check_decode_mapped_output()
+//	a bitmap too large to write a row at a time is the same whether it is
+//	decoded into a file that can be mapped, one opened only for writing,
+//	which can't, or memory.
+const char *check_decode_mapped_output(void)
+{
+	static const uint32 modes[2] = { B_READ_WRITE, B_WRITE_ONLY };
+	const int width = 640, height = 480;
+	uint8 *pixels, *bits;
+	BMallocIO xpm, expected;
+	BFile file;
+	const char *failure = NULL;
+	char *directory, path[B_PATH_NAME_LENGTH];
+	ssize_t length;
+	int i;
+
+	pixels = (uint8 *)malloc((size_t)4*width*height);
+	if (!pixels)
+		return "out of memory";
+	make_pixels(pixels,width,height,64,3);
+	if (encode_pixels(pixels,4*width,B_RGBA32,width,height,NULL,&xpm) != B_OK)
+		failure = "encoding failed";
+	xpm.Seek(0,SEEK_SET);
+	if (!failure && fromXPM(&xpm,&expected) != B_OK)
+		failure = "decoding into memory failed";
+	directory = failure ? NULL : make_scratch_directory();
+	if (!failure && !directory)
+		failure = "can't make a directory";
+	bits = (uint8 *)malloc(expected.BufferLength());
+	for (i = 0; i < 2 && !failure; i++)
+	{
+		snprintf(path,sizeof(path),"%s/out%d.bits",directory,i);
+		xpm.Seek(0,SEEK_SET);
+		if (file.SetTo(path,modes[i] | B_CREATE_FILE | B_ERASE_FILE) != B_OK
+			|| fromXPM(&xpm,&file) != B_OK)
+			failure = "decoding into a file failed";
+		else if (file.Position() != (off_t)expected.BufferLength())
+			failure = "decoding into a file left it at the wrong position";
+		file.Unset();
+		if (failure)
+			break;
+		file.SetTo(path,B_READ_ONLY);
+		length = file.Read(bits,expected.BufferLength());
+		if (length != (ssize_t)expected.BufferLength() || memcmp(bits,expected.Buffer(),length))
+			failure = i ? "the file opened only for writing differs" : "the mapped file differs";
+		file.Unset();
+	}
+	free(bits);
+	free(pixels);
+	if (directory)
+		remove_scratch_directory(directory);
+	return failure;
+}
+
+//	check_strips_quantize()
+//	a bitmap encoded in strips, to stay within a memory limit, is reduced
+//	to the same colors, and written the same, as when it is encoded whole:
+//	with either quantizer, with and without dithering, with transparency,
+//	and from an indexed color space.
+const char *check_strips_quantize(void)
+{
+	const int width = 96, height = 80;
+	uint8 pixels[96*80*4], indices[96*80];
+	xpm_encode_settings settings;
+	BMallocIO whole, strips;
+	const char *failure = NULL;
+	int i, quantizer, dither;
+
+	make_pixels(pixels,width,height,200,4);
+	for (i = 0; i < width; i += 7)
+		memcpy(pixels + 4*i,"\x77\x74\x77\x00",4);
+	for (i = 0; i < width*height; i++)
+		indices[i] = pixels[4*i] ^ pixels[4*i + 2];
+	init_encode_settings(&settings);
+	settings.deterministic = true;
+	settings.maxColors = 24;
+	for (i = 0; i < 2 && !failure; i++)
+		for (quantizer = 0; quantizer < 2 && !failure; quantizer++)
+			for (dither = 0; dither < 2 && !failure; dither++)
+			{
+				settings.quantizer = quantizer ? XPM_QUANTIZE_OCTREE : XPM_QUANTIZE_MEDIAN_CUT;
+				settings.dither = dither;
+				whole.SetSize(0);
+				whole.Seek(0,SEEK_SET);
+				strips.SetSize(0);
+				strips.Seek(0,SEEK_SET);
+				settings.memoryLimit = 0;
+				if (i ? encode_pixels(indices,width,B_CMAP8,width,height,&settings,&whole)
+					: encode_pixels(pixels,4*width,B_RGBA32,width,height,&settings,&whole))
+					failure = "encoding whole failed";
+				settings.memoryLimit = 4096;
+				if (!failure
+					&& (i ? encode_pixels(indices,width,B_CMAP8,width,height,&settings,&strips)
+						: encode_pixels(pixels,4*width,B_RGBA32,width,height,&settings,&strips)))
+					failure = "encoding in strips failed";
+				else if (!failure && xpm_color_count(&strips) > settings.maxColors)
+					failure = "strips wrote more colors than the limit";
+				else if (!failure && (whole.BufferLength() != strips.BufferLength()
+					|| memcmp(whole.Buffer(),strips.Buffer(),whole.BufferLength())))
+					failure = "strips differ from the whole bitmap";
+			}
+	return failure;
+}
+
+//	check_round_trip()
+//	what is encoded decodes to the same pixels, transparency included: as
+//	XPM3 and XPM2, gzipped or not, with one and with two characters to a
+//	pixel, and from B_GRAY8.
+const char *check_round_trip(void)
+{
+	static const int colors[2] = { 16, 200 };
+	const int width = 48, height = 40;
+	uint8 pixels[48*40*4], gray[48*40];
+	uint8 *bits = NULL;
+	xpm_encode_settings settings;
+	BMallocIO xpm;
+	const char *failure = NULL;
+	const uint8 *text;
+	int i, format, gzip, decodedWidth, decodedHeight;
+
+	init_encode_settings(&settings);
+	for (i = 0; i < 2 && !failure; i++)
+		for (format = 0; format < 2 && !failure; format++)
+			for (gzip = 0; gzip < 2 && !failure; gzip++)
+			{
+				make_pixels(pixels,width,height,colors[i],5);
+				add_transparency(pixels,width,height);
+				settings.format = format ? XPM_FORMAT_XPM2 : XPM_FORMAT_XPM3;
+				settings.gzip = gzip;
+				clear_output(&xpm);
+				if (encode_pixels(pixels,4*width,B_RGBA32,width,height,&settings,&xpm) != B_OK)
+				{
+					failure = "encoding failed";
+					break;
+				}
+				text = (const uint8 *)xpm.Buffer();
+				if (gzip && (text[0] != 0x1f || text[1] != 0x8b))
+					failure = "gzip was asked for and not written";
+				else if (!gzip && format
+					&& strncmp((const char *)text,XPM2_HEADER,strlen(XPM2_HEADER)))
+					failure = "XPM2 was asked for and not written";
+				else if (!gzip && !format
+					&& strncmp((const char *)text,XPM_HEADER,strlen(XPM_HEADER)))
+					failure = "XPM3 was asked for and not written";
+				else if (decode_pixels(&xpm,&bits,&decodedWidth,&decodedHeight) != B_OK
+					|| decodedWidth != width || decodedHeight != height)
+					failure = "decoding failed";
+				else if (memcmp(bits,pixels,sizeof(pixels)))
+					failure = "the pixels came back different";
+				free(bits);
+				bits = NULL;
+			}
+	if (failure)
+		return failure;
+
+	for (i = 0; i < width*height; i++)
+		gray[i] = i*7;
+	clear_output(&xpm);
+	if (encode_pixels(gray,width,B_GRAY8,width,height,NULL,&xpm) != B_OK)
+		failure = "encoding B_GRAY8 failed";
+	else if (decode_pixels(&xpm,&bits,&decodedWidth,&decodedHeight) != B_OK
+		|| decodedWidth != width || decodedHeight != height)
+		failure = "decoding B_GRAY8 failed";
+	else if (!same_gray(gray,bits,width*height))
+		failure = "the B_GRAY8 pixels came back different";
+	free(bits);
+	return failure;
+}
+
+//	check_strips_exact()
+//	with every color written exactly, a bitmap encoded in strips is
+//	written byte for byte as when it is encoded whole, in each format.
+const char *check_strips_exact(void)
+{
+	const int width = 96, height = 80;
+	uint8 pixels[96*80*4];
+	xpm_encode_settings settings;
+	BMallocIO whole, strips;
+	const char *failure = NULL;
+	int format, gzip;
+
+	make_pixels(pixels,width,height,300,6);
+	add_transparency(pixels,width,height);
+	init_encode_settings(&settings);
+	settings.deterministic = true;
+	for (format = 0; format < 2 && !failure; format++)
+		for (gzip = 0; gzip < 2 && !failure; gzip++)
+		{
+			settings.format = format ? XPM_FORMAT_XPM2 : XPM_FORMAT_XPM3;
+			settings.gzip = gzip;
+			clear_output(&whole);
+			clear_output(&strips);
+			settings.memoryLimit = 0;
+			if (encode_pixels(pixels,4*width,B_RGBA32,width,height,&settings,&whole) != B_OK)
+				failure = "encoding whole failed";
+			settings.memoryLimit = 4096;
+			if (!failure
+				&& encode_pixels(pixels,4*width,B_RGBA32,width,height,&settings,&strips) != B_OK)
+				failure = "encoding in strips failed";
+			else if (!failure && !same_output(&whole,&strips))
+				failure = "strips differ from the whole bitmap";
+		}
+	return failure;
+}
+
+//	check_parallel_serial()
+//	a bitmap large enough to be split into row bands encodes, quantizes
+//	and decodes the same on eight bands as on one.
+const char *check_parallel_serial(void)
+{
+	static const char *cpuCounts[2] = { "1", "8" };
+	const int width = 320, height = 240;
+	uint8 *pixels;
+	xpm_encode_settings settings;
+	BMallocIO output[2][4];
+	const char *failure = NULL;
+	char *saved;
+	int i;
+
+	pixels = (uint8 *)malloc((size_t)4*width*height);
+	if (!pixels)
+		return "out of memory";
+	make_pixels(pixels,width,height,250,7);
+	add_transparency(pixels,width,height);
+	saved = getenv("XPM_CPU_COUNT") ? strdup(getenv("XPM_CPU_COUNT")) : NULL;
+	for (i = 0; i < 2 && !failure; i++)
+	{
+		setenv("XPM_CPU_COUNT",cpuCounts[i],1);
+		if (count_row_bands(width,height) != atoi(cpuCounts[i]))
+		{
+			failure = "the bitmap isn't split into as many bands as CPUs";
+			break;
+		}
+		init_encode_settings(&settings);
+		settings.deterministic = true;
+		if (encode_pixels(pixels,4*width,B_RGBA32,width,height,&settings,&output[i][0]) != B_OK)
+			failure = "encoding failed";
+		settings.maxColors = 32;
+		settings.dither = true;
+		if (!failure
+			&& encode_pixels(pixels,4*width,B_RGBA32,width,height,&settings,&output[i][1]) != B_OK)
+			failure = "quantizing with median cut failed";
+		settings.quantizer = XPM_QUANTIZE_OCTREE;
+		if (!failure
+			&& encode_pixels(pixels,4*width,B_RGBA32,width,height,&settings,&output[i][2]) != B_OK)
+			failure = "quantizing with an octree failed";
+		output[i][0].Seek(0,SEEK_SET);
+		if (!failure && fromXPM(&output[i][0],&output[i][3]) != B_OK)
+			failure = "decoding failed";
+	}
+	if (saved)
+	{
+		setenv("XPM_CPU_COUNT",saved,1);
+		free(saved);
+	}
+	else
+		unsetenv("XPM_CPU_COUNT");
+	free(pixels);
+	if (failure)
+		return failure;
+	if (!same_output(&output[0][0],&output[1][0]))
+		return "encoding on eight bands differs from one";
+	if (!same_output(&output[0][1],&output[1][1]))
+		return "median cut on eight bands differs from one";
+	if (!same_output(&output[0][2],&output[1][2]))
+		return "the octree on eight bands differs from one";
+	if (!same_output(&output[0][3],&output[1][3]))
+		return "decoding on eight bands differs from one";
+	return NULL;
+}
+
+//	check_cache_hit()
+//	the second time a bitmap is encoded through a cache, its XPM is read
+//	from the entry the first time left: an entry altered in between comes
+//	back altered.  Other settings don't find it.
+const char *check_cache_hit(void)
+{
+	const int width = 32, height = 24;
+	uint8 pixels[32*24*4];
+	xpm_encode_settings settings;
+	BMallocIO first, second, other;
+	const char *failure = NULL;
+	char *directory, path[B_PATH_NAME_LENGTH];
+	struct dirent *entry;
+	DIR *dir;
+	FILE *file;
+	int entries = 0;
+
+	make_pixels(pixels,width,height,40,8);
+	directory = make_scratch_directory();
+	if (!directory)
+		return "can't make a cache directory";
+	init_encode_settings(&settings);
+	settings.deterministic = true;
+	settings.cacheDirectory = directory;
+	if (encode_pixels(pixels,4*width,B_RGBA32,width,height,&settings,&first) != B_OK)
+		failure = "encoding failed";
+
+	dir = failure ? NULL : opendir(directory);
+	if (dir)
+	{
+		while ((entry = readdir(dir)) != NULL)
+			if (strcmp(entry->d_name,".") && strcmp(entry->d_name,".."))
+			{
+				snprintf(path,sizeof(path),"%s/%s",directory,entry->d_name);
+				entries++;
+			}
+		closedir(dir);
+	}
+	if (!failure && entries != 1)
+		failure = "encoding didn't leave one cache entry";
+
+//	the XPM ends the entry; its last byte is replaced
+	file = failure ? NULL : fopen(path,"r+b");
+	if (!failure && (!file || fseek(file,-1,SEEK_END) || fputc('X',file) == EOF))
+		failure = "can't alter the cache entry";
+	if (file)
+		fclose(file);
+	if (!failure && encode_pixels(pixels,4*width,B_RGBA32,width,height,&settings,&second) != B_OK)
+		failure = "encoding again failed";
+	else if (!failure && (second.BufferLength() != first.BufferLength()
+		|| memcmp(second.Buffer(),first.Buffer(),first.BufferLength() - 1)
+		|| ((const char *)second.Buffer())[second.BufferLength() - 1] != 'X'))
+		failure = "encoding again didn't read the cache entry";
+
+	settings.format = XPM_FORMAT_XPM2;
+	if (!failure && encode_pixels(pixels,4*width,B_RGBA32,width,height,&settings,&other) != B_OK)
+		failure = "encoding as XPM2 failed";
+	else if (!failure && strncmp((const char *)other.Buffer(),XPM2_HEADER,strlen(XPM2_HEADER)))
+		failure = "XPM2 was given the XPM3 entry";
+	remove_scratch_directory(directory);
+	return failure;
+}
+
+//	check_stats()
+//	the counters of a translation add up to what it read and wrote, and
+//	everything it allocated was freed.
+const char *check_stats(void)
+{
+	const int width = 64, height = 48;
+	uint8 pixels[64*48*4];
+	xpm_encode_settings settings;
+	xpm_stats stats;
+	BMallocIO input, xpm, bits;
+
+	make_pixels(pixels,width,height,120,9);
+	write_bits(pixels,width,height,&input);
+	input.Seek(0,SEEK_SET);
+	init_encode_settings(&settings);
+	settings.stats = &stats;
+	if (toXPM(&input,&xpm,&settings) != B_OK)
+		return "encoding failed";
+	if (stats.bytesRead != input.BufferLength() || stats.bytesWritten != xpm.BufferLength())
+		return "encoding counted the wrong number of bytes";
+	if (stats.reads == 0 || stats.writes == 0)
+		return "encoding counted no calls";
+	if (stats.ncolors != xpm_color_count(&xpm) || stats.cpp != 2)
+		return "encoding counted the wrong colors";
+	if (stats.allocs == 0 || stats.peakBytes == 0 || stats.heapBytes != 0)
+		return "encoding's memory doesn't add up";
+
+	xpm.Seek(0,SEEK_SET);
+	if (fromXPM(&xpm,&bits,&stats) != B_OK)
+		return "decoding failed";
+	if (stats.bytesRead != xpm.BufferLength() || stats.bytesWritten != bits.BufferLength())
+		return "decoding counted the wrong number of bytes";
+	if (stats.ncolors != xpm_color_count(&xpm) || stats.probes == 0)
+		return "decoding counted the wrong colors";
+	if (stats.allocs == 0 || stats.heapBytes != 0)
+		return "decoding's memory doesn't add up";
+	return NULL;
+}
+
+//	check_trace()
+//	a trace holds a begun and ended span for each translation, and every
+//	span begun is ended.
+const char *check_trace(void)
+{
+	const int width = 64, height = 48;
+	uint8 pixels[64*48*4];
+	BMallocIO xpm, bits, trace;
+	const char *failure = NULL;
+	char *directory, path[B_PATH_NAME_LENGTH];
+	const char *text, *event;
+	int begun = 0, ended = 0;
+
+	make_pixels(pixels,width,height,20,10);
+	directory = make_scratch_directory();
+	if (!directory)
+		return "can't make a directory";
+	snprintf(path,sizeof(path),"%s/trace.json",directory);
+	if (start_xpm_trace(path) != B_OK)
+		failure = "can't start a trace";
+	else
+	{
+		if (encode_pixels(pixels,4*width,B_RGBA32,width,height,NULL,&xpm) != B_OK)
+			failure = "encoding failed";
+		xpm.Seek(0,SEEK_SET);
+		if (!failure && fromXPM(&xpm,&bits) != B_OK)
+			failure = "decoding failed";
+		stop_xpm_trace();
+	}
+	if (!failure && (read_file(path,&trace) != B_OK || trace.Write("",1) != 1))
+		failure = "can't read the trace";
+	text = (const char *)trace.Buffer();
+	if (!failure && (text[0] != '[' || !strstr(text,"\n]\n")))
+		failure = "the trace isn't a JSON array";
+	else if (!failure && (!strstr(text,"{\"name\":\"toXPM\",\"cat\":\"xpm\",\"ph\":\"B\"")
+		|| !strstr(text,"{\"name\":\"toXPM\",\"cat\":\"xpm\",\"ph\":\"E\"")))
+		failure = "encoding left no span";
+	else if (!failure && (!strstr(text,"{\"name\":\"fromXPM\",\"cat\":\"xpm\",\"ph\":\"B\"")
+		|| !strstr(text,"{\"name\":\"fromXPM\",\"cat\":\"xpm\",\"ph\":\"E\"")))
+		failure = "decoding left no span";
+	for (event = text; !failure && (event = strstr(event,"\"ph\":\"")) != NULL; event += 6)
+		if (event[6] == 'B')
+			begun++;
+		else if (event[6] == 'E')
+			ended++;
+	if (!failure && begun != ended)
+		failure = "spans were begun and not ended";
+	remove_scratch_directory(directory);
+	return failure;
+}
+
+//	check_filter_round_trip()
+//	raw rows through xpmfilter to XPM, in strips and gzipped or not, and
+//	back, are what went in.
+const char *check_filter_round_trip(void)
+{
+	const int width = 64, height = 48;
+	uint8 pixels[64*48*4];
+	BMallocIO rows;
+	const char *failure = NULL;
+	char *directory, path[B_PATH_NAME_LENGTH];
+	FILE *file;
+	int gzip;
+
+	if (!sToolDirectory)
+		return kSkipped;
+	make_pixels(pixels,width,height,100,11);
+	directory = make_scratch_directory();
+	if (!directory)
+		return "can't make a directory";
+	snprintf(path,sizeof(path),"%s/in.rgba",directory);
+	file = fopen(path,"wb");
+	if (!file || fwrite(pixels,1,sizeof(pixels),file) != sizeof(pixels))
+		failure = "can't write the rows";
+	if (file)
+		fclose(file);
+	for (gzip = 0; gzip < 2 && !failure; gzip++)
+	{
+		clear_output(&rows);
+		snprintf(path,sizeof(path),"%s/out.rgba",directory);
+		if (run_tool("%s/xpmfilter --to=xpm --from=rgba --size=%dx%d --memory-limit=4096 %s"
+				" < %s/in.rgba > %s/out.xpm",sToolDirectory,width,height,gzip ? "--gzip" : "",
+				directory,directory)
+			|| run_tool("%s/xpmfilter --to=rgba < %s/out.xpm > %s/out.rgba",
+				sToolDirectory,directory,directory))
+			failure = "xpmfilter failed";
+		else if (read_file(path,&rows) != B_OK || rows.BufferLength() != sizeof(pixels)
+			|| memcmp(rows.Buffer(),pixels,sizeof(pixels)))
+			failure = gzip ? "the gzipped rows came back different"
+				: "the rows came back different";
+	}
+	remove_scratch_directory(directory);
+	return failure;
+}
+
+//	check_convert_matches_filter()
+//	xpmconvert and xpmfilter decode an XPM to the same bits as fromXPM().
+const char *check_convert_matches_filter(void)
+{
+	const int width = 64, height = 48;
+	uint8 pixels[64*48*4];
+	BMallocIO xpm, expected, converted, filtered;
+	const char *failure = NULL;
+	char *directory, path[B_PATH_NAME_LENGTH];
+	FILE *file;
+
+	if (!sToolDirectory)
+		return kSkipped;
+	make_pixels(pixels,width,height,100,12);
+	add_transparency(pixels,width,height);
+	if (encode_pixels(pixels,4*width,B_RGBA32,width,height,NULL,&xpm) != B_OK)
+		return "encoding failed";
+	xpm.Seek(0,SEEK_SET);
+	if (fromXPM(&xpm,&expected) != B_OK)
+		return "decoding failed";
+	directory = make_scratch_directory();
+	if (!directory)
+		return "can't make a directory";
+	snprintf(path,sizeof(path),"%s/in.xpm",directory);
+	file = fopen(path,"wb");
+	if (!file || fwrite(xpm.Buffer(),1,xpm.BufferLength(),file) != xpm.BufferLength())
+		failure = "can't write the XPM";
+	if (file)
+		fclose(file);
+	if (!failure && run_tool("%s/xpmconvert --to=bits %s/in.xpm > /dev/null 2>&1",
+		sToolDirectory,directory))
+		failure = "xpmconvert failed";
+	snprintf(path,sizeof(path),"%s/in.bits",directory);
+	if (!failure && (read_file(path,&converted) != B_OK || !same_output(&converted,&expected)))
+		failure = "xpmconvert's bits differ from fromXPM()'s";
+	if (!failure && run_tool("%s/xpmfilter --to=bits < %s/in.xpm > %s/filtered.bits",
+		sToolDirectory,directory,directory))
+		failure = "xpmfilter failed";
+	snprintf(path,sizeof(path),"%s/filtered.bits",directory);
+	if (!failure && (read_file(path,&filtered) != B_OK || !same_output(&filtered,&expected)))
+		failure = "xpmfilter's bits differ from fromXPM()'s";
+	remove_scratch_directory(directory);
+	return failure;
+}
+
+//	check_translator_identify()
+//	the add-on tells XPM from bits and from anything else, and translates
+//	XPM to the bits fromXPM() gives.
+const char *check_translator_identify(void)
+{
+	const int width = 24, height = 16;
+	uint8 pixels[24*16*4];
+	BMallocIO xpm, bits, expected, translated;
+	BMemoryIO junk("neither XPM nor bits",20);
+	translator_info info;
+
+	make_pixels(pixels,width,height,30,13);
+	write_bits(pixels,width,height,&bits);
+	if (encode_pixels(pixels,4*width,B_RGBA32,width,height,NULL,&xpm) != B_OK)
+		return "encoding failed";
+	xpm.Seek(0,SEEK_SET);
+	if (fromXPM(&xpm,&expected) != B_OK)
+		return "decoding failed";
+
+	xpm.Seek(0,SEEK_SET);
+	if (Identify(&xpm,NULL,NULL,&info,0) != B_OK || info.type != inputFormats[0].type)
+		return "XPM wasn't identified";
+	bits.Seek(0,SEEK_SET);
+	if (Identify(&bits,NULL,NULL,&info,0) != B_OK || info.type != B_TRANSLATOR_BITMAP)
+		return "bits weren't identified";
+	if (Identify(&junk,NULL,NULL,&info,0) != B_NO_TRANSLATOR)
+		return "something else was identified";
+
+	xpm.Seek(0,SEEK_SET);
+	if (Translate(&xpm,&info,NULL,B_TRANSLATOR_BITMAP,&translated) != B_OK)
+		return "translating XPM failed";
+	if (!same_output(&translated,&expected))
+		return "the translated bits differ from fromXPM()'s";
+	return NULL;
+}
+
+//	check_cpp_boundary()
+//	XPM_CHAR_COUNT colors take one character a pixel, and one more color
+//	takes two.  Every pixel string is its own, free of the characters C
+//	would read otherwise, and the colors are separated as C array members.
+const char *check_cpp_boundary(void)
+{
+	const int width = 16, height = 8;
+	uint8 pixels[16*8*4];
+	uint8 *bits = NULL;
+	quoted_string strings[1 + XPM_CHAR_COUNT + 1 + 8];
+	BMallocIO xpm;
+	const char *failure = NULL, *text;
+	int i, j, k, ncolors, cpp, count, decodedWidth, decodedHeight;
+
+	for (i = 0; i < 2 && !failure; i++)
+	{
+		ncolors = XPM_CHAR_COUNT + i;
+		make_cycle_pixels(pixels,width,height,ncolors);
+		clear_output(&xpm);
+		if (encode_pixels(pixels,4*width,B_RGBA32,width,height,NULL,&xpm) != B_OK)
+			return "encoding failed";
+		text = (const char *)xpm.Buffer();
+		count = quoted_strings(&xpm,strings,sizeof(strings)/sizeof(strings[0]));
+		if (count != 1 + ncolors + height
+			|| sscanf(text + strings[0].start,"%*d %*d %d %d",&k,&cpp) != 2 || k != ncolors)
+			return "the XPM doesn't have the strings it should";
+		if (cpp != 1 + i)
+			return i ? "one color more than the character set didn't take two characters"
+				: "as many colors as the character set took more than one character";
+		for (j = 1; j <= ncolors && !failure; j++)
+		{
+			if (strings[j].length <= (size_t)cpp || text[strings[j].start + cpp] != '\t')
+				failure = "a pixel string is the wrong length";
+			for (k = 0; k < cpp && !failure; k++)
+				if (text[strings[j].start + k] == '\\' || text[strings[j].start + k] == '?')
+					failure = "a pixel string holds a character C would read as more";
+			for (k = 1; k < j && !failure; k++)
+				if (!memcmp(text + strings[j].start,text + strings[k].start,cpp))
+					failure = "two colors have the same pixel string";
+			if (!failure && text[strings[j].start + strings[j].length + 1] != ',')
+				failure = "a color isn't followed by a comma";
+		}
+		if (!failure && (decode_pixels(&xpm,&bits,&decodedWidth,&decodedHeight) != B_OK
+			|| memcmp(bits,pixels,sizeof(pixels))))
+			failure = "the pixels came back different";
+		free(bits);
+		bits = NULL;
+	}
+	return failure;
+}
+
+//	check_unknown_settings()
+//	toXPM() refuses a quantizer or format it doesn't know, and the add-on
+//	leaves one given in the ioExtension message at its default.
+const char *check_unknown_settings(void)
+{
+	const int width = 24, height = 16;
+	uint8 pixels[24*16*4];
+	xpm_encode_settings settings;
+	BMallocIO bits, xpm, expected;
+	BMessage known, unknown;
+
+	make_pixels(pixels,width,height,60,14);
+	init_encode_settings(&settings);
+	settings.quantizer = 7;
+	if (encode_pixels(pixels,4*width,B_RGBA32,width,height,&settings,&xpm) != B_BAD_VALUE)
+		return "an unknown quantizer wasn't refused";
+	settings.quantizer = XPM_QUANTIZE_MEDIAN_CUT;
+	settings.format = -1;
+	if (encode_pixels(pixels,4*width,B_RGBA32,width,height,&settings,&xpm) != B_BAD_VALUE)
+		return "an unknown format wasn't refused";
+
+	known.AddInt32(XPM_EXT_MAX_COLORS,8);
+	known.AddBool(XPM_EXT_DETERMINISTIC,true);
+	unknown.AddInt32(XPM_EXT_MAX_COLORS,8);
+	unknown.AddBool(XPM_EXT_DETERMINISTIC,true);
+	unknown.AddInt32(XPM_EXT_QUANTIZER,7);
+	unknown.AddInt32(XPM_EXT_FORMAT,9);
+	write_bits(pixels,width,height,&bits);
+	bits.Seek(0,SEEK_SET);
+	if (Translate(&bits,NULL,&known,inputFormats[0].type,&expected) != B_OK)
+		return "translating with the defaults failed";
+	bits.Seek(0,SEEK_SET);
+	clear_output(&xpm);
+	if (Translate(&bits,NULL,&unknown,inputFormats[0].type,&xpm) != B_OK)
+		return "translating with unknown values failed";
+	if (!same_output(&xpm,&expected))
+		return "unknown values weren't left at their defaults";
+	return NULL;
+}
+
+//	check_indexed()
+//	B_CMAP8, B_GRAY8 and B_GRAY1 bitmaps, encoded straight from their
+//	indices, list only the colors they use and decode to the colors of
+//	their indices, rows padded or not.
+const char *check_indexed(void)
+{
+	static const struct
+	{
+		color_space space;
+		int32 rowBytes;
+		int used;
+	}
+	cases[4] =
+	{
+		{ B_CMAP8, 16, 4 },
+		{ B_GRAY8, 13, 5 },
+		{ B_GRAY1, 2, 2 },
+		{ B_GRAY1, 4, 1 }
+	};
+	static const uint8 cmap[4] = { 3, 17, 200, 255 };
+	const int width = 13, height = 6;
+	uint8 data[16*6];
+	uint8 *bits = NULL;
+	rgb_color expected[13*6];
+	BMallocIO xpm;
+	const char *failure = NULL;
+	int c, i, j, decodedWidth, decodedHeight;
+
+	for (c = 0; c < 4 && !failure; c++)
+	{
+		memset(data,0,sizeof(data));
+		for (i = 0; i < height; i++)
+			for (j = 0; j < width; j++)
+			{
+				uint8 *row = data + i*cases[c].rowBytes;
+				int k = (i*width + j) % cases[c].used;
+
+				if (cases[c].space == B_CMAP8)
+					row[j] = cmap[k];
+				else if (cases[c].space == B_GRAY8)
+					row[j] = 40*k + 1;
+				else if (k)
+					row[j >> 3] |= 0x80 >> (j & 7);
+			}
+		for (i = 0; i < height; i++)
+			convert_row(cases[c].space,data + i*cases[c].rowBytes,width,expected + i*width);
+		clear_output(&xpm);
+		if (encode_pixels(data,cases[c].rowBytes,cases[c].space,width,height,NULL,&xpm) != B_OK)
+			failure = "encoding failed";
+		else if (xpm_color_count(&xpm) != cases[c].used)
+			failure = "the colors written aren't those used";
+		else if (decode_pixels(&xpm,&bits,&decodedWidth,&decodedHeight) != B_OK
+			|| decodedWidth != width || decodedHeight != height)
+			failure = "decoding failed";
+		else if (!same_colors(expected,bits,width*height))
+			failure = "the pixels came back as other colors than their indices'";
+		free(bits);
+		bits = NULL;
+	}
+	return failure;
+}
+
+//	check_cache_writers()
+//	two processes writing the same entry over and over, as two converters
+//	sharing a cache directory do, never leave half of one write and half
+//	of the other in it.
+const char *check_cache_writers(void)
+{
+	const size_t length = 256*1024;
+	const int rounds = 200;
+	uint8 first[16], second[16];
+	TranslatorBitmap bmap;
+	BMallocIO entry;
+	const char *failure = NULL;
+	const uint8 *t;
+	char *directory, *data;
+	pid_t child;
+	size_t j;
+	int i, status;
+
+	colliding_pair(first,second,&bmap);
+	directory = make_scratch_directory();
+	if (!directory)
+		return "can't make a cache directory";
+	data = (char *)malloc(length);
+	if (!data)
+	{
+		remove_scratch_directory(directory);
+		return "out of memory";
+	}
+	child = fork();
+	if (child < 0)
+		failure = "can't fork";
+	else if (child == 0)
+	{
+		memset(data,'c',length);
+		for (i = 0; i < rounds; i++)
+			if (write_cached_xpm(directory,1,&bmap,data,length) != B_OK)
+				_exit(1);
+		_exit(0);
+	}
+	memset(data,'p',length);
+	for (i = 0; i < rounds && !failure; i++)
+	{
+		if (write_cached_xpm(directory,1,&bmap,data,length) != B_OK)
+			failure = "writing the entry failed";
+		clear_output(&entry);
+		if (!failure && read_cached_xpm(directory,1,&bmap,&entry) != B_OK)
+			failure = "reading the entry failed";
+		t = (const uint8 *)entry.Buffer();
+		if (!failure && entry.BufferLength() != length)
+			failure = "the entry is the wrong length";
+		for (j = 1; j < entry.BufferLength() && !failure; j++)
+			if (t[j] != t[0])
+				failure = "the entry holds parts of two writes";
+	}
+	if (child > 0 && (waitpid(child,&status,0) != child || !WIFEXITED(status)
+		|| WEXITSTATUS(status)) && !failure)
+		failure = "the other writer failed";
+	free(data);
+	remove_scratch_directory(directory);
+	return failure;
+}
+
+//	check_update_rows()
+//	an update copies every row outside the changed range byte for byte
+//	from the old file, and everything around the rows too.  Changed rows
+//	of old colors leave the palette as it was; a new color is added after
+//	the old ones, which stay as they were.
+const char *check_update_rows(void)
+{
+	const int width = 32, height = 32;
+	uint8 pixels[32*32*4];
+	quoted_string before[1 + 16 + 32], after[1 + 17 + 32];
+	BMallocIO oldXPM, output, expected;
+	const char *text, *values;
+	int i, ncolors, newColors, cpp;
+
+	make_pixels(pixels,width,height,16,15);
+	if (encode_pixels(pixels,4*width,B_RGBA32,width,height,NULL,&oldXPM) != B_OK)
+		return "encoding failed";
+	if (quoted_strings(&oldXPM,before,sizeof(before)/sizeof(before[0])) != 1 + 16 + height)
+		return "the old XPM doesn't have 16 colors";
+
+//	rows 5 and 6 become copies of rows 10 and 11: the new file is the old
+//	one with those two row strings replaced, and nothing else
+	memcpy(pixels + 5*4*width,pixels + 10*4*width,2*4*width);
+	if (update_pixels(&oldXPM,pixels,width,height,5,6,NULL,&output) != B_OK)
+		return "updating with old colors failed";
+	expected.Write(oldXPM.Buffer(),oldXPM.BufferLength());
+	for (i = 5; i <= 6; i++)
+		expected.WriteAt(before[1 + 16 + i].start,
+			(const char *)oldXPM.Buffer() + before[1 + 16 + i + 5].start,before[1 + 16 + i].length);
+	if (!same_output(&output,&expected))
+		return "an update in old colors changed more than its rows";
+
+//	row 7 gets a color of its own
+	memcpy(pixels + 7*4*width + 4*3,"\x01\x02\x03\xff",4);
+	clear_output(&output);
+	if (update_pixels(&oldXPM,pixels,width,height,7,7,NULL,&output) != B_OK)
+		return "updating with a new color failed";
+	text = (const char *)output.Buffer();
+	if (quoted_strings(&output,after,sizeof(after)/sizeof(after[0])) != 1 + 17 + height)
+		return "an update with a new color doesn't have one color more";
+	values = text + after[0].start;
+	if (sscanf(values,"%*d %*d %d %d",&newColors,&cpp) != 2
+		|| sscanf((const char *)oldXPM.Buffer() + before[0].start,"%*d %*d %d",&ncolors) != 1
+		|| newColors != ncolors + 1 || cpp != 1)
+		return "the value string doesn't count the new color";
+	if (!same_text(&oldXPM,0,&output,0,before[0].start))
+		return "the text before the value string changed";
+	for (i = 1; i <= 16; i++)
+		if (!same_string(&oldXPM,&before[i],&output,&after[i])
+			|| !same_text(&oldXPM,before[i - 1].start + before[i - 1].length,
+				&output,after[i - 1].start + after[i - 1].length,
+				before[i].start - before[i - 1].start - before[i - 1].length))
+			return "an old color changed";
+	for (i = 1; i <= 16; i++)
+		if (!memcmp(text + after[17].start,text + after[i].start,cpp))
+			return "the new color took an old color's pixel string";
+	if (after[17].length != (size_t)cpp + 10
+		|| strncmp(text + after[17].start + cpp,"\tc\t#030201",10))
+		return "the new color isn't added after the old ones";
+	for (i = 0; i < height; i++)
+		if (i != 7 && !same_string(&oldXPM,&before[1 + 16 + i],&output,&after[1 + 17 + i]))
+			return "a row outside the changed range changed";
+	for (i = 1; i < height; i++)
+		if (!same_text(&oldXPM,before[16 + i].start + before[16 + i].length,
+				&output,after[17 + i].start + after[17 + i].length,
+				before[1 + 16 + i].start - before[16 + i].start - before[16 + i].length))
+			return "the text between the rows changed";
+	if (!same_text(&oldXPM,before[16 + height].start + before[16 + height].length,
+			&output,after[17 + height].start + after[17 + height].length,
+			oldXPM.BufferLength() - before[16 + height].start - before[16 + height].length))
+		return "the text after the rows changed";
+	return NULL;
+}
+
+//	check_update_palette_overflow()
+//	a new color that takes the palette past the settings' limit is not
+//	added; the bitmap is encoded afresh, within the limit.
+const char *check_update_palette_overflow(void)
+{
+	const int width = 32, height = 16;
+	uint8 pixels[32*16*4], changed[32*16*4];
+	xpm_encode_settings settings;
+
+	make_pixels(pixels,width,height,16,16);
+	memcpy(changed,pixels,sizeof(pixels));
+	memcpy(changed + 3*4*width,"\x01\x02\x03\xff",4);
+	init_encode_settings(&settings);
+	settings.maxColors = 16;
+	return check_update_fallback(pixels,width,height,changed,width,height,&settings);
+}
+
+//	check_update_cpp_growth()
+//	a new color that doesn't fit in the old characters a pixel is not
+//	added; the bitmap is encoded afresh, with more of them.
+const char *check_update_cpp_growth(void)
+{
+	const int width = 16, height = 8;
+	uint8 pixels[16*8*4], changed[16*8*4];
+
+	make_cycle_pixels(pixels,width,height,XPM_CHAR_COUNT);
+	memcpy(changed,pixels,sizeof(pixels));
+	put_color(changed + 4*(width*height - 1),XPM_CHAR_COUNT);
+	return check_update_fallback(pixels,width,height,changed,width,height,NULL);
+}
+
+//	check_update_size_change()
+//	a bitmap of another size than the old file is encoded afresh.
+const char *check_update_size_change(void)
+{
+	const int width = 16, height = 8;
+	uint8 pixels[16*8*4], changed[16*9*4];
+
+	make_pixels(pixels,width,height,10,17);
+	memcpy(changed,pixels,sizeof(pixels));
+	make_pixels(changed + sizeof(pixels),width,1,10,18);
+	return check_update_fallback(pixels,width,height,changed,width,height + 1,NULL);
+}
+
+//	check_update_fallback()
+//	update the XPM of "pixels" to "changed", every row of which may have
+//	changed, and check that it comes out as toXPM() encodes "changed".
+const char *check_update_fallback(const uint8 *pixels, int width, int height,
+	const uint8 *changed, int newWidth, int newHeight, const xpm_encode_settings *settings)
+{
+	BMallocIO oldXPM, output, expected;
+
+	if (encode_pixels(pixels,4*width,B_RGBA32,width,height,settings,&oldXPM) != B_OK)
+		return "encoding the old bitmap failed";
+	if (update_pixels(&oldXPM,changed,newWidth,newHeight,0,newHeight - 1,settings,&output) != B_OK)
+		return "updating failed";
+	if (encode_pixels(changed,4*newWidth,B_RGBA32,newWidth,newHeight,settings,&expected) != B_OK)
+		return "encoding the new bitmap failed";
+	if (!same_body(&output,&expected))
+		return "the update wasn't encoded afresh";
+	return NULL;
+}
+
+//	update_pixels()
+//	update "oldXPM" to the B_RGBA32 "pixels", of which rows "first"
+//	through "last" changed, into "output".
+status_t update_pixels(BMallocIO *oldXPM, const uint8 *pixels, int width, int height,
+	int first, int last, const xpm_encode_settings *settings, BMallocIO *output)
+{
+	BMallocIO input;
+	status_t err;
+
+	err = write_bits(pixels,width,height,&input);
+	if (err != B_OK)
+		return err;
+	input.Seek(0,SEEK_SET);
+	oldXPM->Seek(0,SEEK_SET);
+	return updateXPM(oldXPM,&input,first,last,output,settings);
+}
+
+//	same_string()
+//	whether quoted string "a" of "first" is quoted string "b" of "second".
+bool same_string(BMallocIO *first, quoted_string *a, BMallocIO *second, quoted_string *b)
+{
+	return a->length == b->length && same_text(first,a->start,second,b->start,a->length);
+}
+
+//	same_text()
+//	whether the "length" bytes of "first" at "a" are those of "second" at
+//	"b".
+bool same_text(BMallocIO *first, size_t a, BMallocIO *second, size_t b, size_t length)
+{
+	return a + length <= first->BufferLength() && b + length <= second->BufferLength()
+		&& !memcmp((const char *)first->Buffer() + a,(const char *)second->Buffer() + b,length);
+}
+
+//	same_body()
+//	whether two XPMs are the same from their value strings on, whatever
+//	their arrays are named.
+bool same_body(BMallocIO *first, BMallocIO *second)
+{
+	const char *a = (const char *)memchr(first->Buffer(),'"',first->BufferLength());
+	const char *b = (const char *)memchr(second->Buffer(),'"',second->BufferLength());
+	size_t restA, restB;
+
+	if (!a || !b)
+		return false;
+	restA = first->BufferLength() - (a - (const char *)first->Buffer());
+	restB = second->BufferLength() - (b - (const char *)second->Buffer());
+	return restA == restB && !memcmp(a,b,restA);
+}
+
+//	check_encode_padded()
+//	rows of a bitmap in memory may be padded past their pixels; the
+//	padding is not part of the image, and must not change the output,
+//	whole or in strips.
+const char *check_encode_padded(void)
+{
+	const int width = 13, height = 9, pad = 7;
+	static const color_space spaces[] = { B_RGBA32, B_CMAP8, B_GRAY8 };
+	uint8 pixels[13*9*4], tight[13*9*4], padded[(13*4 + 7)*9];
+	xpm_encode_settings settings;
+	BMallocIO expected, output;
+	size_t pixelBytes;
+	int i, y, strips;
+
+	make_pixels(pixels,width,height,20,19);
+	init_encode_settings(&settings);
+	settings.deterministic = true;
+	for (i = 0; i < (int)(sizeof(spaces)/sizeof(spaces[0])); i++)
+		for (strips = 0; strips < 2; strips++)
+		{
+			pixelBytes = spaces[i] == B_RGBA32 ? 4 : 1;
+			for (y = 0; y < width*height; y++)
+				if (pixelBytes == 4)
+					memcpy(tight + 4*y,pixels + 4*y,4);
+				else
+					tight[y] = pixels[4*y];
+			memset(padded,0xa5,sizeof(padded));
+			for (y = 0; y < height; y++)
+				memcpy(padded + y*(pixelBytes*width + pad),tight + y*pixelBytes*width,
+					pixelBytes*width);
+			settings.memoryLimit = strips ? 256 : 0;
+			clear_output(&expected);
+			clear_output(&output);
+			if (encode_pixels(tight,pixelBytes*width,spaces[i],width,height,&settings,
+					&expected) != B_OK
+				|| encode_pixels(padded,pixelBytes*width + pad,spaces[i],width,height,&settings,
+					&output) != B_OK)
+				return "encoding failed";
+			if (!same_output(&output,&expected))
+				return strips ? "padded rows encode differently in strips"
+					: "padded rows encode differently";
+		}
+	return NULL;
+}
+
+//	check_decode_padded()
+//	decoding into memory whose rows are longer than the image, and which
+//	has rows to spare, fills in each row's pixels and leaves the rest of
+//	the memory alone.  The image is big enough to be decoded in bands.
+const char *check_decode_padded(void)
+{
+	const int width = 300, height = 240, pad = 12, spare = 2;
+	const int32 rowBytes = 4*width + pad;
+	const size_t size = (size_t)rowBytes*(height + spare);
+	uint8 *pixels, *bits = NULL, *padded;
+	BMallocIO xpm;
+	const char *failure = NULL;
+	size_t i;
+	int y, decodedWidth, decodedHeight;
+
+	pixels = (uint8 *)malloc((size_t)4*width*height);
+	padded = (uint8 *)malloc(size);
+	if (!pixels || !padded)
+	{
+		free(pixels);
+		free(padded);
+		return "out of memory";
+	}
+	make_pixels(pixels,width,height,200,21);
+	add_transparency(pixels,width,height);
+	memset(padded,0xa5,size);
+	if (encode_pixels(pixels,4*width,B_RGBA32,width,height,NULL,&xpm) != B_OK)
+		failure = "encoding failed";
+	else if (decode_pixels(&xpm,&bits,&decodedWidth,&decodedHeight) != B_OK)
+		failure = "decoding failed";
+	else
+	{
+		xpm.Seek(0,SEEK_SET);
+		if (fromXPM(&xpm,padded,rowBytes,BRect(0,0,width + 2,height + spare - 1)) != B_OK)
+			failure = "decoding into padded rows failed";
+	}
+	for (y = 0; y < height && !failure; y++)
+	{
+		if (memcmp(padded + (size_t)y*rowBytes,bits + (size_t)y*4*width,4*width))
+			failure = "a padded row was decoded differently";
+		for (i = 4*width; i < (size_t)rowBytes && !failure; i++)
+			if (padded[(size_t)y*rowBytes + i] != 0xa5)
+				failure = "the padding of a row was written";
+	}
+	for (i = (size_t)rowBytes*height; i < size && !failure; i++)
+		if (padded[i] != 0xa5)
+			failure = "a row past the image was written";
+	free(bits);
+	free(padded);
+	free(pixels);
+	return failure;
+}
+
+//	check_pass_through()
+//	copy_bitmap() copies the bitmap at the input's position, and nothing
+//	after it, byte for byte, whichever way it copies: out of memory, file
+//	to file, or through a buffer, into memory or into a file.
+const char *check_pass_through(void)
+{
+	static const char prefix[] = "before", suffix[] = "after";
+	BMallocIO bitmap, source, output, copied;
+	BMemoryIO *memory;
+	BFile from, to;
+	char *directory;
+	char inPath[B_PATH_NAME_LENGTH], outPath[B_PATH_NAME_LENGTH];
+	const char *failure = NULL;
+	off_t end;
+
+	make_bitmap_stream(&bitmap,NULL);
+	source.Write(prefix,sizeof(prefix));
+	source.Write(bitmap.Buffer(),bitmap.BufferLength());
+	source.Write(suffix,sizeof(suffix));
+	end = sizeof(prefix) + bitmap.BufferLength();
+
+	source.Seek(sizeof(prefix),SEEK_SET);
+	if (copy_bitmap(&source,&output) != B_OK || !same_output(&output,&bitmap))
+		return "copying out of memory changed the bitmap";
+	if (source.Position() != end)
+		return "copying out of memory left the input at the wrong position";
+
+	memory = new BMemoryIO(source.Buffer(),source.BufferLength());
+	memory->Seek(sizeof(prefix),SEEK_SET);
+	clear_output(&output);
+	if (copy_bitmap(memory,&output) != B_OK || !same_output(&output,&bitmap))
+		failure = "copying through a buffer changed the bitmap";
+	else if (memory->Position() != end)
+		failure = "copying through a buffer left the input at the wrong position";
+	delete memory;
+	if (failure)
+		return failure;
+
+	directory = make_scratch_directory();
+	if (!directory)
+		return "can't make a directory";
+	snprintf(inPath,sizeof(inPath),"%s/in.bits",directory);
+	snprintf(outPath,sizeof(outPath),"%s/out.bits",directory);
+	if (from.SetTo(inPath,B_READ_WRITE | B_CREATE_FILE | B_ERASE_FILE) != B_OK
+		|| from.Write(source.Buffer(),source.BufferLength()) != (ssize_t)source.BufferLength()
+		|| to.SetTo(outPath,B_WRITE_ONLY | B_CREATE_FILE | B_ERASE_FILE) != B_OK)
+		failure = "can't write the files";
+	from.Seek(sizeof(prefix),SEEK_SET);
+	if (!failure && (copy_bitmap(&from,&to) != B_OK || from.Position() != end
+		|| to.Position() != (off_t)bitmap.BufferLength()))
+		failure = "copying file to file failed";
+	to.Unset();
+	if (!failure && (read_file(outPath,&copied) != B_OK || !same_output(&copied,&bitmap)))
+		failure = "copying file to file changed the bitmap";
+	from.Seek(sizeof(prefix),SEEK_SET);
+	clear_output(&output);
+	if (!failure && (copy_bitmap(&from,&output) != B_OK || !same_output(&output,&bitmap)))
+		failure = "copying out of a file changed the bitmap";
+	from.Unset();
+	remove_scratch_directory(directory);
+	return failure;
+}
+
+//	check_translate_bits()
+//	Translate() asked for a bitmap from a bitmap hands it over as it is:
+//	pixels that an XPM can't hold, such as partial alpha, come out
+//	unchanged, and what follows the bitmap is left behind.
+const char *check_translate_bits(void)
+{
+	BMallocIO bitmap, input, output;
+
+	make_bitmap_stream(&bitmap,&input);
+	input.Write("after",5);
+	input.Seek(0,SEEK_SET);
+	if (Translate(&input,NULL,NULL,B_TRANSLATOR_BITMAP,&output) != B_OK)
+		return "translating failed";
+	if (!same_output(&output,&bitmap))
+		return "the bitmap wasn't handed over as it is";
+	return NULL;
+}
+
+//	check_xpm2_first_char()
+//	no line of an XPM2 file but its header begins with '!', which some
+//	readers take for a comment: pixel strings begin with one character
+//	fewer, and so need two characters a pixel one color sooner than XPM3.
+const char *check_xpm2_first_char(void)
+{
+	const int width = 16, height = 16;
+	static const int counts[] = { XPM_CHAR_COUNT - 1, XPM_CHAR_COUNT, 200 };
+	uint8 pixels[16*16*4];
+	uint8 *bits = NULL;
+	xpm_encode_settings settings;
+	BMallocIO xpm;
+	const char *failure = NULL, *text, *line, *end;
+	int i, lines, ncolors, cpp, decodedWidth, decodedHeight;
+
+	init_encode_settings(&settings);
+	settings.format = XPM_FORMAT_XPM2;
+	for (i = 0; i < (int)(sizeof(counts)/sizeof(counts[0])) && !failure; i++)
+	{
+		make_cycle_pixels(pixels,width,height,counts[i]);
+		clear_output(&xpm);
+		if (encode_pixels(pixels,4*width,B_RGBA32,width,height,&settings,&xpm) != B_OK)
+			return "encoding failed";
+		text = (const char *)xpm.Buffer();
+		end = text + xpm.BufferLength();
+		line = (const char *)memchr(text,'\n',end - text);
+		if (!line || sscanf(line + 1,"%*d %*d %d %d",&ncolors,&cpp) != 2 || ncolors != counts[i])
+			return "the XPM2 doesn't have the value line it should";
+		if (cpp != (counts[i] < XPM_CHAR_COUNT ? 1 : 2))
+			return "the XPM2 doesn't take the characters a pixel it should";
+		for (lines = 0; line && line + 1 < end; lines++)
+		{
+			if (line[1] == '!')
+				failure = "a line begins with '!'";
+			line = (const char *)memchr(line + 1,'\n',end - line - 1);
+		}
+		if (!failure && lines != 1 + ncolors + height)
+			failure = "the XPM2 doesn't have the lines it should";
+		if (!failure && (decode_pixels(&xpm,&bits,&decodedWidth,&decodedHeight) != B_OK
+			|| memcmp(bits,pixels,sizeof(pixels))))
+			failure = "the pixels came back different";
+		free(bits);
+		bits = NULL;
+	}
+	return failure;
+}
+
+//	check_gzip_trickle()
+//	an XPM read a byte or a few at a time, as from a pipe, is told apart,
+//	sized and decoded as when it is read whole, gzipped or not: the gzip
+//	and XPM2 headers come in over several reads.
+const char *check_gzip_trickle(void)
+{
+	const int width = 24, height = 20;
+	static const size_t sizes[] = { 1, 2, 3, 7 };
+	uint8 pixels[24*20*4];
+	xpm_encode_settings settings;
+	BMallocIO xpm, expected, output;
+	BRect bounds;
+	const char *failure = NULL;
+	int format, gzip, i;
+
+	make_pixels(pixels,width,height,30,23);
+	init_encode_settings(&settings);
+	for (format = 0; format < 2 && !failure; format++)
+		for (gzip = 0; gzip < 2 && !failure; gzip++)
+		{
+			settings.format = format ? XPM_FORMAT_XPM2 : XPM_FORMAT_XPM3;
+			settings.gzip = gzip;
+			clear_output(&xpm);
+			clear_output(&expected);
+			if (encode_pixels(pixels,4*width,B_RGBA32,width,height,&settings,&xpm) != B_OK)
+				return "encoding failed";
+			xpm.Seek(0,SEEK_SET);
+			if (fromXPM(&xpm,&expected) != B_OK)
+				return "decoding failed";
+			for (i = 0; i < (int)(sizeof(sizes)/sizeof(sizes[0])) && !failure; i++)
+			{
+				TrickleIO input(&xpm,sizes[i]);
+
+				clear_output(&output);
+				if (Translate(&input,NULL,NULL,B_TRANSLATOR_BITMAP,&output) != B_OK)
+					failure = "a trickled XPM wasn't told apart";
+				else if (!same_output(&output,&expected))
+					failure = "a trickled XPM decoded differently";
+				input.Seek(0,SEEK_SET);
+				if (!failure && (get_xpm_bounds(&input,&bounds) != B_OK
+					|| bounds.IntegerWidth() != width - 1
+					|| bounds.IntegerHeight() != height - 1))
+					failure = "a trickled XPM wasn't sized";
+			}
+		}
+	return failure;
+}
+
+//	check_find_row()
+//	find_row() gives a row the same as an earlier one the earlier one's
+//	number, whatever the padding past the pixels.  A row whose hash is
+//	that of an earlier, different row is not taken for it.
+const char *check_find_row(void)
+{
+	const int32 rowBytes = 12;
+	const size_t length = 10;
+	uint8 data[4*12];
+	row_seen seen[8];
+	uint64 hash;
+	int i, mask = 7;
+
+	memset(data,0,sizeof(data));
+	for (i = 0; i < (int)length; i++)
+	{
+		data[i] = data[2*rowBytes + i] = (uint8)i;
+		data[rowBytes + i] = data[3*rowBytes + i] = (uint8)(i + 100);
+	}
+	data[2*rowBytes + length] = 0xff;
+	data[3*rowBytes + length + 1] = 0xee;
+	for (i = 0; i <= mask; i++)
+		seen[i].row = -1;
+	if (find_row(seen,mask,data,rowBytes,0,length) != -1
+		|| find_row(seen,mask,data,rowBytes,1,length) != -1)
+		return "a row not seen before was found";
+	if (find_row(seen,mask,data,rowBytes,2,length) != 0
+		|| find_row(seen,mask,data,rowBytes,3,length) != 1)
+		return "a row seen before wasn't found";
+
+//	row 0 is filed under row 1's hash, as if their hashes were the same
+	for (i = 0; i <= mask; i++)
+		seen[i].row = -1;
+	hash = hash_bytes(data + rowBytes,length,HASH_SEED);
+	seen[hash & mask].hash = hash;
+	seen[hash & mask].row = 0;
+	if (find_row(seen,mask,data,rowBytes,1,length) != -1)
+		return "a row was taken for another with the same hash";
+	if (find_row(seen,mask,data,rowBytes,3,length) != 1)
+		return "a row whose hash collided wasn't found after";
+	return NULL;
+}
+
+//	check_repeated_rows()
+//	an image made of a few rows over and over, some of them the same but
+//	for one pixel, comes back as it was, and the same rows are written
+//	the same.
+const char *check_repeated_rows(void)
+{
+	const int width = 20, height = 30;
+	uint8 pixels[20*30*4];
+	uint8 *bits = NULL;
+	quoted_string strings[1 + 8 + 30];
+	BMallocIO xpm;
+	const char *failure = NULL;
+	int i, count, decodedWidth, decodedHeight;
+
+	make_pixels(pixels,width,3,6,24);
+	for (i = 3; i < height; i++)
+		memcpy(pixels + (size_t)i*4*width,pixels + (size_t)(i % 3)*4*width,4*width);
+	for (i = 5; i < height; i += 6)
+		put_color(pixels + (size_t)i*4*width + 4*(i % width),6);
+	if (encode_pixels(pixels,4*width,B_RGBA32,width,height,NULL,&xpm) != B_OK)
+		return "encoding failed";
+	count = quoted_strings(&xpm,strings,sizeof(strings)/sizeof(strings[0]));
+	if (count < 1 + height)
+		return "the XPM doesn't have the strings it should";
+	for (i = 3; i < height && !failure; i++)
+		if (i % 6 != 5 && !same_string(&xpm,&strings[count - height + i],&xpm,
+			&strings[count - height + i % 3]))
+			failure = "a repeated row was written differently";
+	if (!failure && (decode_pixels(&xpm,&bits,&decodedWidth,&decodedHeight) != B_OK
+		|| memcmp(bits,pixels,sizeof(pixels))))
+		failure = "the pixels came back different";
+	free(bits);
+	return failure;
+}
+
+//	check_hash_spread()
+//	the pixel strings of a many-colored XPM are spread over the decoder's
+//	color table, so that a pixel is found in a probe or two, not by
+//	walking a chain of every color.
+const char *check_hash_spread(void)
+{
+	const int width = 64, height = 64;
+	uint8 pixels[64*64*4];
+	BMallocIO xpm, output;
+	xpm_stats stats;
+
+	make_cycle_pixels(pixels,width,height,1000);
+	if (encode_pixels(pixels,4*width,B_RGBA32,width,height,NULL,&xpm) != B_OK)
+		return "encoding failed";
+	xpm.Seek(0,SEEK_SET);
+	if (fromXPM(&xpm,&output,&stats) != B_OK)
+		return "decoding failed";
+	if (stats.probes > 2*width*height)
+		return "pixels took too many probes of the color table";
+	return NULL;
+}
+
+//	check_parallel_decodes()
+//	several decodes at once, each of its own many-colored XPM, come out
+//	as they do one at a time: the parsers keep no state between calls.
+//	Threads on one CPU seldom meet in the parsers, so a decode is also
+//	made in the middle of a strtok() of the caller's, which the decode
+//	would upset if it used strtok() too.
+const char *check_parallel_decodes(void)
+{
+	const int width = 40, height = 40, jobs = 4;
+	uint8 pixels[40*40*4];
+	BMallocIO xpm[4], expected[4];
+	decode_job job[4];
+	thread_id thread[4];
+	status_t result;
+	const char *failure = NULL;
+	char words[] = "first second";
+	int i;
+
+	for (i = 0; i < jobs; i++)
+	{
+		make_pixels(pixels,width,height,1200,30 + i);
+		if (encode_pixels(pixels,4*width,B_RGBA32,width,height,NULL,&xpm[i]) != B_OK)
+			return "encoding failed";
+		xpm[i].Seek(0,SEEK_SET);
+		if (i == 0 && !strtok(words," "))
+			return "strtok() failed";
+		if (fromXPM(&xpm[i],&expected[i]) != B_OK)
+			return "decoding failed";
+		if (i == 0 && !strtok(NULL," "))
+			return "a decode upset a strtok() going on around it";
+		job[i].xpm = &xpm[i];
+		job[i].expected = &expected[i];
+		job[i].rounds = 40;
+		job[i].failure = NULL;
+	}
+	for (i = 0; i < jobs; i++)
+	{
+		thread[i] = spawn_thread(decode_thread,"xpmcheck decode",B_NORMAL_PRIORITY,&job[i]);
+		if (thread[i] >= 0 && resume_thread(thread[i]) != B_OK)
+			thread[i] = -1;
+		if (thread[i] < 0)
+			decode_thread(&job[i]);
+	}
+	for (i = 0; i < jobs; i++)
+	{
+		if (thread[i] >= 0)
+			wait_for_thread(thread[i],&result);
+		if (job[i].failure && !failure)
+			failure = job[i].failure;
+	}
+	return failure;
+}
+
+//	decode_thread()
+//	decode a job's XPM over and over, each time into a stream of its own,
+//	and compare it with what it decoded to alone.
+status_t decode_thread(void *data)
+{
+	decode_job *job = (decode_job *)data;
+	int i;
+
+	for (i = 0; i < job->rounds && !job->failure; i++)
+	{
+		BMemoryIO input(job->xpm->Buffer(),job->xpm->BufferLength());
+		BMallocIO output;
+
+		if (fromXPM(&input,&output) != B_OK)
+			job->failure = "a decode alongside others failed";
+		else if (!same_output(&output,job->expected))
+			job->failure = "a decode alongside others came out differently";
+	}
+	return B_OK;
+}
+
+//	colliding_pair()
+//	a 16x1 B_GRAY8 bitmap of 0x10, and the same with pixels 7 and 15, the
+//	top bytes of its two words, set to 0x90.
+void colliding_pair(uint8 *first, uint8 *second, TranslatorBitmap *bmap)
+{
+	memset(first,0x10,16);
+	memset(second,0x10,16);
+	second[7] = second[15] = 0x90;
+	bmap->magic = B_TRANSLATOR_BITMAP;
+	bmap->bounds.Set(0,0,15,0);
+	bmap->rowBytes = 16;
+	bmap->colors = B_GRAY8;
+	bmap->dataSize = 16;
+}
+
+//	make_pixels()
+//	fill a "width" by "height" B_RGBA32 bitmap with "colors" opaque colors,
+//	in an order that depends on "seed".
+void make_pixels(uint8 *bits, int width, int height, int colors, uint32 seed)
+{
+	uint32 state = seed*2654435761U + 1;
+	int i, c;
+
+	for (i = 0; i < width*height; i++, bits += 4)
+	{
+		state = state*1103515245 + 12345;
+		c = (state >> 16) % colors;
+		put_color(bits,c);
+	}
+}
+
+//	make_cycle_pixels()
+//	fill a "width" by "height" B_RGBA32 bitmap with each of "colors"
+//	opaque colors in turn, so that every one of them is used if there
+//	are enough pixels.
+void make_cycle_pixels(uint8 *bits, int width, int height, int colors)
+{
+	int i;
+
+	for (i = 0; i < width*height; i++, bits += 4)
+		put_color(bits,i % colors);
+}
+
+//	put_color()
+//	the "c"th color of make_pixels(), opaque; the first 256 are distinct.
+void put_color(uint8 *pixel, int c)
+{
+	pixel[0] = c*37;
+	pixel[1] = c*91;
+	pixel[2] = c*13 + 7;
+	pixel[3] = 0xff;
+}
+
+//	write_bits()
+//	write a B_RGBA32 bitmap as a B_TRANSLATOR_BITMAP stream.
+status_t write_bits(const uint8 *bits, int width, int height, BMallocIO *output)
+{
+	TranslatorBitmap header;
+
+	header.magic = B_TRANSLATOR_BITMAP;
+	header.bounds.Set(0,0,width-1,height-1);
+	header.rowBytes = 4*width;
+	header.colors = B_RGBA32;
+	header.dataSize = header.rowBytes*height;
+	swap_data(B_INT32_TYPE,&header.magic,sizeof(header.magic),B_SWAP_HOST_TO_BENDIAN);
+	swap_data(B_RECT_TYPE,&header.bounds,sizeof(header.bounds),B_SWAP_HOST_TO_BENDIAN);
+	swap_data(B_INT32_TYPE,&header.rowBytes,sizeof(header.rowBytes),B_SWAP_HOST_TO_BENDIAN);
+	swap_data(B_INT32_TYPE,&header.colors,sizeof(header.colors),B_SWAP_HOST_TO_BENDIAN);
+	swap_data(B_INT32_TYPE,&header.dataSize,sizeof(header.dataSize),B_SWAP_HOST_TO_BENDIAN);
+	if (output->Write(&header,sizeof(header)) != sizeof(header)
+		|| output->Write(bits,(size_t)4*width*height) != (ssize_t)4*width*height)
+		return B_IO_ERROR;
+	return B_OK;
+}
+
+//	encode_pixels()
+//	encode a "width" by "height" bitmap at "data" as an XPM into "output".
+status_t encode_pixels(const uint8 *data, int32 rowBytes, color_space space, int width, int height,
+	const xpm_encode_settings *settings, BMallocIO *output)
+{
+	return toXPM(data,rowBytes,space,BRect(0,0,width-1,height-1),output,settings);
+}
+
+//	decode_pixels()
+//	decode the XPM in "xpm" into B_RGBA32 pixels at "*bits", to be freed.
+status_t decode_pixels(BMallocIO *xpm, uint8 **bits, int *width, int *height)
+{
+	BRect bounds;
+	status_t err;
+
+	*bits = NULL;
+	xpm->Seek(0,SEEK_SET);
+	err = get_xpm_bounds(xpm,&bounds);
+	if (err != B_OK)
+		return err;
+	*width = bounds.IntegerWidth() + 1;
+	*height = bounds.IntegerHeight() + 1;
+	*bits = (uint8 *)calloc((size_t)*width**height,4);
+	if (!*bits)
+		return B_NO_MEMORY;
+	return fromXPM(xpm,*bits,4**width,bounds);
+}
+
+//	add_transparency()
+//	make every eleventh pixel of a B_RGBA32 bitmap transparent.
+void add_transparency(uint8 *bits, int width, int height)
+{
+	int i;
+
+	for (i = 0; i < width*height; i += 11)
+		memcpy(bits + 4*i,"\x77\x74\x77\x00",4);
+}
+
+//	clear_output()
+//	empty "output" to be written again.
+void clear_output(BMallocIO *output)
+{
+	output->SetSize(0);
+	output->Seek(0,SEEK_SET);
+}
+
+//	same_output()
+//	whether "a" and "b" hold the same bytes.
+bool same_output(BMallocIO *a, BMallocIO *b)
+{
+	return a->BufferLength() == b->BufferLength()
+		&& !memcmp(a->Buffer(),b->Buffer(),a->BufferLength());
+}
+
+//	read_file()
+//	append the contents of the file at "path" to "output".
+status_t read_file(const char *path, BMallocIO *output)
+{
+	char buffer[4096];
+	size_t length;
+	FILE *file;
+
+	file = fopen(path,"rb");
+	if (!file)
+		return B_ENTRY_NOT_FOUND;
+	while ((length = fread(buffer,1,sizeof(buffer),file)) > 0)
+		if (output->Write(buffer,length) != (ssize_t)length)
+		{
+			fclose(file);
+			return B_NO_MEMORY;
+		}
+	fclose(file);
+	return B_OK;
+}
+
+//	run_tool()
+//	run the shell command made from "format" and what follows, and return
+//	its exit status, or -1 if it couldn't be run.
+int run_tool(const char *format, ...)
+{
+	char command[4*B_PATH_NAME_LENGTH];
+	va_list args;
+	int status;
+
+	va_start(args,format);
+	vsnprintf(command,sizeof(command),format,args);
+	va_end(args);
+	status = system(command);
+	return status == -1 || !WIFEXITED(status) ? -1 : WEXITSTATUS(status);
+}
+
+//	same_gray()
+//	whether B_RGBA32 "bits" are the B_GRAY8 "gray" pixels.
+bool same_gray(const uint8 *gray, const uint8 *bits, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++, bits += 4)
+		if (bits[0] != gray[i] || bits[1] != gray[i] || bits[2] != gray[i])
+			return false;
+	return true;
+}
+
+//	same_colors()
+//	whether B_RGBA32 "bits" are the colors "colors", the transparent one
+//	included.
+bool same_colors(const rgb_color *colors, const uint8 *bits, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++, bits += 4)
+		if (bits[0] != colors[i].blue || bits[1] != colors[i].green || bits[2] != colors[i].red
+			|| bits[3] != colors[i].alpha)
+			return false;
+	return true;
+}
+
+//	xpm_color_count()
+//	the number of colors the values string of the XPM in "xpm" gives, or
+//	-1 if there is none.
+int xpm_color_count(BMallocIO *xpm)
+{
+	const char *text = (const char *)xpm->Buffer();
+	const char *values;
+	int width, height, ncolors;
+
+	values = (const char *)memchr(text,'"',xpm->BufferLength());
+	if (!values || sscanf(values + 1,"%d %d %d",&width,&height,&ncolors) != 3)
+		return -1;
+	return ncolors;
+}
+
+//	quoted_strings()
+//	find up to "max" of the quoted strings of the XPM in "xpm", and return
+//	how many there are in all.
+int quoted_strings(BMallocIO *xpm, quoted_string *strings, int max)
+{
+	const char *text = (const char *)xpm->Buffer();
+	const char *end = text + xpm->BufferLength();
+	const char *p, *q;
+	int count = 0;
+
+	for (p = text; (p = (const char *)memchr(p,'"',end - p)) != NULL; p = q + 1)
+	{
+		q = (const char *)memchr(p + 1,'"',end - p - 1);
+		if (!q)
+			break;
+		if (count < max)
+		{
+			strings[count].start = p + 1 - text;
+			strings[count].length = q - p - 1;
+		}
+		count++;
+	}
+	return count;
+}
+
+//	make_bitmap_stream()
+//	write a small B_RGBA32 bitmap, whose alpha takes every value, into
+//	"output", and into "copy" too if it is given.
+void make_bitmap_stream(BMallocIO *output, BMallocIO *copy)
+{
+	uint8 pixels[7*5*4];
+	size_t i;
+
+	for (i = 0; i < sizeof(pixels); i++)
+		pixels[i] = (uint8)(i*7 + 3);
+	write_bits(pixels,7,5,output);
+	if (copy)
+		write_bits(pixels,7,5,copy);
+}
+
+//	make_scratch_directory()
+//	an empty directory of its own under /tmp, for a cache.
+char *make_scratch_directory(void)
+{
+	static char path[32];
+
+	strcpy(path,"/tmp/xpmcheckXXXXXX");
+	return mkdtemp(path);
+}
+
+void remove_scratch_directory(char *path)
+{
+	char name[B_PATH_NAME_LENGTH];
+	struct dirent *entry;
+	DIR *dir;
+
+	dir = opendir(path);
+	if (dir)
+	{
+		while ((entry = readdir(dir)) != NULL)
+			if (strcmp(entry->d_name,".") && strcmp(entry->d_name,".."))
+			{
+				snprintf(name,sizeof(name),"%s/%s",path,entry->d_name);
+				remove(name);
+			}
+		closedir(dir);
+	}
+	rmdir(path);
+}
+
+TrickleIO::TrickleIO(BMallocIO *io, size_t most)
+	: io(io), most(most), position(0)
+{
+}
+
+ssize_t TrickleIO::ReadAt(off_t at, void *buffer, size_t size)
+{
+	return io->ReadAt(at,buffer,size < most ? size : most);
+}
+
+ssize_t TrickleIO::WriteAt(off_t, const void *, size_t)
+{
+	return B_NOT_ALLOWED;
+}
+
+off_t TrickleIO::Seek(off_t offset, uint32 seekMode)
+{
+	if (seekMode == SEEK_CUR)
+		offset += position;
+	else if (seekMode == SEEK_END)
+		offset += io->BufferLength();
+	if (offset < 0)
+		return B_BAD_VALUE;
+	position = offset;
+	return position;
+}
+
+off_t TrickleIO::Position(void) const
+{
+	return position;
+}
@@ -0,0 +1,561 @@
+//	XPMCorpus.cc
+//
+//	the XPMs and bitmaps are written a row at a time, so an image need not
+//	fit in memory to be made; make_corpus() collects one in a buffer for
+//	those that want it there.
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "XPM.h"
+#include "XPMColors.h"
+#include "ScanBitmap.h"
+#include "XPMCorpus.h"
+
+#define		CORPUS_CHUNK		65536
+
+const corpus_space corpus_spaces[] =
+{
+	{ "rgba32", B_RGBA32 },
+	{ "rgb32", B_RGB32 },
+	{ "rgb16", B_RGB16 },
+	{ "rgb15", B_RGB15 },
+	{ "cmap8", B_CMAP8 },
+	{ "gray8", B_GRAY8 },
+	{ "gray1", B_GRAY1 }
+};
+const int corpus_space_count = sizeof(corpus_spaces)/sizeof(corpus_spaces[0]);
+
+const char *kKeysNames[] = { "spread", "shuffled", "prefix", "ascending" };
+
+//	output collected into chunks, so that a row is not a Write() of its own
+typedef struct
+{
+	BDataIO *io;
+	char *buffer;
+	size_t used;
+	status_t err;
+}
+corpus_writer;
+
+//	a BDataIO that keeps what is written to it, for make_corpus()
+class CorpusBuffer : public BDataIO
+{
+	public:
+		CorpusBuffer() : data(NULL), length(0), size(0) {}
+		virtual ssize_t Read(void *, size_t) { return B_ERROR; }
+		virtual ssize_t Write(const void *buffer, size_t count);
+		uint8 *data;
+		size_t length;
+		size_t size;
+};
+
+bool has_transparency(color_space);
+uint32 random_below(uint32 *, uint64);
+double random_fraction(uint32 *);
+int pick_key(const corpus_spec *, bool, uint32 *, uint64, uint64);
+bool repeat_row(const corpus_spec *, uint32 *, int);
+void key_code(const corpus_spec *, int, uint64, uint64, char *);
+uint64 scatter(uint32, uint64);
+uint64 common_divisor(uint64, uint64);
+uint32 bitmap_value(const corpus_spec *, int, uint64, uint64);
+void put_value(color_space, uint8 *, int, uint32);
+void write_init(corpus_writer *, BDataIO *);
+void write_bytes(corpus_writer *, const void *, size_t);
+status_t write_flush(corpus_writer *);
+status_t write_done(corpus_writer *);
+
+//	corpus_defaults()
+//	a 256 x 256 XPM of 256 hex colors with two characters per pixel, or a
+//	B_RGBA32 bitmap of as many colors, every pixel picked at random.
+void corpus_defaults(corpus_spec *spec)
+{
+	memset(spec,0,sizeof(*spec));
+	spec->width = spec->height = 256;
+	spec->colors = 256;
+	spec->cpp = 2;
+	spec->space = B_RGBA32;
+	spec->keys = CORPUS_KEYS_SPREAD;
+	spec->seed = 1;
+}
+
+const char *corpus_keys_name(int keys)
+{
+	if (keys < 0 || keys >= (int)(sizeof(kKeysNames)/sizeof(kKeysNames[0])))
+		return "unknown";
+	return kKeysNames[keys];
+}
+
+//	corpus_keys_value()
+//	the CORPUS_KEYS_* named "name", or -1.
+int corpus_keys_value(const char *name)
+{
+	int i;
+
+	for (i = 0; i < (int)(sizeof(kKeysNames)/sizeof(kKeysNames[0])); i++)
+		if (!strcmp(kKeysNames[i],name))
+			return i;
+	return -1;
+}
+
+//	corpus_space_index()
+//	the index in corpus_spaces of the space called by the "length"
+//	characters of "name", or -1.
+int corpus_space_index(const char *name, size_t length)
+{
+	int i;
+
+	for (i = 0; i < corpus_space_count; i++)
+		if (strlen(corpus_spaces[i].name) == length && !strncmp(name,corpus_spaces[i].name,length))
+			return i;
+	return -1;
+}
+
+//	corpus_max_colors()
+//	the most distinct keys an XPM with the spec's cpp, or a bitmap in its
+//	space, can have; 0 if the space isn't one that can be made.
+int corpus_max_colors(const corpus_spec *spec, bool xpm)
+{
+	uint64 codes;
+	int i;
+
+	if (xpm)
+	{
+		for (codes = 1, i = 0; i < spec->cpp && codes < INT_MAX; i++)
+			codes *= XPM_CHAR_COUNT;
+		return codes < INT_MAX ? (int)codes : INT_MAX;
+	}
+	switch (spec->space)
+	{
+		case B_RGBA32:
+		case B_RGB32:
+			return 1 << 24;
+		case B_RGB16:
+			return 1 << 16;
+		case B_RGB15:
+			return 1 << 15;
+		case B_CMAP8:
+//	B_TRANSPARENT_MAGIC_CMAP8 is left for transparent pixels
+			return 255;
+		case B_GRAY8:
+			return 256;
+		case B_GRAY1:
+			return 2;
+		default:
+			return 0;
+	}
+}
+
+//	write_corpus_xpm()
+//	an XPM to the spec.  Key 0 is "None" if any pixels are transparent;
+//	the rest are named colors while there are names and "named" is set,
+//	and hex colors after that.
+status_t write_corpus_xpm(const corpus_spec *spec, BDataIO *io)
+{
+	corpus_writer w;
+	uint32 seed = spec->seed;
+	uint64 codeCount, stride, pixels = (uint64)spec->width*spec->height;
+	char *codes, *row, line[128];
+	int i, j, ix, names = 0;
+	uint32 value;
+	bool transparent = spec->transparent > 0;
+
+	if (spec->width <= 0 || spec->height <= 0 || spec->cpp <= 0 || spec->colors <= 0
+		|| spec->colors > corpus_max_colors(spec,true))
+		return B_BAD_VALUE;
+	codes = (char *)malloc((size_t)spec->colors*spec->cpp);
+	row = (char *)malloc((size_t)spec->width*spec->cpp + 4);
+	if (!codes || !row)
+	{
+		free(codes);
+		free(row);
+		return B_NO_MEMORY;
+	}
+
+	for (codeCount = 1, i = 0; i < spec->cpp && codeCount < ((uint64)1 << 56); i++)
+		codeCount *= XPM_CHAR_COUNT;
+	stride = scatter(next_random(&seed),codeCount);
+	for (i = 0; i < spec->colors; i++)
+		key_code(spec,i,stride,codeCount,codes + (size_t)i*spec->cpp);
+	if (spec->named)
+		while (named_color[names].name)
+			names++;
+
+	write_init(&w,io);
+	if (spec->xpm2)
+		sprintf(line,"%s\n%d %d %d %d\n",XPM2_HEADER,spec->width,spec->height,spec->colors,
+			spec->cpp);
+	else
+		sprintf(line,"%s\nstatic char *corpus[] = {\n\"%d %d %d %d\"",XPM_HEADER,spec->width,
+			spec->height,spec->colors,spec->cpp);
+	write_bytes(&w,line,strlen(line));
+
+	for (i = 0; i < spec->colors; i++)
+	{
+		write_bytes(&w,spec->xpm2 ? "" : ",\n\"",spec->xpm2 ? 0 : 3);
+		write_bytes(&w,codes + (size_t)i*spec->cpp,spec->cpp);
+		ix = i - transparent;
+		if (ix < 0)
+			strcpy(line," c None");
+		else if (ix < names)
+			sprintf(line," c %s",named_color[ix].name);
+		else
+		{
+			if (spec->keys == CORPUS_KEYS_ASCENDING)
+				value = (uint32)((uint64)ix*0xffffff/(spec->colors > 1 ? spec->colors - 1 : 1));
+			else if (spec->keys == CORPUS_KEYS_PREFIX)
+				value = ix & 0xffffff;
+			else
+				value = next_random(&seed) & 0xffffff;
+			sprintf(line," c #%06lx",(unsigned long)value);
+		}
+		strcat(line,spec->xpm2 ? "\n" : "\"");
+		write_bytes(&w,line,strlen(line));
+	}
+
+	for (i = 0; i < spec->height && w.err == B_OK; i++)
+	{
+		if (!repeat_row(spec,&seed,i))
+			for (j = 0; j < spec->width; j++)
+			{
+				ix = pick_key(spec,transparent,&seed,(uint64)i*spec->width + j,pixels);
+				memcpy(row + (size_t)j*spec->cpp,codes + (size_t)ix*spec->cpp,spec->cpp);
+			}
+		write_bytes(&w,spec->xpm2 ? "" : ",\n\"",spec->xpm2 ? 0 : 3);
+		write_bytes(&w,row,(size_t)spec->width*spec->cpp);
+		write_bytes(&w,spec->xpm2 ? "\n" : "\"",1);
+	}
+	if (!spec->xpm2)
+		write_bytes(&w,"\n};\n",4);
+	free(codes);
+	free(row);
+	return write_done(&w);
+}
+
+//	write_corpus_bitmap()
+//	a B_TRANSLATOR_BITMAP stream to the spec.  Key 0 is the space's
+//	transparent value if any pixels are transparent and the space has one.
+status_t write_corpus_bitmap(const corpus_spec *spec, BDataIO *io)
+{
+	TranslatorBitmap bmap;
+	corpus_writer w;
+	uint32 seed = spec->seed;
+	uint64 stride, valueCount, pixels = (uint64)spec->width*spec->height;
+	uint32 *values;
+	uint8 *row;
+	int32 rowBytes;
+	int i, j;
+	bool transparent = spec->transparent > 0 && has_transparency(spec->space);
+
+	if (spec->width <= 0 || spec->height <= 0 || spec->colors <= 0
+		|| spec->colors > corpus_max_colors(spec,false))
+		return B_BAD_VALUE;
+	rowBytes = (row_bytes(spec->space,spec->width) + 3) & ~3;
+	if ((uint64)rowBytes*spec->height > 0xffffffffULL)
+		return B_BAD_VALUE;
+	values = (uint32 *)malloc(spec->colors*sizeof(uint32));
+	row = (uint8 *)calloc(rowBytes,1);
+	if (!values || !row)
+	{
+		free(values);
+		free(row);
+		return B_NO_MEMORY;
+	}
+
+	valueCount = corpus_max_colors(spec,false);
+	stride = scatter(next_random(&seed),valueCount);
+	for (i = 0; i < spec->colors; i++)
+		values[i] = bitmap_value(spec,i,stride,valueCount);
+
+	bmap.magic = B_HOST_TO_BENDIAN_INT32(B_TRANSLATOR_BITMAP);
+	bmap.bounds.Set(0,0,spec->width-1,spec->height-1);
+	swap_data(B_RECT_TYPE,&bmap.bounds,sizeof(bmap.bounds),B_SWAP_HOST_TO_BENDIAN);
+	bmap.rowBytes = B_HOST_TO_BENDIAN_INT32(rowBytes);
+	bmap.colors = (color_space)B_HOST_TO_BENDIAN_INT32(spec->space);
+	bmap.dataSize = B_HOST_TO_BENDIAN_INT32((uint32)((uint64)rowBytes*spec->height));
+	write_init(&w,io);
+	write_bytes(&w,&bmap,sizeof(bmap));
+
+	for (i = 0; i < spec->height && w.err == B_OK; i++)
+	{
+		if (!repeat_row(spec,&seed,i))
+		{
+			memset(row,0,rowBytes);
+			for (j = 0; j < spec->width; j++)
+				put_value(spec->space,row,j,
+					values[pick_key(spec,transparent,&seed,(uint64)i*spec->width + j,pixels)]);
+		}
+		write_bytes(&w,row,rowBytes);
+	}
+	free(values);
+	free(row);
+	return write_done(&w);
+}
+
+//	make_corpus()
+//	an XPM, or a bitmap, to the spec in a buffer of its own, which the
+//	caller frees; NULL if it can't be made.
+uint8 *make_corpus(const corpus_spec *spec, bool xpm, size_t *length)
+{
+	CorpusBuffer buffer;
+	status_t err;
+
+	err = xpm ? write_corpus_xpm(spec,&buffer) : write_corpus_bitmap(spec,&buffer);
+	if (err != B_OK)
+	{
+		free(buffer.data);
+		return NULL;
+	}
+	*length = buffer.length;
+	return buffer.data;
+}
+
+ssize_t CorpusBuffer::Write(const void *buffer, size_t count)
+{
+	uint8 *grown;
+	size_t newSize;
+
+	if (length + count > size)
+	{
+		for (newSize = size ? size : CORPUS_CHUNK; newSize < length + count; newSize *= 2)
+			;
+		grown = (uint8 *)realloc(data,newSize);
+		if (!grown)
+			return B_NO_MEMORY;
+		data = grown;
+		size = newSize;
+	}
+	memcpy(data + length,buffer,count);
+	length += count;
+	return count;
+}
+
+//	next_random()
+//	a small, seeded generator, so that every run makes the same images.
+uint32 next_random(uint32 *state)
+{
+	*state = *state*1664525 + 1013904223;
+	return *state >> 8;
+}
+
+//	random_below()
+//	a random number less than "n"; the generator gives 24 bits at a time.
+uint32 random_below(uint32 *state, uint64 n)
+{
+	uint64 r = next_random(state);
+
+	if (n > (1 << 24))
+		r = r << 24 | next_random(state);
+	return (uint32)(r % n);
+}
+
+double random_fraction(uint32 *state)
+{
+	return next_random(state)/16777216.0;
+}
+
+//	has_transparency()
+//	whether pixels in "space" can be B_TRANSPARENT_32_BIT, the only color
+//	the encoder writes as "None".
+bool has_transparency(color_space space)
+{
+	return space == B_RGBA32 || space == B_RGB32 || space == B_CMAP8;
+}
+
+//	pick_key()
+//	the key of pixel "position" of "pixels": if "transparent", key 0 with
+//	the spec's likelihood, else one of the others--at random, or along a
+//	gradient for CORPUS_KEYS_ASCENDING.
+int pick_key(const corpus_spec *spec, bool transparent, uint32 *state, uint64 position,
+	uint64 pixels)
+{
+	int first = transparent ? 1 : 0;
+	int n = spec->colors - first;
+
+	if (first && (n == 0 || random_fraction(state) < spec->transparent))
+		return 0;
+	if (spec->keys == CORPUS_KEYS_ASCENDING)
+		return first + (int)(position*n/pixels);
+	return first + random_below(state,n);
+}
+
+//	repeat_row()
+//	whether row "row" is to be the same as the one above it.
+bool repeat_row(const corpus_spec *spec, uint32 *state, int row)
+{
+	return row > 0 && spec->repeat > 0 && random_fraction(state) < spec->repeat;
+}
+
+//	scatter()
+//	a stride that visits each of "count" keys once when stepped through
+//	them modulo "count": prime to it, and small enough that a key number
+//	times the stride can't overflow.
+uint64 scatter(uint32 seed, uint64 count)
+{
+	uint64 stride;
+
+	stride = (uint64)seed*2654435761U % (count < ((uint64)1 << 32) ? count : ((uint64)1 << 32));
+	if (stride == 0)
+		stride = 1;
+	while (common_divisor(stride,count) != 1)
+		stride++;
+	return stride;
+}
+
+uint64 common_divisor(uint64 a, uint64 b)
+{
+	uint64 t;
+
+	while (b)
+	{
+		t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+//	key_code()
+//	the pixel string of key "i", "cpp" characters.  CORPUS_KEYS_SPREAD
+//	and _ASCENDING hand them out as the encoder does, first character
+//	fastest; _PREFIX varies the last character fastest, so that the keys
+//	share their leading characters; _SHUFFLED scatters them over all
+//	"count" strings the cpp allows.
+void key_code(const corpus_spec *spec, int i, uint64 stride, uint64 count, char *code)
+{
+	uint64 n = i;
+	int j;
+
+	if (spec->keys == CORPUS_KEYS_SHUFFLED)
+		n = (n*stride + stride/2) % count;
+	for (j = 0; j < spec->cpp; j++)
+	{
+		code[spec->keys == CORPUS_KEYS_PREFIX ? spec->cpp - 1 - j : j]
+			= XPM_CHAR_SET[n % XPM_CHAR_COUNT];
+		n /= XPM_CHAR_COUNT;
+	}
+}
+
+//	bitmap_value()
+//	the pixel value of key "i" in the spec's space, as a host-endian word.
+//	CORPUS_KEYS_SPREAD spreads the values evenly over what the space
+//	holds, scrambling the 32-bit ones; _SHUFFLED scatters them; _PREFIX
+//	counts up from 0, changing only the low bits; _ASCENDING spreads them
+//	evenly, in order.
+uint32 bitmap_value(const corpus_spec *spec, int i, uint64 stride, uint64 count)
+{
+	uint64 max = corpus_max_colors(spec,false);
+	bool transparent = spec->transparent > 0 && has_transparency(spec->space);
+	int n = spec->colors - transparent;
+	uint32 value;
+
+	if (transparent && i == 0)
+	{
+		if (spec->space == B_CMAP8)
+			return B_TRANSPARENT_MAGIC_CMAP8;
+		return (uint32)B_TRANSPARENT_32_BIT.alpha << 24 | B_TRANSPARENT_32_BIT.red << 16
+			| B_TRANSPARENT_32_BIT.green << 8 | B_TRANSPARENT_32_BIT.blue;
+	}
+	i -= transparent;
+	switch (spec->keys)
+	{
+		case CORPUS_KEYS_SHUFFLED:
+			value = (uint32)((i*stride + stride/2) % count);
+			break;
+		case CORPUS_KEYS_PREFIX:
+			value = i;
+			break;
+		default:
+			value = (uint32)((uint64)i*max/n);
+			if (spec->keys == CORPUS_KEYS_SPREAD
+				&& (spec->space == B_RGBA32 || spec->space == B_RGB32))
+				value = value*2654435761U & 0xffffff;
+			break;
+	}
+	if (spec->space == B_RGBA32 || spec->space == B_RGB32)
+		value |= 0xff000000;
+	else if (spec->space == B_RGB15)
+		value |= 0x8000;
+	return value;
+}
+
+//	put_value()
+//	store "value" as pixel "j" of "row".
+void put_value(color_space space, uint8 *row, int j, uint32 value)
+{
+//	the bytes in eight pixels are the bits in one
+	switch (row_bytes(space,8))
+	{
+		case 32:
+			row[4*j] = value & 0xff;
+			row[4*j + 1] = value >> 8;
+			row[4*j + 2] = value >> 16;
+			row[4*j + 3] = value >> 24;
+			break;
+		case 16:
+			row[2*j] = value & 0xff;
+			row[2*j + 1] = value >> 8;
+			break;
+		case 8:
+			row[j] = value;
+			break;
+		default:
+			if (value)
+				row[j >> 3] |= 0x80 >> (j & 7);
+			break;
+	}
+}
+
+void write_init(corpus_writer *w, BDataIO *io)
+{
+	w->io = io;
+	w->used = 0;
+	w->buffer = (char *)malloc(CORPUS_CHUNK);
+	w->err = w->buffer ? B_OK : B_NO_MEMORY;
+}
+
+void write_bytes(corpus_writer *w, const void *data, size_t length)
+{
+	ssize_t written;
+
+	if (w->err != B_OK)
+		return;
+	if (w->used + length > CORPUS_CHUNK && write_flush(w) != B_OK)
+		return;
+	if (length > CORPUS_CHUNK)
+	{
+		written = w->io->Write(data,length);
+		if (written != (ssize_t)length)
+			w->err = written < 0 ? written : B_ERROR;
+		return;
+	}
+	memcpy(w->buffer + w->used,data,length);
+	w->used += length;
+}
+
+//	write_flush()
+//	write out what is buffered; the first error met, if any.
+status_t write_flush(corpus_writer *w)
+{
+	ssize_t written;
+
+	if (w->err == B_OK && w->used)
+	{
+		written = w->io->Write(w->buffer,w->used);
+		if (written != (ssize_t)w->used)
+			w->err = written < 0 ? written : B_ERROR;
+	}
+	w->used = 0;
+	return w->err;
+}
+
+//	write_done()
+//	flush, and let go of the buffer.
+status_t write_done(corpus_writer *w)
+{
+	status_t err = write_flush(w);
+
+	free(w->buffer);
+	return err;
+}
@@ -0,0 +1,57 @@
+//	XPMCorpus.h
+//
+//	seeded, synthetic inputs for the codec: XPMs and B_TRANSLATOR_BITMAP
+//	streams made to order, so that benchmarks and stress runs can build
+//	their corpus on the fly instead of shipping one.  The same spec and
+//	seed always give the same bytes.
+#ifndef XPM_CORPUS_H
+#define XPM_CORPUS_H
+
+#include <be/TranslationKit.h>
+#include <be/SupportKit.h>
+
+//	how the keys--pixel strings in an XPM, pixel values in a bitmap--are
+//	chosen, and laid out over the image
+#define		CORPUS_KEYS_SPREAD		0	// encoder's order, colors spread, pixels at random
+#define		CORPUS_KEYS_SHUFFLED	1	// scattered over every key the cpp or space allows
+#define		CORPUS_KEYS_PREFIX		2	// sharing all but their last character, or low bits
+#define		CORPUS_KEYS_ASCENDING	3	// close, ascending colors, met in order as a gradient
+
+typedef struct
+{
+	int width;
+	int height;
+	int colors;						// distinct keys, including a transparent one
+	int cpp;						// XPM: characters per pixel
+	bool xpm2;						// XPM: write XPM2 rather than XPM3
+	bool named;						// XPM: use color names while there are enough
+	color_space space;				// bitmap: the color space
+	double transparent;				// fraction of pixels that are transparent
+	double repeat;					// fraction of rows that repeat the row above
+	int keys;						// CORPUS_KEYS_*
+	uint32 seed;
+}
+corpus_spec;
+
+//	a color space bitmaps can be made in, by name
+typedef struct
+{
+	const char *name;
+	color_space space;
+}
+corpus_space;
+
+extern const corpus_space corpus_spaces[];
+extern const int corpus_space_count;
+
+void corpus_defaults(corpus_spec *);
+const char *corpus_keys_name(int);
+int corpus_keys_value(const char *);
+int corpus_space_index(const char *, size_t);
+int corpus_max_colors(const corpus_spec *, bool);
+status_t write_corpus_xpm(const corpus_spec *, BDataIO *);
+status_t write_corpus_bitmap(const corpus_spec *, BDataIO *);
+uint8 *make_corpus(const corpus_spec *, bool, size_t *);
+uint32 next_random(uint32 *);
+
+#endif
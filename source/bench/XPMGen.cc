@@ -0,0 +1,162 @@
+//	XPMGen.cc
+//
+//	writes synthetic XPMs or B_TRANSLATOR_BITMAP streams made to order,
+//	the same bytes for the same options and seed.  With --count=n, n
+//	images are made with seeds seed, seed+1, ...; the output name then
+//	holds a "%d" for the image's number.
+//
+//	usage: xpmgen [--format=xpm|xpm2|bits] [--size=WxH] [--colors=n]
+//		[--cpp=n] [--space=rgba32|rgb32|rgb16|rgb15|cmap8|gray8|gray1]
+//		[--named] [--transparent=fraction] [--repeat=fraction]
+//		[--keys=spread|shuffled|prefix|ascending] [--seed=n] [--count=n]
+//		[--output=file]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "XPMCorpus.h"
+
+typedef struct
+{
+	corpus_spec spec;
+	bool xpm;
+	int count;
+	const char *output;
+}
+gen_options;
+
+//	a BDataIO onto a stdio stream
+class StdioIO : public BDataIO
+{
+	public:
+		StdioIO(FILE *file) : file(file) {}
+		virtual ssize_t Read(void *buffer, size_t size) { return fread(buffer,1,size,file); }
+		virtual ssize_t Write(const void *buffer, size_t size)
+			{ return fwrite(buffer,1,size,file) == size ? (ssize_t)size : B_ERROR; }
+	private:
+		FILE *file;
+};
+
+status_t parse_options(int, char **, gen_options *);
+
+int main(int argc, char **argv)
+{
+	gen_options options;
+	char path[1024];
+	FILE *file;
+	status_t err;
+	int i;
+
+	if (parse_options(argc,argv,&options) != B_OK)
+	{
+		fprintf(stderr,"usage: %s [--format=xpm|xpm2|bits] [--size=WxH] [--colors=n] [--cpp=n]\n"
+			"\t[--space=rgba32|rgb32|rgb16|rgb15|cmap8|gray8|gray1] [--named]"
+			" [--transparent=fraction]\n"
+			"\t[--repeat=fraction] [--keys=spread|shuffled|prefix|ascending] [--seed=n]"
+			" [--count=n]\n"
+			"\t[--output=file]\n",argv[0]);
+		return 1;
+	}
+	if (options.spec.colors > corpus_max_colors(&options.spec,options.xpm))
+	{
+		fprintf(stderr,"%s: at most %d colors fit\n",argv[0],
+			corpus_max_colors(&options.spec,options.xpm));
+		return 1;
+	}
+	if (options.count > 1 && (!options.output || !strstr(options.output,"%d")))
+	{
+		fprintf(stderr,"%s: --count needs an --output name holding \"%%d\"\n",argv[0]);
+		return 1;
+	}
+
+	for (i = 0; i < options.count; i++)
+	{
+		file = stdout;
+		if (options.output)
+		{
+			snprintf(path,sizeof(path),options.output,i);
+			file = fopen(path,"wb");
+			if (!file)
+			{
+				perror(path);
+				return 1;
+			}
+		}
+		StdioIO io(file);
+
+		err = options.xpm ? write_corpus_xpm(&options.spec,&io)
+			: write_corpus_bitmap(&options.spec,&io);
+		if (file != stdout && fclose(file))
+			err = B_ERROR;
+		if (err != B_OK)
+		{
+			fprintf(stderr,"%s: error %ld writing %s\n",argv[0],(long)err,
+				options.output ? path : "output");
+			return 1;
+		}
+		options.spec.seed++;
+	}
+	return 0;
+}
+
+status_t parse_options(int argc, char **argv, gen_options *options)
+{
+	const char *arg;
+	int i, space;
+
+	corpus_defaults(&options->spec);
+	options->xpm = true;
+	options->count = 1;
+	options->output = NULL;
+	for (i = 1; i < argc; i++)
+	{
+		arg = argv[i];
+		if (!strncmp(arg,"--format=",9))
+		{
+			options->xpm = strcmp(arg + 9,"bits") != 0;
+			options->spec.xpm2 = !strcmp(arg + 9,"xpm2");
+			if (options->xpm && !options->spec.xpm2 && strcmp(arg + 9,"xpm"))
+				return B_BAD_VALUE;
+		}
+		else if (!strncmp(arg,"--size=",7))
+		{
+			if (sscanf(arg + 7,"%dx%d",&options->spec.width,&options->spec.height) != 2
+				|| options->spec.width <= 0 || options->spec.height <= 0)
+				return B_BAD_VALUE;
+		}
+		else if (!strncmp(arg,"--colors=",9))
+			options->spec.colors = atoi(arg + 9);
+		else if (!strncmp(arg,"--cpp=",6))
+			options->spec.cpp = atoi(arg + 6);
+		else if (!strncmp(arg,"--space=",8))
+		{
+			space = corpus_space_index(arg + 8,strlen(arg + 8));
+			if (space < 0)
+				return B_BAD_VALUE;
+			options->spec.space = corpus_spaces[space].space;
+		}
+		else if (!strcmp(arg,"--named"))
+			options->spec.named = true;
+		else if (!strncmp(arg,"--transparent=",14))
+			options->spec.transparent = atof(arg + 14);
+		else if (!strncmp(arg,"--repeat=",9))
+			options->spec.repeat = atof(arg + 9);
+		else if (!strncmp(arg,"--keys=",7))
+		{
+			options->spec.keys = corpus_keys_value(arg + 7);
+			if (options->spec.keys < 0)
+				return B_BAD_VALUE;
+		}
+		else if (!strncmp(arg,"--seed=",7))
+			options->spec.seed = strtoul(arg + 7,NULL,0);
+		else if (!strncmp(arg,"--count=",8))
+			options->count = atoi(arg + 8);
+		else if (!strncmp(arg,"--output=",9))
+			options->output = arg + 9;
+		else
+			return B_BAD_VALUE;
+	}
+	if (options->spec.colors <= 0 || options->spec.cpp <= 0 || options->count <= 0)
+		return B_BAD_VALUE;
+	return B_OK;
+}
@@ -0,0 +1,640 @@
+//	XPMMicroBench.cc
+//
+//	the codec's hot spots, each measured on its own over controlled inputs:
+//	the pixel string and color hashes, color string parsing, named color
+//	lookup, XPMScanner::GetString(), the row conversion of every color
+//	space scan_bitmap() understands, and UTreeDictionary.  A line of JSON
+//	is written to the output for every kernel, and a table to stderr;
+//	where Linux's performance counters can be read, they are given per
+//	operation and per byte as well.
+//
+//	usage: xpmmicrobench [--filter=substring] [--min-time=seconds]
+//		[--seed=n] [--output=file]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "XPM.h"
+#include "fromXPM.h"
+#include "toXPM.h"
+#include "ScanBitmap.h"
+#include "XPMScanner.h"
+#include "XPMColors.h"
+#include "UTreeDictionary.h"
+#include "PerfCounters.h"
+
+#define		MICRO_KEYS				16384
+#define		MICRO_ROW_PIXELS		4096
+
+//	one batch of a kernel: runs it over its inputs and returns how many
+//	operations that was
+typedef uint64 (*micro_kernel)(void *);
+
+typedef struct
+{
+	const char *filter;
+	double minTime;
+	uint32 seed;
+	FILE *output;
+	perf_counters counters;
+}
+micro_options;
+
+//	what a kernel's result is measured in, and anything else it tells
+typedef struct
+{
+	const char *unit;				// what one operation is
+	uint64 bytes;					// bytes per batch, for MB/s; 0 if none
+	char note[128];					// extra JSON fields, or empty
+}
+micro_info;
+
+typedef struct
+{
+	xpm_info info;
+	char *codes;
+	int count;
+}
+pix_hash_data;
+
+typedef struct
+{
+	rgb_color *colors;
+	int count;
+	int tableSize;
+}
+color_hash_data;
+
+typedef struct
+{
+	const char **strings;
+	int count;
+}
+string_data;
+
+typedef struct
+{
+	char *text;
+	size_t length;
+	size_t stringSize;
+}
+scanner_data;
+
+typedef struct
+{
+	color_space space;
+	uint8 *row;
+	rgb_color *pixels;
+}
+convert_data;
+
+typedef struct
+{
+	int32 *keys;
+	int32 *misses;
+	int count;
+	UTreeDictionary *dictionary;
+}
+tree_data;
+
+volatile uint32 sink;
+
+status_t parse_options(int, char **, micro_options *);
+void run_kernel(micro_options *, const char *, micro_kernel, void *, micro_info *);
+uint32 next_random(uint32 *);
+double now(void);
+void bench_pix_hash(micro_options *);
+void bench_color_hash(micro_options *);
+void bench_color_strings(micro_options *);
+void bench_scanner(micro_options *);
+void bench_convert(micro_options *);
+void bench_tree(micro_options *);
+uint64 pix_hash_kernel(void *);
+uint64 color_hash_kernel(void *);
+uint64 color_string_kernel(void *);
+uint64 hex_color_kernel(void *);
+uint64 named_color_kernel(void *);
+uint64 scanner_kernel(void *);
+uint64 convert_kernel(void *);
+uint64 tree_insert_kernel(void *);
+uint64 tree_find_kernel(void *);
+uint64 tree_miss_kernel(void *);
+
+int main(int argc, char **argv)
+{
+	micro_options options;
+
+	if (parse_options(argc,argv,&options) != B_OK)
+	{
+		fprintf(stderr,"usage: %s [--filter=substring] [--min-time=seconds] [--seed=n]"
+			" [--output=file]\n",argv[0]);
+		return 1;
+	}
+	fprintf(options.output,"{\"type\":\"run\",\"timestamp\":%ld,\"seed\":%lu,\"min_time\":%g}\n",
+		(long)time(NULL),(unsigned long)options.seed,options.minTime);
+	fprintf(stderr,"%-40s %12s %-8s %10s %10s\n","kernel","ns/op","op","MB/s","cyc/op");
+	perf_open(&options.counters);
+
+	bench_pix_hash(&options);
+	bench_color_hash(&options);
+	bench_color_strings(&options);
+	bench_scanner(&options);
+	bench_convert(&options);
+	bench_tree(&options);
+
+	perf_close(&options.counters);
+	if (options.output != stdout)
+		fclose(options.output);
+	return 0;
+}
+
+status_t parse_options(int argc, char **argv, micro_options *options)
+{
+	const char *arg;
+	int i;
+
+	options->filter = NULL;
+	options->minTime = 0.2;
+	options->seed = 1;
+	options->output = stdout;
+	for (i = 1; i < argc; i++)
+	{
+		arg = argv[i];
+		if (!strncmp(arg,"--filter=",9))
+			options->filter = arg + 9;
+		else if (!strncmp(arg,"--min-time=",11))
+			options->minTime = atof(arg + 11);
+		else if (!strncmp(arg,"--seed=",7))
+			options->seed = strtoul(arg + 7,NULL,0);
+		else if (!strncmp(arg,"--output=",9))
+		{
+			options->output = fopen(arg + 9,"w");
+			if (!options->output)
+				return B_ERROR;
+		}
+		else
+			return B_BAD_VALUE;
+	}
+	return B_OK;
+}
+
+//	run_kernel()
+//	run batches of "kernel" until "minTime" has passed, at least three
+//	times, and report the fastest batch per operation.  The counters are
+//	over every batch.
+void run_kernel(micro_options *options, const char *name, micro_kernel kernel, void *arg,
+	micro_info *info)
+{
+	double start, elapsed, total = 0, best = 1e30;
+	uint64 ops = 0;
+	int batches = 0;
+	char rate[32] = "", cycles[32] = "-";
+	char perOp[256], perByte[256];
+	perf_counts counts;
+
+	if (options->filter && !strstr(name,options->filter))
+		return;
+	perf_clear(&counts);
+	while (batches < 3 || total < options->minTime)
+	{
+		start = now();
+		perf_start(&options->counters);
+		ops = kernel(arg);
+		perf_stop(&options->counters,&counts);
+		elapsed = now() - start;
+		total += elapsed;
+		batches++;
+		if (elapsed < best)
+			best = elapsed;
+	}
+	if (info->bytes)
+		sprintf(rate,"%.3f",info->bytes/best/1e6);
+	perf_format(&counts,(double)ops*batches,perOp,sizeof(perOp));
+	perf_format(&counts,(double)info->bytes*batches,perByte,sizeof(perByte));
+	if (counts.valid[PERF_CYCLES])
+		sprintf(cycles,"%.2f",counts.value[PERF_CYCLES]/((double)ops*batches));
+	fprintf(options->output,"{\"type\":\"kernel\",\"name\":\"%s\",\"unit\":\"%s\","
+		"\"ns_per_op\":%.3f,\"ops_per_batch\":%llu,\"batches\":%d%s%s,\"counters_per_op\":%s,"
+		"\"counters_per_byte\":%s%s%s}\n",
+		name,info->unit,best*1e9/ops,(unsigned long long)ops,batches,
+		rate[0] ? ",\"mb_per_s\":" : "",rate,perOp,perByte,info->note[0] ? "," : "",info->note);
+	fprintf(stderr,"%-40s %12.3f %-8s %10s %10s\n",name,best*1e9/ops,info->unit,
+		rate[0] ? rate : "-",cycles);
+}
+
+//	bench_pix_hash()
+//	hash_pix_string() over every pixel string of 4096 colors, for each
+//	cpp.  The number of table slots the strings land in shows how well
+//	they are spread.
+void bench_pix_hash(micro_options *options)
+{
+	pix_hash_data pd;
+	micro_info info;
+	char name[64];
+	bool *used;
+	int cpp, i, j, n, slots;
+
+	for (cpp = 1; cpp <= 4; cpp++)
+	{
+		memset(&pd.info,0,sizeof(pd.info));
+		pd.info.pixwidth = cpp;
+		pd.count = cpp == 1 ? XPM_CHAR_COUNT : 4096;
+		pd.info.ncolors = pd.count;
+		pd.info.clutSize = 4*pd.count;
+		pd.codes = (char *)malloc((size_t)pd.count*cpp);
+		used = (bool *)calloc(pd.info.clutSize,sizeof(bool));
+		for (i = 0; i < pd.count; i++)
+			for (j = 0, n = i; j < cpp; j++, n /= XPM_CHAR_COUNT)
+				pd.codes[(size_t)i*cpp + j] = XPM_CHAR_SET[n % XPM_CHAR_COUNT];
+		for (i = 0, slots = 0; i < pd.count; i++)
+		{
+			n = hash_pix_string(pd.codes + (size_t)i*cpp,&pd.info);
+			if (n >= 0 && n < pd.info.clutSize && !used[n])
+			{
+				used[n] = true;
+				slots++;
+			}
+		}
+		info.unit = "string";
+		info.bytes = 0;
+		sprintf(info.note,"\"keys\":%d,\"table\":%d,\"slots_used\":%d",pd.count,pd.info.clutSize,
+			slots);
+		sprintf(name,"hash_pix_string/cpp%d",cpp);
+		run_kernel(options,name,pix_hash_kernel,&pd,&info);
+		free(used);
+		free(pd.codes);
+	}
+}
+
+uint64 pix_hash_kernel(void *arg)
+{
+	pix_hash_data *pd = (pix_hash_data *)arg;
+	uint32 h = 0;
+	int i;
+
+	for (i = 0; i < pd->count; i++)
+		h += hash_pix_string(pd->codes + (size_t)i*pd->info.pixwidth,&pd->info);
+	sink = h;
+	return pd->count;
+}
+
+//	bench_color_hash()
+//	hash_color() over random colors and over a gradient, whose colors
+//	differ in few bits.
+void bench_color_hash(micro_options *options)
+{
+	color_hash_data cd;
+	micro_info info;
+	uint32 seed = options->seed, value;
+	bool *used;
+	int pass, i, slots;
+
+	cd.count = MICRO_KEYS;
+	cd.tableSize = 4*cd.count;
+	cd.colors = (rgb_color *)malloc(cd.count*sizeof(rgb_color));
+	used = (bool *)malloc(cd.tableSize*sizeof(bool));
+	for (pass = 0; pass < 2; pass++)
+	{
+		for (i = 0; i < cd.count; i++)
+		{
+			value = pass ? (uint32)i*0x010101 : next_random(&seed);
+			cd.colors[i].red = value >> 16;
+			cd.colors[i].green = value >> 8;
+			cd.colors[i].blue = value;
+			cd.colors[i].alpha = 0xff;
+		}
+		memset(used,0,cd.tableSize*sizeof(bool));
+		for (i = 0, slots = 0; i < cd.count; i++)
+		{
+			value = hash_color(&cd.colors[i],cd.tableSize);
+			if (value < (uint32)cd.tableSize && !used[value])
+			{
+				used[value] = true;
+				slots++;
+			}
+		}
+		info.unit = "color";
+		info.bytes = 0;
+		sprintf(info.note,"\"keys\":%d,\"table\":%d,\"slots_used\":%d",cd.count,cd.tableSize,slots);
+		run_kernel(options,pass ? "hash_color/gradient" : "hash_color/random",color_hash_kernel,&cd,
+			&info);
+	}
+	free(used);
+	free(cd.colors);
+}
+
+uint64 color_hash_kernel(void *arg)
+{
+	color_hash_data *cd = (color_hash_data *)arg;
+	uint32 h = 0;
+	int i;
+
+	for (i = 0; i < cd->count; i++)
+		h += hash_color(&cd->colors[i],cd->tableSize);
+	sink = h;
+	return cd->count;
+}
+
+//	bench_color_strings()
+//	handle_color_string() over the kinds of color an XPM gives, and the
+//	two kernels it leans on, handle_hex_color() and find_named_color().
+//	handle_color_string() tokenizes its string in place, so each call
+//	works on a copy, which is part of what is measured.
+void bench_color_strings(micro_options *options)
+{
+	static const char *hex6[] = { "c #1a2b3c", "c #ffffff", "c #000000", "c #7f7f7f" };
+	static const char *hex12[] = { "c #1a1a2b2b3c3c", "c #ffffffffffff", "c #000000000000" };
+	static const char *none[] = { "c None", "c none" };
+	static const char *named[] = { "c snow", "c red", "c LightGreen", "c NoSuchColor" };
+	static const char *keys[] = { "s background m white g4 white g grey c #c0c0c0",
+		"m black c #000000", "s symbol c None" };
+	static const char *hex[] = { "1a", "ff", "00", "1a1a", "f" };
+	static const char *names[] = { "snow", "red", "DarkRed", "LightGreen", "NoSuchColor" };
+	const struct
+	{
+		const char *name;
+		const char **strings;
+		int count;
+		micro_kernel kernel;
+		const char *unit;
+	}
+	cases[] =
+	{
+		{ "handle_color_string/hex6", hex6, 4, color_string_kernel, "string" },
+		{ "handle_color_string/hex12", hex12, 3, color_string_kernel, "string" },
+		{ "handle_color_string/none", none, 2, color_string_kernel, "string" },
+		{ "handle_color_string/named", named, 4, color_string_kernel, "string" },
+		{ "handle_color_string/keys", keys, 3, color_string_kernel, "string" },
+		{ "handle_hex_color", hex, 5, hex_color_kernel, "string" },
+		{ "find_named_color", names, 5, named_color_kernel, "lookup" }
+	};
+	string_data sd;
+	micro_info info;
+	unsigned int i;
+
+	for (i = 0; i < sizeof(cases)/sizeof(cases[0]); i++)
+	{
+		sd.strings = cases[i].strings;
+		sd.count = cases[i].count;
+		info.unit = cases[i].unit;
+		info.bytes = 0;
+		info.note[0] = 0;
+		run_kernel(options,cases[i].name,cases[i].kernel,&sd,&info);
+	}
+}
+
+uint64 color_string_kernel(void *arg)
+{
+	string_data *sd = (string_data *)arg;
+	char string[256];
+	rgb_color color;
+	uint32 h = 0;
+	int i, k;
+
+	for (k = 0; k < 64; k++)
+		for (i = 0; i < sd->count; i++)
+		{
+			strcpy(string,sd->strings[i]);
+			handle_color_string(string,&color);
+			h += color.red;
+		}
+	sink = h;
+	return 64*sd->count;
+}
+
+uint64 hex_color_kernel(void *arg)
+{
+	string_data *sd = (string_data *)arg;
+	uint8 value;
+	uint32 h = 0;
+	int i, k;
+
+	for (k = 0; k < 256; k++)
+		for (i = 0; i < sd->count; i++)
+		{
+			handle_hex_color((char *)sd->strings[i],&value);
+			h += value;
+		}
+	sink = h;
+	return 256*sd->count;
+}
+
+uint64 named_color_kernel(void *arg)
+{
+	string_data *sd = (string_data *)arg;
+	rgb_color color;
+	uint32 h = 0;
+	int i, k;
+
+	for (k = 0; k < 64; k++)
+		for (i = 0; i < sd->count; i++)
+			h += find_named_color(sd->strings[i],&color);
+	sink = h;
+	return 64*sd->count;
+}
+
+//	bench_scanner()
+//	XPMScanner::GetString() through 4 MB of quoted strings of a few lengths,
+//	as an XPM's rows would be laid out.
+void bench_scanner(micro_options *options)
+{
+	static const size_t lengths[] = { 16, 256, 4096, 65536 };
+	scanner_data sd;
+	micro_info info;
+	char name[64];
+	size_t size = 4 << 20;
+	unsigned int i;
+	char *t, *end;
+	uint32 seed = options->seed;
+
+	for (i = 0; i < sizeof(lengths)/sizeof(lengths[0]); i++)
+	{
+		sd.stringSize = lengths[i];
+		sd.text = (char *)malloc(size + lengths[i] + 8);
+		t = sd.text;
+		end = sd.text + size;
+		while (t < end)
+		{
+			*t++ = '"';
+			for (size_t j = 0; j < lengths[i]; j++)
+				*t++ = XPM_CHAR_SET[next_random(&seed) % XPM_CHAR_COUNT];
+			*t++ = '"';
+			*t++ = ',';
+			*t++ = '\n';
+		}
+		sd.length = t - sd.text;
+		info.unit = "string";
+		info.bytes = sd.length;
+		info.note[0] = 0;
+		sprintf(name,"XPMScanner::GetString/%zu",lengths[i]);
+		run_kernel(options,name,scanner_kernel,&sd,&info);
+		free(sd.text);
+	}
+}
+
+uint64 scanner_kernel(void *arg)
+{
+	scanner_data *sd = (scanner_data *)arg;
+	BMemoryIO input(sd->text,sd->length);
+	XPMScanner scanner(&input);
+	char *string;
+	uint64 count = 0;
+
+	string = (char *)malloc(sd->stringSize + 1);
+	if (scanner.Setup() == B_OK)
+		while (scanner.GetString(string,sd->stringSize + 1) == B_OK)
+			count++;
+	free(string);
+	return count ? count : 1;
+}
+
+//	bench_convert()
+//	convert_row(), the heart of scan_bitmap(), over a row of random pixels
+//	in each color space.
+void bench_convert(micro_options *options)
+{
+	static const struct
+	{
+		const char *name;
+		color_space space;
+	}
+	spaces[] =
+	{
+		{ "rgba32", B_RGBA32 }, { "rgb32", B_RGB32 }, { "rgba32_big", B_RGBA32_BIG },
+		{ "rgb16", B_RGB16 }, { "rgb16_big", B_RGB16_BIG }, { "rgb15", B_RGB15 },
+		{ "rgb15_big", B_RGB15_BIG }, { "cmap8", B_CMAP8 }, { "gray8", B_GRAY8 },
+		{ "gray1", B_GRAY1 }
+	};
+	convert_data cd;
+	micro_info info;
+	char name[64];
+	uint32 seed = options->seed;
+	unsigned int i, j;
+
+	cd.row = (uint8 *)malloc(4*MICRO_ROW_PIXELS);
+	cd.pixels = (rgb_color *)malloc(MICRO_ROW_PIXELS*sizeof(rgb_color));
+	for (j = 0; j < 4*MICRO_ROW_PIXELS; j++)
+		cd.row[j] = next_random(&seed);
+	for (i = 0; i < sizeof(spaces)/sizeof(spaces[0]); i++)
+	{
+		cd.space = spaces[i].space;
+		info.unit = "pixel";
+		info.bytes = row_bytes(cd.space,MICRO_ROW_PIXELS);
+		info.note[0] = 0;
+		sprintf(name,"convert_row/%s",spaces[i].name);
+		run_kernel(options,name,convert_kernel,&cd,&info);
+	}
+	free(cd.row);
+	free(cd.pixels);
+}
+
+uint64 convert_kernel(void *arg)
+{
+	convert_data *cd = (convert_data *)arg;
+
+	convert_row(cd->space,cd->row,MICRO_ROW_PIXELS,cd->pixels);
+	sink = cd->pixels[MICRO_ROW_PIXELS - 1].red;
+	return MICRO_ROW_PIXELS;
+}
+
+//	bench_tree()
+//	UTreeDictionary::Insert() and Find(), hits and misses, with random
+//	keys and with the ascending keys a gradient gives, at a few sizes.
+void bench_tree(micro_options *options)
+{
+	static const int counts[] = { 256, 4096, 65536 };
+	tree_data td;
+	micro_info info;
+	char name[64];
+	uint32 seed;
+	int pass, i, k;
+
+	for (pass = 0; pass < 2; pass++)
+		for (k = 0; k < 3; k++)
+		{
+//	ascending keys leave an unbalanced tree a list; keep them few
+			if (pass && counts[k] > 4096)
+				continue;
+			seed = options->seed;
+			td.count = counts[k];
+			td.keys = (int32 *)malloc(td.count*sizeof(int32));
+			td.misses = (int32 *)malloc(td.count*sizeof(int32));
+			for (i = 0; i < td.count; i++)
+			{
+				td.keys[i] = pass ? i*2 : (int32)(next_random(&seed) << 1);
+				td.misses[i] = td.keys[i] | 1;
+			}
+			info.unit = "key";
+			info.bytes = 0;
+			info.note[0] = 0;
+			sprintf(name,"UTreeDictionary::Insert/%s/%d",pass ? "ascending" : "random",td.count);
+			run_kernel(options,name,tree_insert_kernel,&td,&info);
+
+			td.dictionary = new UTreeDictionary(sizeof(int32));
+			for (i = 0; i < td.count; i++)
+				td.dictionary->Insert(&td.keys[i],td.keys[i]);
+			sprintf(name,"UTreeDictionary::Find/%s/%d",pass ? "ascending" : "random",td.count);
+			run_kernel(options,name,tree_find_kernel,&td,&info);
+			sprintf(name,"UTreeDictionary::Find/%s/%d/miss",pass ? "ascending" : "random",td.count);
+			run_kernel(options,name,tree_miss_kernel,&td,&info);
+			delete td.dictionary;
+			free(td.keys);
+			free(td.misses);
+		}
+}
+
+uint64 tree_insert_kernel(void *arg)
+{
+	tree_data *td = (tree_data *)arg;
+	UTreeDictionary *dictionary = new UTreeDictionary(sizeof(int32));
+	int i;
+
+	for (i = 0; i < td->count; i++)
+		dictionary->Insert(&td->keys[i],td->keys[i]);
+	delete dictionary;
+	return td->count;
+}
+
+uint64 tree_find_kernel(void *arg)
+{
+	tree_data *td = (tree_data *)arg;
+	int32 value;
+	uint32 h = 0;
+	int i;
+
+	for (i = 0; i < td->count; i++)
+		if (td->dictionary->Find(&value,td->keys[i]))
+			h += value;
+	sink = h;
+	return td->count;
+}
+
+uint64 tree_miss_kernel(void *arg)
+{
+	tree_data *td = (tree_data *)arg;
+	uint32 h = 0;
+	int i;
+
+	for (i = 0; i < td->count; i++)
+		h += td->dictionary->Find(NULL,td->misses[i]);
+	sink = h;
+	return td->count;
+}
+
+//	next_random()
+//	a small, seeded generator, so that every run measures the same inputs.
+uint32 next_random(uint32 *state)
+{
+	*state = *state*1664525 + 1013904223;
+	return *state >> 8;
+}
+
+double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec + ts.tv_nsec*1e-9;
+}
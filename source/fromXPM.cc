@@ -6,10 +6,31 @@
 //	XPM file are examined; the 'static char *' declarations and
 //	other 'C' language trappings are ignored.
 
+#include <fcntl.h>
+#include <limits.h>
+#include <File.h>
+#include <sys/mman.h>
+#include <unistd.h>
 #include "XPM.h"
 #include "fromXPM.h"
 #include "XPMScanner.h"
 #include "XPMColors.h"
+#include "RowBands.h"
+#include "XPMTrace.h"
+
+//	pixel data at least this large is written into a mapped view of the
+//	output file rather than through Write().
+#define		XPM_MAP_MIN_BYTES		(1 << 20)
+
+//	the rows are scanned ahead, this many bytes of pixel strings at a time,
+//	for the decoding threads to work on; rows decoded for a stream are
+//	written out in chunks of about the same size.  These, a row string and
+//	the color table are all the memory decoding takes, however large the
+//	image.
+#define		XPM_DECODE_CHUNK		(1 << 20)
+
+//	room for the value and color strings
+#define		XPM_STRING_SIZE			10240
 
 //	XPM color space constants, in order of increasing precedence
 enum
@@ -20,62 +41,78 @@ enum
 	XPM_COLOR
 };
 
-//	entry in that XPM color hash table
+//	a chunk of scanned row strings, shared by the decoding threads.  Row
+//	"origin" of the image goes at "rows".
 typedef struct
 {
-	char string[16];
-	rgb_color color;
-	int next;
+	xpm_info *info;
+	char *text;
+	int *offset;
+	int first;
+	int origin;
+	uint8 *rows;
+	int32 rowBytes;
 }
-xpm_clut_entry;
-
-//	Necessary XPM information--header info and color hash table
-typedef struct
-{
-	int width;
-	int height;
-	int ncolors;
-	int pixwidth;
-	int xhotspot;
-	int yhotspot;
-	bool extFlag;
-	int clutSize;
-	xpm_clut_entry *clut;
-}
-xpm_info;
+decode_data;
 
+status_t map_xpm_output(BFile *, TranslatorBitmap *, XPMScanner *, xpm_info *);
+status_t decode_xpm_rows(XPMScanner *, xpm_info *, uint8 *, int32, BPositionIO *);
+status_t decode_band(int, int, int, void *);
+status_t read_xpm_header(XPMScanner *, char *, xpm_info *);
+int decode_xpm_row(char *, xpm_info *, uint8 *);
 status_t handle_value_string(char *, xpm_info *);
-status_t handle_color_string(char *, rgb_color *);
-status_t handle_hex_color(char *, uint8 *);
-uint32 hash_pix_string(char *, xpm_info *);
 
 //	fromXPM()
 //	accepts XPM file in "input" stream, and, if all goes well,
 //	outputs the B_TRANSLATOR_DATA, in the color space B_RGBA32,
-//	into the "output" stream.
-status_t fromXPM(BPositionIO *input, BPositionIO *output)
+//	into the "output" stream.  A large bitmap going into a file is
+//	decoded straight into a mapped view of the file; otherwise the rows
+//	are decoded and written out a chunk at a time.  If "stats" is given,
+//	the translation is counted into it; if "context" is, its memory comes
+//	from there.
+status_t fromXPM(BPositionIO *input, BPositionIO *output, xpm_stats *stats, XPMContext *context)
 {
 	status_t err;
-	char pixstr[16];
-	char string[10240];
+	char string[XPM_STRING_SIZE];
 	xpm_info xpmInfo;
-	uint8 *data, *t;
+	xpm_heap heap;
 	TranslatorBitmap bmap;
-	int size, i, j, k, last, length;
-	XPMScanner scanner(input);
+	BFile *file;
+	uint64 dataSize;
+	XPMStatsIO countedInput(input,stats), countedOutput(output,stats);
+	XPMTraceSpan span("fromXPM",true);
 	
+//	a mapped file is written without Write(), so it is found before the
+//	output is wrapped for counting
+	file = dynamic_cast<BFile *>(output);
+	if (stats)
+	{
+		init_xpm_stats(stats);
+		input = &countedInput;
+		output = &countedOutput;
+	}
+	heap.stats = stats;
+	heap.context = context;
+	XPMScanner scanner(input,&heap);
+
+	xpmInfo.stats = stats;
+	xpmInfo.heap = &heap;
 	err = scanner.Setup();
 	if (err != B_OK)
 		return B_ERROR;
-
-//	first string:  XPM width, height, number of colors, characters-per-pixel
-//	populate TranslatorBitmap header, ensuring big-endianness
-	err = scanner.GetString(string);
+	err = read_xpm_header(&scanner,string,&xpmInfo);
 	if (err != B_OK)
 		return B_ERROR;
-	err = handle_value_string(string,&xpmInfo);
-	if (err != B_OK || xpmInfo.width < 0 || xpmInfo.height < 0 || xpmInfo.pixwidth <= 0)
+
+//	a B_TRANSLATOR_BITMAP can't describe more than 4 GB of pixel data
+	dataSize = (uint64)4*xpmInfo.width*xpmInfo.height;
+	if (dataSize > 0xffffffffULL)
+	{
+		xpm_free(&heap,xpmInfo.clut);
 		return B_ERROR;
+	}
+
+//	populate TranslatorBitmap header, ensuring big-endianness
 	bmap.magic = B_TRANSLATOR_BITMAP;
 	swap_data(B_INT32_TYPE,&bmap.magic,sizeof(bmap.magic),B_SWAP_HOST_TO_BENDIAN);
 	bmap.bounds.Set(0,0,xpmInfo.width-1,xpmInfo.height-1);
@@ -84,93 +121,480 @@ status_t fromXPM(BPositionIO *input, BPositionIO *output)
 	swap_data(B_INT32_TYPE,&bmap.rowBytes,sizeof(bmap.rowBytes),B_SWAP_HOST_TO_BENDIAN);
 	bmap.colors = B_RGB_32_BIT;
 	swap_data(B_INT32_TYPE,&bmap.colors,sizeof(bmap.colors),B_SWAP_HOST_TO_BENDIAN);
-	size = 4*xpmInfo.width;
-	bmap.dataSize = 4*xpmInfo.width*xpmInfo.height;
+	bmap.dataSize = (uint32)dataSize;
 	swap_data(B_INT32_TYPE,&bmap.dataSize,sizeof(bmap.dataSize),B_SWAP_HOST_TO_BENDIAN);
 
-//	allocate bytes for pixel data--four bytes for each of width*height pixels
-//	this pixel data is all initialized to zero, so that any missing or corrupt
-//	pixel data will result in _black_ pixels in the resulting bitmap.
-	data = (uint8 *)malloc(size);
+//	the size of the output is known now, so a file can be given its full
+//	size at once and mapped; if that can't be done, the rows are written
+//	out as usual.
+	if (file && dataSize >= XPM_MAP_MIN_BYTES)
+	{
+		err = map_xpm_output(file,&bmap,&scanner,&xpmInfo);
+		if (err == B_OK)
+		{
+			if (stats)
+				stats->bytesWritten += sizeof(bmap) + dataSize;
+			xpm_free(&heap,xpmInfo.clut);
+			return B_OK;
+		}
+	}
+
+//	write out the header and the pixel data
+	if (output->Write(&bmap,sizeof(bmap)) != sizeof(bmap))
+		err = B_IO_ERROR;
+	else
+		err = decode_xpm_rows(&scanner,&xpmInfo,NULL,4*xpmInfo.width,output);
+
+//	free allocated data structures
+	xpm_free(&heap,xpmInfo.clut);
+	return err;
+}
+
+//	fromXPM()
+//	decodes the XPM file in "input" straight into caller memory, such as
+//	the Bits() of a BBitmap, as B_RGBA32 pixels: each row of the image goes
+//	"rowBytes" after the last, and the image must fit into "bounds", the
+//	extent of the memory at "bits".  get_xpm_bounds() gives the size needed.
+status_t fromXPM(BPositionIO *input, void *bits, int32 rowBytes, BRect bounds, xpm_stats *stats,
+	XPMContext *context)
+{
+	status_t err;
+	char string[XPM_STRING_SIZE];
+	xpm_info xpmInfo;
+	xpm_heap heap;
+	XPMStatsIO countedInput(input,stats);
+	XPMTraceSpan span("fromXPM",true);
+
+	if (!bits)
+		return B_BAD_VALUE;
+	if (stats)
+	{
+		init_xpm_stats(stats);
+		input = &countedInput;
+	}
+	heap.stats = stats;
+	heap.context = context;
+	XPMScanner scanner(input,&heap);
+
+	xpmInfo.stats = stats;
+	xpmInfo.heap = &heap;
+	err = scanner.Setup();
+	if (err != B_OK)
+		return B_ERROR;
+	err = read_xpm_header(&scanner,string,&xpmInfo);
+	if (err != B_OK)
+		return B_ERROR;
+	if (xpmInfo.width > 1+bounds.IntegerWidth() || xpmInfo.height > 1+bounds.IntegerHeight()
+		|| rowBytes < (int64)4*xpmInfo.width)
+	{
+		xpm_free(&heap,xpmInfo.clut);
+		return B_BAD_VALUE;
+	}
+
+	err = decode_xpm_rows(&scanner,&xpmInfo,(uint8 *)bits,rowBytes,NULL);
+	xpm_free(&heap,xpmInfo.clut);
+	return err;
+}
+
+//	map_xpm_output()
+//	give "file" room for the header, already in big-endian order, and the
+//	pixel data, from its current position on, then write both into a mapped
+//	view of it, leaving the position at the end.  A shared mapping that is
+//	written needs a descriptor open for reading as well, so a file opened
+//	only for writing is turned down before its size is touched.  Nothing
+//	has been read from "scanner" if this fails, so the caller can write the
+//	rows out.
+status_t map_xpm_output(BFile *file, TranslatorBitmap *bmap, XPMScanner *scanner, xpm_info *xpmInfo)
+{
+	status_t err;
+	off_t position, base, size, oldSize;
+	size_t length;
+	uint8 *map;
+	int fd, mode;
+
+	position = file->Position();
+	if (position < 0 || file->GetSize(&oldSize) != B_OK)
+		return B_ERROR;
+	size = position + sizeof(*bmap) + (off_t)4*xpmInfo->width*xpmInfo->height;
+	base = position - position % B_PAGE_SIZE;
+	if ((uint64)(size - base) > (size_t)-1)
+		return B_ERROR;
+	length = size - base;
+
+//	the mapping outlives the descriptor it was made with
+	fd = file->Dup();
+	if (fd < 0)
+		return B_ERROR;
+	mode = fcntl(fd,F_GETFL);
+	if (mode < 0 || (mode & O_ACCMODE) != O_RDWR)
+	{
+		close(fd);
+		return B_ERROR;
+	}
+	if (size > oldSize && file->SetSize(size) != B_OK)
+	{
+		close(fd);
+		return B_ERROR;
+	}
+	map = (uint8 *)mmap(NULL,length,PROT_READ | PROT_WRITE,MAP_SHARED,fd,base);
+	close(fd);
+	if (map == (uint8 *)MAP_FAILED)
+	{
+		if (size > oldSize)
+			file->SetSize(oldSize);
+		return B_ERROR;
+	}
+
+	memcpy(map + (position - base),bmap,sizeof(*bmap));
+	err = decode_xpm_rows(scanner,xpmInfo,map + (position - base) + sizeof(*bmap),4*xpmInfo->width,
+		NULL);
+	trace_begin("unmap output","bytes",length);
+	munmap(map,length);
+	trace_end("unmap output");
+	if (err != B_OK)
+	{
+		if (size > oldSize)
+			file->SetSize(oldSize);
+		return err;
+	}
+	file->Seek(size,SEEK_SET);
+	return B_OK;
+}
+
+//	decode_xpm_rows()
+//	decode the pixel rows into memory at "rows", each row "rowBytes" after
+//	the last, or, if "output" is given, into a buffer of a chunk of rows
+//	that is written out to "output" as each chunk is done.  The strings are
+//	scanned a chunk at a time and the rows of each chunk decoded in parallel
+//	bands.  Fails before reading anything, if it can't get its memory.
+status_t decode_xpm_rows(XPMScanner *scanner, xpm_info *xpmInfo, uint8 *rows, int32 rowBytes,
+	BPositionIO *output)
+{
+	status_t err = B_OK;
+	size_t used, textSize, chunkBytes;
+	int first, last, count, chunkRows;
+	uint8 *buffer = NULL;
+	decode_data dd;
+	xpm_phase phase;
+
+//	while less than a chunk is used there is room for another row string
+//	of the width of the image; every string takes at least its null.
+	textSize = XPM_DECODE_CHUNK + (size_t)xpmInfo->width*xpmInfo->pixwidth + 1;
+	chunkRows = xpmInfo->height < XPM_DECODE_CHUNK + 1 ? xpmInfo->height : XPM_DECODE_CHUNK + 1;
+	if (output)
+	{
+		if (rowBytes > 0 && XPM_DECODE_CHUNK / rowBytes < chunkRows)
+			chunkRows = XPM_DECODE_CHUNK / rowBytes;
+		if (chunkRows < 1)
+			chunkRows = 1;
+		buffer = (uint8 *)xpm_malloc(xpmInfo->heap,(size_t)chunkRows*rowBytes + 1);
+		rows = buffer;
+	}
+	dd.info = xpmInfo;
+	dd.rows = rows;
+	dd.rowBytes = rowBytes;
+	dd.text = (char *)xpm_malloc(xpmInfo->heap,textSize);
+	dd.offset = (int *)xpm_malloc(xpmInfo->heap,((size_t)chunkRows + 1)*sizeof(int));
+	if (!dd.text || !dd.offset || (output && !buffer))
+	{
+		xpm_free(xpmInfo->heap,dd.text);
+		xpm_free(xpmInfo->heap,dd.offset);
+		xpm_free(xpmInfo->heap,buffer);
+		return B_NO_MEMORY;
+	}
+
+	start_phase(xpmInfo->stats,&phase);
+	for (first = 0; first < xpmInfo->height && err == B_OK; first = last)
+	{
+		used = 0;
+		trace_begin("scan rows");
+		for (last = first;
+			last < xpmInfo->height && used < XPM_DECODE_CHUNK && last - first < chunkRows; last++)
+		{
+			if (scanner->GetString(&dd.text[used],textSize - used) != B_OK)
+			{
+				dd.offset[last - first] = -1;
+				continue;
+			}
+			dd.offset[last - first] = used;
+			used += strlen(&dd.text[used]) + 1;
+		}
+		trace_end("scan rows","rows",last - first);
+		dd.first = first;
+		dd.origin = output ? first : 0;
+		count = last - first;
+		err = run_row_bands(count_row_bands(xpmInfo->width,count),count,decode_band,NULL,&dd);
+		if (err == B_OK && output)
+		{
+			chunkBytes = (size_t)count*rowBytes;
+			trace_begin("write chunk","bytes",chunkBytes);
+			if (output->Write(buffer,chunkBytes) != (ssize_t)chunkBytes)
+				err = B_IO_ERROR;
+			trace_end("write chunk");
+		}
+	}
+	end_phase(xpmInfo->stats,&phase,XPM_PHASE_PIXELS);
+
+	xpm_free(xpmInfo->heap,dd.text);
+	xpm_free(xpmInfo->heap,dd.offset);
+	xpm_free(xpmInfo->heap,buffer);
+	return err;
+}
+
+//	decode_band()
+//	decode the rows [first, last) of the current chunk.  Runs in a worker
+//	thread; only reads the strings and the color hash table, and adds its
+//	probes of the table to the stats, if there are any.
+status_t decode_band(int band, int first, int last, void *arg)
+{
+	decode_data *dd = (decode_data *)arg;
+	uint8 *row;
+	int64 probes = 0;
+	int i;
+
+	trace_begin("decode band","rows",last - first);
+	for (i = first; i < last; i++)
+	{
+		row = dd->rows + (size_t)(dd->first + i - dd->origin)*dd->rowBytes;
+		memset(row,0,(size_t)4*dd->info->width);
+		if (dd->offset[i] >= 0)
+			probes += decode_xpm_row(&dd->text[dd->offset[i]],dd->info,row);
+	}
+	if (dd->info->stats)
+		atomic_add64(&dd->info->stats->probes,probes);
+	trace_end("decode band");
+	return B_OK;
+}
+
+//	XPMRowDecoder::XPMRowDecoder(BPositionIO *, XPMContext *)
+//	decode the XPM in "input", taking memory from "context", if it is given.
+XPMRowDecoder::XPMRowDecoder(BPositionIO *input, XPMContext *context)
+	: scanner(input,&heap)
+{
+	heap.stats = NULL;
+	heap.context = context;
+	info.stats = NULL;
+	info.heap = &heap;
+	info.clut = NULL;
+	info.width = info.height = 0;
+	string = NULL;
+	stringSize = 0;
+	row = 0;
+}
+
+XPMRowDecoder::~XPMRowDecoder()
+{
+	xpm_free(&heap,info.clut);
+	xpm_free(&heap,string);
+}
+
+//	XPMRowDecoder::ReadHeader(void)
+//	read the value and color strings, up to the first row.
+status_t XPMRowDecoder::ReadHeader(void)
+{
+	status_t err;
+
+	if (string)
+		return B_BAD_VALUE;
+	string = (char *)xpm_malloc(&heap,XPM_STRING_SIZE);
+	if (!string)
+		return B_NO_MEMORY;
+	stringSize = XPM_STRING_SIZE;
+	err = scanner.Setup();
+	if (err != B_OK)
+		return B_ERROR;
+	err = read_xpm_header(&scanner,string,&info);
+	if (err != B_OK)
+		return err == B_NO_MEMORY ? err : B_ERROR;
+
+//	a row string, with its null, may be longer than the header's
+	if ((size_t)info.width*info.pixwidth + 1 > stringSize)
+	{
+		xpm_free(&heap,string);
+		stringSize = (size_t)info.width*info.pixwidth + 1;
+		string = (char *)xpm_malloc(&heap,stringSize);
+		if (!string)
+			return B_NO_MEMORY;
+	}
+	return B_OK;
+}
+
+int XPMRowDecoder::Width(void) const
+{
+	return info.width;
+}
+
+int XPMRowDecoder::Height(void) const
+{
+	return info.height;
+}
+
+//	XPMRowDecoder::DecodeRow(uint8 *)
+//	decode the next row into "bits", which has room for Width() B_RGBA32
+//	pixels.  As fromXPM() does, a row missing from the file comes out
+//	clear; B_ERROR once every row has been decoded.
+status_t XPMRowDecoder::DecodeRow(uint8 *bits)
+{
+	if (!info.clut || row >= info.height)
+		return B_ERROR;
+	memset(bits,0,(size_t)4*info.width);
+	if (scanner.GetString(string,stringSize) == B_OK)
+		decode_xpm_row(string,&info,bits);
+	row++;
+	return B_OK;
+}
+
+//	get_xpm_bounds()
+//	read just the value string of the XPM file in "input", to find the
+//	bounds of the image, then seek back to where reading started.
+status_t get_xpm_bounds(BPositionIO *input, BRect *bounds)
+{
+	status_t err;
+	char string[XPM_STRING_SIZE];
+	xpm_info xpmInfo;
+	off_t position;
+	XPMScanner scanner(input);
+
+	xpmInfo.stats = NULL;
+	xpmInfo.heap = NULL;
+	position = input->Position();
+	err = scanner.Setup();
+	if (err == B_OK)
+		err = scanner.GetString(string,sizeof(string));
+	if (err == B_OK)
+		err = handle_value_string(string,&xpmInfo);
+	input->Seek(position,SEEK_SET);
+	if (err != B_OK || xpmInfo.width <= 0 || xpmInfo.height <= 0)
+		return B_ERROR;
+	bounds->Set(0,0,xpmInfo.width-1,xpmInfo.height-1);
+	return B_OK;
+}
+
+//	read_xpm_header()
+//	read the value string and the color strings, filling out "xpmInfo" and
+//	its color hash table, which the caller must xpm_free().  "string" is a
+//	buffer to scan into.  A missing or corrupt color string is not an
+//	error, so that what can be read of the pixels is.
+status_t read_xpm_header(XPMScanner *scanner, char *string, xpm_info *xpmInfo)
+{
+	status_t err;
+	char pixstr[16];
+	int i, j, last, chain, maxChain = 0;
+	xpm_phase phase;
+
+//	first string:  XPM width, height, number of colors, characters-per-pixel
+	start_phase(xpmInfo->stats,&phase);
+	err = scanner->GetString(string,XPM_STRING_SIZE);
+	if (err != B_OK)
+		return B_ERROR;
+	err = handle_value_string(string,xpmInfo);
+	if (err != B_OK || xpmInfo->width < 0 || xpmInfo->height < 0 || xpmInfo->pixwidth <= 0
+		|| xpmInfo->pixwidth >= sizeof(pixstr))
+		return B_ERROR;
+
+//	a row of B_RGBA32 pixels must fit in its int32 rowBytes, and the
+//	color table by an int
+	if (xpmInfo->width > INT_MAX/4 || xpmInfo->ncolors < 0 || xpmInfo->ncolors > INT_MAX/4)
+		return B_ERROR;
+	end_phase(xpmInfo->stats,&phase,XPM_PHASE_HEADER);
+	start_phase(xpmInfo->stats,&phase);
+	trace_begin("palette","colors",xpmInfo->ncolors);
 
 //	allocate and initialize color hash table.
 //	multiplicative hash (see hash_string() below), coalesced chaining.
 //	an XPM file represents pixels by fixed-width strings of ASCII characters.
 //	associated either with RGB values or with colors specified by the X color
 //	named defined in "rgb.txt".	
-	xpmInfo.clutSize = 4*xpmInfo.ncolors;
-	xpmInfo.clut = (xpm_clut_entry *)calloc(xpmInfo.clutSize,sizeof(xpm_clut_entry));
-	for (i = 0; i < xpmInfo.ncolors; i++)
+	xpmInfo->clutSize = 4*xpmInfo->ncolors;
+	if (xpmInfo->clutSize < 1)
+		xpmInfo->clutSize = 1;
+	xpmInfo->clut = (xpm_clut_entry *)xpm_calloc(xpmInfo->heap,xpmInfo->clutSize,
+		sizeof(xpm_clut_entry));
+	if (!xpmInfo->clut)
+	{
+		trace_end("palette");
+		return B_NO_MEMORY;
+	}
+	for (i = 0; i < xpmInfo->ncolors; i++)
 	{
-		err = scanner.GetString(string);
+		err = scanner->GetString(string,XPM_STRING_SIZE);
 		if (err != B_OK)
-			goto bail;
-		if (strlen(string) < xpmInfo.pixwidth)
+			break;
+		if (strlen(string) < xpmInfo->pixwidth)
 			continue;
-		strncpy(pixstr,string,xpmInfo.pixwidth);
-		j = hash_pix_string(pixstr,&xpmInfo);
-		if (strlen(xpmInfo.clut[j].string))
+		strncpy(pixstr,string,xpmInfo->pixwidth);
+		j = hash_pix_string(pixstr,xpmInfo);
+		chain = 1;
+		if (strlen(xpmInfo->clut[j].string))
 		{
-			while (xpmInfo.clut[j].next != -1)
-				j = xpmInfo.clut[j].next;
+			for (chain = 2; xpmInfo->clut[j].next != -1; chain++)
+				j = xpmInfo->clut[j].next;
 			last = j;
-			while (strlen(xpmInfo.clut[j].string))
+			while (strlen(xpmInfo->clut[j].string))
 			{
 				j++;
-				if (j >= xpmInfo.clutSize)
+				if (j >= xpmInfo->clutSize)
 					j = 0;
 			}
-			xpmInfo.clut[last].next = j;
+			xpmInfo->clut[last].next = j;
 		}
-		handle_color_string(&string[xpmInfo.pixwidth],&xpmInfo.clut[j].color);
-		strncpy(xpmInfo.clut[j].string,pixstr,xpmInfo.pixwidth);
-		xpmInfo.clut[j].next = -1;
-	}	
+		handle_color_string(&string[xpmInfo->pixwidth],&xpmInfo->clut[j].color);
+		strncpy(xpmInfo->clut[j].string,pixstr,xpmInfo->pixwidth);
+		xpmInfo->clut[j].next = -1;
+		if (chain > maxChain)
+			maxChain = chain;
+	}
+	end_phase(xpmInfo->stats,&phase,XPM_PHASE_PALETTE);
+	trace_end("palette");
+	if (xpmInfo->stats)
+	{
+		xpmInfo->stats->ncolors = xpmInfo->ncolors;
+		xpmInfo->stats->cpp = xpmInfo->pixwidth;
+		xpmInfo->stats->maxChain = maxChain;
+	}
+	return B_OK;
+}
 
-//	scan the strings of XPM pixel data, comparing groups of pixels to the
+//	decode_xpm_row()
+//	scan a string of XPM pixel data, comparing groups of pixels to the
 //	strings stored in the color hash table.  Store the pixel values in
-//	BGRA order, as specified by the B_RGBA32 color space.
-bail:
-	output->Write(&bmap,sizeof(bmap));
-	for (i = 0; i < xpmInfo.height; i++)
+//	BGRA order, as specified by the B_RGBA32 color space, into "row",
+//	which has room for the width of the image; unknown pixels are skipped.
+//	Returns the number of table entries looked at.
+int decode_xpm_row(char *string, xpm_info *xpmInfo, uint8 *row)
+{
+	int j, probes = 0;
+	size_t k, length;
+	uint8 *t, *end;
+
+	length = strlen(string);
+	t = row;
+	end = row + (size_t)4*xpmInfo->width;
+	for (k = 0; k < length && t < end; k += xpmInfo->pixwidth)
 	{
-		err = scanner.GetString(string);
-		memset(data,0,size);
-		if (err == B_OK)
-		{
-			length = strlen(string);
-			t = data;
-			for (k = 0; k < length; k += xpmInfo.pixwidth)
+		j = hash_pix_string(&string[k],xpmInfo);
+		if (strlen(xpmInfo->clut[j].string))
+			do
 			{
-				j = hash_pix_string(&string[k],&xpmInfo);
-				if (strlen(xpmInfo.clut[j].string))
-				{
-					do
-					{
-						if (!strncmp(xpmInfo.clut[j].string,&string[k],xpmInfo.pixwidth))
-							break;
-						j = xpmInfo.clut[j].next;
-					}
-					while (j != -1);
-					if (j == -1)
-						t += 4;
-					else
-					{
-						*t++ = xpmInfo.clut[j].color.blue;
-						*t++ = xpmInfo.clut[j].color.green;
-						*t++ = xpmInfo.clut[j].color.red;
-						*t++ = xpmInfo.clut[j].color.alpha;
-					}
-				}
+				probes++;
+				if (!strncmp(xpmInfo->clut[j].string,&string[k],xpmInfo->pixwidth))
+					break;
+				j = xpmInfo->clut[j].next;
 			}
+			while (j != -1);
+		else
+			j = -1;
+		if (j == -1)
+			t += 4;
+		else
+		{
+			*t++ = xpmInfo->clut[j].color.blue;
+			*t++ = xpmInfo->clut[j].color.green;
+			*t++ = xpmInfo->clut[j].color.red;
+			*t++ = xpmInfo->clut[j].color.alpha;
 		}
-		output->Write(data,size);
 	}
-
-//	Write out the header and pixel data; free allocated data structures
-	free(xpmInfo.clut);
-	free(data);
-	return B_OK;
+	return probes;
 }
 
 //	handle_value_string()
@@ -192,35 +616,35 @@ bail:
 //	or other extra data, here ignored.
 status_t handle_value_string(char *string, xpm_info *info)
 {
-	char *token;
+	char *token, *last;
 	int n;
 	
 	info->extFlag = false;		
-	token = strtok(string," \t");
+	token = strtok_r(string," \t",&last);
 	if (!token)
 		return B_ERROR;
 	n = sscanf(token,"%d",&info->width);
 	if (!n)
 		return B_ERROR;
-	token = strtok(NULL," \t");
+	token = strtok_r(NULL," \t",&last);
 	if (!token)
 		return B_ERROR;
 	n = sscanf(token,"%d",&info->height);
 	if (!n)
 		return B_ERROR;
-	token = strtok(NULL," \t");
+	token = strtok_r(NULL," \t",&last);
 	if (!token)
 		return B_ERROR;
 	n = sscanf(token,"%d",&info->ncolors);
 	if (!n)
 		return B_ERROR;
-	token = strtok(NULL," \t");
+	token = strtok_r(NULL," \t",&last);
 	if (!token)
 		return B_ERROR;
 	n = sscanf(token,"%d",&info->pixwidth);
 	if (!n)
 		return B_ERROR;
-	token = strtok(NULL," \t");
+	token = strtok_r(NULL," \t",&last);
 	if (!token)
 		return B_OK;
 	else if (!strcmp("XPMEXT",token))
@@ -231,7 +655,7 @@ status_t handle_value_string(char *string, xpm_info *info)
 		if (!n)
 			return B_ERROR;
 	}
-	token = strtok(NULL," \t");
+	token = strtok_r(NULL," \t",&last);
 	if (!token)
 	{
 		if (info->extFlag)
@@ -244,14 +668,14 @@ status_t handle_value_string(char *string, xpm_info *info)
 	n = sscanf(token,"%d",&info->yhotspot);
 	if (!n)
 		return B_ERROR;
-	token = strtok(NULL," \t");
+	token = strtok_r(NULL," \t",&last);
 	if (!token)
 		return B_OK;
 	else if (!strcmp("XPMEXT",token))
 		info->extFlag = true;
 	else
 		return B_ERROR;
-	token = strtok(NULL," \t");
+	token = strtok_r(NULL," \t",&last);
 	if (token)
 		return B_ERROR;
 		
@@ -279,12 +703,13 @@ status_t handle_color_string(char *string, rgb_color *color)
 	char *type;
 	char *str;
 	char *value;
+	char *last;
 	char hex[16];
 	status_t err;
 	bool done = false;
 	bool gotColor = false;
 	bool first = true;
-	int i, length, width, depth, maxdepth = -1;
+	int length, width, depth, maxdepth = -1;
 
 	while (!done)
 	{
@@ -295,8 +720,8 @@ status_t handle_color_string(char *string, rgb_color *color)
 		}
 		else
 			str = NULL;
-		type = strtok(str," \t");
-		value = strtok(NULL," \t");
+		type = strtok_r(str," \t",&last);
+		value = strtok_r(NULL," \t",&last);
 		if (!type || !value)
 		{
 			done = true;
@@ -347,22 +772,9 @@ status_t handle_color_string(char *string, rgb_color *color)
 				*color = B_TRANSPARENT_32_BIT;
 				gotColor = true;
 			}
-			else
-			{
-				i = 0;
 //	...otherwise search the list of "named" colors.
-				while (named_color[i].name)
-				{
-					if (!strcmp(named_color[i].name,value))
-					{
-						*color = named_color[i].color;
-						gotColor = true;
-						break;
-					}
-					else
-						i++;
-				}
-			}
+			else if (find_named_color(value,color))
+				gotColor = true;
 		}
 	}
 
@@ -408,5 +820,5 @@ uint32 hash_pix_string(char *string, xpm_info *xpmInfo)
 	}
 	
 	f = modf(i*phi,&g);
-	return (uint32)f*xpmInfo->clutSize;
+	return (uint32)(f*xpmInfo->clutSize);
 }
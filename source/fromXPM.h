@@ -2,6 +2,70 @@
 #ifndef FROMXPM_H
 #define FROMXPM_H
 
-status_t fromXPM(BPositionIO *, BPositionIO *);
+#include "XPMContext.h"
+#include "XPMScanner.h"
+
+status_t fromXPM(BPositionIO *, BPositionIO *, xpm_stats * = NULL, XPMContext * = NULL);
+status_t fromXPM(BPositionIO *, void *, int32, BRect, xpm_stats * = NULL, XPMContext * = NULL);
+status_t get_xpm_bounds(BPositionIO *, BRect *);
+status_t handle_color_string(char *, rgb_color *);
+
+//	the decoder's color hash table and the kernels behind it are declared
+//	here so that they can be measured on their own (see bench/).
+
+//	entry in the XPM color hash table
+typedef struct
+{
+	char string[16];
+	rgb_color color;
+	int next;
+}
+xpm_clut_entry;
+
+//	Necessary XPM information--header info and color hash table
+typedef struct
+{
+	int width;
+	int height;
+	int ncolors;
+	int pixwidth;
+	int xhotspot;
+	int yhotspot;
+	bool extFlag;
+	int clutSize;
+	xpm_clut_entry *clut;
+	xpm_stats *stats;			// NULL when not counting
+	xpm_heap *heap;
+}
+xpm_info;
+
+status_t handle_hex_color(char *, uint8 *);
+uint32 hash_pix_string(char *, xpm_info *);
+
+//	decodes an XPM a row at a time, for a caller that passes the rows on
+//	as they come, such as a filter in a pipe.  "input" is only ever read
+//	onward, a buffer at a time, so it needn't be able to seek.  Memory
+//	is the color table and a row string, however tall the image.
+class XPMRowDecoder
+{
+	public:
+
+		XPMRowDecoder(BPositionIO *, XPMContext * = NULL);
+		~XPMRowDecoder();
+
+		status_t ReadHeader(void);
+		int Width(void) const;
+		int Height(void) const;
+		status_t DecodeRow(uint8 *);
+
+	private:
+
+		xpm_heap heap;
+		XPMScanner scanner;
+		xpm_info info;
+		char *string;
+		size_t stringSize;
+		int row;
+};
 
 #endif
\ No newline at end of file
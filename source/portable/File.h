@@ -0,0 +1,3 @@
+//	File.h
+//	see Portable.h
+#include "Portable.h"
@@ -0,0 +1,778 @@
+//	Portable.cc
+//	implementations behind Portable.h, on top of POSIX threads and files.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "Portable.h"
+
+#define		PORTABLE_MAX_THREADS		1024
+#define		PORTABLE_MAX_SEMS			256
+
+const rgb_color B_TRANSPARENT_COLOR = { 0x77, 0x74, 0x77, 0x00 };
+
+//	swap_data()
+//	only the types the codec swaps are handled.
+status_t swap_data(type_code type, void *data, size_t length, swap_action action)
+{
+	uint32 *word = (uint32 *)data;
+	size_t i;
+
+	if (action == B_SWAP_HOST_TO_LENDIAN || action == B_SWAP_LENDIAN_TO_HOST)
+	{
+		if (B_HOST_IS_LENDIAN)
+			return B_OK;
+	}
+	else if (action != B_SWAP_ALWAYS && B_HOST_IS_BENDIAN)
+		return B_OK;
+
+	switch (type)
+	{
+		case B_INT32_TYPE:
+		case B_FLOAT_TYPE:
+		case B_RECT_TYPE:
+			for (i = 0; i < length / 4; i++)
+				word[i] = __builtin_bswap32(word[i]);
+			return B_OK;
+		default:
+			return B_BAD_VALUE;
+	}
+}
+
+//	system_colors()
+//	an approximation of the default 8-bit system palette: a 6x6x6 color
+//	cube, followed by a gray ramp and the transparent magic index.  It is
+//	not Haiku's own palette, so B_CMAP8 colors differ from those on Haiku.
+const color_map *system_colors(void)
+{
+	static color_map map;
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+	struct init
+	{
+		static void run(void)
+		{
+			int i, r, g, b;
+
+			i = 0;
+			for (r = 0; r < 6; r++)
+				for (g = 0; g < 6; g++)
+					for (b = 0; b < 6; b++)
+					{
+						map.color_list[i].red = r*51;
+						map.color_list[i].green = g*51;
+						map.color_list[i].blue = b*51;
+						map.color_list[i].alpha = 0xff;
+						i++;
+					}
+			for (; i < 255; i++)
+			{
+				g = (i - 216) * 255 / 38;
+				map.color_list[i].red = g;
+				map.color_list[i].green = g;
+				map.color_list[i].blue = g;
+				map.color_list[i].alpha = 0xff;
+			}
+			map.color_list[B_TRANSPARENT_MAGIC_CMAP8] = B_TRANSPARENT_COLOR;
+		}
+	};
+
+	pthread_once(&once,init::run);
+	return &map;
+}
+
+//	BPositionIO
+ssize_t BPositionIO::Read(void *buffer, size_t size)
+{
+	off_t position = Position();
+	ssize_t result = ReadAt(position,buffer,size);
+
+	if (result > 0)
+		Seek(position + result,SEEK_SET);
+	return result;
+}
+
+ssize_t BPositionIO::Write(const void *buffer, size_t size)
+{
+	off_t position = Position();
+	ssize_t result = WriteAt(position,buffer,size);
+
+	if (result > 0)
+		Seek(position + result,SEEK_SET);
+	return result;
+}
+
+status_t BPositionIO::SetSize(off_t)
+{
+	return B_ERROR;
+}
+
+status_t BPositionIO::GetSize(off_t *size) const
+{
+	off_t position = Position();
+	BPositionIO *self = const_cast<BPositionIO *>(this);
+
+	*size = self->Seek(0,SEEK_END);
+	self->Seek(position,SEEK_SET);
+	return *size < 0 ? (status_t)*size : B_OK;
+}
+
+//	BMemoryIO
+BMemoryIO::BMemoryIO(void *data, size_t length)
+	: fReadOnly(false), fBuffer((char *)data), fLength(length),
+	  fBufferSize(length), fPosition(0)
+{
+}
+
+BMemoryIO::BMemoryIO(const void *data, size_t length)
+	: fReadOnly(true), fBuffer((char *)data), fLength(length),
+	  fBufferSize(length), fPosition(0)
+{
+}
+
+ssize_t BMemoryIO::ReadAt(off_t position, void *buffer, size_t size)
+{
+	if (position < 0)
+		return B_BAD_VALUE;
+	if ((size_t)position >= fLength)
+		return 0;
+	if (size > fLength - position)
+		size = fLength - position;
+	memcpy(buffer,fBuffer + position,size);
+	return size;
+}
+
+ssize_t BMemoryIO::WriteAt(off_t position, const void *buffer, size_t size)
+{
+	if (fReadOnly)
+		return B_NOT_SUPPORTED;
+	if (position < 0)
+		return B_BAD_VALUE;
+	if ((size_t)position >= fBufferSize)
+		return 0;
+	if (size > fBufferSize - position)
+		size = fBufferSize - position;
+	memcpy(fBuffer + position,buffer,size);
+	if (position + size > fLength)
+		fLength = position + size;
+	return size;
+}
+
+off_t BMemoryIO::Seek(off_t position, uint32 seekMode)
+{
+	switch (seekMode)
+	{
+		case SEEK_SET:
+			break;
+		case SEEK_CUR:
+			position += fPosition;
+			break;
+		case SEEK_END:
+			position += fLength;
+			break;
+		default:
+			return B_BAD_VALUE;
+	}
+	if (position < 0)
+		return B_BAD_VALUE;
+	fPosition = position;
+	return fPosition;
+}
+
+off_t BMemoryIO::Position() const
+{
+	return fPosition;
+}
+
+status_t BMemoryIO::SetSize(off_t size)
+{
+	if (fReadOnly)
+		return B_NOT_SUPPORTED;
+	if (size < 0 || (size_t)size > fBufferSize)
+		return B_ERROR;
+	fLength = size;
+	return B_OK;
+}
+
+//	BMallocIO
+BMallocIO::BMallocIO()
+	: fBlockSize(256), fMallocSize(0), fLength(0), fData(NULL), fPosition(0)
+{
+}
+
+BMallocIO::~BMallocIO()
+{
+	free(fData);
+}
+
+ssize_t BMallocIO::ReadAt(off_t position, void *buffer, size_t size)
+{
+	if (position < 0)
+		return B_BAD_VALUE;
+	if ((size_t)position >= fLength)
+		return 0;
+	if (size > fLength - position)
+		size = fLength - position;
+	memcpy(buffer,fData + position,size);
+	return size;
+}
+
+ssize_t BMallocIO::WriteAt(off_t position, const void *buffer, size_t size)
+{
+	status_t err;
+
+	if (position < 0)
+		return B_BAD_VALUE;
+	if (position + size > fLength)
+	{
+		err = SetSize(position + size);
+		if (err != B_OK)
+			return err;
+	}
+	memcpy(fData + position,buffer,size);
+	return size;
+}
+
+off_t BMallocIO::Seek(off_t position, uint32 seekMode)
+{
+	switch (seekMode)
+	{
+		case SEEK_SET:
+			break;
+		case SEEK_CUR:
+			position += fPosition;
+			break;
+		case SEEK_END:
+			position += fLength;
+			break;
+		default:
+			return B_BAD_VALUE;
+	}
+	if (position < 0)
+		return B_BAD_VALUE;
+	fPosition = position;
+	return fPosition;
+}
+
+off_t BMallocIO::Position() const
+{
+	return fPosition;
+}
+
+status_t BMallocIO::SetSize(off_t size)
+{
+	size_t newSize;
+	char *data;
+
+	if (size < 0)
+		return B_BAD_VALUE;
+	if ((size_t)size > fMallocSize)
+	{
+		newSize = (size + fBlockSize - 1) / fBlockSize * fBlockSize;
+		if (newSize < 2*fMallocSize)
+			newSize = 2*fMallocSize;
+		data = (char *)realloc(fData,newSize);
+		if (!data)
+			return B_NO_MEMORY;
+		fData = data;
+		fMallocSize = newSize;
+	}
+	if ((size_t)size > fLength)
+		memset(fData + fLength,0,size - fLength);
+	fLength = size;
+	return B_OK;
+}
+
+void BMallocIO::SetBlockSize(size_t blockSize)
+{
+	fBlockSize = blockSize ? blockSize : 1;
+}
+
+//	BMessage
+BMessage::BMessage()
+	: fFields(NULL)
+{
+}
+
+BMessage::~BMessage()
+{
+	field *next;
+
+	for (; fFields; fFields = next)
+	{
+		next = fFields->next;
+		free(fFields->name);
+		free(fFields->data);
+		delete fFields;
+	}
+}
+
+status_t BMessage::AddInt32(const char *name, int32 value)
+{
+	return AddData(name,B_INT32_TYPE,&value,sizeof(value));
+}
+
+status_t BMessage::AddInt64(const char *name, int64 value)
+{
+	return AddData(name,B_INT64_TYPE,&value,sizeof(value));
+}
+
+status_t BMessage::AddBool(const char *name, bool value)
+{
+	return AddData(name,B_BOOL_TYPE,&value,sizeof(value));
+}
+
+status_t BMessage::AddString(const char *name, const char *string)
+{
+	return AddData(name,B_STRING_TYPE,string,strlen(string) + 1);
+}
+
+status_t BMessage::FindInt32(const char *name, int32 *value) const
+{
+	const void *data;
+	status_t err = FindData(name,B_INT32_TYPE,&data);
+
+	if (err == B_OK)
+		memcpy(value,data,sizeof(*value));
+	return err;
+}
+
+status_t BMessage::FindInt64(const char *name, int64 *value) const
+{
+	const void *data;
+	status_t err = FindData(name,B_INT64_TYPE,&data);
+
+	if (err == B_OK)
+		memcpy(value,data,sizeof(*value));
+	return err;
+}
+
+status_t BMessage::FindBool(const char *name, bool *value) const
+{
+	const void *data;
+	status_t err = FindData(name,B_BOOL_TYPE,&data);
+
+	if (err == B_OK)
+		memcpy(value,data,sizeof(*value));
+	return err;
+}
+
+status_t BMessage::FindString(const char *name, const char **string) const
+{
+	const void *data;
+	status_t err = FindData(name,B_STRING_TYPE,&data);
+
+	if (err == B_OK)
+		*string = (const char *)data;
+	return err;
+}
+
+status_t BMessage::RemoveName(const char *name)
+{
+	field **link, *f;
+	status_t err = B_NAME_NOT_FOUND;
+
+	for (link = &fFields; (f = *link) != NULL; )
+		if (!strcmp(f->name,name))
+		{
+			*link = f->next;
+			free(f->name);
+			free(f->data);
+			delete f;
+			err = B_OK;
+		}
+		else
+			link = &f->next;
+	return err;
+}
+
+//	AddData()
+//	append a field; the values of a name must all be of one type.
+status_t BMessage::AddData(const char *name, type_code type, const void *data, size_t size)
+{
+	field **link, *f;
+
+	for (link = &fFields; *link; link = &(*link)->next)
+		if (!strcmp((*link)->name,name) && (*link)->type != type)
+			return B_BAD_TYPE;
+	f = new field;
+	f->name = strdup(name);
+	f->type = type;
+	f->data = malloc(size);
+	f->next = NULL;
+	if (!f->name || !f->data)
+	{
+		free(f->name);
+		free(f->data);
+		delete f;
+		return B_NO_MEMORY;
+	}
+	memcpy(f->data,data,size);
+	*link = f;
+	return B_OK;
+}
+
+//	FindData()
+//	the first value of a name, which must be of the type asked for.
+status_t BMessage::FindData(const char *name, type_code type, const void **data) const
+{
+	const field *f;
+
+	for (f = fFields; f; f = f->next)
+		if (!strcmp(f->name,name))
+		{
+			if (f->type != type)
+				return B_BAD_TYPE;
+			*data = f->data;
+			return B_OK;
+		}
+	return B_NAME_NOT_FOUND;
+}
+
+//	BFile
+BFile::BFile()
+	: fFd(-1), fCStatus(B_NO_INIT)
+{
+}
+
+BFile::BFile(const char *path, uint32 openMode)
+	: fFd(-1), fCStatus(B_NO_INIT)
+{
+	SetTo(path,openMode);
+}
+
+BFile::~BFile()
+{
+	Unset();
+}
+
+status_t BFile::SetTo(const char *path, uint32 openMode)
+{
+	int flags;
+
+	Unset();
+	switch (openMode & 0x3)
+	{
+		case B_WRITE_ONLY:
+			flags = O_WRONLY;
+			break;
+		case B_READ_WRITE:
+			flags = O_RDWR;
+			break;
+		default:
+			flags = O_RDONLY;
+			break;
+	}
+	if (openMode & B_CREATE_FILE)
+		flags |= O_CREAT;
+	if (openMode & B_ERASE_FILE)
+		flags |= O_TRUNC;
+	if (openMode & B_FAIL_IF_EXISTS)
+		flags |= O_EXCL;
+	if (openMode & B_OPEN_AT_END)
+		flags |= O_APPEND;
+	fFd = open(path,flags,0644);
+	if (fFd < 0)
+		fCStatus = errno == ENOENT ? B_ENTRY_NOT_FOUND : B_ERROR;
+	else
+		fCStatus = B_OK;
+	return fCStatus;
+}
+
+status_t BFile::InitCheck() const
+{
+	return fCStatus;
+}
+
+void BFile::Unset()
+{
+	if (fFd >= 0)
+		close(fFd);
+	fFd = -1;
+	fCStatus = B_NO_INIT;
+}
+
+int BFile::Dup()
+{
+	return fFd >= 0 ? dup(fFd) : -1;
+}
+
+ssize_t BFile::Read(void *buffer, size_t size)
+{
+	ssize_t result = read(fFd,buffer,size);
+
+	return result < 0 ? B_IO_ERROR : result;
+}
+
+ssize_t BFile::Write(const void *buffer, size_t size)
+{
+	ssize_t result = write(fFd,buffer,size);
+
+	return result < 0 ? B_IO_ERROR : result;
+}
+
+ssize_t BFile::ReadAt(off_t position, void *buffer, size_t size)
+{
+	ssize_t result = pread(fFd,buffer,size,position);
+
+	return result < 0 ? B_IO_ERROR : result;
+}
+
+ssize_t BFile::WriteAt(off_t position, const void *buffer, size_t size)
+{
+	ssize_t result = pwrite(fFd,buffer,size,position);
+
+	return result < 0 ? B_IO_ERROR : result;
+}
+
+off_t BFile::Seek(off_t position, uint32 seekMode)
+{
+	off_t result = lseek(fFd,position,seekMode);
+
+	return result < 0 ? (off_t)B_ERROR : result;
+}
+
+off_t BFile::Position() const
+{
+	off_t result = lseek(fFd,0,SEEK_CUR);
+
+	return result < 0 ? (off_t)B_ERROR : result;
+}
+
+status_t BFile::SetSize(off_t size)
+{
+	return ftruncate(fFd,size) ? B_ERROR : B_OK;
+}
+
+status_t BFile::GetSize(off_t *size) const
+{
+	struct stat st;
+
+	if (fstat(fFd,&st))
+		return B_ERROR;
+	*size = st.st_size;
+	return B_OK;
+}
+
+//	threads
+//	a thread is created suspended, as on Haiku; resume_thread() starts it.
+typedef struct
+{
+	bool used;
+	bool started;
+	pthread_t thread;
+	thread_func func;
+	void *arg;
+	status_t result;
+}
+portable_thread;
+
+static portable_thread sThreads[PORTABLE_MAX_THREADS];
+static pthread_mutex_t sThreadLock = PTHREAD_MUTEX_INITIALIZER;
+static __thread thread_id sCurrentThread = 0;
+static int32 sNextThread = 0;
+
+static void *thread_entry(void *arg)
+{
+	portable_thread *thread = (portable_thread *)arg;
+
+	sCurrentThread = 1 + (thread - sThreads);
+	thread->result = thread->func(thread->arg);
+	return NULL;
+}
+
+thread_id spawn_thread(thread_func func, const char *, int32, void *arg)
+{
+	int32 i, slot;
+
+	pthread_mutex_lock(&sThreadLock);
+	for (i = 0; i < PORTABLE_MAX_THREADS; i++)
+	{
+		slot = (sNextThread + i) % PORTABLE_MAX_THREADS;
+		if (!sThreads[slot].used)
+		{
+			sThreads[slot].used = true;
+			sThreads[slot].started = false;
+			sThreads[slot].func = func;
+			sThreads[slot].arg = arg;
+			sNextThread = slot + 1;
+			pthread_mutex_unlock(&sThreadLock);
+			return slot + 1;
+		}
+	}
+	pthread_mutex_unlock(&sThreadLock);
+	return B_NO_MEMORY;
+}
+
+status_t resume_thread(thread_id id)
+{
+	portable_thread *thread;
+
+	if (id <= 0 || id > PORTABLE_MAX_THREADS || !sThreads[id-1].used)
+		return B_BAD_THREAD_ID;
+	thread = &sThreads[id-1];
+	if (thread->started)
+		return B_OK;
+	thread->started = true;
+	if (pthread_create(&thread->thread,NULL,thread_entry,thread))
+	{
+		thread->started = false;
+		return B_NO_MEMORY;
+	}
+	return B_OK;
+}
+
+status_t wait_for_thread(thread_id id, status_t *result)
+{
+	portable_thread *thread;
+
+	if (id <= 0 || id > PORTABLE_MAX_THREADS || !sThreads[id-1].used)
+		return B_BAD_THREAD_ID;
+	thread = &sThreads[id-1];
+	if (!thread->started)
+		resume_thread(id);
+	pthread_join(thread->thread,NULL);
+	if (result)
+		*result = thread->result;
+	pthread_mutex_lock(&sThreadLock);
+	thread->used = false;
+	pthread_mutex_unlock(&sThreadLock);
+	return B_OK;
+}
+
+//	kill_thread()
+//	only a thread that was never resumed can be killed: a pthread can't be
+//	stopped safely from outside, and nothing here needs that.
+status_t kill_thread(thread_id id)
+{
+	portable_thread *thread;
+
+	if (id <= 0 || id > PORTABLE_MAX_THREADS || !sThreads[id-1].used)
+		return B_BAD_THREAD_ID;
+	thread = &sThreads[id-1];
+	if (thread->started)
+		return B_NOT_ALLOWED;
+	pthread_mutex_lock(&sThreadLock);
+	thread->used = false;
+	pthread_mutex_unlock(&sThreadLock);
+	return B_OK;
+}
+
+thread_id find_thread(const char *name)
+{
+	static int32 sMainThread = 0;
+
+	if (name)
+		return B_NAME_NOT_FOUND;
+	if (!sCurrentThread)
+		sCurrentThread = PORTABLE_MAX_THREADS + 1 + atomic_add(&sMainThread,1);
+	return sCurrentThread;
+}
+
+//	semaphores
+//	counting semaphores, as on Haiku, out of a mutex and a condition each.
+typedef struct
+{
+	bool used;
+	int32 count;
+	pthread_mutex_t lock;
+	pthread_cond_t available;
+}
+portable_sem;
+
+static portable_sem sSems[PORTABLE_MAX_SEMS];
+static pthread_mutex_t sSemLock = PTHREAD_MUTEX_INITIALIZER;
+
+static portable_sem *find_sem(sem_id id)
+{
+	if (id <= 0 || id > PORTABLE_MAX_SEMS || !sSems[id-1].used)
+		return NULL;
+	return &sSems[id-1];
+}
+
+sem_id create_sem(int32 count, const char *)
+{
+	int32 i;
+
+	if (count < 0)
+		return B_BAD_VALUE;
+	pthread_mutex_lock(&sSemLock);
+	for (i = 0; i < PORTABLE_MAX_SEMS; i++)
+		if (!sSems[i].used)
+		{
+			sSems[i].used = true;
+			sSems[i].count = count;
+			pthread_mutex_init(&sSems[i].lock,NULL);
+			pthread_cond_init(&sSems[i].available,NULL);
+			pthread_mutex_unlock(&sSemLock);
+			return i + 1;
+		}
+	pthread_mutex_unlock(&sSemLock);
+	return B_NO_MORE_SEMS;
+}
+
+status_t delete_sem(sem_id id)
+{
+	portable_sem *sem = find_sem(id);
+
+	if (!sem)
+		return B_BAD_SEM_ID;
+	pthread_mutex_lock(&sSemLock);
+	pthread_mutex_destroy(&sem->lock);
+	pthread_cond_destroy(&sem->available);
+	sem->used = false;
+	pthread_mutex_unlock(&sSemLock);
+	return B_OK;
+}
+
+status_t acquire_sem(sem_id id)
+{
+	portable_sem *sem = find_sem(id);
+
+	if (!sem)
+		return B_BAD_SEM_ID;
+	pthread_mutex_lock(&sem->lock);
+	while (sem->count <= 0)
+		pthread_cond_wait(&sem->available,&sem->lock);
+	sem->count--;
+	pthread_mutex_unlock(&sem->lock);
+	return B_OK;
+}
+
+status_t release_sem(sem_id id)
+{
+	portable_sem *sem = find_sem(id);
+
+	if (!sem)
+		return B_BAD_SEM_ID;
+	pthread_mutex_lock(&sem->lock);
+	sem->count++;
+	pthread_cond_signal(&sem->available);
+	pthread_mutex_unlock(&sem->lock);
+	return B_OK;
+}
+
+//	time and system information
+bigtime_t system_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (bigtime_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+status_t get_system_info(system_info *info)
+{
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+	memset(info,0,sizeof(*info));
+	info->cpu_count = count > 0 ? count : 1;
+//	the number of row bands can be pinned, for measurements
+	if (getenv("XPM_CPU_COUNT") && atoi(getenv("XPM_CPU_COUNT")) > 0)
+		info->cpu_count = atoi(getenv("XPM_CPU_COUNT"));
+	info->max_pages = sysconf(_SC_PHYS_PAGES);
+	return B_OK;
+}
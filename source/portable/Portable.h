@@ -0,0 +1,435 @@
+//	Portable.h
+//	a minimal stand-in for the parts of the Support, Interface, Kernel and
+//	Translation Kits that the XPM codec core and the translator's entry
+//	points use, so that they can be built and run on POSIX hosts (see
+//	"make portable").  Nothing here is meant to be complete; it covers
+//	what they need and no more.  The headers beside it, named as on Haiku,
+//	only include this one.
+
+#ifndef PORTABLE_H
+#define PORTABLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+#include <sys/types.h>
+
+//	basic types (SupportDefs.h)
+typedef int8_t int8;
+typedef uint8_t uint8;
+typedef int16_t int16;
+typedef uint16_t uint16;
+typedef int32_t int32;
+typedef uint32_t uint32;
+typedef int64_t int64;
+typedef uint64_t uint64;
+typedef int32 status_t;
+typedef int64 bigtime_t;
+typedef uint32 type_code;
+typedef int32 thread_id;
+typedef int32 sem_id;
+
+//	error codes (Errors.h); the values only need to be distinct
+#define		B_GENERAL_ERROR_BASE		INT_MIN
+#define		B_OS_ERROR_BASE				(B_GENERAL_ERROR_BASE + 0x1000)
+#define		B_STORAGE_ERROR_BASE		(B_GENERAL_ERROR_BASE + 0x6000)
+#define		B_TRANSLATION_ERROR_BASE	(B_GENERAL_ERROR_BASE + 0x4800)
+
+#define		B_OK						((status_t)0)
+#define		B_ERROR						((status_t)-1)
+#define		B_NO_MEMORY					(B_GENERAL_ERROR_BASE + 0)
+#define		B_IO_ERROR					(B_GENERAL_ERROR_BASE + 1)
+#define		B_PERMISSION_DENIED			(B_GENERAL_ERROR_BASE + 2)
+#define		B_BAD_INDEX					(B_GENERAL_ERROR_BASE + 3)
+#define		B_BAD_TYPE					(B_GENERAL_ERROR_BASE + 4)
+#define		B_BAD_VALUE					(B_GENERAL_ERROR_BASE + 5)
+#define		B_MISMATCHED_VALUES			(B_GENERAL_ERROR_BASE + 6)
+#define		B_NAME_NOT_FOUND			(B_GENERAL_ERROR_BASE + 7)
+#define		B_NO_INIT					(B_GENERAL_ERROR_BASE + 13)
+#define		B_NOT_ALLOWED				(B_GENERAL_ERROR_BASE + 15)
+#define		B_BAD_DATA					(B_GENERAL_ERROR_BASE + 16)
+#define		B_NOT_SUPPORTED				(B_GENERAL_ERROR_BASE + 17)
+#define		B_BAD_SEM_ID				(B_OS_ERROR_BASE + 0)
+#define		B_NO_MORE_SEMS				(B_OS_ERROR_BASE + 1)
+#define		B_BAD_THREAD_ID				(B_OS_ERROR_BASE + 0x300)
+#define		B_ENTRY_NOT_FOUND			(B_STORAGE_ERROR_BASE + 3)
+#define		B_FILE_TOO_LARGE			(B_STORAGE_ERROR_BASE + 12)
+#define		B_NO_TRANSLATOR				(B_TRANSLATION_ERROR_BASE + 0)
+#define		B_ILLEGAL_DATA				(B_TRANSLATION_ERROR_BASE + 1)
+
+//	byte order (ByteOrder.h)
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define		B_HOST_IS_LENDIAN			1
+#define		B_HOST_IS_BENDIAN			0
+#else
+#define		B_HOST_IS_LENDIAN			0
+#define		B_HOST_IS_BENDIAN			1
+#endif
+
+static inline float __swap_float(float value)
+{
+	uint32 word;
+
+	memcpy(&word,&value,sizeof(word));
+	word = __builtin_bswap32(word);
+	memcpy(&value,&word,sizeof(word));
+	return value;
+}
+
+#if B_HOST_IS_LENDIAN
+#define		B_BENDIAN_TO_HOST_INT16(x)	((uint16)__builtin_bswap16(x))
+#define		B_BENDIAN_TO_HOST_INT32(x)	((uint32)__builtin_bswap32(x))
+#define		B_BENDIAN_TO_HOST_FLOAT(x)	__swap_float(x)
+#define		B_LENDIAN_TO_HOST_INT16(x)	((uint16)(x))
+#define		B_LENDIAN_TO_HOST_INT32(x)	((uint32)(x))
+#else
+#define		B_BENDIAN_TO_HOST_INT16(x)	((uint16)(x))
+#define		B_BENDIAN_TO_HOST_INT32(x)	((uint32)(x))
+#define		B_BENDIAN_TO_HOST_FLOAT(x)	(x)
+#define		B_LENDIAN_TO_HOST_INT16(x)	((uint16)__builtin_bswap16(x))
+#define		B_LENDIAN_TO_HOST_INT32(x)	((uint32)__builtin_bswap32(x))
+#endif
+#define		B_HOST_TO_BENDIAN_INT16(x)	B_BENDIAN_TO_HOST_INT16(x)
+#define		B_HOST_TO_BENDIAN_INT32(x)	B_BENDIAN_TO_HOST_INT32(x)
+#define		B_HOST_TO_BENDIAN_FLOAT(x)	B_BENDIAN_TO_HOST_FLOAT(x)
+#define		B_HOST_TO_LENDIAN_INT16(x)	B_LENDIAN_TO_HOST_INT16(x)
+#define		B_HOST_TO_LENDIAN_INT32(x)	B_LENDIAN_TO_HOST_INT32(x)
+
+#define		B_INT32_TYPE				'LONG'
+#define		B_INT64_TYPE				'LLNG'
+#define		B_BOOL_TYPE					'BOOL'
+#define		B_STRING_TYPE				'CSTR'
+#define		B_FLOAT_TYPE				'FLOT'
+#define		B_RECT_TYPE					'RECT'
+
+typedef enum
+{
+	B_SWAP_HOST_TO_LENDIAN,
+	B_SWAP_HOST_TO_BENDIAN,
+	B_SWAP_LENDIAN_TO_HOST,
+	B_SWAP_BENDIAN_TO_HOST,
+	B_SWAP_ALWAYS
+}
+swap_action;
+
+status_t swap_data(type_code, void *, size_t, swap_action);
+
+//	colors and color spaces (GraphicsDefs.h)
+typedef struct
+{
+	uint8 red;
+	uint8 green;
+	uint8 blue;
+	uint8 alpha;
+}
+rgb_color;
+
+typedef struct
+{
+	int32 id;
+	rgb_color color_list[256];
+	uint8 inversion_map[256];
+	uint8 index_map[32768];
+}
+color_map;
+
+extern const rgb_color B_TRANSPARENT_COLOR;
+#define		B_TRANSPARENT_32_BIT		B_TRANSPARENT_COLOR
+#define		B_TRANSPARENT_MAGIC_CMAP8	0xff
+
+typedef enum
+{
+	B_NO_COLOR_SPACE =	0x0000,
+	B_RGB32 =			0x0008,
+	B_RGBA32 =			0x2008,
+	B_RGB16 =			0x0005,
+	B_RGB15 =			0x0010,
+	B_RGBA15 =			0x2010,
+	B_CMAP8 =			0x0004,
+	B_GRAY8 =			0x0002,
+	B_GRAY1 =			0x0001,
+	B_RGB32_BIG =		0x1008,
+	B_RGBA32_BIG =		0x3008,
+	B_RGB16_BIG =		0x1005,
+	B_RGB15_BIG =		0x1010,
+	B_RGBA15_BIG =		0x3010,
+	B_RGB32_LITTLE =	B_RGB32,
+	B_RGBA32_LITTLE =	B_RGBA32,
+	B_RGB16_LITTLE =	B_RGB16,
+	B_RGB15_LITTLE =	B_RGB15,
+	B_RGBA15_LITTLE =	B_RGBA15,
+	B_RGB_32_BIT =		B_RGB32,
+	B_COLOR_8_BIT =		B_CMAP8,
+	B_GRAY_8_BIT =		B_GRAY8,
+	B_MONOCHROME_1_BIT = B_GRAY1
+}
+color_space;
+
+const color_map *system_colors(void);
+
+//	BRect (Rect.h)
+class BRect
+{
+	public:
+
+		BRect() : left(0), top(0), right(-1), bottom(-1) {}
+		BRect(float l, float t, float r, float b)
+			: left(l), top(t), right(r), bottom(b) {}
+
+		void Set(float l, float t, float r, float b)
+			{ left = l; top = t; right = r; bottom = b; }
+		float Width() const { return right - left; }
+		float Height() const { return bottom - top; }
+		int32 IntegerWidth() const { return (int32)ceilf(right - left); }
+		int32 IntegerHeight() const { return (int32)ceilf(bottom - top); }
+
+		float left;
+		float top;
+		float right;
+		float bottom;
+};
+
+//	the Translation Kit's bitmap stream header (TranslatorFormats.h)
+#define		B_TRANSLATOR_BITMAP			'bits'
+
+struct TranslatorBitmap
+{
+	uint32 magic;
+	BRect bounds;
+	uint32 rowBytes;
+	color_space colors;
+	uint32 dataSize;
+};
+
+//	what a translator reads and writes (TranslationDefs.h)
+struct translation_format
+{
+	type_code type;
+	type_code group;
+	float quality;
+	float capability;
+	char MIME[251];
+	char name[251];
+};
+
+struct translator_info
+{
+	type_code type;
+	int32 translator;
+	type_code group;
+	float quality;
+	float capability;
+	char name[251];
+	char MIME[251];
+};
+
+//	messages (Message.h), as far as a translator's ioExtension goes: named
+//	fields of a few types, found by the first value under a name
+class BMessage
+{
+	public:
+
+		BMessage();
+		~BMessage();
+
+		status_t AddInt32(const char *name, int32 value);
+		status_t AddInt64(const char *name, int64 value);
+		status_t AddBool(const char *name, bool value);
+		status_t AddString(const char *name, const char *string);
+		status_t FindInt32(const char *name, int32 *value) const;
+		status_t FindInt64(const char *name, int64 *value) const;
+		status_t FindBool(const char *name, bool *value) const;
+		status_t FindString(const char *name, const char **string) const;
+		status_t RemoveName(const char *name);
+
+	private:
+
+		struct field
+		{
+			char *name;
+			type_code type;
+			void *data;
+			field *next;
+		};
+
+		BMessage(const BMessage &);
+		BMessage &operator=(const BMessage &);
+
+		status_t AddData(const char *name, type_code type, const void *data, size_t size);
+		status_t FindData(const char *name, type_code type, const void **data) const;
+
+		field *fFields;
+};
+
+//	streams (DataIO.h, File.h)
+enum
+{
+	B_READ_ONLY =		0x0000,
+	B_WRITE_ONLY =		0x0001,
+	B_READ_WRITE =		0x0002,
+	B_CREATE_FILE =		0x0200,
+	B_ERASE_FILE =		0x0400,
+	B_FAIL_IF_EXISTS =	0x0800,
+	B_OPEN_AT_END =		0x1000
+};
+
+class BDataIO
+{
+	public:
+
+		virtual ~BDataIO() {}
+
+		virtual ssize_t Read(void *buffer, size_t size) = 0;
+		virtual ssize_t Write(const void *buffer, size_t size) = 0;
+};
+
+class BPositionIO : public BDataIO
+{
+	public:
+
+		virtual ssize_t Read(void *buffer, size_t size);
+		virtual ssize_t Write(const void *buffer, size_t size);
+
+		virtual ssize_t ReadAt(off_t position, void *buffer, size_t size) = 0;
+		virtual ssize_t WriteAt(off_t position, const void *buffer, size_t size) = 0;
+
+		virtual off_t Seek(off_t position, uint32 seekMode) = 0;
+		virtual off_t Position() const = 0;
+
+		virtual status_t SetSize(off_t size);
+		virtual status_t GetSize(off_t *size) const;
+};
+
+class BMemoryIO : public BPositionIO
+{
+	public:
+
+		BMemoryIO(void *data, size_t length);
+		BMemoryIO(const void *data, size_t length);
+
+		virtual ssize_t ReadAt(off_t position, void *buffer, size_t size);
+		virtual ssize_t WriteAt(off_t position, const void *buffer, size_t size);
+		virtual off_t Seek(off_t position, uint32 seekMode);
+		virtual off_t Position() const;
+		virtual status_t SetSize(off_t size);
+
+	private:
+
+		bool fReadOnly;
+		char *fBuffer;
+		size_t fLength;
+		size_t fBufferSize;
+		size_t fPosition;
+};
+
+class BMallocIO : public BPositionIO
+{
+	public:
+
+		BMallocIO();
+		virtual ~BMallocIO();
+
+		virtual ssize_t ReadAt(off_t position, void *buffer, size_t size);
+		virtual ssize_t WriteAt(off_t position, const void *buffer, size_t size);
+		virtual off_t Seek(off_t position, uint32 seekMode);
+		virtual off_t Position() const;
+		virtual status_t SetSize(off_t size);
+
+		void SetBlockSize(size_t blockSize);
+		const void *Buffer() const { return fData; }
+		size_t BufferLength() const { return fLength; }
+
+	private:
+
+		size_t fBlockSize;
+		size_t fMallocSize;
+		size_t fLength;
+		char *fData;
+		off_t fPosition;
+};
+
+//	a file-descriptor backed stream, in the manner of BFile; Dup() gives a
+//	descriptor of the same file, for mapping it
+class BFile : public BPositionIO
+{
+	public:
+
+		BFile();
+		BFile(const char *path, uint32 openMode);
+		virtual ~BFile();
+
+		status_t SetTo(const char *path, uint32 openMode);
+		status_t InitCheck() const;
+		void Unset();
+		int Dup();
+
+		virtual ssize_t Read(void *buffer, size_t size);
+		virtual ssize_t Write(const void *buffer, size_t size);
+		virtual ssize_t ReadAt(off_t position, void *buffer, size_t size);
+		virtual ssize_t WriteAt(off_t position, const void *buffer, size_t size);
+		virtual off_t Seek(off_t position, uint32 seekMode);
+		virtual off_t Position() const;
+		virtual status_t SetSize(off_t size);
+		virtual status_t GetSize(off_t *size) const;
+
+	private:
+
+		int fFd;
+		status_t fCStatus;
+};
+
+//	threads, atomics and time (OS.h)
+#define		B_LOW_PRIORITY				5
+#define		B_NORMAL_PRIORITY			10
+#define		B_DISPLAY_PRIORITY			15
+#define		B_PAGE_SIZE					4096
+#define		B_INFINITE_TIMEOUT			((bigtime_t)9223372036854775807LL)
+
+typedef status_t (*thread_func)(void *);
+
+thread_id spawn_thread(thread_func, const char *, int32, void *);
+status_t resume_thread(thread_id);
+status_t wait_for_thread(thread_id, status_t *);
+status_t kill_thread(thread_id);
+thread_id find_thread(const char *);
+
+sem_id create_sem(int32, const char *);
+status_t delete_sem(sem_id);
+status_t acquire_sem(sem_id);
+status_t release_sem(sem_id);
+
+bigtime_t system_time(void);
+
+static inline int32 atomic_add(int32 *value, int32 addValue)
+{
+	return __atomic_fetch_add(value,addValue,__ATOMIC_SEQ_CST);
+}
+
+static inline int64 atomic_add64(int64 *value, int64 addValue)
+{
+	return __atomic_fetch_add(value,addValue,__ATOMIC_SEQ_CST);
+}
+
+static inline int64 atomic_test_and_set64(int64 *value, int64 newValue, int64 testAgainst)
+{
+	__atomic_compare_exchange_n(value,&testAgainst,newValue,false,__ATOMIC_SEQ_CST,
+		__ATOMIC_SEQ_CST);
+	return testAgainst;
+}
+
+typedef struct
+{
+	bigtime_t boot_time;
+	uint32 cpu_count;
+	uint64 max_pages;
+	uint64 used_pages;
+}
+system_info;
+
+status_t get_system_info(system_info *);
+
+#endif
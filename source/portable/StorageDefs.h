@@ -0,0 +1,10 @@
+//	StorageDefs.h
+//	see Portable.h
+#ifndef PORTABLE_STORAGE_DEFS_H
+#define PORTABLE_STORAGE_DEFS_H
+
+#include "Portable.h"
+
+#define		B_PATH_NAME_LENGTH			1024
+
+#endif
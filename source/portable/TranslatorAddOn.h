@@ -0,0 +1,17 @@
+//	TranslatorAddOn.h
+//	see Portable.h; the entry points a translator add-on exports
+#ifndef PORTABLE_TRANSLATOR_ADD_ON_H
+#define PORTABLE_TRANSLATOR_ADD_ON_H
+
+#include "Portable.h"
+
+extern char translatorName[];
+extern char translatorInfo[];
+extern int32 translatorVersion;
+extern translation_format inputFormats[];
+extern translation_format outputFormats[];
+
+status_t Identify(BPositionIO *, const translation_format *, BMessage *, translator_info *, uint32);
+status_t Translate(BPositionIO *, const translator_info *, BMessage *, uint32, BPositionIO *);
+
+#endif
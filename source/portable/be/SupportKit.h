@@ -0,0 +1,3 @@
+//	SupportKit.h
+//	see Portable.h
+#include "../Portable.h"
@@ -0,0 +1,3 @@
+//	TranslationKit.h
+//	see Portable.h
+#include "../Portable.h"
@@ -2,22 +2,25 @@
 //	implements toXPM(), which writes out an XPM file given B_TRANSLATOR_BITMAP
 //	data.
 
+#include <limits.h>
 #include <time.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include "XPM.h"
 #include "toXPM.h"
 #include "ScanBitmap.h"
+#include "RowBands.h"
+#include "Quantize.h"
+#include "XPMCache.h"
+#include "XPMGzip.h"
+#include "XPMTrace.h"
 
 //	an XPM file is in the form of a variable declaration; to make some attempt
 //	at declaring a variable of unique name, I append the result of time() to
-//	this base string, the _nomen_ of the poet P. Ovidius Naso.
+//	this base string, the _nomen_ of the poet P. Ovidius Naso.  Deterministic
+//	output appends a hash of the bitmap instead.
 #define		XPM_NAME_SEED		"ovidius"
 
-//	XPM pixels are represented by strings of characters.  Here's one set of
-//	possibilities.
-#define		XPM_CHAR_SET		"qwertyuiopasdfghjklzxcvbnmQWERTYUIOPASDFGHJKLZXCVBNM1234567890!@#$^&*()-=_+|[]{};':,.<>/?`~"
-
 //	entries into the color hash table
 typedef struct
 {
@@ -34,101 +37,733 @@ typedef struct
 	pix_entry *pixtable;
 	int count;
 	int width;
+	int firstChars;
+	bool xpm2;
+	xpm_stats *stats;
+	xpm_heap *heap;
+	int maxChain;
 }
 traverse_data;
 
-uint32 hash_color(rgb_color *, int);
+//	state shared by the threads formatting the pixel rows; each band is
+//	formatted into its own text buffer, and the buffers are written out in
+//	band order, so that the output is the same as that of a single thread.
+typedef struct
+{
+	BPositionIO *output;
+	bitmap_record *br;
+	traverse_data *td;
+	const char *prefix;
+	int prefixLength;
+	char suffix;
+	size_t rowLength;
+	char *text[ROW_BANDS_MAX];
+	size_t length[ROW_BANDS_MAX];
+}
+emit_data;
+
+//	the rows of a bitmap being encoded a strip at a time: in memory at
+//	"data", or else in "input" from "offset" on, read into "buffer".
+typedef struct
+{
+	TranslatorBitmap *bmap;
+	const uint8 *data;
+	BPositionIO *input;
+	off_t offset;
+	uint8 *buffer;
+}
+strip_source;
+
+status_t encode_cached(TranslatorBitmap *, BPositionIO *, const uint8 *, BPositionIO *,
+	const xpm_encode_settings *);
+status_t encode_bitmap(TranslatorBitmap *, const uint8 *, BPositionIO *,
+	const xpm_encode_settings *, xpm_heap *, uint64);
+uint64 encode_estimate(TranslatorBitmap *, bool);
+status_t encode_strips(TranslatorBitmap *, BPositionIO *, const uint8 *, BPositionIO *,
+	const xpm_encode_settings *, xpm_heap *);
+int strip_rows(bitmap_record *, size_t, size_t);
+status_t read_strip(strip_source *, int, int, const uint8 **);
+status_t quantize_strips(strip_source *, bitmap_record *, bool *, quant_stream **, rgb_color *, int,
+	const xpm_encode_settings *);
+status_t pass_strips(strip_source *, bitmap_record *, rgb_color *, int, quant_stream *, bool);
+status_t write_xpm_head(bitmap_record *, bool, traverse_data *, BPositionIO *,
+	const xpm_encode_settings *, uint64);
+void init_emit_data(emit_data *, bitmap_record *, traverse_data *, BPositionIO *);
+status_t emit_rows(emit_data *);
 void traverseHook(int, void *, void *);
+void write_color_entry(traverse_data *, pix_entry *);
+const char *find_pix_string(rgb_color *, traverse_data *, int *);
+status_t emit_band(int, int, int, void *);
+int format_row(emit_data *, int, char *);
+inline int index_at(bitmap_record *, const uint8 *, int);
+char *fill_run(char *, const char *, int, int);
+status_t write_band(int, void *);
+
+//	init_encode_settings()
+//	fill out the default settings: write every color exactly.
+void init_encode_settings(xpm_encode_settings *settings)
+{
+	settings->maxColors = 0;
+	settings->quantizer = XPM_QUANTIZE_MEDIAN_CUT;
+	settings->dither = false;
+	settings->deterministic = false;
+	settings->cacheDirectory = NULL;
+	settings->format = XPM_FORMAT_XPM3;
+	settings->gzip = false;
+	settings->memoryLimit = 0;
+	settings->stats = NULL;
+	settings->context = NULL;
+}
 
 //	toXPM()
 //	reads B_TRANSLATOR_BITMAP data from the stream "input", and prints an
-//	XPM file onto "output".
-status_t toXPM(BPositionIO *input, BPositionIO *output)
+//	XPM file onto "output".  "settings" may be NULL for the defaults; an
+//	unknown quantizer or format in them is refused with B_BAD_VALUE.
+status_t toXPM(BPositionIO *input, BPositionIO *output, const xpm_encode_settings *settings)
 {
 	status_t err;
-	rgb_color *pixel;
-	int n, i, j, ix;
+	TranslatorBitmap bmap;
+	xpm_stats *stats = settings ? settings->stats : NULL;
+	XPMStatsIO countedInput(input,stats), countedOutput(output,stats);
+	xpm_phase phase;
+	XPMTraceSpan span("toXPM",true);
+
+	if (stats)
+	{
+		init_xpm_stats(stats);
+		input = &countedInput;
+		output = &countedOutput;
+	}
+
+//	first get the bitmap header from the stream; the rows are read as the
+//	settings allow
+	start_phase(stats,&phase);
+	err = read_bitmap_header(input,&bmap);
+	end_phase(stats,&phase,XPM_PHASE_HEADER);
+	if (err != B_OK)
+		return B_ERROR;
+	return encode_cached(&bmap,input,NULL,output,settings);
+}
+
+//	toXPM()
+//	prints an XPM file onto "output" straight from pixels already in memory,
+//	such as those of a BBitmap (Bits(), BytesPerRow(), ColorSpace(), Bounds()):
+//	the rows are read where they lie, without being serialized into a
+//	B_TRANSLATOR_BITMAP stream and read back out of it.
+status_t toXPM(const void *bits, int32 rowBytes, color_space space, BRect bounds,
+	BPositionIO *output, const xpm_encode_settings *settings)
+{
+	TranslatorBitmap bmap;
+	uint64 size;
+	xpm_stats *stats = settings ? settings->stats : NULL;
+	XPMStatsIO countedOutput(output,stats);
+	XPMTraceSpan span("toXPM",true);
+
+	if (stats)
+	{
+		init_xpm_stats(stats);
+		output = &countedOutput;
+	}
+	if (!bits || bounds.IntegerWidth() < 0 || bounds.IntegerHeight() < 0
+		|| rowBytes < 0 || (size_t)rowBytes < row_bytes(space,1+bounds.IntegerWidth()))
+		return B_BAD_VALUE;
+	bmap.magic = B_TRANSLATOR_BITMAP;
+	bmap.bounds = bounds;
+	bmap.rowBytes = rowBytes;
+	bmap.colors = space;
+//	only a stream needs the size of the data, which may not fit here
+	size = (uint64)rowBytes*(1+bounds.IntegerHeight());
+	bmap.dataSize = size > 0xffffffffULL ? 0xffffffff : (uint32)size;
+	return encode_cached(&bmap,NULL,(const uint8 *)bits,output,settings);
+}
+
+//	encode_cached()
+//	apply the settings to a bitmap in host byte order, whose rows start at
+//	"data", or, if that is NULL, at the current position of "input".  The
+//	output is copied out of the cache directory, if there is one and it has
+//	the bitmap, and encoded (and the result kept there) otherwise.  Gzipped
+//	output is deflated on its way out; the cache keeps the plain XPM.  A
+//	bitmap that would take more than the memory limit is encoded in strips.
+//	Memory comes from the settings' context, if they have one.
+status_t encode_cached(TranslatorBitmap *bmap, BPositionIO *input, const uint8 *data,
+	BPositionIO *output, const xpm_encode_settings *settings)
+{
+	status_t err;
+	uint64 hash = 0, key = 0;
+	xpm_encode_settings defaults, plain;
+	xpm_heap heap;
+	BMallocIO *encoded;
+	uint8 *buffer = NULL;
+	xpm_phase phase;
+
+	if (!settings)
+	{
+		init_encode_settings(&defaults);
+		settings = &defaults;
+	}
+//	an unknown quantizer or format would be taken for one of the others
+	if ((settings->quantizer != XPM_QUANTIZE_MEDIAN_CUT
+			&& settings->quantizer != XPM_QUANTIZE_OCTREE)
+		|| (settings->format != XPM_FORMAT_XPM3 && settings->format != XPM_FORMAT_XPM2))
+		return B_BAD_VALUE;
+	heap.stats = settings->stats;
+	heap.context = settings->context;
+	if (settings->gzip)
+	{
+		XPMGzipIO gzip(output,&heap);
+
+		plain = *settings;
+		plain.gzip = false;
+		err = gzip.InitCheck();
+		if (err == B_OK)
+			err = encode_cached(bmap,input,data,&gzip,&plain);
+		if (err == B_OK)
+			err = gzip.Finish();
+		return err;
+	}
+
+	if (settings->memoryLimit > 0 && encode_estimate(bmap,!data) > settings->memoryLimit)
+		return encode_strips(bmap,input,data,output,settings,&heap);
+	start_phase(settings->stats,&phase);
+	if (!data)
+	{
+		trace_begin("read bitmap","bytes",bmap->dataSize);
+		err = read_bitmap_data(input,bmap,&buffer,&heap);
+		trace_end("read bitmap");
+		if (err != B_OK)
+			return B_ERROR;
+		data = buffer;
+	}
+
+	if (settings->deterministic || settings->cacheDirectory)
+		hash = hash_bitmap(bmap,data);
+	end_phase(settings->stats,&phase,XPM_PHASE_HEADER);
+	if (!settings->cacheDirectory)
+	{
+		err = encode_bitmap(bmap,data,output,settings,&heap,hash);
+		xpm_free(&heap,buffer);
+		return err;
+	}
+
+//	an identical bitmap encoded with the same settings before is copied
+//	straight out of the cache; otherwise the encoding is kept for next time.
+	key = cache_key(hash,settings);
+	err = read_cached_xpm(settings->cacheDirectory,key,bmap,output);
+	if (err != B_ENTRY_NOT_FOUND)
+	{
+		xpm_free(&heap,buffer);
+		return err;
+	}
+	encoded = new BMallocIO();
+	err = encode_bitmap(bmap,data,encoded,settings,&heap,hash);
+	if (err == B_OK)
+	{
+		trace_begin("write encoded","bytes",encoded->BufferLength());
+		if (output->Write(encoded->Buffer(),encoded->BufferLength())
+				!= (ssize_t)encoded->BufferLength())
+			err = B_IO_ERROR;
+		trace_end("write encoded");
+		if (err == B_OK)
+			write_cached_xpm(settings->cacheDirectory,key,bmap,encoded->Buffer(),
+				encoded->BufferLength());
+	}
+	delete encoded;
+	xpm_free(&heap,buffer);
+	return err;
+}
+
+//	encode_bitmap()
+//	write out the XPM file for a bitmap in host byte order, whose rows
+//	start at "data".  "hash" is the bitmap's hash, if the settings needed one.
+status_t encode_bitmap(TranslatorBitmap *bmap, const uint8 *data, BPositionIO *output,
+	const xpm_encode_settings *settings, xpm_heap *heap, uint64 hash)
+{
+	status_t err;
+	bool indexed = false;
 	bitmap_record br;
-	char buffer[10240];
 	traverse_data td;
+	emit_data ed;
+	xpm_phase phase;
 
-//	first get the bitmap data from the stream, into a bitmap_record data structure
+//	get the bitmap data into a bitmap_record data structure
 //	as defined in "ScanBitmap.h"	
-    
-	err = scan_bitmap(input,&br);
-	if (err != B_OK)
-	{
-      return B_ERROR;
-    }
-	
-//	write out the header, a comment string, the variable declaration.		
-	sprintf(buffer,"%s\n",XPM_HEADER);
-	output->Write(buffer,strlen(buffer));
-	sprintf(buffer,"/* XPM file written by E. Tomlinson's XPMTranslator, version 1.1.0 */\n");
-	output->Write(buffer,strlen(buffer));
-	sprintf(buffer,"static char *%s%ld[] =\n",XPM_NAME_SEED,time(NULL));
-	output->Write(buffer,strlen(buffer));
-	sprintf(buffer,"{\n");
-	output->Write(buffer,strlen(buffer));
+	start_phase(settings->stats,&phase);
+	br.ctable = NULL;
+	br.heap = heap;
+	br.pix = NULL;
+	td.pixtable = NULL;
 
-//	determine the "width" of the pixel, then
-//	write out the value string (width height number-of-colors) characters-per-pixel.	
-	n = br.ncolors;
-	td.width = 0;
-	do
+//	bitmaps in a palette-indexed color space are encoded straight from their
+//	indices, unless they use more colors than the settings allow.
+	if (is_indexed_space(bmap->colors))
 	{
-		n /= strlen(XPM_CHAR_SET);
-		td.width++;
+		trace_begin("scan bitmap");
+		err = scan_indexed_bitmap(bmap,data,&br);
+		trace_end("scan bitmap","colors",br.ncolors);
+		if (err != B_OK)
+			goto bail;
+		indexed = settings->maxColors <= 0 || br.ncolors <= settings->maxColors;
+	}
+	if (!indexed)
+	{
+		trace_begin("scan bitmap");
+		err = scan_bitmap(bmap,data,&br,settings->maxColors);
+		trace_end("scan bitmap","colors",br.ncolors);
+		if (err != B_OK)
+			goto bail;
+
+//	if a palette size was asked for, reduce the colors to fit
+		trace_begin("quantize");
+		err = quantize_bitmap(&br,settings);
+		trace_end("quantize","colors",br.ncolors);
+		if (err != B_OK)
+			goto bail;
 	}
-	while (n);
-	sprintf(buffer,"\t\"%d %d %d %d\"",br.width,br.height,br.ncolors,td.width);
-	output->Write(buffer,strlen(buffer));
-	
-//	fill out the color hash table, at the same time writing out strings
-//	representing the colors onto the output stream.
-//	In this case, colors are hashed by their RGB values, folded into a
-//	32-bit integer (see hash_color() below.)
-	td.ptSize = 4*br.ncolors;
-	td.pixtable = (pix_entry *)calloc(td.ptSize,sizeof(pix_entry));
 	
-	td.count = 0;
-	td.output = output;
-	br.ctable->TraverseInOrder(traverseHook,&td);
+	trace_begin("palette","colors",br.ncolors);
+	err = write_xpm_head(&br,indexed,&td,output,settings,hash);
+	trace_end("palette");
+	end_phase(settings->stats,&phase,XPM_PHASE_PALETTE);
+	if (err != B_OK)
+		goto bail;
 	
 //	go through the pixel data, comparing the pixel values to the values
 //	stored in the hash table and writing out the respective strings.
-	pixel = br.pix;
-	for (i = 0; i < br.height; i++)
+	start_phase(settings->stats,&phase);
+	init_emit_data(&ed,&br,&td,output);
+	err = emit_rows(&ed);
+	if (err == B_OK && !td.xpm2)
+		output->Write("};\n",3);
+	end_phase(settings->stats,&phase,XPM_PHASE_PIXELS);
+
+bail:
+	xpm_free(heap,td.pixtable);
+	delete_dictionary(br.ctable);
+	xpm_free(heap,br.pix);
+	return err;
+}
+
+//	encode_estimate()
+//	roughly the memory encode_bitmap() takes for a bitmap: the rows, if they
+//	are to be "read", their expansion into rgb_colors, unless they are
+//	indexed, and their text, at two characters a pixel.
+uint64 encode_estimate(TranslatorBitmap *bmap, bool read)
+{
+	uint64 width = 1+bmap->bounds.IntegerWidth();
+	uint64 height = 1+bmap->bounds.IntegerHeight();
+	uint64 size = height*(2*width + 8);
+
+	if (read)
+		size += (uint64)bmap->rowBytes*height;
+	if (!is_indexed_space(bmap->colors))
+		size += height*width*sizeof(rgb_color);
+	return size;
+}
+
+//	encode_strips()
+//	encode a bitmap too large to hold in memory as a whole, a strip of rows
+//	at a time, each strip taking about the memory limit: one pass over the
+//	rows gathers the colors (and the hash that names the array), and a
+//	second formats them.  The output is the same as encode_bitmap()'s, but
+//	the cache isn't used.  If there are more colors than settings->maxColors
+//	the first pass gathers their histogram too, the palette is chosen from
+//	it, and the second pass maps each row to the palette before it is
+//	formatted; see quantize_strips().  That histogram takes about 1 MB on
+//	top of the memory limit.  Rows still in a stream are read more than
+//	once, so it must be able to read at an offset.
+status_t encode_strips(TranslatorBitmap *bmap, BPositionIO *input, const uint8 *data,
+	BPositionIO *output, const xpm_encode_settings *settings, xpm_heap *heap)
+{
+	status_t err = B_OK;
+	strip_source ss;
+	bitmap_record br, strip;
+	traverse_data td;
+	emit_data ed;
+	const uint8 *rows;
+	rgb_color *pix = NULL;
+	quant_stream *qs = NULL;
+	uint64 hash;
+	size_t length;
+	int i, first, count, stripRows;
+	bool indexed;
+	xpm_phase phase;
+
+	start_phase(settings->stats,&phase);
+	br.width = 1+bmap->bounds.IntegerWidth();
+	br.height = 1+bmap->bounds.IntegerHeight();
+	br.ctable = NULL;
+	br.heap = heap;
+	br.ncolors = 0;
+	br.pix = NULL;
+	br.index = NULL;
+	br.rowBytes = bmap->rowBytes;
+	br.space = bmap->colors;
+	memset(br.count,0,sizeof(br.count));
+	td.pixtable = NULL;
+	length = row_bytes(bmap->colors,br.width);
+	if ((size_t)bmap->rowBytes < length)
+		return B_ERROR;
+	indexed = is_indexed_space(bmap->colors);
+	if (indexed)
+		indexed_palette(bmap->colors,br.palette);
+	else
+		br.ctable = new_dictionary(sizeof(rgb_color),heap);
+
+	ss.bmap = bmap;
+	ss.data = data;
+	ss.input = input;
+	ss.offset = input ? input->Position() : 0;
+	ss.buffer = NULL;
+
+//	the first pass needs only the rows as read and a row of rgb_colors
+	stripRows = strip_rows(&br,settings->memoryLimit,data ? 0 : bmap->rowBytes);
+	if (!data)
+		ss.buffer = (uint8 *)xpm_malloc(heap,(size_t)stripRows*bmap->rowBytes);
+	pix = (rgb_color *)xpm_malloc(heap,(size_t)br.width*sizeof(rgb_color));
+	if (!indexed && settings->maxColors > 0)
+		qs = new_quant_stream(&br,settings);
+	if ((!data && !ss.buffer) || !pix || (!indexed && !br.ctable)
+		|| (!indexed && settings->maxColors > 0 && !qs))
 	{
-		sprintf(buffer,",\n\t\"");
-		output->Write(buffer,strlen(buffer));
-		for (j = 0; j < br.width; j++)
+		err = B_NO_MEMORY;
+		goto bail;
+	}
+	hash = hash_bitmap_header(bmap);
+	for (first = 0; first < br.height; first += count)
+	{
+		count = br.height - first < stripRows ? br.height - first : stripRows;
+		err = read_strip(&ss,first,count,&rows);
+		if (err != B_OK)
+			goto bail;
+		trace_begin("scan strip","rows",count);
+		if (settings->deterministic)
+			for (i = 0; i < count; i++)
+				hash = hash_bytes(rows + (size_t)i*bmap->rowBytes,length,hash);
+		if (indexed)
+			count_indexed_rows(&br,rows,count);
+		else
+			for (i = 0; i < count; i++)
+			{
+				convert_row(bmap->colors,rows + (size_t)i*bmap->rowBytes,br.width,pix);
+				collect_row_colors(&br,pix,settings->maxColors);
+				if (qs)
+					quant_stream_count(qs,pix);
+			}
+		trace_end("scan strip");
+	}
+	if (indexed)
+		for (i = 0; i < 256; i++)
+			if (br.count[i])
+				br.ncolors++;
+	if (settings->maxColors > 0 && br.ncolors > settings->maxColors)
+	{
+		trace_begin("quantize");
+		err = quantize_strips(&ss,&br,&indexed,&qs,pix,stripRows,settings);
+		trace_end("quantize","colors",br.ncolors);
+		if (err != B_OK)
+			goto bail;
+	}
+	else
+	{
+		delete_quant_stream(qs);
+		qs = NULL;
+	}
+
+	trace_begin("palette","colors",br.ncolors);
+	err = write_xpm_head(&br,indexed,&td,output,settings,hash);
+	trace_end("palette");
+	end_phase(settings->stats,&phase,XPM_PHASE_PALETTE);
+	if (err != B_OK)
+		goto bail;
+
+//	the second pass formats a strip at a time, of as many rows as the
+//	limit allows, now that their length is known
+	start_phase(settings->stats,&phase);
+	strip = br;
+	init_emit_data(&ed,&strip,&td,output);
+	stripRows = strip_rows(&br,settings->memoryLimit,(data ? 0 : bmap->rowBytes)
+		+ (indexed ? 0 : br.width*sizeof(rgb_color)) + ed.rowLength);
+	if (!indexed)
+	{
+		xpm_free(heap,pix);
+		pix = (rgb_color *)xpm_malloc(heap,(size_t)stripRows*br.width*sizeof(rgb_color));
+		if (!pix)
+		{
+			err = B_NO_MEMORY;
+			goto bail;
+		}
+	}
+	for (first = 0; first < br.height; first += count)
+	{
+		count = br.height - first < stripRows ? br.height - first : stripRows;
+		err = read_strip(&ss,first,count,&rows);
+		if (err != B_OK)
+			goto bail;
+		strip.height = count;
+		if (indexed)
+			strip.index = rows;
+		else
+		{
+			for (i = 0; i < count; i++)
+			{
+				convert_row(bmap->colors,rows + (size_t)i*bmap->rowBytes,br.width,
+					pix + (size_t)i*br.width);
+				if (qs)
+					quant_stream_map(qs,pix + (size_t)i*br.width);
+			}
+			strip.pix = pix;
+		}
+		err = emit_rows(&ed);
+		if (err != B_OK)
+			goto bail;
+	}
+	if (!td.xpm2)
+		output->Write("};\n",3);
+	if (input)
+		input->Seek(ss.offset + (off_t)bmap->dataSize,SEEK_SET);
+	end_phase(settings->stats,&phase,XPM_PHASE_PIXELS);
+
+bail:
+	delete_quant_stream(qs);
+	xpm_free(heap,td.pixtable);
+	delete_dictionary(br.ctable);
+	xpm_free(heap,pix);
+	xpm_free(heap,ss.buffer);
+	return err;
+}
+
+//	quantize_strips()
+//	choose the palette for a bitmap being encoded in strips, whose first
+//	pass found more colors than settings->maxColors, and make it the color
+//	table.  An indexed bitmap was only counted by index, so it is encoded
+//	from rgb_colors instead, and its colors are counted in another pass.
+//	With dithering, which palette colors the error diffusion ends up using
+//	is only known by running it, so it is run over every row once more
+//	before the table is made.  "*qs" is left to map the rows from the first.
+status_t quantize_strips(strip_source *ss, bitmap_record *br, bool *indexed, quant_stream **qs,
+	rgb_color *pix, int stripRows, const xpm_encode_settings *settings)
+{
+	status_t err;
+
+	if (*indexed)
+	{
+		*indexed = false;
+		*qs = new_quant_stream(br,settings);
+		if (!*qs)
+			return B_NO_MEMORY;
+		err = pass_strips(ss,br,pix,stripRows,*qs,false);
+		if (err != B_OK)
+			return err;
+	}
+	err = quant_stream_palette(*qs);
+	if (err == B_OK && settings->dither)
+	{
+		err = pass_strips(ss,br,pix,stripRows,*qs,true);
+		quant_stream_rewind(*qs);
+	}
+	if (err == B_OK)
+		err = quant_stream_table(*qs);
+	return err;
+}
+
+//	pass_strips()
+//	go over every row of the bitmap, a strip at a time, as rgb_colors in the
+//	row at "pix", counting each into "qs", or mapping it if "map".
+status_t pass_strips(strip_source *ss, bitmap_record *br, rgb_color *pix, int stripRows,
+	quant_stream *qs, bool map)
+{
+	const uint8 *rows;
+	status_t err;
+	int i, first, count;
+
+	for (first = 0; first < br->height; first += count)
+	{
+		count = br->height - first < stripRows ? br->height - first : stripRows;
+		err = read_strip(ss,first,count,&rows);
+		if (err != B_OK)
+			return err;
+		for (i = 0; i < count; i++)
 		{
-			ix = hash_color(pixel,td.ptSize);
-			if (strlen(td.pixtable[ix].str))
-				while (ix != -1)
-				{
-					if (!memcmp(pixel,&td.pixtable[ix].color,sizeof(rgb_color)))
-					{
-						sprintf(buffer,"%s",td.pixtable[ix].str);
-						break;
-					}
-					ix = td.pixtable[ix].next;
-				}
-			output->Write(buffer,strlen(buffer));
-			pixel++;
+			convert_row(ss->bmap->colors,rows + (size_t)i*ss->bmap->rowBytes,br->width,pix);
+			if (map)
+				quant_stream_map(qs,pix);
+			else
+				quant_stream_count(qs,pix);
 		}
-		sprintf(buffer,"\"");
+	}
+	return B_OK;
+}
+
+//	strip_rows()
+//	how many rows, at "rowCost" bytes each, fit in "limit", between one and
+//	the height of the bitmap.
+int strip_rows(bitmap_record *br, size_t limit, size_t rowCost)
+{
+	size_t rows;
+
+	rows = rowCost ? limit/rowCost : br->height;
+	if (rows < 1)
+		return 1;
+	if (rows > (size_t)br->height)
+		return br->height;
+	return rows;
+}
+
+//	read_strip()
+//	point "*rows" at "count" rows of the source from row "first" on,
+//	reading them into its buffer if they are not in memory.
+status_t read_strip(strip_source *ss, int first, int count, const uint8 **rows)
+{
+	size_t size = (size_t)count*ss->bmap->rowBytes;
+
+	if (ss->data)
+	{
+		*rows = ss->data + (size_t)first*ss->bmap->rowBytes;
+		return B_OK;
+	}
+	trace_begin("read strip","bytes",size);
+	if (ss->input->ReadAt(ss->offset + (off_t)first*ss->bmap->rowBytes,ss->buffer,size)
+		!= (ssize_t)size)
+	{
+		trace_end("read strip");
+		return B_IO_ERROR;
+	}
+	trace_end("read strip");
+	*rows = ss->buffer;
+	return B_OK;
+}
+
+//	write_xpm_head()
+//	write out everything that comes before the pixel rows, filling out the
+//	color hash table of "td" as the colors are written.  "hash" names the
+//	array of deterministic output.
+status_t write_xpm_head(bitmap_record *br, bool indexed, traverse_data *td, BPositionIO *output,
+	const xpm_encode_settings *settings, uint64 hash)
+{
+	char buffer[10240];
+	int64 capacity;
+	int i;
+
+//	write out the header, a comment string, the variable declaration;
+//	XPM2 has only a header line.
+	td->xpm2 = settings->format == XPM_FORMAT_XPM2;
+	if (td->xpm2)
+	{
+		sprintf(buffer,"%s\n",XPM2_HEADER);
 		output->Write(buffer,strlen(buffer));
 	}
-	sprintf(buffer,"};\n");
+	else
+	{
+		sprintf(buffer,"%s\n",XPM_HEADER);
+		output->Write(buffer,strlen(buffer));
+		sprintf(buffer,"/* XPM file written by E. Tomlinson's XPMTranslator, version 1.1.0 */\n");
+		output->Write(buffer,strlen(buffer));
+		if (settings->deterministic)
+			sprintf(buffer,"static char *%s%016llx[] =\n",XPM_NAME_SEED,(unsigned long long)hash);
+		else
+			sprintf(buffer,"static char *%s%ld[] =\n",XPM_NAME_SEED,time(NULL));
+		output->Write(buffer,strlen(buffer));
+		sprintf(buffer,"{\n");
+		output->Write(buffer,strlen(buffer));
+	}
+
+//	determine the "width" of the pixel, the fewest characters that give
+//	every color a string of its own, then
+//	write out the value string (width height number-of-colors) characters-per-pixel.	
+//	An XPM2 pixel string may begin a line, so it doesn't begin with '!'.
+	td->firstChars = td->xpm2 ? XPM_CHAR_COUNT - 1 : XPM_CHAR_COUNT;
+	td->width = 1;
+	for (capacity = td->firstChars; capacity < br->ncolors; capacity *= XPM_CHAR_COUNT)
+		td->width++;
+	if (td->xpm2)
+		sprintf(buffer,"%d %d %d %d\n",br->width,br->height,br->ncolors,td->width);
+	else
+		sprintf(buffer,"\t\"%d %d %d %d\"",br->width,br->height,br->ncolors,td->width);
 	output->Write(buffer,strlen(buffer));
-	free(td.pixtable);
-	delete br.ctable;
-	free(br.pix);
+	
+	td->count = 0;
+	td->output = output;
+	td->stats = settings->stats;
+	td->heap = br->heap;
+	td->maxChain = 0;
+	if (indexed)
+	{
+//	an indexed bitmap needs no hashing: the table has an entry per index,
+//	and only the indices actually used get a string and are written out.
+		td->ptSize = 256;
+		td->pixtable = (pix_entry *)xpm_calloc(td->heap,td->ptSize,sizeof(pix_entry));
+		if (!td->pixtable)
+			return B_NO_MEMORY;
+		for (i = 0; i < 256; i++)
+			if (br->count[i])
+			{
+				td->pixtable[i].color = br->palette[i];
+				td->pixtable[i].next = -1;
+				write_color_entry(td,&td->pixtable[i]);
+			}
+	}
+	else
+	{
+//	fill out the color hash table, at the same time writing out strings
+//	representing the colors onto the output stream.
+//	In this case, colors are hashed by their RGB values, folded into a
+//	32-bit integer (see hash_color() below.)
+		if (br->ncolors > INT_MAX/4)
+			return B_NO_MEMORY;
+		td->ptSize = 4*br->ncolors;
+		td->pixtable = (pix_entry *)xpm_calloc(td->heap,td->ptSize,sizeof(pix_entry));
+		if (!td->pixtable)
+			return B_NO_MEMORY;
+		br->ctable->TraverseInOrder(traverseHook,td);
+	}
+	if (td->stats)
+	{
+		td->stats->ncolors = br->ncolors;
+		td->stats->cpp = td->width;
+		td->stats->maxChain = td->maxChain;
+	}
 	return B_OK;
 }
 
+//	init_emit_data()
+//	set up the formatting of the rows of "br" onto "output".
+void init_emit_data(emit_data *ed, bitmap_record *br, traverse_data *td, BPositionIO *output)
+{
+	ed->output = output;
+	ed->br = br;
+	ed->td = td;
+	if (td->xpm2)
+	{
+		ed->prefix = "";					// ... \n
+		ed->suffix = '\n';
+	}
+	else
+	{
+		ed->prefix = ",\n\t\"";				// ,\n\t" ... "
+		ed->suffix = '"';
+	}
+	ed->prefixLength = strlen(ed->prefix);
+	ed->rowLength = ed->prefixLength + (size_t)br->width*td->width + 1;
+}
+
+//	emit_rows()
+//	format and write out the rows of ed->br.  Each row depends only on its
+//	own pixels, so bands of rows are formatted in parallel and written out
+//	in order as they complete.
+status_t emit_rows(emit_data *ed)
+{
+	status_t err;
+	int i, bands;
+
+	bands = count_row_bands(ed->br->width,ed->br->height);
+	for (i = 0; i < bands; i++)
+		ed->text[i] = NULL;
+	err = run_row_bands(bands,ed->br->height,emit_band,write_band,ed);
+	for (i = 0; i < bands; i++)
+		xpm_free(ed->td->heap,ed->text[i]);
+	return err;
+}
+
 //	hash_color()
 //	fold an RGBA color into an unsigned 32-bit integer; apply the multiplicative
 //	hash used in fromXPM().
@@ -141,20 +776,191 @@ uint32 hash_color(rgb_color *color, int n)
 	return (uint32)(f*n);
 }
 
+//	find_pix_string()
+//	look up the string written out for "color" in the color hash table,
+//	adding the entries looked at to "*probes".
+const char *find_pix_string(rgb_color *color, traverse_data *td, int *probes)
+{
+	int ix = hash_color(color,td->ptSize);
+
+	if (td->pixtable[ix].str[0])
+		while (ix != -1)
+		{
+			(*probes)++;
+			if (!memcmp(color,&td->pixtable[ix].color,sizeof(rgb_color)))
+				return td->pixtable[ix].str;
+			ix = td->pixtable[ix].next;
+		}
+	return NULL;
+}
+
+//	emit_band()
+//	format the rows [first, last) into a text buffer of their own.  Runs
+//	in a worker thread; only reads the bitmap and the color hash table.
+//	A row with the same pixels as an earlier row of the band is copied
+//	from that row's text rather than formatted again.
+status_t emit_band(int band, int first, int last, void *arg)
+{
+	emit_data *ed = (emit_data *)arg;
+	bitmap_record *br = ed->br;
+	const uint8 *data;
+	int32 rowBytes;
+	size_t length;
+	row_seen *seen;
+	int64 probes = 0;
+	int i, k, mask;
+	char *text, *t;
+
+	text = (char *)xpm_malloc(ed->td->heap,(size_t)(last-first)*ed->rowLength);
+	if (!text)
+		return B_NO_MEMORY;
+	ed->text[band] = text;
+	ed->length[band] = (size_t)(last-first)*ed->rowLength;
+	for (mask = 1; mask < 2*(last-first); mask <<= 1)
+		;
+	seen = (row_seen *)xpm_malloc(ed->td->heap,mask*sizeof(row_seen));
+	if (!seen)
+		return B_NO_MEMORY;
+	for (i = 0; i < mask; i++)
+		seen[i].row = -1;
+	mask--;
+
+//	rows are told apart by their indices if the bitmap has them
+	if (br->index)
+	{
+		data = br->index;
+		rowBytes = br->rowBytes;
+		length = row_bytes(br->space,br->width);
+	}
+	else
+	{
+		data = (const uint8 *)br->pix;
+		rowBytes = length = (size_t)br->width*sizeof(rgb_color);
+	}
+
+	trace_begin("encode band","rows",last - first);
+	t = text;
+	for (i = first; i < last; i++)
+	{
+		k = find_row(seen,mask,data,rowBytes,i,length);
+		if (k >= 0)
+			memcpy(t,text + (size_t)(k-first)*ed->rowLength,ed->rowLength);
+		else
+			probes += format_row(ed,i,t);
+		t += ed->rowLength;
+	}
+	xpm_free(ed->td->heap,seen);
+	if (ed->td->stats)
+		atomic_add64(&ed->td->stats->probes,probes);
+	trace_end("encode band");
+	return B_OK;
+}
+
+//	format_row()
+//	format row "i" into "t", which has room for ed->rowLength characters.
+//	Each run of one color is looked up once and filled in.  Returns the
+//	number of color hash table entries looked at.
+int format_row(emit_data *ed, int i, char *t)
+{
+	bitmap_record *br = ed->br;
+	int width = ed->td->width;
+	rgb_color *pixel;
+	const char *str;
+	const uint8 *index;
+	int j, run, ix, probes = 0;
+
+	memcpy(t,ed->prefix,ed->prefixLength);
+	t += ed->prefixLength;
+	if (br->index)
+	{
+//	indexed pixels look their strings up directly
+		index = br->index + (size_t)i*br->rowBytes;
+		for (j = 0; j < br->width; j += run)
+		{
+			ix = index_at(br,index,j);
+			for (run = 1; j + run < br->width && index_at(br,index,j + run) == ix; run++)
+				;
+			t = fill_run(t,ed->td->pixtable[ix].str,width,run);
+		}
+	}
+	else
+	{
+		pixel = br->pix + (size_t)i*br->width;
+		for (j = 0; j < br->width; j += run)
+		{
+			for (run = 1; j + run < br->width
+				&& !memcmp(&pixel[j + run],&pixel[j],sizeof(rgb_color)); run++)
+				;
+//	every color in the bitmap went into the table, so a miss can't happen
+			str = find_pix_string(&pixel[j],ed->td,&probes);
+			if (str)
+				t = fill_run(t,str,width,run);
+			else
+			{
+				memset(t,XPM_CHAR_SET[0],(size_t)width*run);
+				t += (size_t)width*run;
+			}
+		}
+	}
+	*t = ed->suffix;
+	return probes;
+}
+
+//	index_at()
+//	the palette index of pixel "j" of an indexed row.
+inline int index_at(bitmap_record *br, const uint8 *index, int j)
+{
+	if (br->space == B_GRAY1)
+		return (index[j >> 3] >> (7 - (j & 7))) & 1;
+	return index[j];
+}
+
+//	fill_run()
+//	write "count" copies of the "width"-character string "str" at "t",
+//	doubling what has been written so far, and return the end.
+char *fill_run(char *t, const char *str, int width, int count)
+{
+	size_t done, total = (size_t)width*count;
+
+	if (width == 1)
+	{
+		memset(t,str[0],count);
+		return t + count;
+	}
+	memcpy(t,str,width);
+	for (done = width; done < total; done *= 2)
+		memcpy(t + done,t,done*2 <= total ? done : total - done);
+	return t + total;
+}
+
+//	write_band()
+//	write out a formatted band, in order, and release its buffer.
+status_t write_band(int band, void *arg)
+{
+	emit_data *ed = (emit_data *)arg;
+	ssize_t err;
+
+	trace_begin("write band","bytes",ed->length[band]);
+	err = ed->output->Write(ed->text[band],ed->length[band]);
+	trace_end("write band");
+	xpm_free(ed->td->heap,ed->text[band]);
+	ed->text[band] = NULL;
+	if (err < (ssize_t)ed->length[band])
+		return err < 0 ? err : B_IO_ERROR;
+	return B_OK;
+}
+
 void traverseHook(int key, void *data, void *arg)
 {
-	char buffer[10240];
-	int ix, last, t, j;
+	int ix, last, chain;
 	traverse_data *td = (traverse_data *)arg;
 	rgb_color *color = (rgb_color *)data;
-	rgb_color transp = B_TRANSPARENT_32_BIT;
 
-	sprintf(buffer,".\n\t\"");
-	td->output->Write(buffer,strlen(buffer));
 	ix = hash_color(color,td->ptSize);
+	chain = 1;
 	if (strlen(td->pixtable[ix].str))
 	{
-		while (td->pixtable[ix].next != -1)
+		for (chain = 2; td->pixtable[ix].next != -1; chain++)
 			ix = td->pixtable[ix].next;
 		last = ix;
 		while (strlen(td->pixtable[ix].str))
@@ -165,20 +971,44 @@ void traverseHook(int key, void *data, void *arg)
 		}
 		td->pixtable[last].next = ix;
 	}
+	td->pixtable[ix].color = *color;
+	td->pixtable[ix].next = -1;
+	if (chain > td->maxChain)
+		td->maxChain = chain;
+	write_color_entry(td,&td->pixtable[ix]);
+}
+
+//	write_color_entry()
+//	give the table entry "pe" the next pixel string, and write out its
+//	color string.  The first character is one of td->firstChars, the rest
+//	any of XPM_CHAR_SET.
+void write_color_entry(traverse_data *td, pix_entry *pe)
+{
+	char buffer[64];
+	int t, j;
+	rgb_color *color = &pe->color;
+	rgb_color transp = B_TRANSPARENT_32_BIT;
+
 	t = td->count;
-	for (j = 0; j < td->width; j++)
+	pe->str[0] = XPM_CHAR_SET[t % td->firstChars];
+	t /= td->firstChars;
+	for (j = 1; j < td->width; j++)
 	{
-		td->pixtable[ix].str[j] = XPM_CHAR_SET[t % strlen(XPM_CHAR_SET)];
-		t /= strlen(XPM_CHAR_SET);
+		pe->str[j] = XPM_CHAR_SET[t % XPM_CHAR_COUNT];
+		t /= XPM_CHAR_COUNT;
 	}
-	td->pixtable[ix].str[j] = 0;
-	td->pixtable[ix].color = *color;
-	td->pixtable[ix].next = -1;
-	td->output->Write(td->pixtable[ix].str,strlen(td->pixtable[ix].str));
+	pe->str[j] = 0;
+	if (!td->xpm2)
+	{
+		sprintf(buffer,",\n\t\"");
+		td->output->Write(buffer,strlen(buffer));
+	}
+	td->output->Write(pe->str,strlen(pe->str));
 	if (!memcmp(color,&transp,sizeof(rgb_color)))
-		sprintf(buffer,"\tc\tNone\"");
+		sprintf(buffer,"\tc\tNone%s",td->xpm2 ? "\n" : "\"");
 	else
-		sprintf(buffer,"\tc\t#%02x%02x%02x\"",color->red,color->green,color->blue);
+		sprintf(buffer,"\tc\t#%02x%02x%02x%s",color->red,color->green,color->blue,
+			td->xpm2 ? "\n" : "\"");
 	td->output->Write(buffer,strlen(buffer));
 	td->count++;
 }
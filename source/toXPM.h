@@ -3,6 +3,45 @@
 
 //	toXPM.h
 
-status_t toXPM(BPositionIO *, BPositionIO *);
+#include "XPMContext.h"
 
-#endif
\ No newline at end of file
+//	color reduction methods, for xpm_encode_settings.quantizer
+enum
+{
+	XPM_QUANTIZE_MEDIAN_CUT,
+	XPM_QUANTIZE_OCTREE
+};
+
+//	output formats, for xpm_encode_settings.format: XPM3 is the usual C
+//	array; XPM2 is the same header, colors and rows, one to a line, with no
+//	C around them, which is smaller and quicker to scan.
+enum
+{
+	XPM_FORMAT_XPM3,
+	XPM_FORMAT_XPM2
+};
+
+//	options for toXPM().  A NULL settings pointer gets the defaults, as
+//	filled in by init_encode_settings(): every color written out exactly.
+typedef struct
+{
+	int maxColors;			// at most this many colors, transparency included; 0 for any
+	int quantizer;			// XPM_QUANTIZE_MEDIAN_CUT or XPM_QUANTIZE_OCTREE
+	bool dither;			// diffuse the quantization error (Floyd-Steinberg)
+	bool deterministic;		// name the array after the content, not the time
+	const char *cacheDirectory;	// reuse and keep earlier output here; NULL for none
+	int format;				// XPM_FORMAT_XPM3 or XPM_FORMAT_XPM2
+	bool gzip;				// deflate the output into a gzip stream
+	size_t memoryLimit;		// encode in strips of rows to stay near this; 0 for no limit
+	xpm_stats *stats;		// count the translation into this; NULL for not
+	XPMContext *context;	// take memory from this; NULL for malloc()
+}
+xpm_encode_settings;
+
+void init_encode_settings(xpm_encode_settings *);
+uint32 hash_color(rgb_color *, int);
+status_t toXPM(BPositionIO *, BPositionIO *, const xpm_encode_settings * = NULL);
+status_t toXPM(const void *, int32, color_space, BRect, BPositionIO *,
+	const xpm_encode_settings * = NULL);
+
+#endif
@@ -0,0 +1,339 @@
+//	Netpbm.cc
+//
+//	the headers are read a byte at a time out of the stream's buffer, and
+//	the samples after them too, so that nothing is read past the image;
+//	another image, or anything else, may follow it in a pipe.  Samples
+//	wider than a byte, up to a maxval of 65535, are scaled down to 8 bits.
+//	Whatever is read becomes B_RGBA32 pixels; what is written is always
+//	8 bits a sample, RGB for PPM and RGB_ALPHA for PAM.
+
+#include <ctype.h>
+#include "Netpbm.h"
+#include "ScanBitmap.h"
+
+#define		NETPBM_LINE_SIZE		256
+
+int next_byte(netpbm_stream *);
+status_t read_pnm_header(netpbm_stream *, netpbm_info *);
+status_t read_pam_header(netpbm_stream *, netpbm_info *);
+status_t read_header_number(netpbm_stream *, int *);
+
+//	is_netpbm()
+//	whether "data", the first "length" bytes of a stream, start a PPM, PGM
+//	or PAM image.
+bool is_netpbm(const void *data, size_t length)
+{
+	const char *magic = (const char *)data;
+
+	return length >= 3 && magic[0] == 'P' && (magic[1] == '5' || magic[1] == '6' || magic[1] == '7')
+		&& isspace((unsigned char)magic[2]);
+}
+
+//	init_netpbm_stream()
+//	start reading "io"; the "length" bytes at "data", if any, were read
+//	from it already, to tell what it holds, and come first.
+void init_netpbm_stream(netpbm_stream *stream, BDataIO *io, const void *data, size_t length)
+{
+	stream->io = io;
+	stream->next = 0;
+	stream->length = length < sizeof(stream->buffer) ? length : sizeof(stream->buffer);
+	if (stream->length)
+		memcpy(stream->buffer,data,stream->length);
+}
+
+//	next_byte()
+//	the next byte of the stream, or -1 at its end.
+inline int next_byte(netpbm_stream *stream)
+{
+	ssize_t got;
+
+	if (stream->next == stream->length)
+	{
+		got = stream->io->Read(stream->buffer,sizeof(stream->buffer));
+		if (got <= 0)
+			return -1;
+		stream->next = 0;
+		stream->length = got;
+	}
+	return stream->buffer[stream->next++];
+}
+
+//	read_netpbm_header()
+//	read the magic number and header of a PPM, PGM or PAM image, leaving
+//	the stream at the first sample.
+status_t read_netpbm_header(netpbm_stream *stream, netpbm_info *info)
+{
+	status_t err;
+
+	if (next_byte(stream) != 'P')
+		return B_NO_TRANSLATOR;
+	switch (next_byte(stream))
+	{
+		case '5':
+			info->depth = 1;
+			info->pam = false;
+			err = read_pnm_header(stream,info);
+			break;
+		case '6':
+			info->depth = 3;
+			info->pam = false;
+			err = read_pnm_header(stream,info);
+			break;
+		case '7':
+			info->pam = true;
+			err = read_pam_header(stream,info);
+			break;
+		default:
+			return B_NO_TRANSLATOR;
+	}
+	if (err != B_OK)
+		return err;
+	if (info->width <= 0 || info->height <= 0 || info->depth < 1 || info->depth > 4
+		|| info->maxval < 1 || info->maxval > 65535)
+		return B_BAD_DATA;
+	return B_OK;
+}
+
+//	read_pnm_header()
+//	the width, height and maxval of a "P5" or "P6" image, each after white
+//	space and comments, the last followed by a single white space.
+status_t read_pnm_header(netpbm_stream *stream, netpbm_info *info)
+{
+	status_t err;
+
+	err = read_header_number(stream,&info->width);
+	if (err == B_OK)
+		err = read_header_number(stream,&info->height);
+	if (err == B_OK)
+		err = read_header_number(stream,&info->maxval);
+	return err;
+}
+
+//	read_header_number()
+//	a decimal number, after white space and "#" comments; the character
+//	that ends it, which must be white space, is read too.
+status_t read_header_number(netpbm_stream *stream, int *number)
+{
+	int c;
+	int64 value = 0;
+
+	do
+	{
+		c = next_byte(stream);
+		if (c == '#')
+			while (c >= 0 && c != '\n')
+				c = next_byte(stream);
+	}
+	while (c >= 0 && isspace(c));
+	if (c < '0' || c > '9')
+		return B_BAD_DATA;
+	for (; c >= '0' && c <= '9'; c = next_byte(stream))
+	{
+		value = value*10 + c - '0';
+		if (value > INT_MAX)
+			return B_BAD_DATA;
+	}
+	if (c < 0 || !isspace(c))
+		return B_BAD_DATA;
+	*number = (int)value;
+	return B_OK;
+}
+
+//	read_pam_header()
+//	the "KEY value" lines of a "P7" header, up to "ENDHDR".  The tuple type
+//	is not needed: the depth says what there is, and a depth of 2 or 4
+//	is taken to end in alpha.
+status_t read_pam_header(netpbm_stream *stream, netpbm_info *info)
+{
+	char line[NETPBM_LINE_SIZE], key[16];
+	int c, length, value;
+
+	info->width = info->height = info->depth = info->maxval = 0;
+	if (!isspace(next_byte(stream)))
+		return B_BAD_DATA;
+	for (;;)
+	{
+		length = 0;
+		for (c = next_byte(stream); c >= 0 && c != '\n'; c = next_byte(stream))
+			if (length < NETPBM_LINE_SIZE - 1)
+				line[length++] = c;
+		line[length] = 0;
+		if (c < 0)
+			return B_BAD_DATA;
+		if (sscanf(line," %15s",key) != 1 || key[0] == '#')
+			continue;
+		if (!strcmp(key,"ENDHDR"))
+			return B_OK;
+		if (!strcmp(key,"TUPLTYPE"))
+			continue;
+		if (sscanf(line," %*s %d",&value) != 1)
+			return B_BAD_DATA;
+		if (!strcmp(key,"WIDTH"))
+			info->width = value;
+		else if (!strcmp(key,"HEIGHT"))
+			info->height = value;
+		else if (!strcmp(key,"DEPTH"))
+			info->depth = value;
+		else if (!strcmp(key,"MAXVAL"))
+			info->maxval = value;
+	}
+}
+
+//	read_netpbm_rows()
+//	read the next "rows" rows of the image into "bits" as B_RGBA32 pixels,
+//	each row "rowBytes" after the last.
+status_t read_netpbm_rows(netpbm_stream *stream, const netpbm_info *info, uint8 *bits,
+	int32 rowBytes, int rows)
+{
+	int x, y, s, c, low, sample[4];
+	bool wide = info->maxval > 255;
+	uint8 *t;
+
+	for (y = 0; y < rows; y++, bits += rowBytes)
+		for (x = 0, t = bits; x < info->width; x++, t += 4)
+		{
+			for (s = 0; s < info->depth; s++)
+			{
+				c = next_byte(stream);
+				if (wide && c >= 0)
+				{
+					low = next_byte(stream);
+					c = low < 0 ? -1 : c << 8 | low;
+				}
+				if (c < 0)
+					return B_BAD_DATA;
+				if (c > info->maxval)
+					c = info->maxval;
+				sample[s] = info->maxval == 255 ? c : (c*255 + info->maxval/2)/info->maxval;
+			}
+			if (info->depth < 3)
+			{
+				t[0] = t[1] = t[2] = sample[0];
+				t[3] = info->depth == 2 ? sample[1] : 0xff;
+			}
+			else
+			{
+				t[0] = sample[2];
+				t[1] = sample[1];
+				t[2] = sample[0];
+				t[3] = info->depth == 4 ? sample[3] : 0xff;
+			}
+		}
+	return B_OK;
+}
+
+//	write_netpbm_header()
+//	write the header of an image of 8-bit RGB samples, with alpha if
+//	"info->depth" is 4: a PAM, or else a PPM.
+status_t write_netpbm_header(BDataIO *io, const netpbm_info *info)
+{
+	char header[NETPBM_LINE_SIZE];
+	int length;
+
+	if (info->pam)
+		length = sprintf(header,"P7\nWIDTH %d\nHEIGHT %d\nDEPTH %d\nMAXVAL 255\nTUPLTYPE %s\n"
+			"ENDHDR\n",info->width,info->height,info->depth,info->depth == 4 ? "RGB_ALPHA" : "RGB");
+	else
+		length = sprintf(header,"P6\n%d %d\n255\n",info->width,info->height);
+	return io->Write(header,length) == length ? B_OK : B_IO_ERROR;
+}
+
+//	write_netpbm_row()
+//	write a row of pixels as the header says, packed into "packed", which
+//	has room for a row of "info->depth" bytes a pixel.
+status_t write_netpbm_row(BDataIO *io, const netpbm_info *info, const rgb_color *pixel,
+	uint8 *packed)
+{
+	uint8 *t = packed;
+	int x;
+	ssize_t length;
+
+	for (x = 0; x < info->width; x++, pixel++)
+	{
+		*t++ = pixel->red;
+		*t++ = pixel->green;
+		*t++ = pixel->blue;
+		if (info->depth == 4)
+			*t++ = pixel->alpha;
+	}
+	length = t - packed;
+	return io->Write(packed,length) == length ? B_OK : B_IO_ERROR;
+}
+
+//	read_netpbm()
+//	read a PPM, PGM or PAM image from "stream" into "*data", as B_RGBA32
+//	pixels, and describe them in "bmap", in host byte order, like
+//	read_bitmap().  The caller must xpm_free() the data from "heap".
+status_t read_netpbm(BPositionIO *stream, TranslatorBitmap *bmap, uint8 **data, xpm_heap *heap)
+{
+	netpbm_stream *ns;
+	netpbm_info info;
+	uint64 dataSize;
+	status_t err;
+
+	*data = NULL;
+	ns = (netpbm_stream *)xpm_malloc(heap,sizeof(netpbm_stream));
+	if (!ns)
+		return B_NO_MEMORY;
+	init_netpbm_stream(ns,stream);
+	err = read_netpbm_header(ns,&info);
+	dataSize = (uint64)4*info.width*info.height;
+	if (err == B_OK && dataSize > 0xffffffffULL)
+		err = B_FILE_TOO_LARGE;
+	if (err == B_OK)
+	{
+		*data = (uint8 *)xpm_malloc(heap,dataSize);
+		if (!*data)
+			err = B_NO_MEMORY;
+	}
+	if (err == B_OK)
+		err = read_netpbm_rows(ns,&info,*data,4*info.width,info.height);
+	xpm_free(heap,ns);
+	if (err != B_OK)
+	{
+		xpm_free(heap,*data);
+		*data = NULL;
+		return err;
+	}
+
+	bmap->magic = B_TRANSLATOR_BITMAP;
+	bmap->bounds.Set(0,0,info.width-1,info.height-1);
+	bmap->rowBytes = 4*info.width;
+	bmap->colors = B_RGBA32;
+	bmap->dataSize = (uint32)dataSize;
+	return B_OK;
+}
+
+//	write_netpbm()
+//	write the bitmap "bmap", in host byte order, describes, whose pixels
+//	are at "data", as a PAM with alpha if "pam", or else as a PPM.
+status_t write_netpbm(BDataIO *io, const TranslatorBitmap *bmap, const uint8 *data, bool pam,
+	xpm_heap *heap)
+{
+	netpbm_info info;
+	rgb_color *pixel;
+	uint8 *packed;
+	status_t err;
+	int y;
+
+	info.width = bmap->bounds.IntegerWidth() + 1;
+	info.height = bmap->bounds.IntegerHeight() + 1;
+	info.depth = pam ? 4 : 3;
+	info.maxval = 255;
+	info.pam = pam;
+	if ((uint64)bmap->rowBytes*info.height > bmap->dataSize
+		|| row_bytes(bmap->colors,info.width) > bmap->rowBytes)
+		return B_BAD_DATA;
+
+	pixel = (rgb_color *)xpm_malloc(heap,(size_t)info.width*sizeof(rgb_color));
+	packed = (uint8 *)xpm_malloc(heap,(size_t)info.width*info.depth);
+	err = pixel && packed ? write_netpbm_header(io,&info) : B_NO_MEMORY;
+	for (y = 0; err == B_OK && y < info.height; y++)
+	{
+		convert_row(bmap->colors,data + (size_t)y*bmap->rowBytes,info.width,pixel);
+		err = write_netpbm_row(io,&info,pixel,packed);
+	}
+	xpm_free(heap,packed);
+	xpm_free(heap,pixel);
+	return err;
+}
@@ -0,0 +1,46 @@
+//	Netpbm.h
+//	the Netpbm formats the tools trade in besides XPM: PPM ("P6"), PGM
+//	("P5") and PAM ("P7") with any of the usual tuple types are read, and
+//	PPM and RGB or RGB_ALPHA PAM written.  Both sides work a row at a time
+//	through a BDataIO, so that a stream that can't seek, such as a pipe,
+//	will do.
+
+#ifndef NETPBM_H
+#define NETPBM_H
+
+#include "XPM.h"
+#include "XPMContext.h"
+
+#define		NETPBM_BUFFER_SIZE		4096
+
+//	an image's header, as read or to be written
+typedef struct
+{
+	int width;
+	int height;
+	int depth;					// samples per pixel: 1 gray, 2 gray and alpha, 3 RGB, 4 RGBA
+	int maxval;
+	bool pam;					// "P7", rather than "P6" or "P5"
+}
+netpbm_info;
+
+//	a stream being read, with what has been read ahead of the caller
+typedef struct
+{
+	BDataIO *io;
+	uint8 buffer[NETPBM_BUFFER_SIZE];
+	size_t next;
+	size_t length;
+}
+netpbm_stream;
+
+bool is_netpbm(const void *, size_t);
+void init_netpbm_stream(netpbm_stream *, BDataIO *, const void * = NULL, size_t = 0);
+status_t read_netpbm_header(netpbm_stream *, netpbm_info *);
+status_t read_netpbm_rows(netpbm_stream *, const netpbm_info *, uint8 *, int32, int);
+status_t write_netpbm_header(BDataIO *, const netpbm_info *);
+status_t write_netpbm_row(BDataIO *, const netpbm_info *, const rgb_color *, uint8 *);
+status_t read_netpbm(BPositionIO *, TranslatorBitmap *, uint8 **, xpm_heap * = NULL);
+status_t write_netpbm(BDataIO *, const TranslatorBitmap *, const uint8 *, bool, xpm_heap * = NULL);
+
+#endif
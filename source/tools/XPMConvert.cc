@@ -0,0 +1,756 @@
+//	XPMConvert.cc
+//
+//	converts images, or whole trees of them, between XPM, the Translation
+//	Kit's bitmap stream ("bits"), PAM and PPM.  What each input holds is
+//	told from its first bytes, not its name; files in a directory that
+//	hold none of these are skipped, one named on the command line is an
+//	error.  A directory's images go into the output directory under the
+//	same relative names, or, without --output, beside themselves, with the
+//	extension of the new format.
+//
+//	The files are dealt out in runs, in the order they were found, to one
+//	worker thread per CPU.  Each worker converts its own run from the front
+//	and, when it runs out, steals from the back of another's, so that a
+//	worker dealt a few large images doesn't hold up the rest.  Every worker
+//	keeps an XPMContext, so that after its first few files it stops
+//	allocating.  A file that fails is reported as it fails, and its partial
+//	output removed; a summary of the throughput and failures ends the run,
+//	and the exit status is 1 if anything failed.
+//
+//	usage: xpmconvert --to=xpm|xpm2|bits|pam|ppm [--output=directory]
+//		[--jobs=n] [--gzip] [--colors=n] [--quantizer=median|octree]
+//		[--dither] [--memory-limit=bytes] [--verbose] input...
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <File.h>
+#include "XPM.h"
+#include "fromXPM.h"
+#include "toXPM.h"
+#include "ScanBitmap.h"
+#include "PassThrough.h"
+#include "XPMGzip.h"
+#include "Netpbm.h"
+
+#define		CONVERT_MAX_JOBS		64
+
+//	what an image is held in
+enum
+{
+	CONVERT_UNKNOWN = -1,
+	CONVERT_XPM,
+	CONVERT_BITS,
+	CONVERT_PAM,
+	CONVERT_PPM
+};
+
+typedef struct
+{
+	char *input;
+	char *output;
+	bool named;						// on the command line, rather than found in a directory
+	bool skipped;					// not an image
+	status_t err;
+	const char *why;				// what went wrong, if "err" doesn't say
+	off_t inputBytes;
+	off_t outputBytes;
+}
+convert_file;
+
+typedef struct
+{
+	convert_file *file;
+	int count;
+	int room;
+}
+file_list;
+
+typedef struct
+{
+	int to;							// CONVERT_*
+	xpm_encode_settings settings;
+	int jobs;
+	const char *output;				// directory; NULL for beside the input
+	bool verbose;
+}
+convert_options;
+
+//	a worker's run of files, [head, tail): it takes them from the head,
+//	and the other workers steal from the tail
+typedef struct
+{
+	sem_id lock;
+	int head;
+	int tail;
+}
+work_queue;
+
+typedef struct
+{
+	convert_options *options;
+	file_list *files;
+	work_queue *queue;
+	int jobs;
+	int index;
+	int stolen;
+}
+worker_record;
+
+status_t parse_options(int, char **, convert_options *, int *);
+status_t add_path(convert_options *, file_list *, const char *, const char *, bool);
+status_t add_directory(convert_options *, file_list *, const char *, const char *);
+status_t add_file(convert_options *, file_list *, const char *, const char *, bool);
+status_t add_failure(convert_options *, file_list *, const char *, const char *, const char *);
+char *join_path(const char *, const char *);
+char *output_name(const char *, int, bool);
+status_t make_directories(const char *);
+status_t run_workers(convert_options *, file_list *, int *);
+status_t worker_thread(void *);
+int take_work(work_queue *, bool);
+void convert_one(convert_options *, xpm_encode_settings *, xpm_heap *, convert_file *);
+void convert_file_data(convert_options *, xpm_encode_settings *, xpm_heap *, convert_file *);
+int stream_type(BPositionIO *);
+status_t convert_stream(BPositionIO *, int, BPositionIO *, int, const xpm_encode_settings *,
+	xpm_heap *);
+status_t write_bitmap(BPositionIO *, const TranslatorBitmap *, const uint8 *);
+const char *status_message(status_t);
+
+int main(int argc, char **argv)
+{
+	convert_options options;
+	file_list files;
+	bigtime_t start;
+	double seconds;
+	int64 inputBytes = 0, outputBytes = 0;
+	int inputs, i, jobs, converted = 0, failed = 0, skipped = 0, stolen = 0;
+
+	if (parse_options(argc,argv,&options,&inputs) != B_OK)
+	{
+		fprintf(stderr,"usage: %s --to=xpm|xpm2|bits|pam|ppm [--output=directory] [--jobs=n]"
+			" [--gzip]\n"
+			"\t[--colors=n] [--quantizer=median|octree] [--dither] [--memory-limit=bytes]"
+			" [--verbose]\n"
+			"\tinput...\n",argv[0]);
+		return 2;
+	}
+	if (options.output && make_directories(options.output) != B_OK)
+	{
+		fprintf(stderr,"%s: can't make %s: %s\n",argv[0],options.output,strerror(errno));
+		return 1;
+	}
+
+	files.file = NULL;
+	files.count = files.room = 0;
+	for (i = 1; i <= inputs; i++)
+		if (add_path(&options,&files,argv[i],NULL,true) != B_OK)
+		{
+			fprintf(stderr,"%s: out of memory\n",argv[0]);
+			return 1;
+		}
+
+	start = system_time();
+	if (run_workers(&options,&files,&stolen) != B_OK)
+	{
+		fprintf(stderr,"%s: can't start the workers\n",argv[0]);
+		return 1;
+	}
+	seconds = (system_time() - start)/1e6;
+	jobs = options.jobs < files.count ? options.jobs : files.count;
+
+	for (i = 0; i < files.count; i++)
+	{
+		if (files.file[i].skipped)
+			skipped++;
+		else if (files.file[i].err != B_OK)
+			failed++;
+		else
+		{
+			converted++;
+			inputBytes += files.file[i].inputBytes;
+			outputBytes += files.file[i].outputBytes;
+		}
+		free(files.file[i].input);
+		free(files.file[i].output);
+	}
+	free(files.file);
+
+	if (seconds <= 0)
+		seconds = 1e-6;
+	fprintf(stderr,"%s: %d converted, %d failed, %d skipped in %.2f s on %d threads: %.1f files/s,"
+		" %.2f MB/s in, %.2f MB/s out; %d stolen\n",argv[0],converted,failed,skipped,seconds,jobs,
+		converted/seconds,inputBytes/seconds/1e6,outputBytes/seconds/1e6,stolen);
+	return failed ? 1 : 0;
+}
+
+//	parse_options()
+//	the options may come before, after or among the inputs, which are moved
+//	up to follow argv[0]; "*inputs" is how many there are.  What follows
+//	"--" is an input, whatever it looks like.
+status_t parse_options(int argc, char **argv, convert_options *options, int *inputs)
+{
+	char *arg;
+	system_info info;
+	bool more = true;
+	int i;
+
+	options->to = CONVERT_UNKNOWN;
+	init_encode_settings(&options->settings);
+	options->settings.deterministic = true;
+	options->jobs = get_system_info(&info) == B_OK ? info.cpu_count : 1;
+	options->output = NULL;
+	options->verbose = false;
+	*inputs = 0;
+	for (i = 1; i < argc; i++)
+	{
+		arg = argv[i];
+		if (!more || strncmp(arg,"--",2))
+			argv[++*inputs] = arg;
+		else if (!strcmp(arg,"--"))
+			more = false;
+		else if (!strncmp(arg,"--to=",5))
+		{
+			arg += 5;
+			options->settings.format = !strcmp(arg,"xpm2") ? XPM_FORMAT_XPM2 : XPM_FORMAT_XPM3;
+			if (!strcmp(arg,"xpm") || !strcmp(arg,"xpm2"))
+				options->to = CONVERT_XPM;
+			else if (!strcmp(arg,"bits"))
+				options->to = CONVERT_BITS;
+			else if (!strcmp(arg,"pam"))
+				options->to = CONVERT_PAM;
+			else if (!strcmp(arg,"ppm"))
+				options->to = CONVERT_PPM;
+			else
+				return B_BAD_VALUE;
+		}
+		else if (!strncmp(arg,"--output=",9))
+			options->output = arg + 9;
+		else if (!strncmp(arg,"--jobs=",7))
+			options->jobs = atoi(arg + 7);
+		else if (!strcmp(arg,"--gzip"))
+			options->settings.gzip = true;
+		else if (!strncmp(arg,"--colors=",9))
+			options->settings.maxColors = atoi(arg + 9);
+		else if (!strncmp(arg,"--quantizer=",12))
+		{
+			if (!strcmp(arg + 12,"median"))
+				options->settings.quantizer = XPM_QUANTIZE_MEDIAN_CUT;
+			else if (!strcmp(arg + 12,"octree"))
+				options->settings.quantizer = XPM_QUANTIZE_OCTREE;
+			else
+				return B_BAD_VALUE;
+		}
+		else if (!strcmp(arg,"--dither"))
+			options->settings.dither = true;
+		else if (!strncmp(arg,"--memory-limit=",15))
+			options->settings.memoryLimit = strtoul(arg + 15,NULL,0);
+		else if (!strcmp(arg,"--verbose"))
+			options->verbose = true;
+		else
+			return B_BAD_VALUE;
+	}
+	if (options->to == CONVERT_UNKNOWN || !*inputs || options->jobs <= 0
+		|| options->settings.maxColors < 0)
+		return B_BAD_VALUE;
+	if (options->jobs > CONVERT_MAX_JOBS)
+		options->jobs = CONVERT_MAX_JOBS;
+	return B_OK;
+}
+
+//	add_path()
+//	add the file at "path", or every file under it if it is a directory,
+//	with their output at "output", or where the options say if that is
+//	NULL.  What a directory named on the command line holds goes straight
+//	into the output directory.  A path that can't be looked at is added,
+//	to fail.  B_NO_MEMORY is the only error.
+status_t add_path(convert_options *options, file_list *files, const char *path, const char *output,
+	bool named)
+{
+	struct stat st;
+	char *where = NULL;
+	const char *name;
+	status_t err = B_OK;
+
+	if (named ? stat(path,&st) : lstat(path,&st))
+		return add_failure(options,files,path,output ? output : path,strerror(errno));
+	if (S_ISDIR(st.st_mode))
+		return add_directory(options,files,path,
+			output ? output : options->output ? options->output : path);
+	if (S_ISLNK(st.st_mode) && (stat(path,&st) || !S_ISREG(st.st_mode)))
+		return B_OK;
+	if (!S_ISREG(st.st_mode) && !named)
+		return B_OK;
+
+	if (!output && options->output)
+	{
+		name = strrchr(path,'/');
+		where = join_path(options->output,name ? name + 1 : path);
+		if (!where)
+			return B_NO_MEMORY;
+		output = where;
+	}
+	err = add_file(options,files,path,output ? output : path,named);
+	free(where);
+	return err;
+}
+
+//	add_directory()
+//	add what is under the directory "path", in order of name, with its
+//	output under "output", which is made if it has to be.  Links to
+//	directories are not followed, so that a loop can't be.
+status_t add_directory(convert_options *options, file_list *files, const char *path,
+	const char *output)
+{
+	struct dirent **entry;
+	char *child, *childOutput;
+	status_t err = B_OK;
+	int count, i;
+
+	count = scandir(path,&entry,NULL,alphasort);
+	if (count < 0)
+		return add_failure(options,files,path,output,strerror(errno));
+	if (options->output && make_directories(output) != B_OK)
+		fprintf(stderr,"xpmconvert: can't make %s: %s\n",output,strerror(errno));
+	for (i = 0; i < count; i++)
+	{
+		if (err == B_OK && strcmp(entry[i]->d_name,".") && strcmp(entry[i]->d_name,".."))
+		{
+			child = join_path(path,entry[i]->d_name);
+			childOutput = join_path(output,entry[i]->d_name);
+			err = child && childOutput ? add_path(options,files,child,childOutput,false)
+				: B_NO_MEMORY;
+			free(child);
+			free(childOutput);
+		}
+		free(entry[i]);
+	}
+	free(entry);
+	return err;
+}
+
+//	add_file()
+//	add the file at "path", to be written to "output" with the extension
+//	of the format it is converted to.
+status_t add_file(convert_options *options, file_list *files, const char *path, const char *output,
+	bool named)
+{
+	convert_file *file;
+	int room;
+
+	if (files->count == files->room)
+	{
+		room = files->room ? 2*files->room : 256;
+		file = (convert_file *)realloc(files->file,room*sizeof(convert_file));
+		if (!file)
+			return B_NO_MEMORY;
+		files->file = file;
+		files->room = room;
+	}
+	file = &files->file[files->count];
+	memset(file,0,sizeof(*file));
+	file->input = strdup(path);
+	file->output = output_name(output,options->to,options->settings.gzip);
+	file->named = named;
+	if (!file->input || !file->output)
+	{
+		free(file->input);
+		free(file->output);
+		return B_NO_MEMORY;
+	}
+	files->count++;
+	return B_OK;
+}
+
+//	add_failure()
+//	add a file that fails, as "why" says, without being looked at again.
+status_t add_failure(convert_options *options, file_list *files, const char *path,
+	const char *output, const char *why)
+{
+	status_t err;
+
+	err = add_file(options,files,path,output,true);
+	if (err == B_OK)
+	{
+		files->file[files->count-1].err = B_ERROR;
+		files->file[files->count-1].why = why;
+	}
+	return err;
+}
+
+//	join_path()
+//	"directory/name", which the caller must free().
+char *join_path(const char *directory, const char *name)
+{
+	size_t length = strlen(directory);
+	char *path;
+
+	while (length > 1 && directory[length-1] == '/')
+		length--;
+	path = (char *)malloc(length + 1 + strlen(name) + 1);
+	if (path)
+		sprintf(path,"%.*s/%s",(int)length,directory,name);
+	return path;
+}
+
+//	output_name()
+//	"path" with the extension of the format "to" in place of its own, if
+//	that is an image format's, which the caller must free().
+char *output_name(const char *path, int to, bool gzip)
+{
+	const char *kKnown[] = { ".xpm", ".bits", ".pam", ".ppm", ".pgm", ".pnm", NULL };
+	const char *extension, *name, *dot;
+	size_t length = strlen(path);
+	char *output;
+	int i;
+
+	name = strrchr(path,'/');
+	name = name ? name + 1 : path;
+	if (length - (name - path) > 3 && !strcmp(path + length - 3,".gz"))
+		length -= 3;
+	for (dot = path + length - 1; dot > name && *dot != '.'; dot--)
+		;
+	for (i = 0; dot > name && kKnown[i]; i++)
+		if ((size_t)(path + length - dot) == strlen(kKnown[i])
+			&& !strncasecmp(dot,kKnown[i],strlen(kKnown[i])))
+		{
+			length = dot - path;
+			break;
+		}
+
+	switch (to)
+	{
+		case CONVERT_XPM:
+			extension = gzip ? ".xpm.gz" : ".xpm";
+			break;
+		case CONVERT_BITS:
+			extension = ".bits";
+			break;
+		case CONVERT_PAM:
+			extension = ".pam";
+			break;
+		default:
+			extension = ".ppm";
+			break;
+	}
+	output = (char *)malloc(length + strlen(extension) + 1);
+	if (output)
+		sprintf(output,"%.*s%s",(int)length,path,extension);
+	return output;
+}
+
+//	make_directories()
+//	make the directory "path", and any above it, that are missing.
+status_t make_directories(const char *path)
+{
+	char *copy, *slash;
+	status_t err = B_OK;
+
+	copy = strdup(path);
+	if (!copy)
+		return B_NO_MEMORY;
+	for (slash = strchr(copy + 1,'/'); err == B_OK; slash = strchr(slash + 1,'/'))
+	{
+		if (slash)
+			*slash = 0;
+		if (mkdir(copy,0755) && errno != EEXIST)
+			err = B_ERROR;
+		if (!slash)
+			break;
+		*slash = '/';
+	}
+	free(copy);
+	return err;
+}
+
+//	run_workers()
+//	deal the files out in runs, one to a worker, and convert them all;
+//	how many were stolen from one worker by another goes into "*stolen".
+//	Fails only if the workers can't be set going.
+status_t run_workers(convert_options *options, file_list *files, int *stolen)
+{
+	work_queue queue[CONVERT_MAX_JOBS];
+	worker_record record[CONVERT_MAX_JOBS];
+	thread_id thread[CONVERT_MAX_JOBS];
+	status_t err = B_OK, result;
+	int jobs, i;
+
+	jobs = options->jobs < files->count ? options->jobs : files->count;
+	if (jobs < 1)
+		jobs = 1;
+	for (i = 0; i < jobs; i++)
+	{
+		queue[i].head = (int)((int64)files->count*i/jobs);
+		queue[i].tail = (int)((int64)files->count*(i+1)/jobs);
+		queue[i].lock = create_sem(1,"xpmconvert queue");
+		if (queue[i].lock < 0)
+			err = B_NO_MORE_SEMS;
+		record[i].options = options;
+		record[i].files = files;
+		record[i].queue = queue;
+		record[i].jobs = jobs;
+		record[i].index = i;
+		record[i].stolen = 0;
+	}
+
+	for (i = 0; err == B_OK && i < jobs; i++)
+	{
+		thread[i] = spawn_thread(worker_thread,"xpmconvert worker",B_NORMAL_PRIORITY,&record[i]);
+		if (thread[i] >= 0 && resume_thread(thread[i]) != B_OK)
+		{
+			kill_thread(thread[i]);
+			thread[i] = -1;
+		}
+		if (thread[i] < 0)
+			worker_thread(&record[i]);
+	}
+
+//	a worker that is done may still be stolen from, until they all are
+	*stolen = 0;
+	for (i = 0; i < jobs; i++)
+		if (err == B_OK && thread[i] >= 0)
+			wait_for_thread(thread[i],&result);
+	for (i = 0; i < jobs; i++)
+	{
+		if (queue[i].lock >= 0)
+			delete_sem(queue[i].lock);
+		*stolen += record[i].stolen;
+	}
+	return err;
+}
+
+//	worker_thread()
+//	convert the worker's own run, then what can be stolen from the others',
+//	trying them in turn from the next one on, until there is nothing left.
+status_t worker_thread(void *data)
+{
+	worker_record *record = (worker_record *)data;
+	XPMContext context;
+	xpm_encode_settings settings = record->options->settings;
+	xpm_heap heap;
+	int i, next;
+
+	settings.context = &context;
+	heap.stats = NULL;
+	heap.context = &context;
+	for (;;)
+	{
+		next = take_work(&record->queue[record->index],false);
+		for (i = 1; next < 0 && i < record->jobs; i++)
+		{
+			next = take_work(&record->queue[(record->index + i) % record->jobs],true);
+			if (next >= 0)
+				record->stolen++;
+		}
+		if (next < 0)
+			return B_OK;
+		convert_one(record->options,&settings,&heap,&record->files->file[next]);
+	}
+}
+
+//	take_work()
+//	the next file of a run, from its head, or, to "steal", from its tail;
+//	-1 when the run is done.
+int take_work(work_queue *queue, bool steal)
+{
+	int next = -1;
+
+	acquire_sem(queue->lock);
+	if (queue->head < queue->tail)
+		next = steal ? --queue->tail : queue->head++;
+	release_sem(queue->lock);
+	return next;
+}
+
+//	convert_one()
+//	convert one file, unless it failed already, and say so if it fails.
+void convert_one(convert_options *options, xpm_encode_settings *settings, xpm_heap *heap,
+	convert_file *file)
+{
+	if (file->err == B_OK)
+		convert_file_data(options,settings,heap,file);
+	if (file->skipped)
+		return;
+	if (file->err != B_OK)
+		fprintf(stderr,"xpmconvert: %s: %s\n",file->input,
+			file->why ? file->why : status_message(file->err));
+	else if (options->verbose)
+		printf("%s -> %s\n",file->input,file->output);
+}
+
+//	convert_file_data()
+//	open the file and its output, and convert it, noting how it went in
+//	"file".  The output is removed if it couldn't be written in full.  It is
+//	opened for reading as well as writing, which fromXPM() needs to map a
+//	large one rather than write it.
+void convert_file_data(convert_options *options, xpm_encode_settings *settings, xpm_heap *heap,
+	convert_file *file)
+{
+	BFile input, output;
+	int from;
+
+	if (input.SetTo(file->input,B_READ_ONLY) != B_OK)
+	{
+		file->err = B_ERROR;
+		file->why = strerror(errno);
+	}
+	else if ((from = stream_type(&input)) == CONVERT_UNKNOWN)
+	{
+		file->err = B_NO_TRANSLATOR;
+		file->skipped = !file->named;
+	}
+	else if (!strcmp(file->input,file->output))
+	{
+		file->err = B_BAD_VALUE;
+		file->why = "would be written over; give an --output directory";
+	}
+	else if (output.SetTo(file->output,B_READ_WRITE | B_CREATE_FILE | B_ERASE_FILE) != B_OK)
+	{
+		file->err = B_ERROR;
+		file->why = strerror(errno);
+	}
+	else
+	{
+		input.GetSize(&file->inputBytes);
+		file->err = convert_stream(&input,from,&output,options->to,settings,heap);
+		file->outputBytes = output.Position();
+		output.Unset();
+		if (file->err != B_OK)
+			unlink(file->output);
+	}
+}
+
+//	stream_type()
+//	what "stream" holds, by its first bytes; it is left where it was.
+int stream_type(BPositionIO *stream)
+{
+	char buffer[16];
+	ssize_t length;
+	uint32 bitsType = B_HOST_TO_BENDIAN_INT32(B_TRANSLATOR_BITMAP);
+
+	length = stream->Read(buffer,sizeof(buffer));
+	if (length <= 0)
+		return CONVERT_UNKNOWN;
+	stream->Seek(-length,SEEK_CUR);
+	if (is_gzip(buffer,length))
+		length = peek_gzip(stream,buffer,sizeof(buffer));
+	if (length >= (ssize_t)strlen(XPM_HEADER) && (!strncmp(buffer,XPM_HEADER,strlen(XPM_HEADER))
+		|| !strncmp(buffer,XPM2_HEADER,strlen(XPM2_HEADER))))
+		return CONVERT_XPM;
+	if (length >= (ssize_t)sizeof(bitsType) && !memcmp(buffer,&bitsType,sizeof(bitsType)))
+		return CONVERT_BITS;
+	if (length > 0 && is_netpbm(buffer,length))
+		return buffer[1] == '7' ? CONVERT_PAM : CONVERT_PPM;
+	return CONVERT_UNKNOWN;
+}
+
+//	convert_stream()
+//	convert the image in "input", of type "from", into "output", of type
+//	"to".  XPM to bits and back, and bits to bits, go straight through the
+//	codec; anything else is read into memory whole, as a bitmap, and
+//	written out from there.
+status_t convert_stream(BPositionIO *input, int from, BPositionIO *output, int to,
+	const xpm_encode_settings *settings, xpm_heap *heap)
+{
+	TranslatorBitmap bmap;
+	BRect bounds;
+	uint8 *data = NULL;
+	status_t err;
+
+	if (from == CONVERT_XPM && to == CONVERT_BITS)
+		return fromXPM(input,output,NULL,heap->context);
+	if (from == CONVERT_BITS && to == CONVERT_XPM)
+		return toXPM(input,output,settings);
+	if (from == CONVERT_BITS && to == CONVERT_BITS)
+		return copy_bitmap(input,output);
+
+	switch (from)
+	{
+		case CONVERT_XPM:
+			err = get_xpm_bounds(input,&bounds);
+			if (err != B_OK)
+				break;
+			bmap.magic = B_TRANSLATOR_BITMAP;
+			bmap.bounds = bounds;
+			bmap.rowBytes = 4*(bounds.IntegerWidth() + 1);
+			bmap.colors = B_RGBA32;
+			if ((uint64)bmap.rowBytes*(bounds.IntegerHeight() + 1) > 0xffffffffULL)
+			{
+				err = B_FILE_TOO_LARGE;
+				break;
+			}
+			bmap.dataSize = bmap.rowBytes*(bounds.IntegerHeight() + 1);
+//	what the rows don't give stays clear, as it does going straight to bits
+			data = (uint8 *)xpm_calloc(heap,bmap.dataSize,1);
+			err = data ? fromXPM(input,data,bmap.rowBytes,bounds,NULL,heap->context) : B_NO_MEMORY;
+			break;
+		case CONVERT_BITS:
+			err = read_bitmap_header(input,&bmap);
+			if (err == B_OK)
+				err = read_bitmap_data(input,&bmap,&data,heap);
+			break;
+		default:
+			err = read_netpbm(input,&bmap,&data,heap);
+			break;
+	}
+
+	if (err == B_OK)
+		switch (to)
+		{
+			case CONVERT_XPM:
+				err = toXPM(data,bmap.rowBytes,bmap.colors,bmap.bounds,output,settings);
+				break;
+			case CONVERT_BITS:
+				err = write_bitmap(output,&bmap,data);
+				break;
+			default:
+				err = write_netpbm(output,&bmap,data,to == CONVERT_PAM,heap);
+				break;
+		}
+	xpm_free(heap,data);
+	return err;
+}
+
+//	write_bitmap()
+//	write the bitmap "bmap", in host byte order, describes, and its pixels
+//	at "data", as a B_TRANSLATOR_BITMAP stream.
+status_t write_bitmap(BPositionIO *output, const TranslatorBitmap *bmap, const uint8 *data)
+{
+	TranslatorBitmap header = *bmap;
+
+	swap_data(B_INT32_TYPE,&header.magic,sizeof(header.magic),B_SWAP_HOST_TO_BENDIAN);
+	swap_data(B_RECT_TYPE,&header.bounds,sizeof(header.bounds),B_SWAP_HOST_TO_BENDIAN);
+	swap_data(B_INT32_TYPE,&header.rowBytes,sizeof(header.rowBytes),B_SWAP_HOST_TO_BENDIAN);
+	swap_data(B_INT32_TYPE,&header.colors,sizeof(header.colors),B_SWAP_HOST_TO_BENDIAN);
+	swap_data(B_INT32_TYPE,&header.dataSize,sizeof(header.dataSize),B_SWAP_HOST_TO_BENDIAN);
+	if (output->Write(&header,sizeof(header)) != sizeof(header)
+		|| output->Write(data,bmap->dataSize) != (ssize_t)bmap->dataSize)
+		return B_IO_ERROR;
+	return B_OK;
+}
+
+//	status_message()
+//	what a codec error means, to someone converting a file.
+const char *status_message(status_t err)
+{
+	switch (err)
+	{
+		case B_NO_TRANSLATOR:
+			return "not an XPM, bits, PAM or PPM image";
+		case B_NO_MEMORY:
+			return "out of memory";
+		case B_IO_ERROR:
+			return "can't write the output";
+		case B_FILE_TOO_LARGE:
+			return "too large";
+		case B_NOT_SUPPORTED:
+			return "color space not supported";
+		case B_BAD_VALUE:
+			return "bad settings for this image";
+		default:
+			return "bad or truncated image";
+	}
+}
@@ -0,0 +1,582 @@
+//	XPMFilter.cc
+//
+//	converts one image from standard input to standard output, for use in
+//	a pipeline.  Either may be a pipe: nothing is looked up again once it
+//	has been read, beyond the first few kilobytes, which are kept so that
+//	what the input holds can be told from them and they read again.
+//
+//	Decoding runs a row at a time, each row written out as soon as it is
+//	decoded, so that its memory is the palette and a row or two, however
+//	large the image: XPM, gzipped or not, bits, PAM, PPM, PGM or raw RGBA
+//	rows in, and PAM, PPM, raw RGBA rows or bits out.  Writing an XPM
+//	can't be done that way, since its palette comes before its pixels and
+//	is only known once every pixel has been seen; the input is spooled
+//	to an unlinked temporary file as bits, then encoded from there in
+//	strips of rows, which keeps memory near --memory-limit instead.
+//
+//	usage: xpmfilter --to=pam|ppm|rgba|bits|xpm|xpm2 [--from=rgba --size=WxH]
+//		[--gzip] [--colors=n] [--quantizer=median|octree] [--dither]
+//		[--memory-limit=bytes] < input > output
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <File.h>
+#include "XPM.h"
+#include "fromXPM.h"
+#include "toXPM.h"
+#include "ScanBitmap.h"
+#include "PassThrough.h"
+#include "XPMGzip.h"
+#include "Netpbm.h"
+
+//	as much of the input as is kept to be read again; enough for
+//	peek_gzip() to look into a compressed XPM
+#define		FILTER_HEAD_SIZE		4096
+
+//	the memory limit an XPM is encoded within, unless one is given
+#define		FILTER_MEMORY_LIMIT		(1 << 20)
+
+//	what an image is held in
+enum
+{
+	FILTER_UNKNOWN = -1,
+	FILTER_XPM,
+	FILTER_BITS,
+	FILTER_NETPBM,
+	FILTER_PAM,
+	FILTER_PPM,
+	FILTER_RGBA
+};
+
+typedef struct
+{
+	int from;						// FILTER_UNKNOWN to tell from the input
+	int to;
+	int width;						// of raw RGBA input
+	int height;
+	xpm_encode_settings settings;
+}
+filter_options;
+
+//	a stream onto a file descriptor that may be a pipe.  The first
+//	FILTER_HEAD_SIZE bytes read are kept, and may be read again; past them
+//	it can only be read, or written, onward.
+class PipeIO : public BPositionIO
+{
+	public:
+
+		PipeIO(int);
+
+		virtual ssize_t Read(void *, size_t);
+		virtual ssize_t Write(const void *, size_t);
+		virtual ssize_t ReadAt(off_t, void *, size_t);
+		virtual ssize_t WriteAt(off_t, const void *, size_t);
+		virtual off_t Seek(off_t, uint32);
+		virtual off_t Position(void) const;
+
+	private:
+
+		int fd;
+		off_t position;
+		off_t total;					// read or written so far
+		uint8 head[FILTER_HEAD_SIZE];
+		size_t headLength;
+};
+
+//	where the rows come from
+typedef struct
+{
+	int type;
+	int width;
+	int height;
+	BPositionIO *input;
+	XPMRowDecoder *decoder;
+	netpbm_stream *stream;
+	netpbm_info info;
+	TranslatorBitmap bmap;
+	uint8 *raw;						// a row as read
+}
+row_source;
+
+status_t parse_options(int, char **, filter_options *);
+int stream_type(BPositionIO *);
+status_t open_source(row_source *, BPositionIO *, int, filter_options *, xpm_heap *);
+void close_source(row_source *, xpm_heap *);
+status_t read_source_row(row_source *, rgb_color *);
+status_t read_all(BDataIO *, void *, size_t);
+status_t write_rows(row_source *, BPositionIO *, int, xpm_heap *);
+status_t write_xpm(row_source *, BPositionIO *, filter_options *, xpm_heap *);
+void pack_row(const rgb_color *, int, uint8 *);
+const char *status_message(status_t);
+
+int main(int argc, char **argv)
+{
+	filter_options options;
+	PipeIO input(STDIN_FILENO), output(STDOUT_FILENO);
+	XPMContext context;
+	xpm_heap heap;
+	row_source source;
+	status_t err;
+	int from;
+
+	if (parse_options(argc,argv,&options) != B_OK)
+	{
+		fprintf(stderr,"usage: %s --to=pam|ppm|rgba|bits|xpm|xpm2 [--from=rgba --size=WxH]"
+			" [--gzip]\n"
+			"\t[--colors=n] [--quantizer=median|octree] [--dither] [--memory-limit=bytes]\n"
+			"\t< input > output\n",argv[0]);
+		return 2;
+	}
+	heap.stats = NULL;
+	heap.context = &context;
+	options.settings.context = &context;
+
+	from = options.from == FILTER_UNKNOWN ? stream_type(&input) : options.from;
+	if (from == FILTER_UNKNOWN)
+		err = B_NO_TRANSLATOR;
+	else if (from == FILTER_BITS && options.to == FILTER_BITS)
+		err = copy_bitmap(&input,&output);
+	else
+	{
+		err = open_source(&source,&input,from,&options,&heap);
+		if (err == B_OK)
+			err = options.to == FILTER_XPM ? write_xpm(&source,&output,&options,&heap)
+				: write_rows(&source,&output,options.to,&heap);
+		close_source(&source,&heap);
+	}
+	if (err != B_OK)
+	{
+		fprintf(stderr,"%s: %s\n",argv[0],status_message(err));
+		return 1;
+	}
+	return 0;
+}
+
+status_t parse_options(int argc, char **argv, filter_options *options)
+{
+	const char *arg;
+	int i;
+
+	options->from = options->to = FILTER_UNKNOWN;
+	options->width = options->height = 0;
+	init_encode_settings(&options->settings);
+	options->settings.deterministic = true;
+	options->settings.memoryLimit = FILTER_MEMORY_LIMIT;
+	for (i = 1; i < argc; i++)
+	{
+		arg = argv[i];
+		if (!strncmp(arg,"--to=",5))
+		{
+			arg += 5;
+			options->settings.format = !strcmp(arg,"xpm2") ? XPM_FORMAT_XPM2 : XPM_FORMAT_XPM3;
+			if (!strcmp(arg,"xpm") || !strcmp(arg,"xpm2"))
+				options->to = FILTER_XPM;
+			else if (!strcmp(arg,"bits"))
+				options->to = FILTER_BITS;
+			else if (!strcmp(arg,"pam"))
+				options->to = FILTER_PAM;
+			else if (!strcmp(arg,"ppm"))
+				options->to = FILTER_PPM;
+			else if (!strcmp(arg,"rgba"))
+				options->to = FILTER_RGBA;
+			else
+				return B_BAD_VALUE;
+		}
+		else if (!strcmp(arg,"--from=rgba"))
+			options->from = FILTER_RGBA;
+		else if (!strncmp(arg,"--size=",7))
+		{
+			if (sscanf(arg + 7,"%dx%d",&options->width,&options->height) != 2
+				|| options->width <= 0 || options->height <= 0)
+				return B_BAD_VALUE;
+		}
+		else if (!strcmp(arg,"--gzip"))
+			options->settings.gzip = true;
+		else if (!strncmp(arg,"--colors=",9))
+			options->settings.maxColors = atoi(arg + 9);
+		else if (!strncmp(arg,"--quantizer=",12))
+		{
+			if (!strcmp(arg + 12,"median"))
+				options->settings.quantizer = XPM_QUANTIZE_MEDIAN_CUT;
+			else if (!strcmp(arg + 12,"octree"))
+				options->settings.quantizer = XPM_QUANTIZE_OCTREE;
+			else
+				return B_BAD_VALUE;
+		}
+		else if (!strcmp(arg,"--dither"))
+			options->settings.dither = true;
+		else if (!strncmp(arg,"--memory-limit=",15))
+			options->settings.memoryLimit = strtoul(arg + 15,NULL,0);
+		else
+			return B_BAD_VALUE;
+	}
+	if (options->to == FILTER_UNKNOWN || options->settings.maxColors < 0
+		|| (options->from == FILTER_RGBA) != (options->width > 0))
+		return B_BAD_VALUE;
+	return B_OK;
+}
+
+PipeIO::PipeIO(int descriptor)
+{
+	fd = descriptor;
+	position = total = 0;
+	headLength = 0;
+}
+
+ssize_t PipeIO::Read(void *data, size_t size)
+{
+	ssize_t got;
+
+	got = ReadAt(position,data,size);
+	if (got > 0)
+		position += got;
+	return got;
+}
+
+//	PipeIO::Write(const void *, size_t)
+//	write all of "data", however many goes that takes.
+ssize_t PipeIO::Write(const void *data, size_t size)
+{
+	const uint8 *t = (const uint8 *)data;
+	size_t done = 0;
+	ssize_t n;
+
+	while (done < size)
+	{
+		n = write(fd,t + done,size - done);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return B_IO_ERROR;
+		done += n;
+	}
+	position += size;
+	total = position;
+	return size;
+}
+
+//	PipeIO::ReadAt(off_t, void *, size_t)
+//	what is at "at" in the head, reading as far into it as that needs;
+//	past the head, only what comes next.
+ssize_t PipeIO::ReadAt(off_t at, void *data, size_t size)
+{
+	ssize_t n;
+
+	if (at < 0)
+		return B_BAD_VALUE;
+	if (at < FILTER_HEAD_SIZE)
+	{
+		while (headLength < FILTER_HEAD_SIZE && (off_t)headLength < at + (off_t)size)
+		{
+			n = read(fd,head + headLength,FILTER_HEAD_SIZE - headLength);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n <= 0)
+				break;
+			headLength += n;
+			total = headLength;
+		}
+		if (at >= (off_t)headLength)
+			return 0;
+		if (size > headLength - at)
+			size = headLength - at;
+		memcpy(data,head + at,size);
+		return size;
+	}
+	if (at != total)
+		return B_NOT_SUPPORTED;
+	do
+		n = read(fd,data,size);
+	while (n < 0 && errno == EINTR);
+	if (n < 0)
+		return B_IO_ERROR;
+	total += n;
+	return n;
+}
+
+ssize_t PipeIO::WriteAt(off_t at, const void *data, size_t size)
+{
+	if (at != position)
+		return B_NOT_SUPPORTED;
+	return Write(data,size);
+}
+
+//	PipeIO::Seek(off_t, uint32)
+//	only within the head, or to where the stream is.
+off_t PipeIO::Seek(off_t to, uint32 mode)
+{
+	if (mode == SEEK_CUR)
+		to += position;
+	else if (mode != SEEK_SET)
+		return B_NOT_SUPPORTED;
+	if (to < 0 || (to > (off_t)headLength && to != total))
+		return B_NOT_SUPPORTED;
+	position = to;
+	return position;
+}
+
+off_t PipeIO::Position(void) const
+{
+	return position;
+}
+
+//	stream_type()
+//	what "stream" holds, by its first bytes, which are left to be read.
+int stream_type(BPositionIO *stream)
+{
+	char buffer[16];
+	ssize_t length;
+	uint32 bitsType = B_HOST_TO_BENDIAN_INT32(B_TRANSLATOR_BITMAP);
+
+	length = stream->Read(buffer,sizeof(buffer));
+	if (length <= 0)
+		return FILTER_UNKNOWN;
+	stream->Seek(-length,SEEK_CUR);
+	if (is_gzip(buffer,length))
+		length = peek_gzip(stream,buffer,sizeof(buffer));
+	if (length >= (ssize_t)strlen(XPM_HEADER) && (!strncmp(buffer,XPM_HEADER,strlen(XPM_HEADER))
+		|| !strncmp(buffer,XPM2_HEADER,strlen(XPM2_HEADER))))
+		return FILTER_XPM;
+	if (length >= (ssize_t)sizeof(bitsType) && !memcmp(buffer,&bitsType,sizeof(bitsType)))
+		return FILTER_BITS;
+	if (length > 0 && is_netpbm(buffer,length))
+		return FILTER_NETPBM;
+	return FILTER_UNKNOWN;
+}
+
+//	open_source()
+//	read the header of the image in "input", of type "from", and get the
+//	memory to read its rows into.
+status_t open_source(row_source *source, BPositionIO *input, int from, filter_options *options,
+	xpm_heap *heap)
+{
+	status_t err = B_OK;
+	size_t rowSize;
+
+	*source = row_source();
+	source->type = from;
+	source->input = input;
+	switch (from)
+	{
+		case FILTER_XPM:
+			source->decoder = new XPMRowDecoder(input,heap->context);
+			err = source->decoder->ReadHeader();
+			source->width = source->decoder->Width();
+			source->height = source->decoder->Height();
+			rowSize = (size_t)4*source->width;
+			break;
+		case FILTER_BITS:
+			err = read_bitmap_header(input,&source->bmap);
+			source->width = source->bmap.bounds.IntegerWidth() + 1;
+			source->height = source->bmap.bounds.IntegerHeight() + 1;
+			rowSize = source->bmap.rowBytes;
+			if (err == B_OK && row_bytes(source->bmap.colors,source->width) > rowSize)
+				err = B_BAD_DATA;
+			break;
+		case FILTER_NETPBM:
+			source->stream = (netpbm_stream *)xpm_malloc(heap,sizeof(netpbm_stream));
+			if (!source->stream)
+				return B_NO_MEMORY;
+			init_netpbm_stream(source->stream,input);
+			err = read_netpbm_header(source->stream,&source->info);
+			source->width = source->info.width;
+			source->height = source->info.height;
+			rowSize = (size_t)4*source->width;
+			break;
+		default:
+			source->width = options->width;
+			source->height = options->height;
+			rowSize = (size_t)4*source->width;
+			break;
+	}
+	if (err != B_OK)
+		return err;
+	if ((uint64)4*source->width*source->height > 0xffffffffULL)
+		return B_FILE_TOO_LARGE;
+	source->raw = (uint8 *)xpm_malloc(heap,rowSize);
+	return source->raw ? B_OK : B_NO_MEMORY;
+}
+
+void close_source(row_source *source, xpm_heap *heap)
+{
+	delete source->decoder;
+	xpm_free(heap,source->stream);
+	xpm_free(heap,source->raw);
+}
+
+//	read_source_row()
+//	the next row of the source, as colors.
+status_t read_source_row(row_source *source, rgb_color *pixel)
+{
+	status_t err;
+
+	switch (source->type)
+	{
+		case FILTER_XPM:
+			err = source->decoder->DecodeRow(source->raw);
+			if (err == B_OK)
+				convert_row(B_RGBA32,source->raw,source->width,pixel);
+			return err;
+		case FILTER_BITS:
+			err = read_all(source->input,source->raw,source->bmap.rowBytes);
+			if (err == B_OK)
+				convert_row(source->bmap.colors,source->raw,source->width,pixel);
+			return err;
+		case FILTER_NETPBM:
+			err = read_netpbm_rows(source->stream,&source->info,source->raw,4*source->width,1);
+			if (err == B_OK)
+				convert_row(B_RGBA32,source->raw,source->width,pixel);
+			return err;
+		default:
+//	an rgb_color is laid out as RGBA bytes
+			return read_all(source->input,pixel,(size_t)4*source->width);
+	}
+}
+
+//	read_all()
+//	read all "size" bytes, however many goes that takes.
+status_t read_all(BDataIO *io, void *data, size_t size)
+{
+	size_t done = 0;
+	ssize_t n;
+
+	while (done < size)
+	{
+		n = io->Read((uint8 *)data + done,size - done);
+		if (n <= 0)
+			return B_BAD_DATA;
+		done += n;
+	}
+	return B_OK;
+}
+
+//	write_rows()
+//	write the source out as "to" says, a row as soon as it is read.
+status_t write_rows(row_source *source, BPositionIO *output, int to, xpm_heap *heap)
+{
+	netpbm_info info;
+	TranslatorBitmap bmap;
+	rgb_color *pixel;
+	uint8 *packed;
+	status_t err = B_OK;
+	int y;
+
+	pixel = (rgb_color *)xpm_malloc(heap,(size_t)source->width*sizeof(rgb_color));
+	packed = (uint8 *)xpm_malloc(heap,(size_t)4*source->width);
+	if (!pixel || !packed)
+		err = B_NO_MEMORY;
+
+	info.width = source->width;
+	info.height = source->height;
+	info.depth = to == FILTER_PAM ? 4 : 3;
+	info.maxval = 255;
+	info.pam = to == FILTER_PAM;
+	if (err == B_OK && (to == FILTER_PAM || to == FILTER_PPM))
+		err = write_netpbm_header(output,&info);
+	else if (err == B_OK && to == FILTER_BITS)
+	{
+		bmap.magic = B_TRANSLATOR_BITMAP;
+		bmap.bounds.Set(0,0,source->width-1,source->height-1);
+		bmap.rowBytes = 4*source->width;
+//	labelled as fromXPM() labels what it decodes, so the two agree
+		bmap.colors = source->type == FILTER_XPM ? B_RGB_32_BIT : B_RGBA32;
+		bmap.dataSize = bmap.rowBytes*source->height;
+		swap_data(B_INT32_TYPE,&bmap.magic,sizeof(bmap.magic),B_SWAP_HOST_TO_BENDIAN);
+		swap_data(B_RECT_TYPE,&bmap.bounds,sizeof(bmap.bounds),B_SWAP_HOST_TO_BENDIAN);
+		swap_data(B_INT32_TYPE,&bmap.rowBytes,sizeof(bmap.rowBytes),B_SWAP_HOST_TO_BENDIAN);
+		swap_data(B_INT32_TYPE,&bmap.colors,sizeof(bmap.colors),B_SWAP_HOST_TO_BENDIAN);
+		swap_data(B_INT32_TYPE,&bmap.dataSize,sizeof(bmap.dataSize),B_SWAP_HOST_TO_BENDIAN);
+		if (output->Write(&bmap,sizeof(bmap)) != sizeof(bmap))
+			err = B_IO_ERROR;
+	}
+
+	for (y = 0; err == B_OK && y < source->height; y++)
+	{
+		err = read_source_row(source,pixel);
+		if (err != B_OK)
+			break;
+		switch (to)
+		{
+			case FILTER_PAM:
+			case FILTER_PPM:
+				err = write_netpbm_row(output,&info,pixel,packed);
+				break;
+			case FILTER_BITS:
+				pack_row(pixel,source->width,packed);
+				if (output->Write(packed,(size_t)4*source->width) != (ssize_t)4*source->width)
+					err = B_IO_ERROR;
+				break;
+			default:
+				if (output->Write(pixel,(size_t)4*source->width) != (ssize_t)4*source->width)
+					err = B_IO_ERROR;
+				break;
+		}
+	}
+	xpm_free(heap,pixel);
+	xpm_free(heap,packed);
+	return err;
+}
+
+//	write_xpm()
+//	spool the source into a temporary file as bits, then encode it from
+//	there, in strips of rows if it is large.
+status_t write_xpm(row_source *source, BPositionIO *output, filter_options *options, xpm_heap *heap)
+{
+	char path[] = "/tmp/xpmfilterXXXXXX";
+	BFile spool;
+	status_t err;
+	int fd;
+
+	fd = mkstemp(path);
+	if (fd < 0)
+		return B_IO_ERROR;
+	err = spool.SetTo(path,B_READ_WRITE);
+	unlink(path);
+	close(fd);
+	if (err == B_OK)
+		err = write_rows(source,&spool,FILTER_BITS,heap);
+	if (err == B_OK && spool.Seek(0,SEEK_SET) != 0)
+		err = B_IO_ERROR;
+	if (err == B_OK)
+		err = toXPM(&spool,output,&options->settings);
+	return err;
+}
+
+//	pack_row()
+//	colors as B_RGBA32 pixels.
+void pack_row(const rgb_color *pixel, int width, uint8 *t)
+{
+	int x;
+
+	for (x = 0; x < width; x++, pixel++)
+	{
+		*t++ = pixel->blue;
+		*t++ = pixel->green;
+		*t++ = pixel->red;
+		*t++ = pixel->alpha;
+	}
+}
+
+//	status_message()
+//	what a codec error means, to someone filtering an image.
+const char *status_message(status_t err)
+{
+	switch (err)
+	{
+		case B_NO_TRANSLATOR:
+			return "input is not an XPM, bits, PAM or PPM image";
+		case B_NO_MEMORY:
+			return "out of memory";
+		case B_IO_ERROR:
+			return "can't write the output";
+		case B_FILE_TOO_LARGE:
+			return "image too large";
+		case B_NOT_SUPPORTED:
+			return "color space not supported";
+		default:
+			return "bad or truncated image";
+	}
+}
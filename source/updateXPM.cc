@@ -0,0 +1,427 @@
+//	updateXPM.cc
+//
+//	implements updateXPM(), which writes out a new version of an XPM file
+//	given the bitmap it now represents and the range of rows that changed.
+//	Everything outside that range is copied byte for byte from the old file;
+//	the changed rows are formatted again, and colors the old palette lacks
+//	are added to it.  When that can't be done--the size of the image changed,
+//	the new colors don't fit in the old characters-per-pixel, or the old file
+//	can't be made sense of--the bitmap is encoded from scratch by toXPM().
+
+#include <limits.h>
+#include <stdio.h>
+#include "XPM.h"
+#include "updateXPM.h"
+#include "fromXPM.h"
+#include "ScanBitmap.h"
+
+#define		UPDATE_READ_SIZE		65536
+#define		UPDATE_MAX_CPP			4			// pixel strings must pack into a key
+
+//	where a quoted string of the old file lies: the offsets of its first
+//	character and of its closing quote.
+typedef struct
+{
+	size_t start;
+	size_t end;
+}
+xpm_span;
+
+//	the old file, and what is known of its palette.  "code" and "color"
+//	hold the old colors followed by any new ones; "colors" finds a color's
+//	entry, and "codes" tells which pixel strings are taken.
+typedef struct
+{
+	char *text;
+	size_t length;
+	int width;
+	int height;
+	int ncolors;
+	int cpp;
+	int tail;						// offset of anything after cpp in the value string
+	xpm_span *span;					// value string, colors, rows
+	char (*code)[16];
+	rgb_color *color;
+	int total;
+	int capacity;
+	int64 nextCode;
+	UTreeDictionary *colors;
+	UTreeDictionary *codes;
+	xpm_heap *heap;					// where all of the above come from
+}
+old_xpm;
+
+status_t read_old_xpm(BPositionIO *, old_xpm *);
+status_t parse_old_xpm(old_xpm *);
+int32 color_key(rgb_color *);
+int32 code_key(const char *, int);
+int find_or_add_color(old_xpm *, rgb_color *);
+status_t grow_colors(old_xpm *);
+status_t write_text(BPositionIO *, const char *, size_t);
+void free_old_xpm(old_xpm *);
+
+//	updateXPM()
+//	"oldXPM" is the file as last written, "input" the B_TRANSLATOR_BITMAP
+//	it should now represent, and rows "firstRow" through "lastRow" the rows
+//	that may have changed.  The new file goes to "output".  Memory comes
+//	from the settings' context, and is counted in their stats, as toXPM()'s
+//	is.
+status_t updateXPM(BPositionIO *oldXPM, BPositionIO *input, int firstRow, int lastRow,
+	BPositionIO *output, const xpm_encode_settings *settings)
+{
+	status_t err;
+	old_xpm old;
+	TranslatorBitmap bmap;
+	uint8 *data = NULL;
+	rgb_color *row = NULL;
+	char *rows = NULL;
+	char *t;
+	char buffer[256];
+	off_t inputStart;
+	size_t pos, rowLength;
+	int i, j, ix, oldColors, width, height;
+	xpm_span *last;
+	xpm_heap heap;
+
+	heap.stats = settings ? settings->stats : NULL;
+	heap.context = settings ? settings->context : NULL;
+	memset(&old,0,sizeof(old));
+	old.heap = &heap;
+	inputStart = input->Position();
+
+//	settings that change the whole file can't be honored piecemeal
+	if (settings
+		&& (settings->deterministic || settings->format != XPM_FORMAT_XPM3 || settings->gzip))
+		goto encode;
+
+	err = read_old_xpm(oldXPM,&old);
+	if (err == B_OK)
+		err = parse_old_xpm(&old);
+	if (err != B_OK)
+		goto encode;
+	err = read_bitmap_header(input,&bmap);
+	if (err == B_OK)
+		err = read_bitmap_data(input,&bmap,&data,&heap);
+	if (err != B_OK)
+	{
+		free_old_xpm(&old);
+		return err;
+	}
+	width = 1+bmap.bounds.IntegerWidth();
+	height = 1+bmap.bounds.IntegerHeight();
+	if (width != old.width || height != old.height
+		|| (size_t)bmap.rowBytes < row_bytes(bmap.colors,width))
+		goto encode;
+	if (firstRow < 0)
+		firstRow = 0;
+	if (lastRow >= height)
+		lastRow = height-1;
+
+//	format the changed rows, adding any new colors to the palette
+	oldColors = old.total;
+	rowLength = (size_t)width*old.cpp;
+	row = (rgb_color *)xpm_malloc(&heap,width*sizeof(rgb_color));
+	rows = (char *)xpm_malloc(&heap,firstRow <= lastRow ? (lastRow-firstRow+1)*rowLength : 1);
+	if (!row || !rows)
+	{
+		err = B_NO_MEMORY;
+		goto bail;
+	}
+	t = rows;
+	for (i = firstRow; i <= lastRow; i++)
+	{
+		convert_row(bmap.colors,data + (size_t)i*bmap.rowBytes,width,row);
+		for (j = 0; j < width; j++)
+		{
+			ix = find_or_add_color(&old,&row[j]);
+			if (ix < 0)
+				goto encode;
+			memcpy(t,old.code[ix],old.cpp);
+			t += old.cpp;
+		}
+	}
+	if (settings && settings->maxColors > 0 && old.total > settings->maxColors)
+		goto encode;
+
+//	write out the old text up to the value string, and the new value string
+	err = write_text(output,old.text,old.span[0].start);
+	if (err != B_OK)
+		goto bail;
+	sprintf(buffer,"%d %d %d %d",old.width,old.height,old.total,old.cpp);
+	err = write_text(output,buffer,strlen(buffer));
+	if (err == B_OK)
+		err = write_text(output,old.text + old.span[0].start + old.tail,
+			old.span[0].end - old.span[0].start - old.tail);
+	pos = old.span[0].end;
+
+//	then the old colors, and the new ones after the last of them
+	last = &old.span[old.ncolors];
+	if (err == B_OK && old.total > oldColors)
+	{
+		err = write_text(output,old.text + pos,last->end + 1 - pos);
+		pos = last->end + 1;
+		for (i = oldColors; i < old.total && err == B_OK; i++)
+		{
+			rgb_color *color = &old.color[i];
+			rgb_color transp = B_TRANSPARENT_32_BIT;
+
+			if (!memcmp(color,&transp,sizeof(rgb_color)))
+				sprintf(buffer,",\n\t\"%s\tc\tNone\"",old.code[i]);
+			else
+				sprintf(buffer,",\n\t\"%s\tc\t#%02x%02x%02x\"",old.code[i],
+					color->red,color->green,color->blue);
+			err = write_text(output,buffer,strlen(buffer));
+		}
+	}
+
+//	then the rows, old or new, and whatever follows them
+	for (i = 0; i < old.height && err == B_OK; i++)
+	{
+		xpm_span *span = &old.span[1 + old.ncolors + i];
+
+		err = write_text(output,old.text + pos,span->start - pos);
+		if (err != B_OK)
+			break;
+		if (i >= firstRow && i <= lastRow)
+			err = write_text(output,rows + (i-firstRow)*rowLength,rowLength);
+		else
+			err = write_text(output,old.text + span->start,span->end - span->start);
+		pos = span->end;
+	}
+	if (err == B_OK)
+		err = write_text(output,old.text + pos,old.length - pos);
+	goto bail;
+
+//	fall back on encoding the whole bitmap
+encode:
+	xpm_free(&heap,rows);
+	xpm_free(&heap,row);
+	xpm_free(&heap,data);
+	free_old_xpm(&old);
+	if (input->Seek(inputStart,SEEK_SET) != inputStart)
+		return B_ERROR;
+	return toXPM(input,output,settings);
+
+bail:
+	xpm_free(&heap,rows);
+	xpm_free(&heap,row);
+	xpm_free(&heap,data);
+	free_old_xpm(&old);
+	return err;
+}
+
+//	read_old_xpm()
+//	read the whole of the old file into memory.
+status_t read_old_xpm(BPositionIO *stream, old_xpm *old)
+{
+	size_t size = 0;
+	ssize_t n;
+	char *text;
+
+	old->text = NULL;
+	old->length = 0;
+	do
+	{
+		if (old->length + UPDATE_READ_SIZE + 1 > size)
+		{
+			size = 2*size + UPDATE_READ_SIZE + 1;
+			text = (char *)xpm_realloc(old->heap,old->text,size);
+			if (!text)
+				return B_NO_MEMORY;
+			old->text = text;
+		}
+		n = stream->Read(old->text + old->length,UPDATE_READ_SIZE);
+		if (n > 0)
+			old->length += n;
+	}
+	while (n > 0);
+	old->text[old->length] = 0;
+	return n < 0 ? (status_t)n : B_OK;
+}
+
+//	parse_old_xpm()
+//	find the quoted strings of the old file, as XPMScanner would, and read
+//	its value string and colors.
+status_t parse_old_xpm(old_xpm *old)
+{
+	char string[1024];
+	char *p, *q, *end;
+	size_t length;
+	int i, nspans, n;
+	rgb_color color;
+	int32 key;
+
+	end = old->text + old->length;
+	p = (char *)memchr(old->text,'"',old->length);
+	q = p ? (char *)memchr(p+1,'"',end-p-1) : NULL;
+	if (!q || q-p-1 >= (int)sizeof(string))
+		return B_ERROR;
+	memcpy(string,p+1,q-p-1);
+	string[q-p-1] = 0;
+	if (sscanf(string,"%d %d %d %d%n",&old->width,&old->height,&old->ncolors,&old->cpp,&n) < 4
+		|| old->width <= 0 || old->height <= 0 || old->ncolors < 0
+		|| old->height > INT_MAX/4 || old->ncolors > INT_MAX/4
+		|| old->cpp <= 0 || old->cpp > UPDATE_MAX_CPP)
+		return B_ERROR;
+	old->tail = n;
+
+	nspans = 1 + old->ncolors + old->height;
+	old->span = (xpm_span *)xpm_malloc(old->heap,(size_t)nspans*sizeof(xpm_span));
+	if (!old->span)
+		return B_NO_MEMORY;
+	for (i = 0; i < nspans; i++)
+	{
+		if (!p || !q)
+			return B_ERROR;
+		old->span[i].start = p+1 - old->text;
+		old->span[i].end = q - old->text;
+		p = (char *)memchr(q+1,'"',end-q-1);
+		q = p ? (char *)memchr(p+1,'"',end-p-1) : NULL;
+	}
+
+//	room for the old colors and a few new ones; find_or_add_color() makes
+//	more as it needs it
+	old->capacity = old->ncolors + 256;
+	old->code = (char (*)[16])xpm_malloc(old->heap,old->capacity*sizeof(*old->code));
+	old->color = (rgb_color *)xpm_malloc(old->heap,old->capacity*sizeof(rgb_color));
+	old->colors = new_dictionary(sizeof(int),old->heap);
+	old->codes = new_dictionary(sizeof(int),old->heap);
+	if (!old->code || !old->color || !old->colors || !old->codes)
+		return B_NO_MEMORY;
+	old->total = 0;
+	old->nextCode = 0;
+	for (i = 1; i <= old->ncolors; i++)
+	{
+		length = old->span[i].end - old->span[i].start;
+		if (length < (size_t)old->cpp || length >= sizeof(string))
+			return B_ERROR;
+		memcpy(string,old->text + old->span[i].start,length);
+		string[length] = 0;
+		handle_color_string(&string[old->cpp],&color);
+		n = old->total++;
+		memcpy(old->code[n],old->text + old->span[i].start,old->cpp);
+		old->code[n][old->cpp] = 0;
+		old->color[n] = color;
+		key = color_key(&color);
+		if (!old->colors->Find(NULL,key))
+			old->colors->Insert(&n,key);
+		key = code_key(old->code[n],old->cpp);
+		if (!old->codes->Find(NULL,key))
+			old->codes->Insert(&n,key);
+	}
+	return B_OK;
+}
+
+//	color_key()
+//	colors are written without their alpha, so they compare without it,
+//	except for the transparent color, which is written as "None".
+int32 color_key(rgb_color *color)
+{
+	rgb_color c = *color;
+	rgb_color transp = B_TRANSPARENT_32_BIT;
+	int32 key;
+
+	if (memcmp(&c,&transp,sizeof(rgb_color)))
+		c.alpha = 0xff;
+	memcpy(&key,&c,sizeof(key));
+	return key;
+}
+
+int32 code_key(const char *code, int cpp)
+{
+	int32 key = 0;
+	int j;
+
+	for (j = 0; j < cpp; j++)
+		key = (key << 8) | (uint8)code[j];
+	return key;
+}
+
+//	find_or_add_color()
+//	the palette entry of "color", adding one with a pixel string not yet
+//	taken if need be.  Returns -1 if the pixel strings have run out.
+int find_or_add_color(old_xpm *old, rgb_color *color)
+{
+	int32 key = color_key(color);
+	int64 t, limit = 1;
+	int ix, j;
+	char *code;
+
+	if (old->colors->Find(&ix,key))
+		return ix;
+	if (old->total >= old->capacity && grow_colors(old) != B_OK)
+		return -1;
+	for (j = 0; j < old->cpp; j++)
+		limit *= XPM_CHAR_COUNT;
+	ix = old->total;
+	code = old->code[ix];
+	do
+	{
+		if (old->nextCode >= limit)
+			return -1;
+		t = old->nextCode++;
+		for (j = 0; j < old->cpp; j++)
+		{
+			code[j] = XPM_CHAR_SET[t % XPM_CHAR_COUNT];
+			t /= XPM_CHAR_COUNT;
+		}
+		code[j] = 0;
+	}
+	while (old->codes->Find(NULL,code_key(code,old->cpp)));
+	old->total++;
+	old->color[ix] = *color;
+	if (memcmp(&old->color[ix],&B_TRANSPARENT_32_BIT,sizeof(rgb_color)))
+		old->color[ix].alpha = 0xff;
+	old->colors->Insert(&ix,key);
+	old->codes->Insert(&ix,code_key(code,old->cpp));
+	return ix;
+}
+
+//	grow_colors()
+//	double the room for palette entries.
+status_t grow_colors(old_xpm *old)
+{
+	char (*code)[16];
+	rgb_color *color;
+	int capacity;
+
+	if (old->capacity > INT_MAX/2)
+		return B_NO_MEMORY;
+	capacity = 2*old->capacity;
+	code = (char (*)[16])xpm_realloc(old->heap,old->code,(size_t)capacity*sizeof(*old->code));
+	if (!code)
+		return B_NO_MEMORY;
+	old->code = code;
+	color = (rgb_color *)xpm_realloc(old->heap,old->color,(size_t)capacity*sizeof(rgb_color));
+	if (!color)
+		return B_NO_MEMORY;
+	old->color = color;
+	old->capacity = capacity;
+	return B_OK;
+}
+
+status_t write_text(BPositionIO *output, const char *text, size_t length)
+{
+	ssize_t n;
+
+	if (!length)
+		return B_OK;
+	n = output->Write(text,length);
+	if (n < (ssize_t)length)
+		return n < 0 ? (status_t)n : B_IO_ERROR;
+	return B_OK;
+}
+
+void free_old_xpm(old_xpm *old)
+{
+	xpm_heap *heap = old->heap;
+
+	xpm_free(heap,old->text);
+	xpm_free(heap,old->span);
+	xpm_free(heap,old->code);
+	xpm_free(heap,old->color);
+	delete_dictionary(old->colors);
+	delete_dictionary(old->codes);
+	memset(old,0,sizeof(*old));
+	old->heap = heap;
+}
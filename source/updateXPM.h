@@ -0,0 +1,12 @@
+//	updateXPM.h
+#ifndef UPDATEXPM_H
+#define UPDATEXPM_H
+
+#include "toXPM.h"
+
+//	rewrite an XPM file written earlier, reformatting only the rows in
+//	[firstRow, lastRow] and splicing the rest in from the old file.
+status_t updateXPM(BPositionIO *, BPositionIO *, int, int, BPositionIO *,
+	const xpm_encode_settings * = NULL);
+
+#endif